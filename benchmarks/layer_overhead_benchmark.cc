@@ -0,0 +1,975 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the CPU overhead of the layers on top of a null Vulkan driver.
+//
+// Usage: layer_overhead_benchmark [--<option>=<value>]...
+//
+// Loads the layer libraries and links them to the mock ICD of mock_icd.h, the
+// way the loader links layers to a driver, so that no GPU, loader or ICD is
+// needed. Then replays synthetic workloads directly on the mock, as the
+// baseline, through each layer alone, and through all the layers stacked:
+//   - draws: each thread records command buffers of --draws draws and submits
+//     them to its own queue,
+//   - allocations: each thread allocates and frees device memory,
+//   - pipelines: creates shader modules, graphics and compute pipelines,
+//   - presents: presents --presents frames,
+//   - proc_addr: looks up device functions.
+// The multi-threaded workloads run on one thread and on --threads threads.
+//
+// Prints one CSV line per workload and entry point, with the CPU time per call
+// and its overhead over the baseline, the heap allocations per call, counted
+// by replacing the global operator new, and for the multi-threaded runs, the
+// contention: the time per call on all the threads divided by the time per
+// call on one thread. Locks contended in the layers raise the contention above
+// the one of the baseline.
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/barrier.h"
+#include "layer_utils.h"
+#include "mock_icd.h"
+#include "vulkan/vk_layer.h"
+#include "vulkan/vulkan.h"
+
+// clang-format: do not reorder the include below.
+#include "vk_layer_dispatch_table.h"
+
+namespace performancelayers {
+namespace {
+// The number of heap allocations made by the current thread.
+thread_local uint64_t allocation_count = 0;
+
+void* CountedAllocate(size_t size, size_t alignment) {
+  ++allocation_count;
+  size = size == 0 ? 1 : size;
+  if (alignment <= alignof(std::max_align_t)) {
+    return malloc(size);
+  }
+  // aligned_alloc() requires a size multiple of the alignment.
+  return aligned_alloc(alignment,
+                       (size + alignment - 1) / alignment * alignment);
+}
+
+void* CountedAllocateOrDie(size_t size, size_t alignment) {
+  void* memory = CountedAllocate(size, alignment);
+  if (!memory) {
+    abort();
+  }
+  return memory;
+}
+}  // namespace
+}  // namespace performancelayers
+
+// The replaced global allocation functions. The benchmark exports them, so
+// that the layer libraries allocate through them too.
+void* operator new(size_t size) {
+  return performancelayers::CountedAllocateOrDie(size, 0);
+}
+void* operator new[](size_t size) {
+  return performancelayers::CountedAllocateOrDie(size, 0);
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+  return performancelayers::CountedAllocateOrDie(
+      size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return performancelayers::CountedAllocateOrDie(
+      size, static_cast<size_t>(alignment));
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return performancelayers::CountedAllocate(size, 0);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return performancelayers::CountedAllocate(size, 0);
+}
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept {
+  free(memory);
+}
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+  free(memory);
+}
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+  free(memory);
+}
+
+namespace performancelayers {
+namespace {
+struct Options {
+  // The directory with the layer libraries. Defaults to the directory of the
+  // benchmark.
+  std::string layer_dir;
+  // The layer configurations to measure, in addition to the baseline.
+  std::vector<std::string> layers = {"compile_time", "runtime",
+                                     "frame_time",   "cache_sideload",
+                                     "memory_usage", "stack"};
+  uint32_t threads = 4;
+  // Per thread.
+  uint32_t command_buffers = 100;
+  // Per command buffer.
+  uint32_t draws = 1000;
+  uint32_t pipelines = 1000;
+  // Per thread.
+  uint32_t allocations = 10000;
+  uint32_t presents = 10000;
+  uint32_t lookups = 1000;
+};
+
+struct UintOption {
+  const char* name;
+  uint32_t Options::*member;
+};
+
+constexpr UintOption kUintOptions[] = {
+    {"threads", &Options::threads},
+    {"command_buffers", &Options::command_buffers},
+    {"draws", &Options::draws},
+    {"pipelines", &Options::pipelines},
+    {"allocations", &Options::allocations},
+    {"presents", &Options::presents},
+    {"lookups", &Options::lookups},
+};
+
+constexpr char kUsage[] =
+    "Usage: layer_overhead_benchmark [--layer_dir=<dir>]\n"
+    "    [--layers=<configuration>,...] [--threads=<n>]\n"
+    "    [--command_buffers=<n>] [--draws=<n>] [--pipelines=<n>]\n"
+    "    [--allocations=<n>] [--presents=<n>] [--lookups=<n>]\n"
+    "The configurations are the layers compile_time, runtime, frame_time,\n"
+    "cache_sideload and memory_usage, and stack for all of them stacked.\n";
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i != argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg.substr(0, 2) != "--" || arg.find('=') == std::string_view::npos) {
+      return false;
+    }
+    std::pair<std::string_view, std::string_view> flag =
+        absl::StrSplit(arg.substr(2), absl::MaxSplits('=', 1));
+    if (flag.first == "layer_dir") {
+      options->layer_dir = std::string(flag.second);
+      continue;
+    }
+    if (flag.first == "layers") {
+      options->layers = std::vector<std::string>(
+          absl::StrSplit(flag.second, ',', absl::SkipEmpty()));
+      continue;
+    }
+    bool parsed = false;
+    for (const UintOption& option : kUintOptions) {
+      if (flag.first == option.name) {
+        parsed = absl::SimpleAtoi(flag.second, &(options->*option.member));
+        break;
+      }
+    }
+    if (!parsed) {
+      return false;
+    }
+  }
+  return options->threads != 0;
+}
+
+std::string GetExecutableDirectory() {
+  char path[PATH_MAX];
+  const ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+  if (length <= 0 || length == sizeof(path)) {
+    return ".";
+  }
+  std::string_view directory(path, length);
+  return std::string(directory.substr(0, directory.rfind('/')));
+}
+
+// ----------------------------------------------------------------------------
+// Layer loading
+// ----------------------------------------------------------------------------
+
+struct LayerLibrary {
+  // The name of the layer configuration.
+  const char* name;
+  const char* library;
+  // The prefix of the names of the entry points of the layer.
+  const char* prefix;
+};
+
+// The layers, in the order they are stacked, from the application to the
+// driver.
+constexpr LayerLibrary kStandaloneLayers[] = {
+    {"frame_time", "libVkLayer_stadia_frame_time.so", "FrameTimeLayer_"},
+    {"memory_usage", "libVkLayer_stadia_memory_usage.so", "MemoryUsageLayer_"},
+    {"compile_time", "libVkLayer_stadia_pipeline_compile_time.so",
+     "CompileTimeLayer_"},
+    {"runtime", "libVkLayer_stadia_pipeline_runtime.so", "RuntimeLayer_"},
+    {"cache_sideload", "libVkLayer_stadia_pipeline_cache_sideload.so",
+     "CacheSideloadLayer_"},
+};
+
+// The logs of the layers only go to a file, or to stderr by default. Unless
+// they are set, discard them.
+constexpr const char* kLogFilenameEnvVars[] = {
+    "VK_COMPILE_TIME_LOG",
+    "VK_FRAME_TIME_LOG",
+    "VK_MEMORY_USAGE_LOG",
+    "VK_RUNTIME_LOG",
+};
+
+struct LayerEntryPoints {
+  PFN_vkGetInstanceProcAddr get_instance_proc_addr;
+  PFN_vkGetDeviceProcAddr get_device_proc_addr;
+};
+
+// Loads |layer| from |layer_dir|. The library stays loaded until the process
+// exits, as the layers keep background threads and static state.
+absl::StatusOr<LayerEntryPoints> LoadLayer(const std::string& layer_dir,
+                                           const LayerLibrary& layer) {
+  const std::string path = absl::StrCat(layer_dir, "/", layer.library);
+  void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    return absl::NotFoundError(
+        absl::StrCat("Failed to load ", path, ": ", dlerror()));
+  }
+  const std::string gipa_name =
+      absl::StrCat(layer.prefix, "GetInstanceProcAddr");
+  const std::string gdpa_name = absl::StrCat(layer.prefix, "GetDeviceProcAddr");
+  LayerEntryPoints entry_points = {
+      reinterpret_cast<PFN_vkGetInstanceProcAddr>(
+          dlsym(handle, gipa_name.c_str())),
+      reinterpret_cast<PFN_vkGetDeviceProcAddr>(
+          dlsym(handle, gdpa_name.c_str()))};
+  if (!entry_points.get_instance_proc_addr ||
+      !entry_points.get_device_proc_addr) {
+    return absl::NotFoundError(
+        absl::StrCat(path, " does not export ", gipa_name, " and ", gdpa_name));
+  }
+  return entry_points;
+}
+
+// Returns the layers of the configuration |name|, ordered from the application
+// to the driver.
+absl::StatusOr<std::vector<LayerEntryPoints>> LoadConfiguration(
+    const std::string& layer_dir, std::string_view name) {
+  std::vector<const LayerLibrary*> libraries;
+  if (name == "stack") {
+    for (const LayerLibrary& layer : kStandaloneLayers) {
+      libraries.push_back(&layer);
+    }
+  } else if (name != "none") {
+    for (const LayerLibrary& layer : kStandaloneLayers) {
+      if (name == layer.name) {
+        libraries.push_back(&layer);
+      }
+    }
+    if (libraries.empty()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unknown layer configuration: ", name));
+    }
+  }
+
+  std::vector<LayerEntryPoints> layers;
+  for (const LayerLibrary* library : libraries) {
+    absl::StatusOr<LayerEntryPoints> layer = LoadLayer(layer_dir, *library);
+    if (!layer.ok()) {
+      return layer.status();
+    }
+    layers.push_back(*layer);
+  }
+  return layers;
+}
+
+// ----------------------------------------------------------------------------
+// Instance and device creation
+// ----------------------------------------------------------------------------
+
+// An instance and a device created through a chain of layers on top of the
+// mock ICD. Like the loader, passes each layer the link to the next one, and
+// calls the device functions through the first layer.
+class LayerChain {
+ public:
+  // Creates the instance and the device through |layers|, ordered from the
+  // application to the driver, with |queue_count| queues.
+  static absl::StatusOr<std::unique_ptr<LayerChain>> Create(
+      std::vector<LayerEntryPoints> layers, uint32_t queue_count);
+  ~LayerChain();
+
+  LayerChain(const LayerChain&) = delete;
+  LayerChain& operator=(const LayerChain&) = delete;
+
+  VkDevice GetDevice() const { return device_; }
+  const VkLayerDispatchTable& GetDispatchTable() const {
+    return dispatch_table_;
+  }
+  PFN_vkGetDeviceProcAddr GetDeviceProcAddr() const {
+    return get_device_proc_addr_;
+  }
+  VkQueue GetQueue(uint32_t index) const { return queues_[index]; }
+  // A graphics pipeline created through the layers.
+  VkPipeline GetPipeline() const { return pipeline_; }
+
+ private:
+  explicit LayerChain(std::vector<LayerEntryPoints> layers)
+      : layers_(std::move(layers)) {}
+
+  absl::Status CreateInstance();
+  absl::Status CreateDevice(uint32_t queue_count);
+
+  std::vector<LayerEntryPoints> layers_;
+  PFN_vkGetInstanceProcAddr get_instance_proc_addr_ =
+      &MockIcdGetInstanceProcAddr;
+  PFN_vkGetDeviceProcAddr get_device_proc_addr_ = &MockIcdGetDeviceProcAddr;
+  VkInstance instance_ = VK_NULL_HANDLE;
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkLayerDispatchTable dispatch_table_ = {};
+  std::vector<VkQueue> queues_;
+  VkShaderModule shader_module_ = VK_NULL_HANDLE;
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+};
+
+// Returns SPIR-V-like code, different for each |seed|. The mock ICD doesn't
+// parse it, and the layers only hash it.
+std::vector<uint32_t> MakeShaderCode(uint32_t seed) {
+  constexpr size_t kShaderWords = 1024;
+  std::vector<uint32_t> code(kShaderWords);
+  code[0] = 0x07230203;  // The SPIR-V magic number.
+  code[1] = 0x00010000;
+  for (size_t i = 2; i != code.size(); ++i) {
+    code[i] = static_cast<uint32_t>((seed + 1) * 2654435761u + i * 40503u);
+  }
+  return code;
+}
+
+VkShaderModuleCreateInfo MakeShaderModuleCreateInfo(
+    const std::vector<uint32_t>& code) {
+  VkShaderModuleCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  create_info.codeSize = code.size() * sizeof(uint32_t);
+  create_info.pCode = code.data();
+  return create_info;
+}
+
+VkPipelineShaderStageCreateInfo MakeShaderStageCreateInfo(
+    VkShaderStageFlagBits stage, VkShaderModule shader_module) {
+  VkPipelineShaderStageCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  create_info.stage = stage;
+  create_info.module = shader_module;
+  create_info.pName = "main";
+  return create_info;
+}
+
+absl::StatusOr<std::unique_ptr<LayerChain>> LayerChain::Create(
+    std::vector<LayerEntryPoints> layers, uint32_t queue_count) {
+  std::unique_ptr<LayerChain> chain(new LayerChain(std::move(layers)));
+  if (absl::Status status = chain->CreateInstance(); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = chain->CreateDevice(queue_count); !status.ok()) {
+    return status;
+  }
+
+  const VkLayerDispatchTable& dispatch = chain->dispatch_table_;
+  const std::vector<uint32_t> code = MakeShaderCode(UINT32_MAX);
+  const VkShaderModuleCreateInfo module_info = MakeShaderModuleCreateInfo(code);
+  VkResult result = dispatch.CreateShaderModule(
+      chain->device_, &module_info, nullptr, &chain->shader_module_);
+  const VkPipelineShaderStageCreateInfo stages[] = {
+      MakeShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT,
+                                chain->shader_module_),
+      MakeShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT,
+                                chain->shader_module_)};
+  VkGraphicsPipelineCreateInfo pipeline_info = {};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipeline_info.stageCount = 2;
+  pipeline_info.pStages = stages;
+  if (result == VK_SUCCESS) {
+    result = dispatch.CreateGraphicsPipelines(chain->device_, VK_NULL_HANDLE, 1,
+                                              &pipeline_info, nullptr,
+                                              &chain->pipeline_);
+  }
+  if (result != VK_SUCCESS) {
+    return absl::InternalError(
+        absl::StrCat("Failed to create a pipeline: ", result));
+  }
+  return chain;
+}
+
+absl::Status LayerChain::CreateInstance() {
+  std::vector<VkLayerInstanceLink> links(layers_.size());
+  for (size_t i = 0; i != links.size(); ++i) {
+    const bool last = i + 1 == links.size();
+    links[i].pNext = last ? nullptr : &links[i + 1];
+    links[i].pfnNextGetInstanceProcAddr =
+        last ? &MockIcdGetInstanceProcAddr
+             : layers_[i + 1].get_instance_proc_addr;
+    links[i].pfnNextGetPhysicalDeviceProcAddr = nullptr;
+  }
+  VkLayerInstanceCreateInfo layer_info = {};
+  layer_info.sType = VK_STRUCTURE_TYPE_LOADER_INSTANCE_CREATE_INFO;
+  layer_info.function = VK_LAYER_LINK_INFO;
+  layer_info.u.pLayerInfo = links.empty() ? nullptr : links.data();
+
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "layer_overhead_benchmark";
+  app_info.apiVersion = VK_API_VERSION_1_2;
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pNext = &layer_info;
+  create_info.pApplicationInfo = &app_info;
+
+  if (!layers_.empty()) {
+    get_instance_proc_addr_ = layers_.front().get_instance_proc_addr;
+    get_device_proc_addr_ = layers_.front().get_device_proc_addr;
+  }
+  auto create_instance = reinterpret_cast<PFN_vkCreateInstance>(
+      get_instance_proc_addr_(VK_NULL_HANDLE, "vkCreateInstance"));
+  const VkResult result = create_instance(&create_info, nullptr, &instance_);
+  if (result != VK_SUCCESS) {
+    instance_ = VK_NULL_HANDLE;
+    return absl::InternalError(
+        absl::StrCat("Failed to create an instance: ", result));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LayerChain::CreateDevice(uint32_t queue_count) {
+  auto enumerate_physical_devices =
+      reinterpret_cast<PFN_vkEnumeratePhysicalDevices>(
+          get_instance_proc_addr_(instance_, "vkEnumeratePhysicalDevices"));
+  uint32_t physical_device_count = 1;
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  enumerate_physical_devices(instance_, &physical_device_count,
+                             &physical_device);
+  if (physical_device_count == 0) {
+    return absl::InternalError("No physical device");
+  }
+
+  std::vector<VkLayerDeviceLink> links(layers_.size());
+  for (size_t i = 0; i != links.size(); ++i) {
+    const bool last = i + 1 == links.size();
+    links[i].pNext = last ? nullptr : &links[i + 1];
+    links[i].pfnNextGetInstanceProcAddr =
+        last ? &MockIcdGetInstanceProcAddr
+             : layers_[i + 1].get_instance_proc_addr;
+    links[i].pfnNextGetDeviceProcAddr =
+        last ? &MockIcdGetDeviceProcAddr : layers_[i + 1].get_device_proc_addr;
+  }
+  VkLayerDeviceCreateInfo layer_info = {};
+  layer_info.sType = VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO;
+  layer_info.function = VK_LAYER_LINK_INFO;
+  layer_info.u.pLayerInfo = links.empty() ? nullptr : links.data();
+
+  const std::vector<float> priorities(queue_count, 1.0f);
+  VkDeviceQueueCreateInfo queue_info = {};
+  queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queue_info.queueFamilyIndex = 0;
+  queue_info.queueCount = queue_count;
+  queue_info.pQueuePriorities = priorities.data();
+  VkDeviceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  create_info.pNext = &layer_info;
+  create_info.queueCreateInfoCount = 1;
+  create_info.pQueueCreateInfos = &queue_info;
+
+  auto create_device = reinterpret_cast<PFN_vkCreateDevice>(
+      get_instance_proc_addr_(instance_, "vkCreateDevice"));
+  const VkResult result =
+      create_device(physical_device, &create_info, nullptr, &device_);
+  if (result != VK_SUCCESS) {
+    device_ = VK_NULL_HANDLE;
+    return absl::InternalError(
+        absl::StrCat("Failed to create a device: ", result));
+  }
+
+  PFN_vkGetDeviceProcAddr gdpa = get_device_proc_addr_;
+  VkDevice* device = &device_;
+  VkLayerDispatchTable& dispatch_table = dispatch_table_;
+  SPL_DISPATCH_DEVICE_FUNC(AllocateCommandBuffers);
+  SPL_DISPATCH_DEVICE_FUNC(AllocateMemory);
+  SPL_DISPATCH_DEVICE_FUNC(BeginCommandBuffer);
+  SPL_DISPATCH_DEVICE_FUNC(CmdBindPipeline);
+  SPL_DISPATCH_DEVICE_FUNC(CmdDraw);
+  SPL_DISPATCH_DEVICE_FUNC(CreateCommandPool);
+  SPL_DISPATCH_DEVICE_FUNC(CreateComputePipelines);
+  SPL_DISPATCH_DEVICE_FUNC(CreateGraphicsPipelines);
+  SPL_DISPATCH_DEVICE_FUNC(CreateShaderModule);
+  SPL_DISPATCH_DEVICE_FUNC(DestroyCommandPool);
+  SPL_DISPATCH_DEVICE_FUNC(DestroyDevice);
+  SPL_DISPATCH_DEVICE_FUNC(DestroyPipeline);
+  SPL_DISPATCH_DEVICE_FUNC(DestroyShaderModule);
+  SPL_DISPATCH_DEVICE_FUNC(DeviceWaitIdle);
+  SPL_DISPATCH_DEVICE_FUNC(EndCommandBuffer);
+  SPL_DISPATCH_DEVICE_FUNC(FreeCommandBuffers);
+  SPL_DISPATCH_DEVICE_FUNC(FreeMemory);
+  SPL_DISPATCH_DEVICE_FUNC(GetDeviceQueue);
+  SPL_DISPATCH_DEVICE_FUNC(QueuePresentKHR);
+  SPL_DISPATCH_DEVICE_FUNC(QueueSubmit);
+  SPL_DISPATCH_DEVICE_FUNC(ResetCommandBuffer);
+
+  queues_.resize(queue_count);
+  for (uint32_t i = 0; i != queue_count; ++i) {
+    dispatch_table_.GetDeviceQueue(device_, 0, i, &queues_[i]);
+  }
+  return absl::OkStatus();
+}
+
+LayerChain::~LayerChain() {
+  if (device_) {
+    dispatch_table_.DeviceWaitIdle(device_);
+    if (pipeline_) {
+      dispatch_table_.DestroyPipeline(device_, pipeline_, nullptr);
+    }
+    if (shader_module_) {
+      dispatch_table_.DestroyShaderModule(device_, shader_module_, nullptr);
+    }
+    dispatch_table_.DestroyDevice(device_, nullptr);
+  }
+  if (instance_) {
+    auto destroy_instance = reinterpret_cast<PFN_vkDestroyInstance>(
+        get_instance_proc_addr_(instance_, "vkDestroyInstance"));
+    destroy_instance(instance_, nullptr);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Workloads
+// ----------------------------------------------------------------------------
+
+enum EntryPoint : size_t {
+  kBeginCommandBuffer,
+  kCmdBindPipeline,
+  kCmdDraw,
+  kEndCommandBuffer,
+  kQueueSubmit,
+  kResetCommandBuffer,
+  kAllocateMemory,
+  kFreeMemory,
+  kCreateShaderModule,
+  kCreateGraphicsPipelines,
+  kCreateComputePipelines,
+  kDestroyPipeline,
+  kDestroyShaderModule,
+  kQueuePresentKHR,
+  kGetDeviceProcAddr,
+  kEntryPointCount,
+};
+
+constexpr const char* kEntryPointNames[kEntryPointCount] = {
+    "vkBeginCommandBuffer",    "vkCmdBindPipeline",
+    "vkCmdDraw",               "vkEndCommandBuffer",
+    "vkQueueSubmit",           "vkResetCommandBuffer",
+    "vkAllocateMemory",        "vkFreeMemory",
+    "vkCreateShaderModule",    "vkCreateGraphicsPipelines",
+    "vkCreateComputePipelines", "vkDestroyPipeline",
+    "vkDestroyShaderModule",   "vkQueuePresentKHR",
+    "vkGetDeviceProcAddr",
+};
+
+struct CallStats {
+  uint64_t calls = 0;
+  int64_t nanoseconds = 0;
+  uint64_t allocations = 0;
+};
+
+using WorkloadStats = std::array<CallStats, kEntryPointCount>;
+
+// Runs |calls_func|, which makes |calls| calls to one entry point, and adds its
+// time and the allocations of the current thread to |stats|.
+template <typename CallsFuncT>
+void Measure(uint64_t calls, CallStats& stats, CallsFuncT&& calls_func) {
+  const uint64_t allocations = allocation_count;
+  const auto start = std::chrono::steady_clock::now();
+  calls_func();
+  const auto end = std::chrono::steady_clock::now();
+  stats.allocations += allocation_count - allocations;
+  stats.nanoseconds +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  stats.calls += calls;
+}
+
+// Runs |thread_func| with the index of the thread and its stats on
+// |thread_count| threads, started together, and returns the sum of the stats.
+template <typename ThreadFuncT>
+WorkloadStats RunOnThreads(uint32_t thread_count, ThreadFuncT&& thread_func) {
+  std::vector<WorkloadStats> thread_stats(thread_count);
+  std::vector<std::thread> threads;
+  auto* barrier = new absl::Barrier(thread_count);
+  for (uint32_t i = 0; i != thread_count; ++i) {
+    threads.emplace_back([&thread_func, &thread_stats, barrier, i] {
+      if (barrier->Block()) {
+        delete barrier;
+      }
+      thread_func(i, thread_stats[i]);
+    });
+  }
+  WorkloadStats total = {};
+  for (uint32_t i = 0; i != thread_count; ++i) {
+    threads[i].join();
+    for (size_t entry_point = 0; entry_point != kEntryPointCount;
+         ++entry_point) {
+      total[entry_point].calls += thread_stats[i][entry_point].calls;
+      total[entry_point].nanoseconds +=
+          thread_stats[i][entry_point].nanoseconds;
+      total[entry_point].allocations +=
+          thread_stats[i][entry_point].allocations;
+    }
+  }
+  return total;
+}
+
+// Each thread records and submits |options.command_buffers| times a command
+// buffer of |options.draws| draws, on its own queue.
+WorkloadStats RunDraws(const LayerChain& chain, const Options& options,
+                       uint32_t thread_count) {
+  const VkLayerDispatchTable& dispatch = chain.GetDispatchTable();
+  const VkDevice device = chain.GetDevice();
+  return RunOnThreads(thread_count, [&](uint32_t thread, WorkloadStats& stats) {
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    VkCommandPool pool = VK_NULL_HANDLE;
+    dispatch.CreateCommandPool(device, &pool_info, nullptr, &pool);
+    VkCommandBufferAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool = pool;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = 1;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    dispatch.AllocateCommandBuffers(device, &allocate_info, &command_buffer);
+
+    const VkQueue queue = chain.GetQueue(thread);
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    for (uint32_t i = 0; i != options.command_buffers; ++i) {
+      Measure(1, stats[kBeginCommandBuffer], [&] {
+        dispatch.BeginCommandBuffer(command_buffer, &begin_info);
+      });
+      Measure(1, stats[kCmdBindPipeline], [&] {
+        dispatch.CmdBindPipeline(command_buffer,
+                                 VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                 chain.GetPipeline());
+      });
+      Measure(options.draws, stats[kCmdDraw], [&] {
+        for (uint32_t draw = 0; draw != options.draws; ++draw) {
+          dispatch.CmdDraw(command_buffer, 3, 1, 0, 0);
+        }
+      });
+      Measure(1, stats[kEndCommandBuffer],
+              [&] { dispatch.EndCommandBuffer(command_buffer); });
+      Measure(1, stats[kQueueSubmit], [&] {
+        dispatch.QueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+      });
+      Measure(1, stats[kResetCommandBuffer],
+              [&] { dispatch.ResetCommandBuffer(command_buffer, 0); });
+    }
+
+    dispatch.FreeCommandBuffers(device, pool, 1, &command_buffer);
+    dispatch.DestroyCommandPool(device, pool, nullptr);
+  });
+}
+
+// Each thread makes |options.allocations| allocations of various sizes, and
+// frees each one after the next |kLiveAllocations| allocations.
+WorkloadStats RunAllocations(const LayerChain& chain, const Options& options,
+                             uint32_t thread_count) {
+  constexpr uint32_t kLiveAllocations = 64;
+  const VkLayerDispatchTable& dispatch = chain.GetDispatchTable();
+  const VkDevice device = chain.GetDevice();
+  return RunOnThreads(thread_count, [&](uint32_t, WorkloadStats& stats) {
+    std::array<VkDeviceMemory, kLiveAllocations> live = {};
+    for (uint32_t i = 0; i != options.allocations; ++i) {
+      VkDeviceMemory& memory = live[i % kLiveAllocations];
+      if (memory != VK_NULL_HANDLE) {
+        Measure(1, stats[kFreeMemory],
+                [&] { dispatch.FreeMemory(device, memory, nullptr); });
+      }
+      VkMemoryAllocateInfo allocate_info = {};
+      allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocate_info.allocationSize = VkDeviceSize(4096) << (i % 12);
+      allocate_info.memoryTypeIndex = i % 2;
+      Measure(1, stats[kAllocateMemory], [&] {
+        dispatch.AllocateMemory(device, &allocate_info, nullptr, &memory);
+      });
+    }
+    for (VkDeviceMemory memory : live) {
+      if (memory != VK_NULL_HANDLE) {
+        Measure(1, stats[kFreeMemory],
+                [&] { dispatch.FreeMemory(device, memory, nullptr); });
+      }
+    }
+  });
+}
+
+// Creates |options.pipelines| shader modules, each with a graphics and a
+// compute pipeline, and destroys them.
+WorkloadStats RunPipelines(const LayerChain& chain, const Options& options) {
+  const VkLayerDispatchTable& dispatch = chain.GetDispatchTable();
+  const VkDevice device = chain.GetDevice();
+  WorkloadStats stats = {};
+  for (uint32_t i = 0; i != options.pipelines; ++i) {
+    const std::vector<uint32_t> code = MakeShaderCode(i);
+    const VkShaderModuleCreateInfo module_info =
+        MakeShaderModuleCreateInfo(code);
+    VkShaderModule shader_module = VK_NULL_HANDLE;
+    Measure(1, stats[kCreateShaderModule], [&] {
+      dispatch.CreateShaderModule(device, &module_info, nullptr,
+                                  &shader_module);
+    });
+
+    const VkPipelineShaderStageCreateInfo stages[] = {
+        MakeShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, shader_module),
+        MakeShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT,
+                                  shader_module)};
+    VkGraphicsPipelineCreateInfo graphics_info = {};
+    graphics_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    graphics_info.stageCount = 2;
+    graphics_info.pStages = stages;
+    VkPipeline graphics_pipeline = VK_NULL_HANDLE;
+    Measure(1, stats[kCreateGraphicsPipelines], [&] {
+      dispatch.CreateGraphicsPipelines(device, VK_NULL_HANDLE, 1,
+                                       &graphics_info, nullptr,
+                                       &graphics_pipeline);
+    });
+
+    VkComputePipelineCreateInfo compute_info = {};
+    compute_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    compute_info.stage =
+        MakeShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shader_module);
+    VkPipeline compute_pipeline = VK_NULL_HANDLE;
+    Measure(1, stats[kCreateComputePipelines], [&] {
+      dispatch.CreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_info,
+                                      nullptr, &compute_pipeline);
+    });
+
+    Measure(2, stats[kDestroyPipeline], [&] {
+      dispatch.DestroyPipeline(device, graphics_pipeline, nullptr);
+      dispatch.DestroyPipeline(device, compute_pipeline, nullptr);
+    });
+    Measure(1, stats[kDestroyShaderModule], [&] {
+      dispatch.DestroyShaderModule(device, shader_module, nullptr);
+    });
+  }
+  return stats;
+}
+
+WorkloadStats RunPresents(const LayerChain& chain, const Options& options) {
+  const VkLayerDispatchTable& dispatch = chain.GetDispatchTable();
+  const VkQueue queue = chain.GetQueue(0);
+  const VkSwapchainKHR swapchain = reinterpret_cast<VkSwapchainKHR>(1);
+  const uint32_t image_index = 0;
+  VkPresentInfoKHR present_info = {};
+  present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  present_info.swapchainCount = 1;
+  present_info.pSwapchains = &swapchain;
+  present_info.pImageIndices = &image_index;
+  WorkloadStats stats = {};
+  for (uint32_t i = 0; i != options.presents; ++i) {
+    Measure(1, stats[kQueuePresentKHR],
+            [&] { dispatch.QueuePresentKHR(queue, &present_info); });
+  }
+  return stats;
+}
+
+// Looks up |options.lookups| times each entry point of the workloads.
+WorkloadStats RunProcAddr(const LayerChain& chain, const Options& options) {
+  const PFN_vkGetDeviceProcAddr get_device_proc_addr =
+      chain.GetDeviceProcAddr();
+  const VkDevice device = chain.GetDevice();
+  WorkloadStats stats = {};
+  for (const char* name : kEntryPointNames) {
+    Measure(options.lookups, stats[kGetDeviceProcAddr], [&] {
+      for (uint32_t i = 0; i != options.lookups; ++i) {
+        get_device_proc_addr(device, name);
+      }
+    });
+  }
+  return stats;
+}
+
+struct Measurement {
+  const char* workload;
+  uint32_t threads;
+  WorkloadStats stats;
+};
+
+// Runs all the workloads through |chain|. The measurements are in the same
+// order for every chain.
+std::vector<Measurement> RunWorkloads(const LayerChain& chain,
+                                      const Options& options) {
+  std::vector<Measurement> measurements;
+  measurements.push_back({"draws", 1, RunDraws(chain, options, 1)});
+  measurements.push_back({"allocations", 1, RunAllocations(chain, options, 1)});
+  if (options.threads > 1) {
+    measurements.push_back(
+        {"draws", options.threads, RunDraws(chain, options, options.threads)});
+    measurements.push_back({"allocations", options.threads,
+                            RunAllocations(chain, options, options.threads)});
+  }
+  measurements.push_back({"pipelines", 1, RunPipelines(chain, options)});
+  measurements.push_back({"presents", 1, RunPresents(chain, options)});
+  measurements.push_back({"proc_addr", 1, RunProcAddr(chain, options)});
+  return measurements;
+}
+
+// ----------------------------------------------------------------------------
+// Reporting
+// ----------------------------------------------------------------------------
+
+double GetNanosecondsPerCall(const CallStats& stats) {
+  return stats.calls == 0 ? 0.0
+                          : static_cast<double>(stats.nanoseconds) /
+                                static_cast<double>(stats.calls);
+}
+
+// Returns the stats of the same workload as |measurements[index]| on one
+// thread, or nullptr if it is a single-threaded measurement.
+const WorkloadStats* FindSingleThreadStats(
+    const std::vector<Measurement>& measurements, size_t index) {
+  if (measurements[index].threads == 1) {
+    return nullptr;
+  }
+  for (const Measurement& measurement : measurements) {
+    if (measurement.threads == 1 &&
+        std::string_view(measurement.workload) ==
+            measurements[index].workload) {
+      return &measurement.stats;
+    }
+  }
+  return nullptr;
+}
+
+constexpr char kCsvHeader[] =
+    "layers,workload,threads,entry_point,calls,ns_per_call,"
+    "overhead_ns_per_call,allocations_per_call,contention";
+
+void PrintMeasurements(std::string_view layers,
+                       const std::vector<Measurement>& measurements,
+                       const std::vector<Measurement>& baseline) {
+  for (size_t i = 0; i != measurements.size(); ++i) {
+    const Measurement& measurement = measurements[i];
+    const WorkloadStats* single_thread =
+        FindSingleThreadStats(measurements, i);
+    for (size_t entry_point = 0; entry_point != kEntryPointCount;
+         ++entry_point) {
+      const CallStats& stats = measurement.stats[entry_point];
+      if (stats.calls == 0) {
+        continue;
+      }
+      const double ns_per_call = GetNanosecondsPerCall(stats);
+      const double baseline_ns_per_call =
+          GetNanosecondsPerCall(baseline[i].stats[entry_point]);
+      const double allocations_per_call =
+          static_cast<double>(stats.allocations) /
+          static_cast<double>(stats.calls);
+      std::string contention;
+      if (single_thread) {
+        const double single_thread_ns_per_call =
+            GetNanosecondsPerCall((*single_thread)[entry_point]);
+        if (single_thread_ns_per_call > 0.0) {
+          contention =
+              absl::StrFormat("%.2f", ns_per_call / single_thread_ns_per_call);
+        }
+      }
+      absl::PrintF("%s,%s,%u,%s,%u,%.1f,%.1f,%.2f,%s\n", layers,
+                   measurement.workload, measurement.threads,
+                   kEntryPointNames[entry_point], stats.calls, ns_per_call,
+                   ns_per_call - baseline_ns_per_call, allocations_per_call,
+                   contention);
+    }
+  }
+  fflush(stdout);
+}
+
+int RunBenchmark(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    fputs(kUsage, stderr);
+    return 1;
+  }
+  if (options.layer_dir.empty()) {
+    options.layer_dir = GetExecutableDirectory();
+  }
+
+  for (const char* env_var : kLogFilenameEnvVars) {
+    setenv(env_var, "/dev/null", /*overwrite=*/0);
+  }
+  // Exiting after a number of frames would end the benchmark.
+  unsetenv("VK_FRAME_TIME_EXIT_AFTER_FRAME");
+
+  std::vector<std::string> configurations = {"none"};
+  for (const std::string& layers : options.layers) {
+    if (layers != "none") {
+      configurations.push_back(layers);
+    }
+  }
+
+  puts(kCsvHeader);
+  std::vector<Measurement> baseline;
+  for (const std::string& configuration : configurations) {
+    absl::StatusOr<std::vector<LayerEntryPoints>> layers =
+        LoadConfiguration(options.layer_dir, configuration);
+    if (!layers.ok()) {
+      fprintf(stderr, "%s\n", layers.status().ToString().c_str());
+      return 1;
+    }
+    absl::StatusOr<std::unique_ptr<LayerChain>> chain =
+        LayerChain::Create(*std::move(layers), options.threads);
+    if (!chain.ok()) {
+      fprintf(stderr, "%s: %s\n", configuration.c_str(),
+              chain.status().ToString().c_str());
+      return 1;
+    }
+    std::vector<Measurement> measurements = RunWorkloads(**chain, options);
+    if (baseline.empty()) {
+      baseline = measurements;
+    }
+    PrintMeasurements(configuration, measurements, baseline);
+  }
+  return 0;
+}
+}  // namespace
+}  // namespace performancelayers
+
+int main(int argc, char** argv) {
+  return performancelayers::RunBenchmark(argc, argv);
+}
@@ -0,0 +1,567 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mock_icd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace performancelayers {
+namespace {
+// The first member of every dispatchable handle. The loader keeps its dispatch
+// table pointer there, and the layers use that pointer as the dispatch key.
+struct DispatchableObject {
+  void* dispatch_key;
+};
+
+struct MockInstance : DispatchableObject {
+  DispatchableObject physical_device;
+};
+
+struct MockDevice : DispatchableObject {
+  std::vector<std::unique_ptr<DispatchableObject>> queues;
+};
+
+MockInstance* ToMock(VkInstance instance) {
+  return reinterpret_cast<MockInstance*>(instance);
+}
+
+MockDevice* ToMock(VkDevice device) {
+  return reinterpret_cast<MockDevice*>(device);
+}
+
+// Returns a new non-null value for a non-dispatchable handle. Each thread
+// takes the values from its own block, so that threads creating objects
+// concurrently don't contend on a shared counter.
+template <typename HandleT>
+HandleT NewHandle() {
+  constexpr uint64_t kBlockSize = uint64_t(1) << 32;
+  static std::atomic<uint64_t> next_block = kBlockSize;
+  thread_local uint64_t next = 0;
+  thread_local uint64_t block_end = 0;
+  if (next == block_end) {
+    next = next_block.fetch_add(kBlockSize, std::memory_order_relaxed);
+    block_end = next + kBlockSize;
+  }
+  const uint64_t value = next++;
+  if constexpr (std::is_pointer_v<HandleT>) {
+    return reinterpret_cast<HandleT>(static_cast<uintptr_t>(value));
+  } else {
+    return static_cast<HandleT>(value);
+  }
+}
+
+// Copies the |count| elements of |source| to |destination|, with the semantics
+// of the Vulkan enumeration functions.
+template <typename T>
+VkResult Enumerate(const T* source, uint32_t count, uint32_t* out_count,
+                   T* destination) {
+  if (!destination) {
+    *out_count = count;
+    return VK_SUCCESS;
+  }
+  const uint32_t copied = std::min(*out_count, count);
+  for (uint32_t i = 0; i != copied; ++i) {
+    destination[i] = source[i];
+  }
+  *out_count = copied;
+  return copied < count ? VK_INCOMPLETE : VK_SUCCESS;
+}
+
+constexpr uint32_t kApiVersion = VK_API_VERSION_1_2;
+constexpr uint64_t kHeapSize = uint64_t(8) << 30;
+
+//////////////////////////////////////////////////////////////////////////////
+//  Instance functions.
+//////////////////////////////////////////////////////////////////////////////
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo*,
+                                              const VkAllocationCallbacks*,
+                                              VkInstance* instance) {
+  auto* mock = new MockInstance();
+  mock->dispatch_key = mock;
+  mock->physical_device.dispatch_key = mock;
+  *instance = reinterpret_cast<VkInstance>(mock);
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroyInstance(VkInstance instance,
+                                           const VkAllocationCallbacks*) {
+  delete ToMock(instance);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+EnumeratePhysicalDevices(VkInstance instance, uint32_t* count,
+                         VkPhysicalDevice* physical_devices) {
+  const VkPhysicalDevice physical_device =
+      reinterpret_cast<VkPhysicalDevice>(&ToMock(instance)->physical_device);
+  return Enumerate(&physical_device, 1, count, physical_devices);
+}
+
+VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceProperties(
+    VkPhysicalDevice, VkPhysicalDeviceProperties* properties) {
+  *properties = {};
+  properties->apiVersion = kApiVersion;
+  strncpy(properties->deviceName, "Mock device",
+          VK_MAX_PHYSICAL_DEVICE_NAME_SIZE - 1);
+  properties->limits.timestampPeriod = 1.0f;
+  properties->limits.timestampComputeAndGraphics = VK_TRUE;
+}
+
+VKAPI_ATTR void VKAPI_CALL
+GetPhysicalDeviceFeatures2(VkPhysicalDevice, VkPhysicalDeviceFeatures2*) {
+  // No optional features: leave the structures in the chain unchanged.
+}
+
+VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceQueueFamilyProperties(
+    VkPhysicalDevice, uint32_t* count, VkQueueFamilyProperties* families) {
+  VkQueueFamilyProperties family = {};
+  family.queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+  family.queueCount = 64;
+  family.timestampValidBits = 64;
+  family.minImageTransferGranularity = {1, 1, 1};
+  Enumerate(&family, 1, count, families);
+}
+
+VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceMemoryProperties(
+    VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* properties) {
+  *properties = {};
+  properties->memoryTypeCount = 2;
+  properties->memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+  properties->memoryTypes[1] = {
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      0};
+  properties->memoryHeapCount = 1;
+  properties->memoryHeaps[0] = {kHeapSize, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+}
+
+VKAPI_ATTR void VKAPI_CALL GetPhysicalDeviceMemoryProperties2(
+    VkPhysicalDevice physical_device,
+    VkPhysicalDeviceMemoryProperties2* properties) {
+  GetPhysicalDeviceMemoryProperties(physical_device,
+                                    &properties->memoryProperties);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL EnumerateDeviceExtensionProperties(
+    VkPhysicalDevice, const char*, uint32_t* count, VkExtensionProperties*) {
+  *count = 0;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice,
+                                            const VkDeviceCreateInfo* info,
+                                            const VkAllocationCallbacks*,
+                                            VkDevice* device) {
+  auto* mock = new MockDevice();
+  mock->dispatch_key = mock;
+  for (uint32_t i = 0; i != info->queueCreateInfoCount; ++i) {
+    for (uint32_t j = 0; j != info->pQueueCreateInfos[i].queueCount; ++j) {
+      mock->queues.push_back(
+          std::make_unique<DispatchableObject>(DispatchableObject{mock}));
+    }
+  }
+  *device = reinterpret_cast<VkDevice>(mock);
+  return VK_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//  Device functions.
+//////////////////////////////////////////////////////////////////////////////
+
+VKAPI_ATTR void VKAPI_CALL DestroyDevice(VkDevice device,
+                                         const VkAllocationCallbacks*) {
+  delete ToMock(device);
+}
+
+VKAPI_ATTR void VKAPI_CALL GetDeviceQueue(VkDevice device, uint32_t,
+                                          uint32_t index, VkQueue* queue) {
+  MockDevice* mock = ToMock(device);
+  *queue = index < mock->queues.size()
+               ? reinterpret_cast<VkQueue>(mock->queues[index].get())
+               : VK_NULL_HANDLE;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL DeviceWaitIdle(VkDevice) { return VK_SUCCESS; }
+
+VKAPI_ATTR VkResult VKAPI_CALL QueueWaitIdle(VkQueue) { return VK_SUCCESS; }
+
+VKAPI_ATTR VkResult VKAPI_CALL QueueSubmit(VkQueue, uint32_t,
+                                           const VkSubmitInfo*, VkFence) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue,
+                                               const VkPresentInfoKHR*) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateFence(VkDevice, const VkFenceCreateInfo*,
+                                           const VkAllocationCallbacks*,
+                                           VkFence* fence) {
+  *fence = NewHandle<VkFence>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroyFence(VkDevice, VkFence,
+                                        const VkAllocationCallbacks*) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL ResetFences(VkDevice, uint32_t,
+                                           const VkFence*) {
+  return VK_SUCCESS;
+}
+
+// All the work completes on submission, so fences are always signaled.
+VKAPI_ATTR VkResult VKAPI_CALL GetFenceStatus(VkDevice, VkFence) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL WaitForFences(VkDevice, uint32_t,
+                                             const VkFence*, VkBool32,
+                                             uint64_t) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateSemaphore(VkDevice,
+                                               const VkSemaphoreCreateInfo*,
+                                               const VkAllocationCallbacks*,
+                                               VkSemaphore* semaphore) {
+  *semaphore = NewHandle<VkSemaphore>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroySemaphore(VkDevice, VkSemaphore,
+                                            const VkAllocationCallbacks*) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL AllocateMemory(VkDevice,
+                                              const VkMemoryAllocateInfo*,
+                                              const VkAllocationCallbacks*,
+                                              VkDeviceMemory* memory) {
+  *memory = NewHandle<VkDeviceMemory>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL FreeMemory(VkDevice, VkDeviceMemory,
+                                      const VkAllocationCallbacks*) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateQueryPool(VkDevice,
+                                               const VkQueryPoolCreateInfo*,
+                                               const VkAllocationCallbacks*,
+                                               VkQueryPool* query_pool) {
+  *query_pool = NewHandle<VkQueryPool>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroyQueryPool(VkDevice, VkQueryPool,
+                                            const VkAllocationCallbacks*) {}
+
+// Reports every query as available, with a zero result.
+VKAPI_ATTR VkResult VKAPI_CALL GetQueryPoolResults(
+    VkDevice, VkQueryPool, uint32_t, uint32_t query_count, size_t data_size,
+    void* data, VkDeviceSize stride, VkQueryResultFlags flags) {
+  memset(data, 0, data_size);
+  if ((flags & VK_QUERY_RESULT_WITH_AVAILABILITY_BIT) != 0) {
+    const bool is_64_bit = (flags & VK_QUERY_RESULT_64_BIT) != 0;
+    const size_t value_size = is_64_bit ? sizeof(uint64_t) : sizeof(uint32_t);
+    for (uint32_t i = 0; i != query_count; ++i) {
+      // Without pipeline statistics, each query has one value followed by its
+      // availability.
+      char* availability = static_cast<char*>(data) + i * stride + value_size;
+      if (availability + value_size <= static_cast<char*>(data) + data_size) {
+        availability[0] = 1;
+      }
+    }
+  }
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL ResetQueryPool(VkDevice, VkQueryPool, uint32_t,
+                                          uint32_t) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateShaderModule(
+    VkDevice, const VkShaderModuleCreateInfo*, const VkAllocationCallbacks*,
+    VkShaderModule* shader_module) {
+  *shader_module = NewHandle<VkShaderModule>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroyShaderModule(VkDevice, VkShaderModule,
+                                               const VkAllocationCallbacks*) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreatePipelineCache(
+    VkDevice, const VkPipelineCacheCreateInfo*, const VkAllocationCallbacks*,
+    VkPipelineCache* pipeline_cache) {
+  *pipeline_cache = NewHandle<VkPipelineCache>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroyPipelineCache(VkDevice, VkPipelineCache,
+                                                const VkAllocationCallbacks*) {}
+
+// Pipeline caches are always empty.
+VKAPI_ATTR VkResult VKAPI_CALL GetPipelineCacheData(VkDevice, VkPipelineCache,
+                                                    size_t* data_size, void*) {
+  *data_size = 0;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL MergePipelineCaches(VkDevice, VkPipelineCache,
+                                                   uint32_t,
+                                                   const VkPipelineCache*) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(
+    VkDevice, VkPipelineCache, uint32_t count,
+    const VkGraphicsPipelineCreateInfo*, const VkAllocationCallbacks*,
+    VkPipeline* pipelines) {
+  for (uint32_t i = 0; i != count; ++i) {
+    pipelines[i] = NewHandle<VkPipeline>();
+  }
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateComputePipelines(
+    VkDevice, VkPipelineCache, uint32_t count,
+    const VkComputePipelineCreateInfo*, const VkAllocationCallbacks*,
+    VkPipeline* pipelines) {
+  for (uint32_t i = 0; i != count; ++i) {
+    pipelines[i] = NewHandle<VkPipeline>();
+  }
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroyPipeline(VkDevice, VkPipeline,
+                                           const VkAllocationCallbacks*) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateCommandPool(VkDevice,
+                                                 const VkCommandPoolCreateInfo*,
+                                                 const VkAllocationCallbacks*,
+                                                 VkCommandPool* command_pool) {
+  *command_pool = NewHandle<VkCommandPool>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL DestroyCommandPool(VkDevice, VkCommandPool,
+                                              const VkAllocationCallbacks*) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL ResetCommandPool(VkDevice, VkCommandPool,
+                                                VkCommandPoolResetFlags) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+AllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* info,
+                       VkCommandBuffer* command_buffers) {
+  for (uint32_t i = 0; i != info->commandBufferCount; ++i) {
+    command_buffers[i] = reinterpret_cast<VkCommandBuffer>(
+        new DispatchableObject{ToMock(device)->dispatch_key});
+  }
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL
+FreeCommandBuffers(VkDevice, VkCommandPool, uint32_t count,
+                   const VkCommandBuffer* command_buffers) {
+  for (uint32_t i = 0; i != count; ++i) {
+    delete reinterpret_cast<DispatchableObject*>(command_buffers[i]);
+  }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL BeginCommandBuffer(
+    VkCommandBuffer, const VkCommandBufferBeginInfo*) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL EndCommandBuffer(VkCommandBuffer) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL ResetCommandBuffer(VkCommandBuffer,
+                                                  VkCommandBufferResetFlags) {
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL CmdBindPipeline(VkCommandBuffer,
+                                           VkPipelineBindPoint, VkPipeline) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdDispatch(VkCommandBuffer, uint32_t, uint32_t,
+                                       uint32_t) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdDraw(VkCommandBuffer, uint32_t, uint32_t,
+                                   uint32_t, uint32_t) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdDrawIndexed(VkCommandBuffer, uint32_t, uint32_t,
+                                          uint32_t, int32_t, uint32_t) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdDrawIndirect(VkCommandBuffer, VkBuffer,
+                                           VkDeviceSize, uint32_t, uint32_t) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdResetQueryPool(VkCommandBuffer, VkQueryPool,
+                                             uint32_t, uint32_t) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdWriteTimestamp(VkCommandBuffer,
+                                             VkPipelineStageFlagBits,
+                                             VkQueryPool, uint32_t) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdBeginQuery(VkCommandBuffer, VkQueryPool,
+                                         uint32_t, VkQueryControlFlags) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdEndQuery(VkCommandBuffer, VkQueryPool,
+                                       uint32_t) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdPipelineBarrier(
+    VkCommandBuffer, VkPipelineStageFlags, VkPipelineStageFlags,
+    VkDependencyFlags, uint32_t, const VkMemoryBarrier*, uint32_t,
+    const VkBufferMemoryBarrier*, uint32_t, const VkImageMemoryBarrier*) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdBeginRenderPass(VkCommandBuffer,
+                                              const VkRenderPassBeginInfo*,
+                                              VkSubpassContents) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdNextSubpass(VkCommandBuffer, VkSubpassContents) {
+}
+
+VKAPI_ATTR void VKAPI_CALL CmdEndRenderPass(VkCommandBuffer) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdBeginRendering(VkCommandBuffer,
+                                             const VkRenderingInfo*) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdEndRendering(VkCommandBuffer) {}
+
+VKAPI_ATTR void VKAPI_CALL CmdExecuteCommands(VkCommandBuffer, uint32_t,
+                                              const VkCommandBuffer*) {}
+
+struct MockFunction {
+  const char* name;
+  PFN_vkVoidFunction function;
+};
+
+#define SPL_MOCK_FUNC(NAME_, FUNCTION_) \
+  MockFunction { "vk" #NAME_, reinterpret_cast<PFN_vkVoidFunction>(FUNCTION_) }
+
+const MockFunction kInstanceFunctions[] = {
+    SPL_MOCK_FUNC(CreateInstance, &CreateInstance),
+    SPL_MOCK_FUNC(DestroyInstance, &DestroyInstance),
+    SPL_MOCK_FUNC(EnumeratePhysicalDevices, &EnumeratePhysicalDevices),
+    SPL_MOCK_FUNC(GetPhysicalDeviceProperties, &GetPhysicalDeviceProperties),
+    SPL_MOCK_FUNC(GetPhysicalDeviceFeatures2, &GetPhysicalDeviceFeatures2),
+    SPL_MOCK_FUNC(GetPhysicalDeviceFeatures2KHR, &GetPhysicalDeviceFeatures2),
+    SPL_MOCK_FUNC(GetPhysicalDeviceQueueFamilyProperties,
+                  &GetPhysicalDeviceQueueFamilyProperties),
+    SPL_MOCK_FUNC(GetPhysicalDeviceMemoryProperties,
+                  &GetPhysicalDeviceMemoryProperties),
+    SPL_MOCK_FUNC(GetPhysicalDeviceMemoryProperties2,
+                  &GetPhysicalDeviceMemoryProperties2),
+    SPL_MOCK_FUNC(GetPhysicalDeviceMemoryProperties2KHR,
+                  &GetPhysicalDeviceMemoryProperties2),
+    SPL_MOCK_FUNC(EnumerateDeviceExtensionProperties,
+                  &EnumerateDeviceExtensionProperties),
+    SPL_MOCK_FUNC(CreateDevice, &CreateDevice),
+    SPL_MOCK_FUNC(GetInstanceProcAddr, &MockIcdGetInstanceProcAddr),
+};
+
+const MockFunction kDeviceFunctions[] = {
+    SPL_MOCK_FUNC(GetDeviceProcAddr, &MockIcdGetDeviceProcAddr),
+    SPL_MOCK_FUNC(DestroyDevice, &DestroyDevice),
+    SPL_MOCK_FUNC(GetDeviceQueue, &GetDeviceQueue),
+    SPL_MOCK_FUNC(DeviceWaitIdle, &DeviceWaitIdle),
+    SPL_MOCK_FUNC(QueueWaitIdle, &QueueWaitIdle),
+    SPL_MOCK_FUNC(QueueSubmit, &QueueSubmit),
+    SPL_MOCK_FUNC(QueuePresentKHR, &QueuePresentKHR),
+    SPL_MOCK_FUNC(CreateFence, &CreateFence),
+    SPL_MOCK_FUNC(DestroyFence, &DestroyFence),
+    SPL_MOCK_FUNC(ResetFences, &ResetFences),
+    SPL_MOCK_FUNC(GetFenceStatus, &GetFenceStatus),
+    SPL_MOCK_FUNC(WaitForFences, &WaitForFences),
+    SPL_MOCK_FUNC(CreateSemaphore, &CreateSemaphore),
+    SPL_MOCK_FUNC(DestroySemaphore, &DestroySemaphore),
+    SPL_MOCK_FUNC(AllocateMemory, &AllocateMemory),
+    SPL_MOCK_FUNC(FreeMemory, &FreeMemory),
+    SPL_MOCK_FUNC(CreateQueryPool, &CreateQueryPool),
+    SPL_MOCK_FUNC(DestroyQueryPool, &DestroyQueryPool),
+    SPL_MOCK_FUNC(GetQueryPoolResults, &GetQueryPoolResults),
+    SPL_MOCK_FUNC(ResetQueryPool, &ResetQueryPool),
+    SPL_MOCK_FUNC(ResetQueryPoolEXT, &ResetQueryPool),
+    SPL_MOCK_FUNC(CreateShaderModule, &CreateShaderModule),
+    SPL_MOCK_FUNC(DestroyShaderModule, &DestroyShaderModule),
+    SPL_MOCK_FUNC(CreatePipelineCache, &CreatePipelineCache),
+    SPL_MOCK_FUNC(DestroyPipelineCache, &DestroyPipelineCache),
+    SPL_MOCK_FUNC(GetPipelineCacheData, &GetPipelineCacheData),
+    SPL_MOCK_FUNC(MergePipelineCaches, &MergePipelineCaches),
+    SPL_MOCK_FUNC(CreateGraphicsPipelines, &CreateGraphicsPipelines),
+    SPL_MOCK_FUNC(CreateComputePipelines, &CreateComputePipelines),
+    SPL_MOCK_FUNC(DestroyPipeline, &DestroyPipeline),
+    SPL_MOCK_FUNC(CreateCommandPool, &CreateCommandPool),
+    SPL_MOCK_FUNC(DestroyCommandPool, &DestroyCommandPool),
+    SPL_MOCK_FUNC(ResetCommandPool, &ResetCommandPool),
+    SPL_MOCK_FUNC(AllocateCommandBuffers, &AllocateCommandBuffers),
+    SPL_MOCK_FUNC(FreeCommandBuffers, &FreeCommandBuffers),
+    SPL_MOCK_FUNC(BeginCommandBuffer, &BeginCommandBuffer),
+    SPL_MOCK_FUNC(EndCommandBuffer, &EndCommandBuffer),
+    SPL_MOCK_FUNC(ResetCommandBuffer, &ResetCommandBuffer),
+    SPL_MOCK_FUNC(CmdBindPipeline, &CmdBindPipeline),
+    SPL_MOCK_FUNC(CmdDispatch, &CmdDispatch),
+    SPL_MOCK_FUNC(CmdDraw, &CmdDraw),
+    SPL_MOCK_FUNC(CmdDrawIndexed, &CmdDrawIndexed),
+    SPL_MOCK_FUNC(CmdDrawIndirect, &CmdDrawIndirect),
+    SPL_MOCK_FUNC(CmdDrawIndexedIndirect, &CmdDrawIndirect),
+    SPL_MOCK_FUNC(CmdResetQueryPool, &CmdResetQueryPool),
+    SPL_MOCK_FUNC(CmdWriteTimestamp, &CmdWriteTimestamp),
+    SPL_MOCK_FUNC(CmdBeginQuery, &CmdBeginQuery),
+    SPL_MOCK_FUNC(CmdEndQuery, &CmdEndQuery),
+    SPL_MOCK_FUNC(CmdPipelineBarrier, &CmdPipelineBarrier),
+    SPL_MOCK_FUNC(CmdBeginRenderPass, &CmdBeginRenderPass),
+    SPL_MOCK_FUNC(CmdNextSubpass, &CmdNextSubpass),
+    SPL_MOCK_FUNC(CmdEndRenderPass, &CmdEndRenderPass),
+    SPL_MOCK_FUNC(CmdBeginRendering, &CmdBeginRendering),
+    SPL_MOCK_FUNC(CmdEndRendering, &CmdEndRendering),
+    SPL_MOCK_FUNC(CmdBeginRenderingKHR, &CmdBeginRendering),
+    SPL_MOCK_FUNC(CmdEndRenderingKHR, &CmdEndRendering),
+    SPL_MOCK_FUNC(CmdExecuteCommands, &CmdExecuteCommands),
+};
+
+#undef SPL_MOCK_FUNC
+
+template <size_t N>
+PFN_vkVoidFunction FindFunction(const MockFunction (&functions)[N],
+                                std::string_view name) {
+  for (const MockFunction& function : functions) {
+    if (name == function.name) {
+      return function.function;
+    }
+  }
+  return nullptr;
+}
+}  // namespace
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+MockIcdGetInstanceProcAddr(VkInstance, const char* name) {
+  if (PFN_vkVoidFunction function = FindFunction(kInstanceFunctions, name)) {
+    return function;
+  }
+  return FindFunction(kDeviceFunctions, name);
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+MockIcdGetDeviceProcAddr(VkDevice, const char* name) {
+  return FindFunction(kDeviceFunctions, name);
+}
+
+}  // namespace performancelayers
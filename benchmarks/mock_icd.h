@@ -0,0 +1,48 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BENCHMARKS_MOCK_ICD_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BENCHMARKS_MOCK_ICD_H_
+
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// A null Vulkan driver, linked into the benchmarks in place of the loader and
+// a real ICD. Every function succeeds without doing any work, so that the time
+// measured through a layer chain is the overhead of the layers.
+//
+// The mock reports one physical device per instance, with one queue family
+// that supports graphics, compute and 64-bit timestamps, one device-local
+// memory heap, and no device extensions. Dispatchable handles start with a
+// dispatch key, as the handles created by the loader do: physical devices
+// share the key of their instance, and queues and command buffers the key of
+// their device.
+//
+// The mock functions are thread safe, with the external synchronization rules
+// of the Vulkan functions they stand in for.
+
+// Returns the mock instance or device function named |name|, or nullptr if the
+// mock does not implement it.
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+MockIcdGetInstanceProcAddr(VkInstance instance, const char* name);
+
+// Returns the mock device function named |name|, or nullptr if the mock does
+// not implement it.
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+MockIcdGetDeviceProcAddr(VkDevice device, const char* name);
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BENCHMARKS_MOCK_ICD_H_
@@ -0,0 +1,432 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the hot paths of the support library, on a fixed corpus.
+//
+// Run with --benchmark_out=<file> --benchmark_out_format=json to keep the
+// results, or build the `benchmark_support` target, which writes them to
+// layer_support_benchmarks.json in the build directory.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "common_logging.h"
+#include "compile_time_events.h"
+#include "csv_logging.h"
+#include "event_logging.h"
+#include "farmhash.h"
+#include "frame_time_events.h"
+#include "input_buffer.h"
+#include "layer_data.h"
+#include "log_scanner.h"
+#include "memory_usage_events.h"
+
+namespace performancelayers {
+namespace {
+// ----------------------------------------------------------------------------
+// Event corpus
+// ----------------------------------------------------------------------------
+
+// The events below are the events logged by the layers, with typical values.
+
+const std::vector<uint64_t> kPipelineHashes = {
+    0x9e3779b97f4a7c15, 0x243f6a8885a308d3, 0x13198a2e03707344};
+constexpr DurationClock::duration kDuration = std::chrono::nanoseconds(1234567);
+const TimestampClock::time_point kTimestamp(
+    std::chrono::nanoseconds(1650000000123456789));
+
+std::unique_ptr<Event> MakeCreateShaderModuleEvent() {
+  return std::make_unique<CreateShaderModuleEvent>(
+      "create_shader_module", kTimestamp, kPipelineHashes[0], kDuration,
+      LogLevel::kHigh);
+}
+
+std::unique_ptr<Event> MakeCreateGraphicsPipelinesEvent() {
+  VectorInt64Attr hashes("hashes", kPipelineHashes);
+  return std::make_unique<CreateGraphicsPipelinesEvent>(
+      "create_graphics_pipelines", kTimestamp, hashes, kDuration,
+      LogLevel::kHigh);
+}
+
+std::unique_ptr<Event> MakeCompileTimeEvent() {
+  return std::make_unique<CompileTimeEvent>("compile_time", kPipelineHashes,
+                                            kDuration, kTimestamp, 12345);
+}
+
+std::unique_ptr<Event> MakePipelineFeedbackEvent() {
+  constexpr VkPipelineCreationFeedbackFlags kValid =
+      VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT;
+  constexpr VkPipelineCreationFeedbackFlags kCacheHit =
+      VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT;
+  VkPipelineCreationFeedbackEXT pipeline_feedback = {
+      kValid, static_cast<uint64_t>(kDuration.count())};
+  VkPipelineCreationFeedbackEXT stage_feedbacks[] = {
+      {kValid, 850123}, {kValid, 301234}, {kValid | kCacheHit, 83210}};
+  VkPipelineCreationFeedbackCreateInfoEXT feedback = {};
+  feedback.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+  feedback.pPipelineCreationFeedback = &pipeline_feedback;
+  feedback.pipelineStageCreationFeedbackCount = 3;
+  feedback.pPipelineStageCreationFeedbacks = stage_feedbacks;
+  auto event = std::make_unique<PipelineFeedbackEvent>();
+  event->Update("pipeline_creation_feedback", kPipelineHashes, feedback);
+  return event;
+}
+
+std::unique_ptr<Event> MakeFrameTimeEvent() {
+  return std::make_unique<FrameTimeEvent>(
+      "frame_present", std::chrono::nanoseconds(16666667), true);
+}
+
+std::unique_ptr<Event> MakeHitchEvent() {
+  Hitch hitch;
+  hitch.frame_time = std::chrono::nanoseconds(83333333);
+  hitch.limit = std::chrono::nanoseconds(33333333);
+  hitch.activity.allocation_count = 12;
+  hitch.activity.allocation_size = 201326592;
+  return std::make_unique<HitchEvent>(
+      "hitch", hitch,
+      "0x9e3779b97f4a7c15+0x243f6a8885a308d3@4242:21000000;"
+      "0x13198a2e03707344@4243:9000000",
+      "0x13198a2e03707344@4243:1200000");
+}
+
+std::unique_ptr<Event> MakeFrameTimeSummaryEvent() {
+  FrameTimeSummary summary;
+  summary.frame_count = 1000;
+  summary.mean = std::chrono::nanoseconds(16701234);
+  summary.min = std::chrono::nanoseconds(15998765);
+  summary.max = std::chrono::nanoseconds(83333333);
+  summary.p50 = std::chrono::nanoseconds(16654321);
+  summary.p90 = std::chrono::nanoseconds(17012345);
+  summary.p99 = std::chrono::nanoseconds(19876543);
+  summary.p999 = std::chrono::nanoseconds(81234567);
+  summary.one_percent_low = std::chrono::nanoseconds(24567890);
+  summary.jitter = std::chrono::nanoseconds(345678);
+  return std::make_unique<FrameTimeSummaryEvent>("frame_time_summary",
+                                                 summary, true);
+}
+
+std::unique_ptr<Event> MakeMemoryUsageEvent() {
+  DeviceMemoryUsage usage;
+  usage.heap_count = 2;
+  usage.heaps[0] = {VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, 3221225472, 4294967296};
+  usage.heaps[1] = {0, 67108864, 134217728};
+  usage.memory_type_count = 3;
+  usage.memory_type_current[0] = 3221225472;
+  usage.memory_type_current[2] = 67108864;
+  usage.size_histogram[12] = 12;
+  usage.size_histogram[16] = 40;
+  usage.size_histogram[20] = 210;
+  usage.size_histogram[24] = 31;
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+  budget.heapBudget[0] = 8589934592;
+  budget.heapBudget[1] = 17179869184;
+  budget.heapUsage[0] = 3288334336;
+  budget.heapUsage[1] = 67108864;
+  auto event = std::make_unique<MemoryUsageEvent>();
+  event->Update("memory_usage_present", 3221225472, 4294967296,
+                MemoryChurn{17, 15}, usage, &budget);
+  return event;
+}
+
+using MakeEventFunc = std::unique_ptr<Event> (*)();
+
+void BM_EventToCSVString(benchmark::State& state, MakeEventFunc make_event) {
+  std::unique_ptr<Event> event = make_event();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(EventToCSVString(*event));
+  }
+}
+
+void BM_AppendEventToCSV(benchmark::State& state, MakeEventFunc make_event) {
+  std::unique_ptr<Event> event = make_event();
+  std::string out;
+  for (auto _ : state) {
+    out.clear();
+    AppendEventToCSV(*event, &out);
+    benchmark::DoNotOptimize(out.data());
+  }
+}
+
+void BM_EventToCommonLogStr(benchmark::State& state,
+                            MakeEventFunc make_event) {
+  std::unique_ptr<Event> event = make_event();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(EventToCommonLogStr(*event));
+  }
+}
+
+void BM_AppendEventToCommonLog(benchmark::State& state,
+                               MakeEventFunc make_event) {
+  std::unique_ptr<Event> event = make_event();
+  std::string out;
+  for (auto _ : state) {
+    out.clear();
+    AppendEventToCommonLog(*event, &out);
+    benchmark::DoNotOptimize(out.data());
+  }
+}
+
+#define SPL_EVENT_BENCHMARKS(BENCHMARK_FUNC_)                                \
+  BENCHMARK_CAPTURE(BENCHMARK_FUNC_, create_shader_module,                   \
+                    &MakeCreateShaderModuleEvent);                           \
+  BENCHMARK_CAPTURE(BENCHMARK_FUNC_, create_graphics_pipelines,              \
+                    &MakeCreateGraphicsPipelinesEvent);                      \
+  BENCHMARK_CAPTURE(BENCHMARK_FUNC_, compile_time,                           \
+                    &MakeCompileTimeEvent);                                  \
+  BENCHMARK_CAPTURE(BENCHMARK_FUNC_, pipeline_creation_feedback,             \
+                    &MakePipelineFeedbackEvent);                             \
+  BENCHMARK_CAPTURE(BENCHMARK_FUNC_, frame_present,                          \
+                    &MakeFrameTimeEvent);                                    \
+  BENCHMARK_CAPTURE(BENCHMARK_FUNC_, hitch, &MakeHitchEvent);                \
+  BENCHMARK_CAPTURE(BENCHMARK_FUNC_, frame_time_summary,                     \
+                    &MakeFrameTimeSummaryEvent);                             \
+  BENCHMARK_CAPTURE(BENCHMARK_FUNC_, memory_usage, &MakeMemoryUsageEvent)
+
+SPL_EVENT_BENCHMARKS(BM_EventToCSVString);
+SPL_EVENT_BENCHMARKS(BM_AppendEventToCSV);
+SPL_EVENT_BENCHMARKS(BM_EventToCommonLogStr);
+SPL_EVENT_BENCHMARKS(BM_AppendEventToCommonLog);
+
+#undef SPL_EVENT_BENCHMARKS
+
+// ----------------------------------------------------------------------------
+// Hashing
+// ----------------------------------------------------------------------------
+
+// The argument is the number of shader stages of the pipeline.
+void BM_PipelineHashToString(benchmark::State& state) {
+  LayerData layer_data;
+  LayerData::HashVector pipeline;
+  for (int64_t i = 0; i != state.range(0); ++i) {
+    pipeline.push_back(0x9e3779b97f4a7c15u * static_cast<uint64_t>(i + 1));
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(layer_data.PipelineHashToString(pipeline));
+  }
+}
+BENCHMARK(BM_PipelineHashToString)->Arg(1)->Arg(2)->Arg(5);
+
+void BM_AppendPipelineHash(benchmark::State& state) {
+  LayerData::HashVector pipeline;
+  for (int64_t i = 0; i != state.range(0); ++i) {
+    pipeline.push_back(0x9e3779b97f4a7c15u * static_cast<uint64_t>(i + 1));
+  }
+  std::string out;
+  for (auto _ : state) {
+    out.clear();
+    LayerData::AppendPipelineHash(pipeline, &out);
+    benchmark::DoNotOptimize(out.data());
+  }
+}
+BENCHMARK(BM_AppendPipelineHash)->Arg(1)->Arg(2)->Arg(5);
+
+// Returns |size| bytes of random words, starting with the SPIR-V magic number.
+std::vector<uint32_t> MakeShaderCode(size_t size) {
+  std::mt19937 random(size);
+  std::vector<uint32_t> code(size / sizeof(uint32_t));
+  for (uint32_t& word : code) {
+    word = random();
+  }
+  code[0] = 0x07230203;
+  return code;
+}
+
+// The argument is the size of the SPIR-V code in bytes, from small shaders to
+// the largest uber-shaders.
+void BM_Fingerprint64(benchmark::State& state) {
+  const std::vector<uint32_t> code =
+      MakeShaderCode(static_cast<size_t>(state.range(0)));
+  const char* data = reinterpret_cast<const char*>(code.data());
+  const size_t size = code.size() * sizeof(uint32_t);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(util::Fingerprint64(data, size));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_Fingerprint64)->RangeMultiplier(4)->Range(1 << 10, 4 << 20);
+
+// ----------------------------------------------------------------------------
+// File reading
+// ----------------------------------------------------------------------------
+
+// A file in the temporary directory, removed on destruction.
+class TemporaryFile {
+ public:
+  explicit TemporaryFile(const std::string& name)
+      : path_((std::filesystem::temp_directory_path() / name).string()) {}
+  ~TemporaryFile() { std::remove(path_.c_str()); }
+
+  TemporaryFile(const TemporaryFile&) = delete;
+  TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+  const std::string& GetPath() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+// Appends log lines, like the ones of a game, to |out| until it has at least
+// |size| bytes. None of the lines contains the patterns of |kLogPatterns|.
+void AppendLogLines(size_t size, std::string* out) {
+  static uint64_t line_num = 0;
+  const size_t target_size = out->size() + size;
+  while (out->size() < target_size) {
+    ++line_num;
+    absl::StrAppend(out, "[", line_num / 60, ".", line_num % 60 * 16,
+                    "] Info: Streamed asset textures/terrain/rock_",
+                    line_num % 4096, ".ktx2 (2048x2048, 5592405 bytes)\n");
+  }
+}
+
+const char* const kLogPatterns[] = {"Benchmark started", "Entering combat",
+                                    "Benchmark finished"};
+
+// Returns a scanner of |path| watching |kLogPatterns|.
+LogScanner MakeLogScanner(const std::string& path) {
+  std::optional<LogScanner> scanner = LogScanner::FromFilename(path);
+  if (!scanner) {
+    fprintf(stderr, "Failed to open %s\n", path.c_str());
+    abort();
+  }
+  for (const char* pattern : kLogPatterns) {
+    scanner->RegisterWatchedPattern(pattern);
+  }
+  return *std::move(scanner);
+}
+
+// Scans a whole log on the first call. The argument is the size of the log in
+// MiB.
+void BM_LogScannerConsumeNewLines_Full(benchmark::State& state) {
+  const TemporaryFile log("spl_benchmark_full.log");
+  std::string contents;
+  AppendLogLines(static_cast<size_t>(state.range(0)) << 20, &contents);
+  std::ofstream(log.GetPath(), std::ios::binary) << contents;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    LogScanner scanner = MakeLogScanner(log.GetPath());
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(scanner.ConsumeNewLines());
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations() * contents.size()));
+}
+BENCHMARK(BM_LogScannerConsumeNewLines_Full)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(256)
+    ->Unit(benchmark::kMillisecond);
+
+// Scans the lines appended to a log since the previous call, as the benchmark
+// watcher of the frame time layer does. The argument is the size of each
+// append in KiB.
+void BM_LogScannerConsumeNewLines_Appended(benchmark::State& state) {
+  const TemporaryFile log("spl_benchmark_appended.log");
+  std::ofstream out(log.GetPath(), std::ios::binary);
+  std::string contents;
+  AppendLogLines(size_t(64) << 20, &contents);
+  out << contents << std::flush;
+  LogScanner scanner = MakeLogScanner(log.GetPath());
+  scanner.ConsumeNewLines();
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    contents.clear();
+    AppendLogLines(static_cast<size_t>(state.range(0)) << 10, &contents);
+    out << contents << std::flush;
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(scanner.ConsumeNewLines());
+  }
+  state.SetBytesProcessed(state.iterations() * (state.range(0) << 10));
+}
+// Bound the number of iterations, as each one grows the log.
+BENCHMARK(BM_LogScannerConsumeNewLines_Appended)
+    ->Arg(4)
+    ->Arg(64)
+    ->Arg(1024)
+    ->Iterations(200);
+
+// Returns a pipeline cache file of |size| bytes, created on the first call.
+// The files are shared by the benchmarks, as large ones take seconds to write,
+// and removed when the process exits.
+const TemporaryFile& GetCacheFile(size_t size) {
+  static std::map<size_t, std::unique_ptr<TemporaryFile>> files;
+  std::unique_ptr<TemporaryFile>& file = files[size];
+  if (!file) {
+    file = std::make_unique<TemporaryFile>(
+        absl::StrCat("spl_benchmark_cache_", size, ".bin"));
+    std::ofstream out(file->GetPath(), std::ios::binary);
+    std::mt19937_64 random(size);
+    std::vector<uint64_t> chunk(1 << 17);
+    for (size_t written = 0; written < size;
+         written += chunk.size() * sizeof(uint64_t)) {
+      for (uint64_t& word : chunk) {
+        word = random();
+      }
+      out.write(reinterpret_cast<const char*>(chunk.data()),
+                std::min(chunk.size() * sizeof(uint64_t), size - written));
+    }
+  }
+  return *file;
+}
+
+// Creates an input buffer for a pipeline cache file, and reads a byte of each
+// page, as the driver reads the whole cache. The file is in the page cache.
+// The argument is the size of the file in MiB.
+void BM_InputBufferCreate(benchmark::State& state,
+                          InputBuffer::ImplementationKind kind) {
+  const size_t size = static_cast<size_t>(state.range(0)) << 20;
+  const std::string& path = GetCacheFile(size).GetPath();
+  for (auto _ : state) {
+    absl::StatusOr<InputBuffer> buffer = InputBuffer::Create(path, kind);
+    if (!buffer.ok()) {
+      state.SkipWithError(buffer.status().ToString().c_str());
+      break;
+    }
+    absl::Span<const uint8_t> data = buffer->GetBuffer();
+    uint8_t sum = 0;
+    for (size_t i = 0; i < data.size(); i += 4096) {
+      sum += data[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK_CAPTURE(BM_InputBufferCreate, file_read,
+                  InputBuffer::ImplementationKind::kFileRead)
+    ->Arg(100)
+    ->Arg(1024)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_InputBufferCreate, mem_mapped,
+                  InputBuffer::ImplementationKind::kMemMapped)
+    ->Arg(100)
+    ->Arg(1024)
+    ->Unit(benchmark::kMillisecond);
+}  // namespace
+}  // namespace performancelayers
+
+BENCHMARK_MAIN();
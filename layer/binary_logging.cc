@@ -0,0 +1,381 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "binary_logging.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "debug_logging.h"
+#include "layer_utils.h"
+
+namespace performancelayers {
+namespace {
+// The number of buffered bytes after which the records are written.
+constexpr size_t kFlushSize = 64 * 1024;
+
+constexpr size_t kMagicSize = sizeof(kBinaryLogMagic) - 1;
+
+void AppendVarint(uint64_t value, std::string *out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void AppendSignedVarint(int64_t value, std::string *out) {
+  const uint64_t bits = static_cast<uint64_t>(value);
+  AppendVarint((bits << 1) ^ (value < 0 ? ~uint64_t(0) : 0), out);
+}
+
+void AppendFixed64(int64_t value, std::string *out) {
+  uint64_t bits = static_cast<uint64_t>(value);
+  for (int i = 0; i != 8; ++i) {
+    out->push_back(static_cast<char>(bits & 0xff));
+    bits >>= 8;
+  }
+}
+
+void AppendString(std::string_view value, std::string *out) {
+  AppendVarint(value.size(), out);
+  out->append(value.data(), value.size());
+}
+
+// Appends the encoding of the attribute values it is called with to `out`.
+// Timestamps are encoded as the difference from `last_timestamp`, which is
+// then updated.
+struct ValueEncoder {
+  void operator()(bool value) const { out->push_back(value ? 1 : 0); }
+
+  void operator()(DurationClock::duration value) const {
+    AppendSignedVarint(ToInt64Nanoseconds(value), out);
+  }
+
+  void operator()(int64_t value) const { AppendSignedVarint(value, out); }
+
+  void operator()(std::string_view value) const { AppendString(value, out); }
+
+  void operator()(TimestampClock::time_point value) const {
+    const int64_t unix_nanos = ToUnixNanos(value);
+    AppendSignedVarint(unix_nanos - *last_timestamp, out);
+    *last_timestamp = unix_nanos;
+  }
+
+  void operator()(absl::Span<const int64_t> values) const {
+    AppendVarint(values.size(), out);
+    for (int64_t value : values) AppendFixed64(value, out);
+  }
+
+  std::string *out;
+  int64_t *last_timestamp;
+};
+
+// Reads the values encoded by the functions above from the front of |data|.
+// All return false if |data| ends before the value.
+bool ReadVarint(std::string_view *data, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (data->empty()) {
+      return false;
+    }
+    const uint8_t byte = static_cast<uint8_t>(data->front());
+    data->remove_prefix(1);
+    *value |= uint64_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadSignedVarint(std::string_view *data, int64_t *value) {
+  uint64_t bits = 0;
+  if (!ReadVarint(data, &bits)) {
+    return false;
+  }
+  *value = static_cast<int64_t>((bits >> 1) ^ (~(bits & 1) + 1));
+  return true;
+}
+
+bool ReadFixed64(std::string_view *data, int64_t *value) {
+  if (data->size() < 8) {
+    return false;
+  }
+  uint64_t bits = 0;
+  for (int i = 0; i != 8; ++i) {
+    bits |= uint64_t(static_cast<uint8_t>((*data)[i])) << (8 * i);
+  }
+  data->remove_prefix(8);
+  *value = static_cast<int64_t>(bits);
+  return true;
+}
+
+bool ReadString(std::string_view *data, std::string *value) {
+  uint64_t size = 0;
+  if (!ReadVarint(data, &size) || data->size() < size) {
+    return false;
+  }
+  value->assign(data->data(), size);
+  data->remove_prefix(size);
+  return true;
+}
+
+bool ReadByte(std::string_view *data, uint8_t *value) {
+  if (data->empty()) {
+    return false;
+  }
+  *value = static_cast<uint8_t>(data->front());
+  data->remove_prefix(1);
+  return true;
+}
+
+absl::Status TruncatedError() {
+  return absl::DataLossError("Binary log ends within a record");
+}
+}  // namespace
+
+BinaryLogger::BinaryLogger(const char *header, const char *filename)
+    : header_(header) {
+  if (!filename) {
+    SPL_LOG(ERROR) << "The binary log requires a file name. Not logging.";
+    return;
+  }
+  absl::MutexLock lock(&lock_);
+  out_ = fopen(filename, "wb");
+  if (!out_) {
+    SPL_LOG(ERROR) << "Failed to open " << filename << ". Not logging.";
+  }
+}
+
+void BinaryLogger::StartLog() {
+  absl::MutexLock lock(&lock_);
+  buffer_.append(kBinaryLogMagic, kMagicSize);
+  buffer_.push_back(static_cast<char>(kBinaryLogVersion));
+  if (header_) {
+    buffer_.push_back(static_cast<char>(BinaryLogRecordKind::kHeader));
+    AppendString(header_, &buffer_);
+  }
+  WriteBuffered();
+}
+
+void BinaryLogger::AddEvent(Event *event) {
+  const int64_t timestamp = ToUnixNanos(GetTimestamp());
+  absl::MutexLock lock(&lock_);
+  if (!out_) {
+    return;
+  }
+  const uint64_t schema_id = GetSchemaId(*event);
+  buffer_.push_back(static_cast<char>(BinaryLogRecordKind::kEvent));
+  AppendVarint(schema_id, &buffer_);
+  // Events can be added out of order by different threads, hence the signed
+  // difference.
+  AppendSignedVarint(timestamp - last_timestamp_, &buffer_);
+  last_timestamp_ = timestamp;
+
+  for (Attribute *attribute : event->GetAttributes()) {
+    VisitAttributeValue(*attribute, ValueEncoder{&buffer_, &last_timestamp_});
+  }
+
+  if (buffer_.size() >= kFlushSize) {
+    WriteBuffered();
+  }
+}
+
+void BinaryLogger::EndLog() {
+  absl::MutexLock lock(&lock_);
+  WriteBuffered();
+  if (out_) {
+    fclose(out_);
+    out_ = nullptr;
+  }
+}
+
+void BinaryLogger::Flush() {
+  absl::MutexLock lock(&lock_);
+  WriteBuffered();
+}
+
+uint64_t BinaryLogger::GetSchemaId(Event &event) {
+  absl::Span<Attribute *const> attributes = event.GetAttributes();
+  auto it = schemas_.find(std::string_view(event.GetEventName()));
+  if (it != schemas_.end()) {
+    const std::vector<ValueType> &value_types = it->second.value_types;
+    bool matches = value_types.size() == attributes.size();
+    for (size_t i = 0, e = attributes.size(); matches && i != e; ++i) {
+      matches = value_types[i] == attributes[i]->GetValueType();
+    }
+    if (matches) {
+      return it->second.id;
+    }
+  }
+
+  Schema &schema = schemas_[event.GetEventName()];
+  schema.id = next_schema_id_++;
+  schema.value_types.clear();
+  buffer_.push_back(static_cast<char>(BinaryLogRecordKind::kSchema));
+  AppendVarint(schema.id, &buffer_);
+  AppendString(event.GetEventName(), &buffer_);
+  AppendVarint(attributes.size(), &buffer_);
+  for (Attribute *attribute : attributes) {
+    schema.value_types.push_back(attribute->GetValueType());
+    buffer_.push_back(static_cast<char>(attribute->GetValueType()));
+    AppendString(attribute->GetName(), &buffer_);
+  }
+  return schema.id;
+}
+
+void BinaryLogger::WriteBuffered() {
+  if (out_ && !buffer_.empty()) {
+    fwrite(buffer_.data(), 1, buffer_.size(), out_);
+    fflush(out_);
+  }
+  buffer_.clear();
+}
+
+absl::StatusOr<BinaryLogDecoder> BinaryLogDecoder::Create(
+    std::string_view data) {
+  if (data.size() < kMagicSize + 1 ||
+      data.substr(0, kMagicSize) != kBinaryLogMagic) {
+    return absl::InvalidArgumentError("Not a binary log");
+  }
+  const uint8_t version = static_cast<uint8_t>(data[kMagicSize]);
+  if (version != kBinaryLogVersion) {
+    return absl::UnimplementedError(
+        absl::StrCat("Unsupported binary log version ", version));
+  }
+  return BinaryLogDecoder(data.substr(kMagicSize + 1));
+}
+
+absl::StatusOr<bool> BinaryLogDecoder::Next(DecodedEvent *event) {
+  assert(event);
+  while (!data_.empty()) {
+    uint8_t kind = 0;
+    ReadByte(&data_, &kind);
+    switch (static_cast<BinaryLogRecordKind>(kind)) {
+      case BinaryLogRecordKind::kHeader:
+        if (!ReadString(&data_, &header_)) {
+          return TruncatedError();
+        }
+        break;
+      case BinaryLogRecordKind::kSchema:
+        if (absl::Status status = ReadSchema(); !status.ok()) {
+          return status;
+        }
+        break;
+      case BinaryLogRecordKind::kEvent:
+        if (absl::Status status = ReadEvent(event); !status.ok()) {
+          return status;
+        }
+        return true;
+      default:
+        return absl::DataLossError(
+            absl::StrCat("Unknown binary log record kind ", kind));
+    }
+  }
+  return false;
+}
+
+absl::Status BinaryLogDecoder::ReadSchema() {
+  uint64_t id = 0;
+  Schema schema;
+  uint64_t count = 0;
+  if (!ReadVarint(&data_, &id) || !ReadString(&data_, &schema.name) ||
+      !ReadVarint(&data_, &count)) {
+    return TruncatedError();
+  }
+  for (uint64_t i = 0; i != count; ++i) {
+    uint8_t type = 0;
+    std::string name;
+    if (!ReadByte(&data_, &type) || !ReadString(&data_, &name)) {
+      return TruncatedError();
+    }
+    if (type > ValueType::kVectorInt64) {
+      return absl::DataLossError(
+          absl::StrCat("Unknown binary log value type ", type));
+    }
+    schema.attributes.emplace_back(std::move(name),
+                                   static_cast<ValueType>(type));
+  }
+  schemas_.insert_or_assign(id, std::move(schema));
+  return absl::OkStatus();
+}
+
+absl::Status BinaryLogDecoder::ReadEvent(DecodedEvent *event) {
+  uint64_t schema_id = 0;
+  int64_t timestamp_delta = 0;
+  if (!ReadVarint(&data_, &schema_id) ||
+      !ReadSignedVarint(&data_, &timestamp_delta)) {
+    return TruncatedError();
+  }
+  auto it = schemas_.find(schema_id);
+  if (it == schemas_.end()) {
+    return absl::DataLossError(
+        absl::StrCat("Binary log event with unknown schema ", schema_id));
+  }
+  const Schema &schema = it->second;
+  last_timestamp_ += timestamp_delta;
+  event->name = schema.name;
+  event->timestamp = last_timestamp_;
+  event->values.resize(schema.attributes.size());
+
+  for (size_t i = 0, e = schema.attributes.size(); i != e; ++i) {
+    DecodedValue &value = event->values[i];
+    value.name = schema.attributes[i].first;
+    value.type = schema.attributes[i].second;
+    value.int64_value = 0;
+    value.string_value.clear();
+    value.vector_value.clear();
+    bool ok = true;
+    switch (value.type) {
+      case ValueType::kBool: {
+        uint8_t byte = 0;
+        ok = ReadByte(&data_, &byte);
+        value.int64_value = byte != 0;
+        break;
+      }
+      case ValueType::kDuration:
+      case ValueType::kInt64:
+        ok = ReadSignedVarint(&data_, &value.int64_value);
+        break;
+      case ValueType::kString:
+        ok = ReadString(&data_, &value.string_value);
+        break;
+      case ValueType::kTimestamp:
+        ok = ReadSignedVarint(&data_, &timestamp_delta);
+        last_timestamp_ += timestamp_delta;
+        value.int64_value = last_timestamp_;
+        break;
+      case ValueType::kVectorInt64: {
+        uint64_t count = 0;
+        ok = ReadVarint(&data_, &count);
+        for (uint64_t j = 0; ok && j != count; ++j) {
+          int64_t element = 0;
+          ok = ReadFixed64(&data_, &element);
+          value.vector_value.push_back(element);
+        }
+        break;
+      }
+    }
+    if (!ok) {
+      return TruncatedError();
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,172 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BINARY_LOGGING_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BINARY_LOGGING_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "event_logging.h"
+
+namespace performancelayers {
+// Binary event log format
+//
+// A compact alternative to the CSV logs, for long runs. A log is the magic
+// string `SPLB`, a version byte, and a sequence of records. Each record starts
+// with a `BinaryLogRecordKind` byte:
+// - kHeader: `string`. The CSV header of the log.
+// - kSchema: `id:varint name:string count:varint (type:u8 name:string)*`.
+//   Describes the attributes of the events named `name`, by `ValueType`. Comes
+//   before the first event that uses the schema `id`.
+// - kEvent: `schema_id:varint timestamp:svarint value*`. The values of the
+//   attributes described by the schema, encoded as:
+//   - kBool: u8.
+//   - kInt64: svarint.
+//   - kDuration: svarint, in nanoseconds.
+//   - kTimestamp: svarint.
+//   - kString: string.
+//   - kVectorInt64: `count:varint u64*`, with fixed-width little-endian
+//     elements, as these are usually hashes.
+//
+// `varint`s are unsigned LEB128, `svarint`s are zigzag-encoded `varint`s, and
+// `string`s are a `varint` length followed by the bytes. Timestamps, including
+// the time at which each event was logged, are Unix nanoseconds encoded as the
+// difference from the previous timestamp in the log, starting from 0.
+//
+// scripts/binary_log.py decodes the logs, and converts them to CSV.
+inline constexpr char kBinaryLogMagic[] = "SPLB";
+inline constexpr uint8_t kBinaryLogVersion = 1;
+
+enum class BinaryLogRecordKind : uint8_t {
+  kHeader = 1,
+  kSchema = 2,
+  kEvent = 3,
+};
+
+// BinaryLogger logs the events in the binary format to the file `filename`.
+// The events are buffered, and written in large chunks. Nothing is logged if
+// the file cannot be opened. The only valid methods after calling `EndLog()`
+// is `EndLog()`.
+class BinaryLogger : public EventLogger {
+ public:
+  BinaryLogger(const char *header, const char *filename);
+
+  BinaryLogger(const BinaryLogger &) = delete;
+  BinaryLogger &operator=(const BinaryLogger &) = delete;
+
+  ~BinaryLogger() override { EndLog(); }
+
+  void AddEvent(Event *event) override;
+
+  // Writes the magic string and the header given in the constructor.
+  void StartLog() override;
+
+  void EndLog() override;
+
+  void Flush() override;
+
+ private:
+  struct Schema {
+    uint64_t id = 0;
+    std::vector<ValueType> value_types;
+  };
+
+  // Returns the id of the schema of `event`. Adds a schema record for new
+  // event names, and for events whose attributes differ from the previous
+  // events with the same name.
+  uint64_t GetSchemaId(Event &event) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  void WriteBuffered() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  const char *header_ = nullptr;
+  absl::Mutex lock_;
+  FILE *out_ ABSL_GUARDED_BY(lock_) = nullptr;
+  // The encoded records that are not written yet.
+  std::string buffer_ ABSL_GUARDED_BY(lock_);
+  absl::flat_hash_map<std::string, Schema> schemas_ ABSL_GUARDED_BY(lock_);
+  uint64_t next_schema_id_ ABSL_GUARDED_BY(lock_) = 0;
+  int64_t last_timestamp_ ABSL_GUARDED_BY(lock_) = 0;
+};
+
+// An attribute value read from a binary log.
+struct DecodedValue {
+  std::string_view name;
+  ValueType type = ValueType::kInt64;
+  // The value of kBool, kInt64, kDuration (in nanoseconds) and kTimestamp (in
+  // Unix nanoseconds) attributes.
+  int64_t int64_value = 0;
+  std::string string_value;
+  std::vector<int64_t> vector_value;
+};
+
+// An event read from a binary log. The names are valid for the lifetime of the
+// decoder.
+struct DecodedEvent {
+  std::string_view name;
+  // The time at which the event was logged, in Unix nanoseconds.
+  int64_t timestamp = 0;
+  std::vector<DecodedValue> values;
+};
+
+// Reads the events of a binary log one at a time. Sample use:
+// ```c++
+// absl::StatusOr<BinaryLogDecoder> decoder = BinaryLogDecoder::Create(data);
+// DecodedEvent event;
+// while (decoder->Next(&event).value_or(false)) { ... }
+// ```
+class BinaryLogDecoder {
+ public:
+  // Creates a decoder of the log in `data`, which must outlive the decoder.
+  // Fails if `data` does not start with a supported magic string and version.
+  static absl::StatusOr<BinaryLogDecoder> Create(std::string_view data);
+
+  // Decodes the next event into `event`, along with the header and schema
+  // records in front of it. Returns false at the end of the log, and an error
+  // if the log is corrupt or ends within a record, e.g., because the
+  // application was terminated while writing it.
+  absl::StatusOr<bool> Next(DecodedEvent *event);
+
+  // Returns the CSV header of the log, if already decoded.
+  const std::string &GetHeader() const { return header_; }
+
+ private:
+  struct Schema {
+    std::string name;
+    std::vector<std::pair<std::string, ValueType>> attributes;
+  };
+
+  explicit BinaryLogDecoder(std::string_view data) : data_(data) {}
+
+  absl::Status ReadSchema();
+  absl::Status ReadEvent(DecodedEvent *event);
+
+  std::string_view data_;
+  std::string header_;
+  // Node-based, so that decoded events can refer to the names.
+  absl::node_hash_map<uint64_t, Schema> schemas_;
+  int64_t last_timestamp_ = 0;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BINARY_LOGGING_H_
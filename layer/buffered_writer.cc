@@ -0,0 +1,200 @@
+// Copyright 2020-2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "buffered_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/numbers.h"
+#include "debug_logging.h"
+
+namespace performancelayers {
+namespace {
+constexpr char kFlushIntervalEnvVar[] =
+    "VK_PERFORMANCE_LAYERS_LOG_FLUSH_INTERVAL_MS";
+constexpr char kFlushBytesEnvVar[] = "VK_PERFORMANCE_LAYERS_LOG_FLUSH_BYTES";
+
+// Parses the non-negative integer value of |env_var|, if it is set.
+bool ParseEnvVar(const char* env_var, uint64_t* value) {
+  const char* str = getenv(env_var);
+  if (!str) {
+    return false;
+  }
+  if (!absl::SimpleAtoi(str, value)) {
+    SPL_LOG(WARNING) << "Ignoring invalid value of " << env_var << ": " << str;
+    return false;
+  }
+  return true;
+}
+
+uint64_t GetNextWriterId() {
+  static std::atomic<uint64_t> next_id = 0;
+  return next_id++;
+}
+}  // namespace
+
+LogBufferingOptions LogBufferingOptions::FromEnvironment() {
+  LogBufferingOptions options;
+  uint64_t value = 0;
+  if (ParseEnvVar(kFlushIntervalEnvVar, &value)) {
+    options.flush_interval = absl::Milliseconds(value);
+  }
+  if (ParseEnvVar(kFlushBytesEnvVar, &value)) {
+    options.flush_size = value;
+  }
+  return options;
+}
+
+BufferedWriter::BufferedWriter(FILE* file, const LogBufferingOptions& options)
+    : id_(GetNextWriterId()), options_(options), file_(file) {
+  if (file_) {
+    // Each batch goes to the file in a single write, in whole lines.
+    setvbuf(file_, nullptr, _IONBF, 0);
+  }
+  if (options_.flush_interval > absl::ZeroDuration()) {
+    writer_ = std::thread([this] { RunWriter(); });
+  }
+}
+
+void BufferedWriter::WriteLine(std::string_view line) {
+  if (!writer_.joinable()) {
+    absl::MutexLock lock(&write_lock_);
+    batch_.append(line.data(), line.size()).push_back('\n');
+    WriteBuffered();
+    return;
+  }
+
+  ThreadBuffer* buffer = GetThreadBuffer();
+  bool full = false;
+  {
+    absl::MutexLock lock(&buffer->lock);
+    const uint64_t sequence =
+        next_sequence_.fetch_add(1, std::memory_order_acq_rel);
+    buffer->text.append(line.data(), line.size()).push_back('\n');
+    buffer->lines.push_back({sequence, buffer->text.size()});
+    full = buffer->text.size() >= options_.flush_size;
+  }
+  if (full) {
+    absl::MutexLock lock(&state_lock_);
+    wake_up_ = true;
+  }
+}
+
+void BufferedWriter::Flush() {
+  absl::MutexLock lock(&write_lock_);
+  WriteBuffered();
+}
+
+void BufferedWriter::Close() {
+  if (writer_.joinable()) {
+    {
+      absl::MutexLock lock(&state_lock_);
+      stop_ = true;
+    }
+    writer_.join();
+  }
+
+  absl::MutexLock lock(&write_lock_);
+  WriteBuffered();
+  if (file_ && file_ != stderr) {
+    fclose(file_);
+  }
+  file_ = nullptr;
+}
+
+BufferedWriter::ThreadBuffer* BufferedWriter::GetThreadBuffer() {
+  // The buffers stay owned by the writer, so that they are written out even
+  // after their thread exits.
+  thread_local absl::flat_hash_map<uint64_t, ThreadBuffer*> thread_buffers;
+  ThreadBuffer*& buffer = thread_buffers[id_];
+  if (!buffer) {
+    absl::MutexLock lock(&buffers_lock_);
+    buffers_.push_back(std::make_unique<ThreadBuffer>());
+    buffer = buffers_.back().get();
+  }
+  return buffer;
+}
+
+void BufferedWriter::WriteBuffered() {
+  // Only the lines numbered before |end_sequence| are taken. Those are all in
+  // the buffers once their locks are taken, since the numbers are taken under
+  // the locks. The later lines are left for the next batch, so that they are
+  // not written before a line with a lower number that is still being logged.
+  const uint64_t end_sequence = next_sequence_.load(std::memory_order_acquire);
+  {
+    absl::MutexLock lock(&buffers_lock_);
+    for (std::unique_ptr<ThreadBuffer>& buffer : buffers_) {
+      absl::MutexLock buffer_lock(&buffer->lock);
+      size_t begin = 0;
+      size_t taken_count = 0;
+      for (const BufferedLine& line : buffer->lines) {
+        if (line.sequence >= end_sequence) {
+          break;
+        }
+        taken_lines_.push_back({line.sequence, taken_.size() + begin,
+                                taken_.size() + line.end});
+        begin = line.end;
+        ++taken_count;
+      }
+      if (taken_count == 0) {
+        continue;
+      }
+      taken_.append(buffer->text, 0, begin);
+      buffer->text.erase(0, begin);
+      buffer->lines.erase(buffer->lines.begin(),
+                          buffer->lines.begin() + taken_count);
+      for (BufferedLine& line : buffer->lines) {
+        line.end -= begin;
+      }
+    }
+  }
+  std::sort(taken_lines_.begin(), taken_lines_.end(),
+            [](const TakenLine& a, const TakenLine& b) {
+              return a.sequence < b.sequence;
+            });
+  for (const TakenLine& line : taken_lines_) {
+    batch_.append(taken_, line.begin, line.end - line.begin);
+  }
+  taken_.clear();
+  taken_lines_.clear();
+  if (file_ && !batch_.empty()) {
+    fwrite(batch_.data(), 1, batch_.size(), file_);
+    fflush(file_);
+  }
+  batch_.clear();
+}
+
+void BufferedWriter::RunWriter() {
+  while (true) {
+    bool stop = false;
+    {
+      absl::MutexLock lock(&state_lock_);
+      state_lock_.AwaitWithTimeout(
+          absl::Condition(this, &BufferedWriter::ShouldWakeUp),
+          options_.flush_interval);
+      wake_up_ = false;
+      stop = stop_;
+    }
+    if (stop) {
+      // |Close| writes whatever is left.
+      return;
+    }
+    Flush();
+  }
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,148 @@
+// Copyright 2020-2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BUFFERED_WRITER_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BUFFERED_WRITER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace performancelayers {
+
+// Controls how long log lines can stay in memory before they are written.
+struct LogBufferingOptions {
+  // The maximum time between two writes of the buffered lines. Zero disables
+  // buffering: every line is written and flushed right away.
+  absl::Duration flush_interval = absl::Milliseconds(100);
+  // The number of bytes buffered by a single thread after which the lines are
+  // written without waiting for |flush_interval| to pass.
+  size_t flush_size = 64 * 1024;
+
+  // Returns the default options, overridden by the
+  // VK_PERFORMANCE_LAYERS_LOG_FLUSH_INTERVAL_MS and
+  // VK_PERFORMANCE_LAYERS_LOG_FLUSH_BYTES environment variables.
+  static LogBufferingOptions FromEnvironment();
+};
+
+// Writes lines to a file in large batches from a background thread, so that
+// the threads that log never wait for the file.
+//
+// Each logging thread appends to its own buffer. The buffers are written out
+// when |flush_interval| passes, when one of them grows over |flush_size|,
+// when |Flush| is called, and when the writer is closed. Every line gets a
+// sequence number when it is logged, and the lines are written in that order,
+// also across threads and batches. Every batch is written with a single call to
+// the unbuffered |file|, so lines are never interleaved with those of other
+// writers appending to the same file.
+//
+// This class is thread safe.
+class BufferedWriter {
+ public:
+  // Takes ownership of |file|, which is closed by |Close| unless it is
+  // stderr.
+  explicit BufferedWriter(
+      FILE* file, const LogBufferingOptions& options =
+                      LogBufferingOptions::FromEnvironment());
+
+  BufferedWriter(const BufferedWriter&) = delete;
+  BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+  ~BufferedWriter() { Close(); }
+
+  // Appends |line| and a newline to the output. Lines written after |Close|
+  // are dropped.
+  void WriteLine(std::string_view line);
+
+  // Writes all the buffered lines and flushes the file.
+  void Flush();
+
+  // Writes all the buffered lines, stops the background thread, and closes
+  // the file. Must not be called concurrently with itself.
+  void Close();
+
+ private:
+  // A line in a buffer, which ends at |end| in the buffered text.
+  struct BufferedLine {
+    uint64_t sequence = 0;
+    size_t end = 0;
+  };
+
+  struct ThreadBuffer {
+    absl::Mutex lock;
+    // The text of the lines, which are in the order of their sequence numbers.
+    std::string text ABSL_GUARDED_BY(lock);
+    std::vector<BufferedLine> lines ABSL_GUARDED_BY(lock);
+  };
+
+  // A line taken out of a thread buffer by |WriteBuffered|, which is
+  // [|begin|, |end|) of |taken_|.
+  struct TakenLine {
+    uint64_t sequence = 0;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  // Returns the buffer of the calling thread, creating it on first use.
+  ThreadBuffer* GetThreadBuffer();
+
+  // Writes the lines of all the thread buffers to |file_|, in the order of
+  // their sequence numbers.
+  void WriteBuffered() ABSL_EXCLUSIVE_LOCKS_REQUIRED(write_lock_);
+
+  // The body of the background thread.
+  void RunWriter();
+
+  bool ShouldWakeUp() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(state_lock_) {
+    return wake_up_ || stop_;
+  }
+
+  // Distinguishes the buffers of this writer in the thread-local cache. Never
+  // reused, unlike the address of the writer.
+  const uint64_t id_;
+  const LogBufferingOptions options_;
+
+  // The sequence number of the next line. Only taken while holding the lock of
+  // the buffer the line goes to.
+  std::atomic<uint64_t> next_sequence_ = 0;
+  absl::Mutex buffers_lock_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_
+      ABSL_GUARDED_BY(buffers_lock_);
+
+  absl::Mutex write_lock_;
+  FILE* file_ ABSL_GUARDED_BY(write_lock_) = nullptr;
+  // The lines being written, and the lines taken out of the thread buffers to
+  // be sorted into |batch_|. Kept to reuse their memory.
+  std::string batch_ ABSL_GUARDED_BY(write_lock_);
+  std::string taken_ ABSL_GUARDED_BY(write_lock_);
+  std::vector<TakenLine> taken_lines_ ABSL_GUARDED_BY(write_lock_);
+
+  absl::Mutex state_lock_;
+  bool wake_up_ ABSL_GUARDED_BY(state_lock_) = false;
+  bool stop_ ABSL_GUARDED_BY(state_lock_) = false;
+  std::thread writer_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_BUFFERED_WRITER_H_
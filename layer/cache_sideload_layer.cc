@@ -14,43 +14,127 @@
 
 #include <cassert>
 #include <cstring>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "debug_logging.h"
+#include "farmhash.h"
 #include "input_buffer.h"
 #include "layer_data.h"
 #include "layer_utils.h"
+#include "output_file.h"
+#include "pipeline_cache_header.h"
 
 namespace performancelayers {
 namespace {
+// A pipeline cache file used to initialize implicit pipeline caches.
+struct CacheFile {
+  std::string path;
+  // Mapped once when the file is first used. Never modified afterwards.
+  std::optional<InputBuffer> contents;
+  // The hash of the data last written to the file in write-back mode.
+  std::optional<uint64_t> written_data_hash;
+};
+
 class CacheSideloadLayerData : public LayerData {
  public:
-  CacheSideloadLayerData(const char* pipeline_cache_path)
-      : LayerData(nullptr, ""),
-        implicit_pipeline_cache_path_(pipeline_cache_path) {
+  CacheSideloadLayerData(const char* pipeline_cache_path,
+                         const char* pipeline_cache_directory, bool write_back)
+      : LayerData(nullptr, ""), write_back_(write_back) {
     LogEventOnly("cache_sideload_layer_init");
+    if (pipeline_cache_directory && strlen(pipeline_cache_directory) != 0) {
+      // The file to use depends on the device.
+      pipeline_cache_directory_ = pipeline_cache_directory;
+      return;
+    }
+    if (!pipeline_cache_path || strlen(pipeline_cache_path) == 0) {
+      SPL_LOG(WARNING) << "Invalid implicit pipeline cache file path";
+      return;
+    }
+    // Start reading the cache file now, so that the read overlaps with the
+    // instance setup instead of delaying device creation.
+    implicit_cache_file_.path = pipeline_cache_path;
+    implicit_cache_file_.contents = ReadCacheFile(implicit_cache_file_.path);
+    if (implicit_cache_file_.contents) {
+      implicit_cache_file_.contents->Prefetch();
+    }
   }
 
   VkPipelineCache GetImplicitDeviceCache(VkDevice) const;
   void RemoveImplicitDeviceCache(VkDevice);
   VkPipelineCache CreateImplicitDeviceCache(
       VkDevice device, const VkAllocationCallbacks* alloc_callbacks,
-      absl::Span<const uint8_t> initial_data);
+      const std::string& path, absl::Span<const uint8_t> initial_data);
+
+  // Creates the implicit pipeline cache of |device|, initialized with the
+  // pipeline cache file for |physical_device| if it matches the device, and
+  // the write-back cache of |device| in write-back mode.
+  void CreateDeviceCaches(VkDevice device, VkPhysicalDevice physical_device,
+                          const VkAllocationCallbacks* alloc_callbacks);
 
   std::optional<size_t> QueryPipelineCacheSize(VkDevice, VkPipelineCache cache);
 
-  std::optional<InputBuffer> ReadImplicitCacheFile();
+  // Returns true if the pipelines compiled during the session are written back
+  // to the implicit pipeline cache file.
+  bool IsWriteBackEnabled() const { return write_back_; }
+
+  // Creates the empty cache that collects the pipelines to write back to |file|
+  // for |device|.
+  void CreateWriteBackDeviceCache(VkDevice device,
+                                  const VkAllocationCallbacks* alloc_callbacks,
+                                  CacheFile* file);
+  // Merges |cache| into the write-back cache of |device|, if any.
+  void MergeIntoWriteBackCache(VkDevice device, VkPipelineCache cache);
+  // Merges the implicit cache of |device| into its write-back cache, writes the
+  // result to the pipeline cache file of |device| if it has new contents, and
+  // destroys the write-back cache.
+  void WriteBackDeviceCache(VkDevice device,
+                            const VkAllocationCallbacks* alloc_callbacks);
 
  private:
+  struct WriteBackCache {
+    VkPipelineCache cache;
+    CacheFile* file;
+  };
+
+  std::optional<InputBuffer> ReadCacheFile(const std::string& path) const;
+
+  // Returns the pipeline cache file for the devices with |properties|, or
+  // nullptr if there is none.
+  CacheFile* GetCacheFile(const VkPhysicalDeviceProperties& properties);
+
+  // Returns true if |data| matches the contents of |file|, as read when it was
+  // first used or last written.
+  bool IsPersisted(const CacheFile& file, absl::Span<const uint8_t> data) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(write_back_lock_);
+
   mutable absl::Mutex device_to_implicit_cache_handle_lock_;
   absl::flat_hash_map<VkDevice, VkPipelineCache>
       device_to_implicit_cache_handle_
           ABSL_GUARDED_BY(device_to_implicit_cache_handle_lock_);
 
-  const char* implicit_pipeline_cache_path_ = nullptr;
+  // The file shared by all devices, read when the layer is loaded. Unused when
+  // |pipeline_cache_directory_| is set.
+  CacheFile implicit_cache_file_;
+  // The directory with one pipeline cache file per device and driver, or
+  // nullptr.
+  const char* pipeline_cache_directory_ = nullptr;
+  absl::Mutex cache_files_lock_;
+  absl::flat_hash_map<std::string, std::unique_ptr<CacheFile>>
+      directory_cache_files_ ABSL_GUARDED_BY(cache_files_lock_);
+
+  const bool write_back_ = false;
+  // Merging into a cache requires external synchronization, so all merges
+  // into write-back caches happen under this lock. The write-back caches are
+  // not used for pipeline creation. Also guards the |written_data_hash| of the
+  // cache files.
+  absl::Mutex write_back_lock_;
+  absl::flat_hash_map<VkDevice, WriteBackCache> device_to_write_back_cache_
+      ABSL_GUARDED_BY(write_back_lock_);
 };
 
 VkPipelineCache CacheSideloadLayerData::GetImplicitDeviceCache(
@@ -70,7 +154,7 @@ void CacheSideloadLayerData::RemoveImplicitDeviceCache(VkDevice device) {
 
 VkPipelineCache CacheSideloadLayerData::CreateImplicitDeviceCache(
     VkDevice device, const VkAllocationCallbacks* alloc_callbacks,
-    absl::Span<const uint8_t> initial_data) {
+    const std::string& path, absl::Span<const uint8_t> initial_data) {
   absl::MutexLock lock(&device_to_implicit_cache_handle_lock_);
   assert(device_to_implicit_cache_handle_.count(device) == 0 &&
          "Implicit cache already created for this device.");
@@ -81,8 +165,7 @@ VkPipelineCache CacheSideloadLayerData::CreateImplicitDeviceCache(
   create_info.initialDataSize = initial_data_size;
   create_info.pInitialData = initial_data.data();
 
-  const std::string path_info =
-      absl::StrCat("path: ", implicit_pipeline_cache_path_);
+  const std::string path_info = absl::StrCat("path: ", path);
   const std::string initial_size_info =
       absl::StrCat("initial_data_size: ", initial_data_size);
 
@@ -147,18 +230,178 @@ std::optional<size_t> CacheSideloadLayerData::QueryPipelineCacheSize(
   return cache_size_upper_bound;
 }
 
-std::optional<InputBuffer> CacheSideloadLayerData::ReadImplicitCacheFile() {
-  if (!implicit_pipeline_cache_path_ ||
-      strlen(implicit_pipeline_cache_path_) == 0) {
-    SPL_LOG(WARNING) << "Invalid implicit pipeline cache file path";
-    return std::nullopt;
+void CacheSideloadLayerData::CreateDeviceCaches(
+    VkDevice device, VkPhysicalDevice physical_device,
+    const VkAllocationCallbacks* alloc_callbacks) {
+  VkPhysicalDeviceProperties properties = {};
+  auto get_properties_proc = GetNextInstanceProcAddr(
+      physical_device,
+      &VkLayerInstanceDispatchTable::GetPhysicalDeviceProperties);
+  get_properties_proc(physical_device, &properties);
+
+  CacheFile* file = GetCacheFile(properties);
+  if (!file) return;
+
+  // Drivers silently ignore the initial data of other devices and drivers,
+  // after reading all of it, so check the header first.
+  absl::Span<const uint8_t> initial_data;
+  if (file->contents) {
+    absl::Span<const uint8_t> file_data = file->contents->GetBuffer();
+    absl::Status status = ValidatePipelineCacheHeader(file_data, properties);
+    if (status.ok()) {
+      initial_data = file_data;
+    } else {
+      SPL_LOG(WARNING) << "Not using pipeline cache file " << file->path
+                       << ": " << status;
+      LogEventOnly("reject_implicit_pipeline_cache",
+                   CsvCat(absl::StrCat("path: ", file->path),
+                          absl::StrCat("reason: ", status.message())));
+    }
+  }
+
+  if (file->contents || write_back_) {
+    auto implicit_cache_handle = CreateImplicitDeviceCache(
+        device, alloc_callbacks, file->path, initial_data);
+    (void)implicit_cache_handle;
+  }
+  if (write_back_) {
+    CreateWriteBackDeviceCache(device, alloc_callbacks, file);
+  }
+}
+
+CacheFile* CacheSideloadLayerData::GetCacheFile(
+    const VkPhysicalDeviceProperties& properties) {
+  if (!pipeline_cache_directory_) {
+    return implicit_cache_file_.path.empty() ? nullptr : &implicit_cache_file_;
+  }
+
+  std::string path = absl::StrCat(pipeline_cache_directory_, "/",
+                                  GetPipelineCacheFileName(properties));
+  absl::MutexLock lock(&cache_files_lock_);
+  std::unique_ptr<CacheFile>& file = directory_cache_files_[path];
+  if (!file) {
+    file = std::make_unique<CacheFile>();
+    file->contents = ReadCacheFile(path);
+    file->path = std::move(path);
+  }
+  return file.get();
+}
+
+void CacheSideloadLayerData::CreateWriteBackDeviceCache(
+    VkDevice device, const VkAllocationCallbacks* alloc_callbacks,
+    CacheFile* file) {
+  assert(write_back_);
+  assert(file);
+  VkPipelineCacheCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+  auto create_proc =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::CreatePipelineCache);
+  VkPipelineCache new_cache = nullptr;
+  if (create_proc(device, &create_info, alloc_callbacks, &new_cache) !=
+      VK_SUCCESS) {
+    SPL_LOG(ERROR) << "Failed to create write-back pipeline cache";
+    return;
+  }
+
+  absl::MutexLock lock(&write_back_lock_);
+  device_to_write_back_cache_[device] = {new_cache, file};
+}
+
+void CacheSideloadLayerData::MergeIntoWriteBackCache(VkDevice device,
+                                                     VkPipelineCache cache) {
+  absl::MutexLock lock(&write_back_lock_);
+  auto it = device_to_write_back_cache_.find(device);
+  if (it == device_to_write_back_cache_.end()) return;
+
+  auto merge_cache_proc = GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::MergePipelineCaches);
+  if (merge_cache_proc(device, it->second.cache, 1, &cache) != VK_SUCCESS) {
+    SPL_LOG(WARNING) << "Failed to merge pipeline cache into write-back cache";
+  }
+}
+
+void CacheSideloadLayerData::WriteBackDeviceCache(
+    VkDevice device, const VkAllocationCallbacks* alloc_callbacks) {
+  if (VkPipelineCache implicit_cache = GetImplicitDeviceCache(device)) {
+    MergeIntoWriteBackCache(device, implicit_cache);
+  }
+
+  absl::MutexLock lock(&write_back_lock_);
+  auto it = device_to_write_back_cache_.find(device);
+  if (it == device_to_write_back_cache_.end()) return;
+  const VkPipelineCache cache = it->second.cache;
+  CacheFile& file = *it->second.file;
+  device_to_write_back_cache_.erase(it);
+
+  // The cache may grow between the two calls only if another thread uses it,
+  // which the layer doesn't do.
+  std::vector<uint8_t> data;
+  auto get_data_proc = GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::GetPipelineCacheData);
+  size_t data_size = 0;
+  VkResult result = get_data_proc(device, cache, &data_size, nullptr);
+  if (result == VK_SUCCESS) {
+    data.resize(data_size);
+    result = get_data_proc(device, cache, &data_size, data.data());
+    data.resize(data_size);
+  }
+  auto destroy_proc = GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::DestroyPipelineCache);
+  destroy_proc(device, cache, alloc_callbacks);
+  if (result != VK_SUCCESS) {
+    SPL_LOG(ERROR) << "Failed to get write-back pipeline cache data";
+    return;
   }
 
-  auto cache_file_or_status =
-      performancelayers::InputBuffer::Create(implicit_pipeline_cache_path_);
+  const std::string path_info = absl::StrCat("path: ", file.path);
+  const std::string size_info = absl::StrCat("data_size: ", data.size());
+  if (data.empty() || IsPersisted(file, data)) {
+    SPL_LOG(INFO) << "No new pipelines to write back (" << path_info << ")";
+    LogEventOnly("skip_pipeline_cache_write_back",
+                 CsvCat(path_info, size_info));
+    return;
+  }
+
+  if (absl::Status status = WriteFileAtomically(file.path, data);
+      !status.ok()) {
+    SPL_LOG(ERROR) << "Failed to write back pipeline cache: " << status;
+    return;
+  }
+  file.written_data_hash = util::Fingerprint64(
+      reinterpret_cast<const char*>(data.data()), data.size());
+  SPL_LOG(INFO) << "Wrote back pipeline cache (" << path_info << ", "
+                << size_info << ")";
+  LogEventOnly("write_back_pipeline_cache", CsvCat(path_info, size_info));
+}
+
+bool CacheSideloadLayerData::IsPersisted(
+    const CacheFile& file, absl::Span<const uint8_t> data) const {
+  if (file.written_data_hash) {
+    return *file.written_data_hash ==
+           util::Fingerprint64(reinterpret_cast<const char*>(data.data()),
+                               data.size());
+  }
+  // The mapping keeps the contents of the file as first read, even after the
+  // file is replaced.
+  if (!file.contents) return false;
+  absl::Span<const uint8_t> file_data = file.contents->GetBuffer();
+  return file_data.size() == data.size() &&
+         memcmp(file_data.data(), data.data(), data.size()) == 0;
+}
+
+std::optional<InputBuffer> CacheSideloadLayerData::ReadCacheFile(
+    const std::string& path) const {
+  auto cache_file_or_status = performancelayers::InputBuffer::Create(path);
   if (!cache_file_or_status.ok()) {
-    SPL_LOG(ERROR) << "Failed to read implicit pipeline cache: "
-                   << cache_file_or_status.status();
+    // In write-back mode, the first run creates the file.
+    if (write_back_) {
+      SPL_LOG(INFO) << "Starting with an empty implicit pipeline cache: "
+                    << cache_file_or_status.status();
+    } else {
+      SPL_LOG(ERROR) << "Failed to read implicit pipeline cache: "
+                     << cache_file_or_status.status();
+    }
     return std::nullopt;
   }
   return std::move(*cache_file_or_status);
@@ -178,12 +421,25 @@ constexpr char kLayerName[] = "VK_LAYER_STADIA_pipeline_cache_sideload";
 constexpr char kLayerDescription[] = "Stadia Pipeline Cache Sideloading Layer";
 constexpr char kImplicitCacheFilenameEnvVar[] =
     "VK_PIPELINE_CACHE_SIDELOAD_FILE";
+// When set, the pipeline cache file of each device is picked from this
+// directory by GetPipelineCacheFileName, instead of
+// VK_PIPELINE_CACHE_SIDELOAD_FILE.
+constexpr char kCacheDirectoryEnvVar[] = "VK_PIPELINE_CACHE_SIDELOAD_DIR";
+// Set to "1" to write the pipelines compiled during the session back to the
+// implicit pipeline cache file.
+constexpr char kWriteBackEnvVar[] = "VK_PIPELINE_CACHE_SIDELOAD_WRITE_BACK";
+
+bool IsWriteBackRequested() {
+  const char* write_back = getenv(kWriteBackEnvVar);
+  return write_back && std::string_view(write_back) == "1";
+}
 
 performancelayers::CacheSideloadLayerData* GetLayerData() {
   // Don't use new -- make the destructor run when the layer gets unloaded.
   static performancelayers::CacheSideloadLayerData layer_data =
       performancelayers::CacheSideloadLayerData(
-          getenv(kImplicitCacheFilenameEnvVar));
+          getenv(kImplicitCacheFilenameEnvVar), getenv(kCacheDirectoryEnvVar),
+          IsWriteBackRequested());
   return &layer_data;
 }
 
@@ -223,6 +479,8 @@ SPL_CACHE_SIDELOAD_LAYER_FUNC(VkResult, CreateInstance,
         // override.
         SPL_DISPATCH_INSTANCE_FUNC(DestroyInstance);
         SPL_DISPATCH_INSTANCE_FUNC(GetInstanceProcAddr);
+        // Get the next layer's instance of the instance functions we will use.
+        SPL_DISPATCH_INSTANCE_FUNC(GetPhysicalDeviceProperties);
 
         return dispatch_table;
       };
@@ -343,7 +601,8 @@ SPL_CACHE_SIDELOAD_LAYER_FUNC(VkResult, GetPipelineCacheData,
 }
 
 // Override for vkDestroyPipelineCache. Checks that application does destroy
-// an implicit device pipeline cache.
+// an implicit device pipeline cache. In write-back mode, keeps the pipelines
+// of the destroyed cache for the write back.
 SPL_CACHE_SIDELOAD_LAYER_FUNC(void, DestroyPipelineCache,
                               (VkDevice device, VkPipelineCache cache,
                                const VkAllocationCallbacks* allocator)) {
@@ -361,15 +620,22 @@ SPL_CACHE_SIDELOAD_LAYER_FUNC(void, DestroyPipelineCache,
     return;
   }
 
+  if (layer_data->IsWriteBackEnabled()) {
+    layer_data->MergeIntoWriteBackCache(device, cache);
+  }
   return next_proc(device, cache, allocator);
 }
 
 // Override for vkDestroyDevice. Removes the dispatch table for the device from
-// the layer data.
+// the layer data. In write-back mode, writes the pipelines compiled for the
+// device back to the implicit pipeline cache file first.
 SPL_CACHE_SIDELOAD_LAYER_FUNC(void, DestroyDevice,
                               (VkDevice device,
                                const VkAllocationCallbacks* allocator)) {
   performancelayers::CacheSideloadLayerData* layer_data = GetLayerData();
+  if (layer_data->IsWriteBackEnabled()) {
+    layer_data->WriteBackDeviceCache(device, allocator);
+  }
 
   // Destroy all layer objects created for this device.
   if (VkPipelineCache cache = layer_data->GetImplicitDeviceCache(device)) {
@@ -388,7 +654,10 @@ SPL_CACHE_SIDELOAD_LAYER_FUNC(void, DestroyDevice,
 // Override for vkCreateDevice. Builds the dispatch table for the new device
 // and add it to the layer data. Creates an implicit layer-managed pipeline
 // for each device. This cache is pre-populated with the implicit pipeline
-// cache file.
+// cache file, or the file for the device in the pipeline cache directory, if
+// its header matches the device. In write-back mode, the implicit cache is
+// created even without the file, along with the cache that collects the
+// pipelines to write back.
 SPL_CACHE_SIDELOAD_LAYER_FUNC(VkResult, CreateDevice,
                               (VkPhysicalDevice physical_device,
                                const VkDeviceCreateInfo* create_info,
@@ -418,11 +687,7 @@ SPL_CACHE_SIDELOAD_LAYER_FUNC(VkResult, CreateDevice,
       physical_device, create_info, allocator, device, build_dispatch_table);
   if (create_device_result == VK_SUCCESS) {
     assert(*device && "Device not created?");
-    if (auto cache_blob_or_none = layer_data->ReadImplicitCacheFile()) {
-      auto implicit_cache_handle = layer_data->CreateImplicitDeviceCache(
-          *device, allocator, cache_blob_or_none->GetBuffer());
-      (void)implicit_cache_handle;
-    }
+    layer_data->CreateDeviceCaches(*device, physical_device, allocator);
   }
 
   return create_device_result;
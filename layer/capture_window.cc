@@ -0,0 +1,319 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "capture_window.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+#include "absl/time/time.h"
+#include "debug_logging.h"
+
+#if defined(__unix__)
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace performancelayers {
+namespace {
+constexpr char kCaptureEnvVar[] = "VK_PERFORMANCE_LAYERS_CAPTURE";
+// Shared with the frame time layer.
+constexpr char kBenchmarkWatchFileEnvVar[] =
+    "VK_FRAME_TIME_BENCHMARK_WATCH_FILE";
+constexpr char kBenchmarkStartStringEnvVar[] =
+    "VK_FRAME_TIME_BENCHMARK_START_STRING";
+
+// How often the benchmark watch file is scanned for new lines.
+constexpr absl::Duration kBenchmarkWatchInterval = absl::Milliseconds(50);
+
+// The depth of the nested calls to vkQueuePresentKHR on this thread.
+thread_local uint32_t present_depth = 0;
+
+bool FileExists(const std::string& path) {
+#if defined(__unix__)
+  return access(path.c_str(), F_OK) == 0;
+#else
+  FILE* file = fopen(path.c_str(), "r");
+  if (!file) return false;
+  fclose(file);
+  return true;
+#endif
+}
+
+bool IsInitiallyOpen(const CaptureWindowConfig& config,
+                     bool has_benchmark_scanner) {
+  switch (config.trigger) {
+    case CaptureWindowConfig::Trigger::kAlways:
+      return true;
+    case CaptureWindowConfig::Trigger::kFrames:
+      return config.first_frame == 0 && config.end_frame != 0;
+    case CaptureWindowConfig::Trigger::kBenchmark:
+      return !has_benchmark_scanner;
+    case CaptureWindowConfig::Trigger::kSignal:
+      return false;
+    case CaptureWindowConfig::Trigger::kControlFile:
+      return FileExists(config.control_file);
+  }
+  return true;
+}
+}  // namespace
+
+absl::StatusOr<CaptureWindowConfig> ParseCaptureWindowConfig(
+    absl::string_view config_str) {
+  CaptureWindowConfig config;
+  if (config_str.empty() || config_str == "always") {
+    return config;
+  }
+  if (config_str == "benchmark") {
+    config.trigger = CaptureWindowConfig::Trigger::kBenchmark;
+    return config;
+  }
+  if (config_str == "signal") {
+    config.trigger = CaptureWindowConfig::Trigger::kSignal;
+    return config;
+  }
+  if (absl::ConsumePrefix(&config_str, "file:")) {
+    if (config_str.empty()) {
+      return absl::InvalidArgumentError("Missing capture control file");
+    }
+    config.trigger = CaptureWindowConfig::Trigger::kControlFile;
+    config.control_file = std::string(config_str);
+    return config;
+  }
+  if (absl::ConsumePrefix(&config_str, "frames:")) {
+    const size_t separator = config_str.find('-');
+    if (separator == absl::string_view::npos) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Capture frames must be <first>-<end>: ", config_str));
+    }
+    const absl::string_view first = config_str.substr(0, separator);
+    const absl::string_view end = config_str.substr(separator + 1);
+    if ((!first.empty() && !absl::SimpleAtoi(first, &config.first_frame)) ||
+        (!end.empty() && !absl::SimpleAtoi(end, &config.end_frame))) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid capture frames: ", config_str));
+    }
+    if (config.first_frame >= config.end_frame) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Empty capture frame range: ", config_str));
+    }
+    config.trigger = CaptureWindowConfig::Trigger::kFrames;
+    return config;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown capture window: ", config_str));
+}
+
+CaptureWindow::CaptureWindow(const CaptureWindowConfig& config,
+                             std::optional<LogScanner> benchmark_scanner)
+    : config_(config),
+      open_(IsInitiallyOpen(config, benchmark_scanner.has_value())) {
+  if (config.trigger == CaptureWindowConfig::Trigger::kBenchmark &&
+      benchmark_scanner) {
+    benchmark_watcher_.emplace(*std::move(benchmark_scanner),
+                               kBenchmarkWatchInterval);
+  }
+}
+
+void CaptureWindow::BeginPresent() { ++present_depth; }
+
+void CaptureWindow::EndPresent() {
+  assert(present_depth != 0);
+  if (--present_depth == 0) {
+    EndFrame();
+  }
+}
+
+void CaptureWindow::EndFrame() {
+  const uint64_t frame_count =
+      frame_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (config_.trigger == CaptureWindowConfig::Trigger::kAlways) {
+    return;
+  }
+
+  absl::MutexLock lock(&update_lock_);
+  const bool was_open = open_.load(std::memory_order_relaxed);
+  bool open = was_open;
+  switch (config_.trigger) {
+    case CaptureWindowConfig::Trigger::kAlways:
+      break;
+    case CaptureWindowConfig::Trigger::kFrames:
+      open = frame_count >= config_.first_frame &&
+             frame_count < config_.end_frame;
+      break;
+    case CaptureWindowConfig::Trigger::kBenchmark:
+      open = !benchmark_watcher_ ||
+             benchmark_watcher_->GetSeenPatternCount() != 0;
+      break;
+    case CaptureWindowConfig::Trigger::kSignal:
+      if (toggle_requests_.exchange(0, std::memory_order_relaxed) % 2 != 0) {
+        open = !open;
+      }
+      break;
+    case CaptureWindowConfig::Trigger::kControlFile:
+      open = FileExists(config_.control_file);
+      break;
+  }
+  if (open != was_open) {
+    open_.store(open, std::memory_order_relaxed);
+    SPL_LOG(INFO) << "Capture window " << (open ? "opened" : "closed")
+                  << " after frame " << frame_count;
+  }
+}
+
+namespace {
+#if defined(__unix__)
+std::atomic<CaptureWindow*> signal_window = nullptr;
+
+void HandleToggleSignal(int) {
+  if (CaptureWindow* window = signal_window.load(std::memory_order_relaxed)) {
+    window->RequestToggle();
+  }
+}
+
+void InstallToggleSignalHandler(CaptureWindow* window) {
+  signal_window.store(window, std::memory_order_relaxed);
+  struct sigaction action = {};
+  action.sa_handler = &HandleToggleSignal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  if (sigaction(SIGUSR2, &action, nullptr) != 0) {
+    SPL_LOG(WARNING) << "Failed to handle SIGUSR2: " << strerror(errno);
+  }
+}
+#else
+void InstallToggleSignalHandler(CaptureWindow*) {
+  SPL_LOG(WARNING) << "Signals can only open the capture window on Unix";
+}
+#endif
+
+// Returns the scanner of the benchmark start pattern of the frame time layer,
+// or nullopt if it is not set.
+std::optional<LogScanner> CreateBenchmarkScanner() {
+  const char* watch_file = getenv(kBenchmarkWatchFileEnvVar);
+  const char* start_string = getenv(kBenchmarkStartStringEnvVar);
+  if (!watch_file || !start_string || strlen(start_string) == 0) {
+    SPL_LOG(WARNING) << kCaptureEnvVar << "=benchmark needs "
+                     << kBenchmarkWatchFileEnvVar << " and "
+                     << kBenchmarkStartStringEnvVar;
+    return std::nullopt;
+  }
+  std::optional<LogScanner> scanner = LogScanner::FromFilename(watch_file);
+  if (scanner) {
+    scanner->RegisterWatchedPattern(start_string);
+  }
+  return scanner;
+}
+
+CaptureWindow* CreateLocalWindow() {
+  CaptureWindowConfig config;
+  if (const char* config_str = getenv(kCaptureEnvVar)) {
+    absl::StatusOr<CaptureWindowConfig> parsed =
+        ParseCaptureWindowConfig(config_str);
+    if (parsed.ok()) {
+      config = *std::move(parsed);
+    } else {
+      SPL_LOG(WARNING) << "Invalid " << kCaptureEnvVar << ": "
+                       << parsed.status() << ". Capturing the whole run.";
+    }
+  }
+  std::optional<LogScanner> benchmark_scanner;
+  if (config.trigger == CaptureWindowConfig::Trigger::kBenchmark) {
+    benchmark_scanner = CreateBenchmarkScanner();
+  }
+  auto* window = new CaptureWindow(config, std::move(benchmark_scanner));
+  if (config.trigger == CaptureWindowConfig::Trigger::kSignal) {
+    InstallToggleSignalHandler(window);
+  }
+  return window;
+}
+
+// Never destroyed, as other libraries may use it until the process exits.
+CaptureWindow& GetLocalWindow() {
+  static CaptureWindow* window = CreateLocalWindow();
+  return *window;
+}
+
+void LocalBeginPresent() { GetLocalWindow().BeginPresent(); }
+
+void LocalEndPresent() { GetLocalWindow().EndPresent(); }
+
+const SplCaptureWindowInterface& GetLocalInterface() {
+  static const SplCaptureWindowInterface interface = {
+      kCaptureWindowInterfaceVersion, GetLocalWindow().GetOpenFlag(),
+      &LocalBeginPresent, &LocalEndPresent};
+  return interface;
+}
+
+// The interface used by this library, once it is known.
+std::atomic<const SplCaptureWindowInterface*> shared_interface = nullptr;
+
+// Returns the interface used by another loaded layer library, or nullptr if
+// there is none.
+const SplCaptureWindowInterface* FindOtherInterface() {
+  const SplCaptureWindowInterface* other = nullptr;
+  const bool found = FindInOtherLayerLibraries(
+      "SPL_GetCaptureWindowInterface",
+      reinterpret_cast<void*>(&SPL_GetCaptureWindowInterface),
+      [&other](void* address) {
+        using GetInterfaceFunc = const SplCaptureWindowInterface* (*)();
+        other = reinterpret_cast<GetInterfaceFunc>(address)();
+        return other && other != &GetLocalInterface() &&
+               other->version >= kCaptureWindowInterfaceVersion &&
+               other->open && other->begin_present && other->end_present;
+      });
+  return found ? other : nullptr;
+}
+
+const SplCaptureWindowInterface& GetSharedInterface() {
+  if (const auto* known = shared_interface.load(std::memory_order_acquire)) {
+    return *known;
+  }
+  const SplCaptureWindowInterface* found = FindOtherInterface();
+  const SplCaptureWindowInterface* expected = nullptr;
+  shared_interface.compare_exchange_strong(
+      expected, found ? found : &GetLocalInterface(),
+      std::memory_order_acq_rel);
+  return *shared_interface.load(std::memory_order_acquire);
+}
+}  // namespace
+
+bool IsCaptureWindowOpen() {
+  return GetSharedInterface().open->load(std::memory_order_relaxed);
+}
+
+ScopedCapturePresent::ScopedCapturePresent() {
+  GetSharedInterface().begin_present();
+}
+
+ScopedCapturePresent::~ScopedCapturePresent() {
+  GetSharedInterface().end_present();
+}
+
+}  // namespace performancelayers
+
+const performancelayers::SplCaptureWindowInterface*
+SPL_GetCaptureWindowInterface() {
+  using performancelayers::shared_interface;
+  const auto* known = shared_interface.load(std::memory_order_acquire);
+  return known ? known : &performancelayers::GetLocalInterface();
+}
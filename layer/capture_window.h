@@ -0,0 +1,161 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_CAPTURE_WINDOW_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_CAPTURE_WINDOW_H_
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "layer_utils.h"
+#include "log_scanner.h"
+
+namespace performancelayers {
+
+// When the capture window is open. Set with the VK_PERFORMANCE_LAYERS_CAPTURE
+// environment variable.
+struct CaptureWindowConfig {
+  enum class Trigger {
+    // Unset or "always": The window is always open.
+    kAlways,
+    // "frames:<first>-<end>": The window opens after <first> presents and
+    // closes after <end> presents. Either bound can be omitted.
+    kFrames,
+    // "benchmark": The window opens when the frame time layer's benchmark
+    // start string, VK_FRAME_TIME_BENCHMARK_START_STRING, appears in its
+    // benchmark watch file, VK_FRAME_TIME_BENCHMARK_WATCH_FILE.
+    kBenchmark,
+    // "signal": The window is closed at first, and each SIGUSR2 opens or
+    // closes it.
+    kSignal,
+    // "file:<path>": The window is open while the file <path> exists.
+    kControlFile,
+  };
+
+  Trigger trigger = Trigger::kAlways;
+  // The window of |Trigger::kFrames|, in numbers of presents.
+  uint64_t first_frame = 0;
+  uint64_t end_frame = std::numeric_limits<uint64_t>::max();
+  // The control file of |Trigger::kControlFile|.
+  std::string control_file;
+};
+
+// Parses the value of VK_PERFORMANCE_LAYERS_CAPTURE.
+absl::StatusOr<CaptureWindowConfig> ParseCaptureWindowConfig(
+    absl::string_view config_str);
+
+// Decides which part of the run the layers measure. Outside of the window,
+// the layers pass the calls they intercept straight through to the next layer,
+// so that loading screens and menus run with as little overhead as possible.
+//
+// The window only opens and closes when a frame ends, i.e., after a call to
+// vkQueuePresentKHR, so that all the layers see it open for the same frames.
+// The current state is a single atomic flag.
+//
+// This class is thread safe.
+class CaptureWindow {
+ public:
+  // Creates a window opened and closed by |config|. |benchmark_scanner| watches
+  // the benchmark start pattern of |Trigger::kBenchmark|. Without it, the
+  // window opens with the first frame.
+  explicit CaptureWindow(
+      const CaptureWindowConfig& config,
+      std::optional<LogScanner> benchmark_scanner = std::nullopt);
+
+  CaptureWindow(const CaptureWindow&) = delete;
+  CaptureWindow& operator=(const CaptureWindow&) = delete;
+
+  // Returns whether the window is open.
+  bool IsOpen() const { return open_.load(std::memory_order_relaxed); }
+
+  // Returns the flag read by |IsOpen()|.
+  const std::atomic<bool>* GetOpenFlag() const { return &open_; }
+
+  // Returns the number of frames that ended so far.
+  uint64_t GetFrameCount() const {
+    return frame_count_.load(std::memory_order_relaxed);
+  }
+
+  // Marks the beginning and the end of a call to vkQueuePresentKHR. Nested
+  // calls on the same thread, made by stacked layers, end a single frame, when
+  // the outermost call ends.
+  void BeginPresent();
+  void EndPresent();
+
+  // Makes the window open if it is closed, or close if it is open, at the end
+  // of the next frame. Can be called from a signal handler.
+  void RequestToggle() {
+    toggle_requests_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  // Counts a frame that just ended, and updates the window.
+  void EndFrame();
+
+  const CaptureWindowConfig config_;
+  std::atomic<bool> open_;
+  std::atomic<uint64_t> frame_count_ = 0;
+  std::atomic<uint32_t> toggle_requests_ = 0;
+  // Serializes the updates of |open_| by frames ending on different threads.
+  absl::Mutex update_lock_;
+  std::optional<LogWatcher> benchmark_watcher_;
+};
+
+// The C interface to the `CaptureWindow` shared by the layer libraries, which
+// may have been built separately. Only extend it by appending members and
+// incrementing `kCaptureWindowInterfaceVersion`.
+struct SplCaptureWindowInterface {
+  uint32_t version;
+  // `CaptureWindow::GetOpenFlag()`.
+  const std::atomic<bool>* open;
+  // `CaptureWindow::BeginPresent()` and `CaptureWindow::EndPresent()`.
+  void (*begin_present)();
+  void (*end_present)();
+};
+
+inline constexpr uint32_t kCaptureWindowInterfaceVersion = 1;
+
+// Returns whether the capture window shared by all the layers in the process
+// is open. Once the window is found, this is a relaxed atomic load.
+//
+// The window is found through `SPL_GetCaptureWindowInterface`, exported by
+// each layer library, like the `ShaderHashCache`. The first library to look
+// for the window creates it from the environment.
+bool IsCaptureWindowOpen();
+
+// Marks a call to vkQueuePresentKHR for the shared capture window for the
+// lifetime of this object. Every layer intercepting vkQueuePresentKHR creates
+// one, so that frames are counted whichever layers are enabled.
+class ScopedCapturePresent {
+ public:
+  ScopedCapturePresent();
+  ~ScopedCapturePresent();
+
+  ScopedCapturePresent(const ScopedCapturePresent&) = delete;
+  ScopedCapturePresent& operator=(const ScopedCapturePresent&) = delete;
+};
+
+}  // namespace performancelayers
+
+// Returns the interface of the capture window used by this layer library.
+SPL_LAYER_ENTRY_POINT const performancelayers::SplCaptureWindowInterface*
+SPL_GetCaptureWindowInterface();
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_CAPTURE_WINDOW_H_
@@ -15,58 +15,42 @@
 #include "common_logging.h"
 
 #include <string>
+#include <vector>
 
 #include "csv_logging.h"
 #include "debug_logging.h"
 #include "event_logging.h"
 
 namespace performancelayers {
-std::string EventToCommonLogStr(Event &event) {
-  const std::vector<Attribute *> &attributes = event.GetAttributes();
-
-  std::ostringstream csv_str;
-  csv_str << event.GetEventName();
-  csv_str << ",";
+void AppendEventToCommonLog(Event &event, std::string *out) {
+  out->append(event.GetEventName());
+  out->push_back(',');
+  absl::Span<Attribute *const> attributes = event.GetAttributes();
   for (size_t i = 0, e = attributes.size(); i != e; ++i) {
-    csv_str << attributes[i]->GetName() << ":";
-    switch (attributes[i]->GetValueType()) {
-      case ValueType::kBool: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<BoolAttr>()->GetValue());
-        break;
-      }
-      case ValueType::kInt64: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<Int64Attr>()->GetValue());
-        break;
-      }
-      case ValueType::kString: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<StringAttr>()->GetValue());
-        break;
-      }
-      case ValueType::kVectorInt64: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<VectorInt64Attr>()->GetValue());
-        break;
-      }
-    }
-    if (i + 1 != e) csv_str << ",";
+    if (i != 0) out->push_back(',');
+    out->append(attributes[i]->GetName());
+    out->push_back(':');
+    AppendCSVAttributeValue(*attributes[i], out);
   }
-  return csv_str.str();
+}
+
+std::string EventToCommonLogStr(Event &event) {
+  std::string str;
+  AppendEventToCommonLog(event, &str);
+  return str;
 }
 
 CommonLogger::CommonLogger(const char *filename) {
+  FILE *out = stderr;
   if (filename) {
-    out_ = fopen(filename, "w");
-    if (!out_) {
+    out = fopen(filename, "w");
+    if (!out) {
       SPL_LOG(ERROR) << "Failed to open " << filename
                      << ". Using stderr as the alternative output.";
-      out_ = stderr;
+      out = stderr;
     }
-  } else {
-    out_ = stderr;
   }
+  out_ = std::make_unique<BufferedWriter>(out);
 }
 
 }  // namespace performancelayers
@@ -17,8 +17,10 @@
 
 #include <cassert>
 #include <cstdio>
+#include <memory>
 #include <string>
 
+#include "buffered_writer.h"
 #include "event_logging.h"
 #include "layer_utils.h"
 
@@ -26,37 +28,41 @@ namespace performancelayers {
 // Converts `event` to a string with the common log format. The common log
 // format looks like this:
 // `event_name,attribute1_name:attribute1_value,attribute2_name:attribute2_value,...`
+// Prefer `AppendEventToCommonLog` in hot paths.
 std::string EventToCommonLogStr(Event &event);
 
+// Appends `event` in the common log format to `out`, reusing its memory.
+void AppendEventToCommonLog(Event &event, std::string *out);
+
 // CommonLogger logs the events in the common log.
 // `filename` can be nullptr. In this case, the output will be written to
-// stderr. The only valid methods after calling `EndLog()` is `EndLog()`.
+// stderr. The events are buffered and written in batches by a
+// `BufferedWriter`; `Flush()` writes them right away. The only valid methods
+// after calling `EndLog()` is `EndLog()`.
 class CommonLogger : public EventLogger {
  public:
   CommonLogger(const char *filename);
 
   void AddEvent(Event *event) override {
     assert(out_);
-    std::string event_str = EventToCommonLogStr(*event);
-    WriteLnAndFlush(out_, event_str);
+    thread_local std::string event_str;
+    event_str.clear();
+    AppendEventToCommonLog(*event, &event_str);
+    out_->WriteLine(event_str);
   }
 
   void StartLog() override {}
 
-  void EndLog() override {
-    if (out_ && out_ != stderr) {
-      fclose(out_);
-      out_ = nullptr;
-    }
-  }
+  // Writes the buffered events and closes the output.
+  void EndLog() override { out_.reset(); }
 
   void Flush() override {
     assert(out_);
-    fflush(out_);
+    out_->Flush();
   }
 
  private:
-  FILE *out_ = nullptr;
+  std::unique_ptr<BufferedWriter> out_;
 };
 
 }  // namespace performancelayers
@@ -0,0 +1,120 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_COMPILE_TIME_EVENTS_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_COMPILE_TIME_EVENTS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "event_logging.h"
+#include "layer_utils.h"
+#include "pipeline_creation_feedback.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// The events logged by the compile time layer.
+
+// The creation of one pipeline, with the hashes of its shader modules.
+class CompileTimeEvent : public Event {
+ public:
+  CompileTimeEvent(const char* name, absl::Span<const uint64_t> hash_values,
+                   DurationClock::duration duration,
+                   TimestampClock::time_point start_timestamp,
+                   uint32_t thread_id)
+      : Event(name, LogLevel::kHigh),
+        hash_values_("hashes", hash_values),
+        duration_{"duration", duration},
+        start_timestamp_("start_timestamp", start_timestamp),
+        thread_id_("thread_id", thread_id) {
+    InitAttributes({&hash_values_, &duration_, &start_timestamp_, &thread_id_});
+  }
+
+ private:
+  VectorInt64Attr hash_values_;
+  DurationAttr duration_;
+  TimestampAttr start_timestamp_;
+  Int64Attr thread_id_;
+};
+
+// The creation feedback of one pipeline. The stage durations and cache hits are
+// ';'-separated lists with one entry per shader stage, empty for the stages
+// without valid feedback.
+//
+// The event is logged for every pipeline, so it is reused with |Update|, which
+// keeps the memory of the lists.
+class PipelineFeedbackEvent : public Event {
+ public:
+  PipelineFeedbackEvent()
+      : Event("pipeline_creation_feedback", LogLevel::kHigh),
+        hash_values_("hashes", absl::Span<const uint64_t>()),
+        duration_{"duration", DurationClock::duration::zero()},
+        cache_hit_("cache_hit", false),
+        stage_durations_("stage_durations", ""),
+        stage_cache_hits_("stage_cache_hits", "") {
+    InitAttributes({&hash_values_, &duration_, &cache_hit_, &stage_durations_,
+                    &stage_cache_hits_});
+  }
+
+  // Sets the name of the event and the values from |feedback|, which must be
+  // valid.
+  void Update(const char* name, absl::Span<const uint64_t> hash_values,
+              const VkPipelineCreationFeedbackCreateInfoEXT& feedback) {
+    const VkPipelineCreationFeedbackEXT& pipeline_feedback =
+        *feedback.pPipelineCreationFeedback;
+    SetEventName(name);
+    hash_values_.SetValue(hash_values);
+    duration_.SetValue(std::chrono::nanoseconds(pipeline_feedback.duration));
+    *cache_hit_.MutableValue() = IsPipelineCacheHit(pipeline_feedback);
+    std::string* durations = stage_durations_.MutableValue();
+    std::string* cache_hits = stage_cache_hits_.MutableValue();
+    durations->clear();
+    cache_hits->clear();
+    for (uint32_t i = 0; i != feedback.pipelineStageCreationFeedbackCount;
+         ++i) {
+      const VkPipelineCreationFeedbackEXT& stage_feedback =
+          feedback.pPipelineStageCreationFeedbacks[i];
+      const char* separator = i == 0 ? "" : ";";
+      durations->append(separator);
+      cache_hits->append(separator);
+      // Drivers may leave the feedback of some stages invalid.
+      if (IsFeedbackValid(stage_feedback)) {
+        absl::StrAppend(durations, stage_feedback.duration);
+        cache_hits->push_back(IsPipelineCacheHit(stage_feedback) ? '1' : '0');
+      }
+    }
+  }
+
+  // Appends the values of the event, without the hashes, to |out| as CSV.
+  void AppendValues(std::string* out) const {
+    absl::StrAppend(out, ",", ToInt64Nanoseconds(duration_.GetValue()), ",",
+                    cache_hit_.GetValue() ? 1 : 0, ",",
+                    stage_durations_.GetValue(), ",",
+                    stage_cache_hits_.GetValue());
+  }
+
+ private:
+  VectorInt64Attr hash_values_;
+  DurationAttr duration_;
+  BoolAttr cache_hit_;
+  StringAttr stage_durations_;
+  StringAttr stage_cache_hits_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_COMPILE_TIME_EVENTS_H_
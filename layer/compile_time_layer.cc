@@ -17,14 +17,19 @@
 #include <cstdlib>
 #include <cstring>
 #include <functional>
-#include <iomanip>
 #include <optional>
-#include <sstream>
 #include <string>
+#include <vector>
 
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "capture_window.h"
+#include "compile_time_events.h"
+#include "copy_on_write_map.h"
 #include "event_logging.h"
 #include "layer_data.h"
 #include "layer_utils.h"
+#include "pipeline_creation_feedback.h"
 
 namespace performancelayers {
 namespace {
@@ -38,25 +43,12 @@ constexpr char kLayerDescription[] =
     "Stadia Pipeline Compile Time Measuring Layer";
 constexpr char kLogFilenameEnvVar[] = "VK_COMPILE_TIME_LOG";
 
-class CompileTimeEvent : public Event {
- public:
-  CompileTimeEvent(const char* name, const std::vector<int64_t>& hash_values,
-                   DurationClock::duration duration)
-      : Event(name, LogLevel::kHigh),
-        hash_values_("hashes", hash_values),
-        duration_{"duration", duration} {
-    InitAttributes({&hash_values_, &duration_});
-  }
-
- private:
-  VectorInt64Attr hash_values_;
-  DurationAttr duration_;
-};
-
 class CompileTimeLayerData : public LayerDataWithEventLogger {
  public:
   CompileTimeLayerData(char* log_filename)
-      : LayerDataWithEventLogger(log_filename, "Pipeline,Compile Time (ns)") {
+      : LayerDataWithEventLogger(
+            log_filename,
+            "Pipeline,Compile Time (ns),Start Timestamp (ns),Thread") {
     LogEventOnly("compile_time_layer_init");
   }
 
@@ -102,11 +94,64 @@ class CompileTimeLayerData : public LayerDataWithEventLogger {
     }
   }
 
+  // Enables VK_EXT_pipeline_creation_feedback in |create_info| if
+  // |physical_device| supports it. Returns true if the extension is enabled,
+  // including by the application.
+  bool EnableCreationFeedback(VkPhysicalDevice physical_device,
+                              ExtendedDeviceCreateInfo* create_info) const {
+    if (create_info->IsExtensionEnabled(
+            VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+      return true;
+    }
+    if (!IsDeviceExtensionSupported(
+            physical_device,
+            VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+      return false;
+    }
+    create_info->EnableExtension(
+        VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    return true;
+  }
+
+  void AddFeedbackDevice(VkDevice device) {
+    feedback_devices_.Insert(device, true);
+  }
+
+  void RemoveFeedbackDevice(VkDevice device) {
+    feedback_devices_.Erase(device);
+  }
+
+  // Returns true if the pipelines of |device| report their creation feedback.
+  bool HasCreationFeedback(VkDevice device) const {
+    return feedback_devices_.Find(device) != nullptr;
+  }
+
+  // Logs the creation feedback of the pipeline with |hashes|, unless the
+  // driver did not provide it.
+  void LogPipelineFeedback(
+      const char* event_name, const HashVector& hashes,
+      const VkPipelineCreationFeedbackCreateInfoEXT& feedback) {
+    if (!IsFeedbackValid(*feedback.pPipelineCreationFeedback)) return;
+
+    // Reused, so that logging the feedback does not allocate per stage.
+    thread_local PipelineFeedbackEvent event;
+    thread_local std::string csv_line;
+    event.Update(event_name, hashes, feedback);
+    LogEvent(&event);
+
+    csv_line.clear();
+    AppendQuotedPipelineHash(hashes, &csv_line);
+    event.AppendValues(&csv_line);
+    LogEventOnly(event_name, csv_line);
+  }
+
  private:
   mutable absl::Mutex shader_module_usage_lock_;
   // Map from  shader module handles to their usage info.
   absl::flat_hash_map<VkShaderModule, ShaderModuleSlack> shader_module_to_usage_
       ABSL_GUARDED_BY(shader_module_usage_lock_);
+  // The devices with VK_EXT_pipeline_creation_feedback enabled.
+  CopyOnWriteMap<VkDevice, bool> feedback_devices_;
 };
 
 CompileTimeLayerData* GetLayerData() {
@@ -151,6 +196,8 @@ SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateInstance,
         // override.
         SPL_DISPATCH_INSTANCE_FUNC(DestroyInstance);
         SPL_DISPATCH_INSTANCE_FUNC(GetInstanceProcAddr);
+        // Get the next layer's instance of the instance functions we will use.
+        SPL_DISPATCH_INSTANCE_FUNC(EnumerateDeviceExtensionProperties);
         return dispatch_table;
       };
 
@@ -171,20 +218,35 @@ SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateComputePipelines,
                              const VkAllocationCallbacks* alloc_callbacks,
                              VkPipeline* pipelines)) {
   CompileTimeLayerData* layer_data = GetLayerData();
-
-  for (uint32_t i = 0; i != create_info_count; ++i) {
-    layer_data->RecordShaderModuleUse(create_infos[i].stage.module);
-  }
-
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       device, &VkLayerDispatchTable::CreateComputePipelines);
 
   assert(create_info_count > 0 &&
          "Specification says create_info_count must be > 0.");
 
+  // Outside of the capture window, nothing is measured.
+  if (!IsCaptureWindowOpen()) {
+    return next_proc(device, pipeline_cache, create_info_count, create_infos,
+                     alloc_callbacks, pipelines);
+  }
+
+  for (uint32_t i = 0; i != create_info_count; ++i) {
+    layer_data->RecordShaderModuleUse(create_infos[i].stage.module);
+  }
+
+  // Request the feedback before starting the timer, to only measure the
+  // creation.
+  std::optional<PipelineCreationFeedbackRequest<VkComputePipelineCreateInfo>>
+      feedback;
+  if (layer_data->HasCreationFeedback(device)) {
+    feedback.emplace(create_infos, create_info_count);
+  }
+
+  const TimestampClock::time_point start_timestamp = GetTimestamp();
   DurationClock::time_point start = Now();
   auto result = next_proc(device, pipeline_cache, create_info_count,
-                          create_infos, alloc_callbacks, pipelines);
+                          feedback ? feedback->GetCreateInfos() : create_infos,
+                          alloc_callbacks, pipelines);
   DurationClock::time_point end = Now();
   DurationClock::duration duration = end - start;
 
@@ -192,15 +254,20 @@ SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateComputePipelines,
   for (uint32_t i = 0; i < create_info_count; ++i) {
     auto h = layer_data->HashComputePipeline(pipelines[i], create_infos[i]);
     hashes.insert(hashes.end(), h.begin(), h.end());
+    if (feedback && pipelines[i] != VK_NULL_HANDLE) {
+      layer_data->LogPipelineFeedback("compute_pipeline_creation_feedback", h,
+                                      feedback->GetFeedback(i));
+    }
   }
-  std::vector<int64_t> pipeline_hashes(hashes.begin(), hashes.end());
-  CompileTimeEvent event("create_compute_pipelines", pipeline_hashes, duration);
+  const uint32_t thread_id = GetThreadId();
+  CompileTimeEvent event("create_compute_pipelines", hashes, duration,
+                         start_timestamp, thread_id);
   layer_data->LogEvent(&event);
 
-  std::stringstream pipeline_hash_str;
-  pipeline_hash_str << std::quoted(layer_data->PipelineHashToString(hashes));
-  std::string pipeline_and_time =
-      CsvCat(pipeline_hash_str.str(), ToInt64Nanoseconds(duration));
+  std::string pipeline_and_time;
+  LayerData::AppendQuotedPipelineHash(hashes, &pipeline_and_time);
+  absl::StrAppend(&pipeline_and_time, ",", ToInt64Nanoseconds(duration), ",",
+                  thread_id);
   layer_data->LogEventOnly("create_compute_pipelines", pipeline_and_time);
   return result;
 }
@@ -214,6 +281,17 @@ SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateGraphicsPipelines,
                              const VkAllocationCallbacks* alloc_callbacks,
                              VkPipeline* pipelines)) {
   CompileTimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::CreateGraphicsPipelines);
+
+  assert(create_info_count > 0 &&
+         "Specification says create_info_count must be > 0.");
+
+  // Outside of the capture window, nothing is measured.
+  if (!IsCaptureWindowOpen()) {
+    return next_proc(device, pipeline_cache, create_info_count, create_infos,
+                     alloc_callbacks, pipelines);
+  }
 
   for (uint32_t i = 0; i != create_info_count; ++i) {
     const uint32_t stage_count = create_infos[i].stageCount;
@@ -223,15 +301,19 @@ SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateGraphicsPipelines,
     }
   }
 
-  auto next_proc = layer_data->GetNextDeviceProcAddr(
-      device, &VkLayerDispatchTable::CreateGraphicsPipelines);
-
-  assert(create_info_count > 0 &&
-         "Specification says create_info_count must be > 0.");
+  // Request the feedback before starting the timer, to only measure the
+  // creation.
+  std::optional<PipelineCreationFeedbackRequest<VkGraphicsPipelineCreateInfo>>
+      feedback;
+  if (layer_data->HasCreationFeedback(device)) {
+    feedback.emplace(create_infos, create_info_count);
+  }
 
+  const TimestampClock::time_point start_timestamp = GetTimestamp();
   DurationClock::time_point start = Now();
   auto result = next_proc(device, pipeline_cache, create_info_count,
-                          create_infos, alloc_callbacks, pipelines);
+                          feedback ? feedback->GetCreateInfos() : create_infos,
+                          alloc_callbacks, pipelines);
   DurationClock::time_point end = Now();
   DurationClock::duration duration = end - start;
 
@@ -239,22 +321,28 @@ SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateGraphicsPipelines,
   for (uint32_t i = 0; i < create_info_count; ++i) {
     auto h = layer_data->HashGraphicsPipeline(pipelines[i], create_infos[i]);
     hashes.insert(hashes.end(), h.begin(), h.end());
+    if (feedback && pipelines[i] != VK_NULL_HANDLE) {
+      layer_data->LogPipelineFeedback("graphics_pipeline_creation_feedback", h,
+                                      feedback->GetFeedback(i));
+    }
   }
-  std::vector<int64_t> pipeline_hashes(hashes.begin(), hashes.end());
-  CompileTimeEvent event("create_graphics_pipelines", pipeline_hashes,
-                         duration);
+  const uint32_t thread_id = GetThreadId();
+  CompileTimeEvent event("create_graphics_pipelines", hashes, duration,
+                         start_timestamp, thread_id);
   layer_data->LogEvent(&event);
 
-  std::stringstream pipeline_hash_str;
-  pipeline_hash_str << std::quoted(layer_data->PipelineHashToString(hashes));
-  std::string pipeline_and_time =
-      CsvCat(pipeline_hash_str.str(), ToInt64Nanoseconds(duration));
+  std::string pipeline_and_time;
+  LayerData::AppendQuotedPipelineHash(hashes, &pipeline_and_time);
+  absl::StrAppend(&pipeline_and_time, ",", ToInt64Nanoseconds(duration), ",",
+                  thread_id);
   layer_data->LogEventOnly("create_graphics_pipelines", pipeline_and_time);
   return result;
 }
 
 // Override for vkCreateShaderModule.  Records the hash of the shader module in
-// the layer data.
+// the layer data, and logs the creation time inside the capture window. The
+// shader modules created outside of the window are still hashed, as the
+// pipelines created in the window may use them.
 SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateShaderModule,
                             (VkDevice device,
                              const VkShaderModuleCreateInfo* create_info,
@@ -267,6 +355,9 @@ SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateShaderModule,
 
   if (res.result == VK_SUCCESS) {
     layer_data->RecordShaderModuleCreation(*shader_module, res.create_end);
+    if (!IsCaptureWindowOpen()) {
+      return res.result;
+    }
     const int64_t create_time_ns =
         ToInt64Nanoseconds(res.create_end - res.create_start);
     layer_data->LogEventOnly(
@@ -285,6 +376,25 @@ SPL_COMPILE_TIME_LAYER_FUNC(void, DestroyShaderModule,
   return GetLayerData()->DestroyShaderModule(device, shader_module, allocator);
 }
 
+// Override for vkDestroyPipeline. Erases the hash of the pipeline from the
+// layer data.
+SPL_COMPILE_TIME_LAYER_FUNC(void, DestroyPipeline,
+                            (VkDevice device, VkPipeline pipeline,
+                             const VkAllocationCallbacks* allocator)) {
+  return GetLayerData()->DestroyPipeline(device, pipeline, allocator);
+}
+
+// Override for vkQueuePresentKHR. Ends the frame of the capture window once the
+// present returns.
+SPL_COMPILE_TIME_LAYER_FUNC(VkResult, QueuePresentKHR,
+                            (VkQueue queue,
+                             const VkPresentInfoKHR* present_info)) {
+  ScopedCapturePresent capture_present;
+  auto next_proc = GetLayerData()->GetNextDeviceProcAddr(
+      queue, &VkLayerDispatchTable::QueuePresentKHR);
+  return next_proc(queue, present_info);
+}
+
 // Override for vkDestroyDevice. Removes the dispatch table for the device from
 // the layer data.
 SPL_COMPILE_TIME_LAYER_FUNC(void, DestroyDevice,
@@ -293,12 +403,14 @@ SPL_COMPILE_TIME_LAYER_FUNC(void, DestroyDevice,
   CompileTimeLayerData* layer_data = GetLayerData();
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       device, &VkLayerDispatchTable::DestroyDevice);
+  layer_data->RemoveFeedbackDevice(device);
   layer_data->RemoveDevice(device);
   next_proc(device, allocator);
 }
 
 // Override for vkCreateDevice. Builds the dispatch table for the new device
-// and add it to the layer data.
+// and add it to the layer data. Enables VK_EXT_pipeline_creation_feedback when
+// supported, to log the creation feedback of each pipeline.
 SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateDevice,
                             (VkPhysicalDevice physical_device,
                              const VkDeviceCreateInfo* create_info,
@@ -314,12 +426,23 @@ SPL_COMPILE_TIME_LAYER_FUNC(VkResult, CreateDevice,
     SPL_DISPATCH_DEVICE_FUNC(CreateGraphicsPipelines);
     SPL_DISPATCH_DEVICE_FUNC(CreateShaderModule);
     SPL_DISPATCH_DEVICE_FUNC(DestroyShaderModule);
+    SPL_DISPATCH_DEVICE_FUNC(DestroyPipeline);
+    SPL_DISPATCH_DEVICE_FUNC(QueuePresentKHR);
 
     return dispatch_table;
   };
 
-  return GetLayerData()->CreateDevice(physical_device, create_info, allocator,
-                                      device, build_dispatch_table);
+  CompileTimeLayerData* layer_data = GetLayerData();
+  ExtendedDeviceCreateInfo extended_create_info(*create_info);
+  const bool creation_feedback = layer_data->EnableCreationFeedback(
+      physical_device, &extended_create_info);
+  const VkResult result =
+      layer_data->CreateDevice(physical_device, extended_create_info.get(),
+                               allocator, device, build_dispatch_table);
+  if (result == VK_SUCCESS && creation_feedback) {
+    layer_data->AddFeedbackDevice(*device);
+  }
+  return result;
 }
 
 SPL_COMPILE_TIME_LAYER_FUNC(VkResult, EnumerateInstanceLayerProperties,
@@ -0,0 +1,241 @@
+// Copyright 2020-2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_COPY_ON_WRITE_MAP_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_COPY_ON_WRITE_MAP_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+
+namespace performancelayers {
+
+// The snapshots of the |CopyOnWriteMap|s that are being read, so that the
+// snapshots replaced by a modification can be freed once no thread reads them.
+//
+// Each thread announces the snapshot it reads in a slot of its own, so that
+// readers never write to memory shared with other threads.
+//
+// This class is thread safe.
+class CopyOnWriteReaders {
+ public:
+  // Returns the slot of the calling thread, claiming one on the first call from
+  // the thread. The slot is released when the thread exits.
+  static std::atomic<const void*>& ThreadSlot() {
+    thread_local SlotHolder holder;
+    return holder.slot->snapshot;
+  }
+
+  // Returns true if any thread is reading |snapshot|.
+  static bool IsRead(const void* snapshot) {
+    Registry& registry = GetRegistry();
+    absl::MutexLock lock(&registry.lock);
+    for (const std::unique_ptr<Slot>& slot : registry.slots) {
+      if (slot->snapshot.load(std::memory_order_seq_cst) == snapshot) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  // Aligned so that the slots of different threads never share a cache line.
+  struct alignas(64) Slot {
+    std::atomic<const void*> snapshot = nullptr;
+    bool in_use = false;
+  };
+
+  struct Registry {
+    absl::Mutex lock;
+    // Slots are reused by later threads, and never freed.
+    std::vector<std::unique_ptr<Slot>> slots ABSL_GUARDED_BY(lock);
+  };
+
+  struct SlotHolder {
+    SlotHolder() {
+      Registry& registry = GetRegistry();
+      absl::MutexLock lock(&registry.lock);
+      for (const std::unique_ptr<Slot>& free_slot : registry.slots) {
+        if (!free_slot->in_use) {
+          slot = free_slot.get();
+          break;
+        }
+      }
+      if (!slot) {
+        registry.slots.push_back(std::make_unique<Slot>());
+        slot = registry.slots.back().get();
+      }
+      slot->in_use = true;
+    }
+
+    ~SlotHolder() {
+      Registry& registry = GetRegistry();
+      absl::MutexLock lock(&registry.lock);
+      slot->snapshot.store(nullptr, std::memory_order_relaxed);
+      slot->in_use = false;
+    }
+
+    Slot* slot = nullptr;
+  };
+
+  static Registry& GetRegistry() {
+    // Never destroyed, so that threads exiting late can still release their
+    // slots.
+    static Registry* registry = new Registry();
+    return *registry;
+  }
+};
+
+// A map for read-mostly data, such as the dispatch tables of the instances and
+// devices, that is looked up on every intercepted call but only changes when
+// an instance or a device gets created or destroyed.
+//
+// Lookups never take a lock: they read the current immutable snapshot of the
+// map. Every modification copies the current snapshot, applies the change to
+// the copy, and publishes it as the new current snapshot. The replaced
+// snapshots are freed by the next modifications once no thread reads them, so
+// at most one snapshot per reading thread is kept besides the current one.
+//
+// The snapshots only point to the values, which are kept until the map is
+// destroyed, even after their key is erased or reassigned. This makes pointers
+// returned by |Find| valid for the lifetime of the map, at the cost of memory
+// proportional to the number of values ever inserted. Do not use with
+// frequently modified data.
+//
+// This class is thread safe.
+template <typename Key, typename Value>
+class CopyOnWriteMap {
+ public:
+  using Map = absl::flat_hash_map<Key, const Value*>;
+
+  CopyOnWriteMap() : current_(new Map()) {}
+
+  CopyOnWriteMap(const CopyOnWriteMap&) = delete;
+  CopyOnWriteMap& operator=(const CopyOnWriteMap&) = delete;
+
+  ~CopyOnWriteMap() { delete current_.load(std::memory_order_relaxed); }
+
+  // Returns the value of |key|, or nullptr if there is none. The value is never
+  // modified, even if |key| gets reassigned or erased later.
+  const Value* Find(const Key& key) const {
+    return Read([&key](const Map& map) -> const Value* {
+      auto it = map.find(key);
+      return it != map.end() ? it->second : nullptr;
+    });
+  }
+
+  // Returns true if the map contains |key|.
+  bool Contains(const Key& key) const { return Find(key) != nullptr; }
+
+  // Returns the number of entries in the map.
+  size_t Size() const {
+    return Read([](const Map& map) { return map.size(); });
+  }
+
+  // Adds |value| for |key|, unless |key| is already present. Returns true if
+  // the value was added.
+  bool Insert(const Key& key, Value value) {
+    absl::MutexLock lock(&write_lock_);
+    if (Find(key)) {
+      return false;
+    }
+    const Value* stored = Store(std::move(value));
+    Update([&key, stored](Map* map) { map->emplace(key, stored); });
+    return true;
+  }
+
+  // Sets the value of |key| to |value|.
+  void InsertOrAssign(const Key& key, Value value) {
+    absl::MutexLock lock(&write_lock_);
+    const Value* stored = Store(std::move(value));
+    Update([&key, stored](Map* map) { map->insert_or_assign(key, stored); });
+  }
+
+  // Removes |key| from the map. Returns true if the map contained |key|.
+  bool Erase(const Key& key) {
+    absl::MutexLock lock(&write_lock_);
+    if (!Find(key)) {
+      return false;
+    }
+    Update([&key](Map* map) { map->erase(key); });
+    return true;
+  }
+
+ private:
+  // Returns |read| applied to the current snapshot. The snapshot is announced
+  // in the slot of the calling thread while it is read, and |read| must not
+  // read another map.
+  template <typename ReadFunc>
+  auto Read(ReadFunc read) const {
+    std::atomic<const void*>& slot = CopyOnWriteReaders::ThreadSlot();
+    const Map* map = current_.load(std::memory_order_acquire);
+    // The snapshot may be replaced and freed before it is announced, so it is
+    // only read once it is still current after the announcement.
+    while (true) {
+      slot.store(map, std::memory_order_seq_cst);
+      const Map* current = current_.load(std::memory_order_seq_cst);
+      if (current == map) {
+        break;
+      }
+      map = current;
+    }
+    auto result = read(*map);
+    slot.store(nullptr, std::memory_order_release);
+    return result;
+  }
+
+  // Keeps |value| until the map is destroyed, and returns its address.
+  const Value* Store(Value value) ABSL_EXCLUSIVE_LOCKS_REQUIRED(write_lock_) {
+    values_.push_back(std::make_unique<const Value>(std::move(value)));
+    return values_.back().get();
+  }
+
+  // Publishes a copy of the current snapshot modified by |modify|, and frees
+  // the replaced snapshots that are no longer read.
+  template <typename ModifyFunc>
+  void Update(ModifyFunc modify) ABSL_EXCLUSIVE_LOCKS_REQUIRED(write_lock_) {
+    const Map* previous = current_.load(std::memory_order_relaxed);
+    auto next = std::make_unique<Map>(*previous);
+    modify(next.get());
+    current_.store(next.release(), std::memory_order_seq_cst);
+    replaced_.emplace_back(previous);
+    replaced_.erase(
+        std::remove_if(replaced_.begin(), replaced_.end(),
+                       [](const std::unique_ptr<const Map>& snapshot) {
+                         return !CopyOnWriteReaders::IsRead(snapshot.get());
+                       }),
+        replaced_.end());
+  }
+
+  // Owned, and only replaced under |write_lock_|.
+  std::atomic<const Map*> current_;
+  absl::Mutex write_lock_;
+  // The replaced snapshots that were still read by some thread when last
+  // checked.
+  std::vector<std::unique_ptr<const Map>> replaced_
+      ABSL_GUARDED_BY(write_lock_);
+  // All the values ever inserted.
+  std::vector<std::unique_ptr<const Value>> values_
+      ABSL_GUARDED_BY(write_lock_);
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_COPY_ON_WRITE_MAP_H_
@@ -0,0 +1,132 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_recording_stats.h"
+
+#include <algorithm>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace performancelayers {
+namespace {
+// The source of the ids of the |CpuRecordingStats| instances. 0 is never used.
+std::atomic<uint64_t> next_instance_id = 1;
+
+uint64_t Take(std::atomic<uint64_t>* counter) {
+  return counter->exchange(0, std::memory_order_relaxed);
+}
+}  // namespace
+
+void CpuRecordingCounters::Add(const CpuRecordingCounters& other) {
+  recordings += other.recordings;
+  recording_ns += other.recording_ns;
+  max_recording_draws =
+      std::max(max_recording_draws, other.max_recording_draws);
+  pipeline_binds += other.pipeline_binds;
+  draws += other.draws;
+  submits += other.submits;
+  submit_ns += other.submit_ns;
+  descriptor_updates += other.descriptor_updates;
+  descriptor_writes += other.descriptor_writes;
+  descriptor_update_ns += other.descriptor_update_ns;
+}
+
+CpuRecordingStats::CpuRecordingStats()
+    : id_(next_instance_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+CpuRecordingStats::ThreadState& CpuRecordingStats::GetThreadState() {
+  // Threads almost always use a single instance, which gets cached.
+  thread_local uint64_t cached_id = 0;
+  thread_local ThreadState* cached_state = nullptr;
+  if (cached_id == id_) {
+    return *cached_state;
+  }
+
+  thread_local absl::flat_hash_map<uint64_t, ThreadState*> thread_states;
+  ThreadState*& state = thread_states[id_];
+  if (!state) {
+    absl::MutexLock lock(&lock_);
+    threads_.push_back(std::make_unique<ThreadState>(GetThreadId()));
+    state = threads_.back().get();
+  }
+  cached_id = id_;
+  cached_state = state;
+  return *state;
+}
+
+void CpuRecordingStats::EndRecording(Recording* recording,
+                                     DurationClock::time_point now) {
+  if (!recording || !recording->open) {
+    return;
+  }
+  recording->open = false;
+
+  ThreadState& state = GetThreadState();
+  state.recordings.fetch_add(1, std::memory_order_relaxed);
+  state.recording_ns.fetch_add(ToInt64Nanoseconds(now - recording->begin),
+                               std::memory_order_relaxed);
+  // Only this thread raises the maximum, so a plain comparison suffices.
+  if (recording->draws >
+      state.max_recording_draws.load(std::memory_order_relaxed)) {
+    state.max_recording_draws.store(recording->draws,
+                                    std::memory_order_relaxed);
+  }
+}
+
+void CpuRecordingStats::RecordSubmit(DurationClock::duration duration) {
+  ThreadState& state = GetThreadState();
+  state.submits.fetch_add(1, std::memory_order_relaxed);
+  state.submit_ns.fetch_add(ToInt64Nanoseconds(duration),
+                            std::memory_order_relaxed);
+}
+
+void CpuRecordingStats::RecordDescriptorUpdate(
+    uint32_t write_count, uint32_t copy_count,
+    DurationClock::duration duration) {
+  ThreadState& state = GetThreadState();
+  state.descriptor_updates.fetch_add(1, std::memory_order_relaxed);
+  state.descriptor_writes.fetch_add(uint64_t{write_count} + copy_count,
+                                    std::memory_order_relaxed);
+  state.descriptor_update_ns.fetch_add(ToInt64Nanoseconds(duration),
+                                       std::memory_order_relaxed);
+}
+
+CpuFrameStats CpuRecordingStats::TakeFrameStats() {
+  CpuFrameStats stats;
+  absl::MutexLock lock(&lock_);
+  for (const std::unique_ptr<ThreadState>& state : threads_) {
+    ThreadRecordingStats thread = {state->thread_id, {}};
+    CpuRecordingCounters& counters = thread.counters;
+    counters.recordings = Take(&state->recordings);
+    counters.recording_ns = Take(&state->recording_ns);
+    counters.max_recording_draws = Take(&state->max_recording_draws);
+    counters.pipeline_binds = Take(&state->pipeline_binds);
+    counters.draws = Take(&state->draws);
+    counters.submits = Take(&state->submits);
+    counters.submit_ns = Take(&state->submit_ns);
+    counters.descriptor_updates = Take(&state->descriptor_updates);
+    counters.descriptor_writes = Take(&state->descriptor_writes);
+    counters.descriptor_update_ns = Take(&state->descriptor_update_ns);
+    if (counters.IsEmpty()) {
+      continue;
+    }
+    stats.total.Add(counters);
+    stats.max_thread_recording_ns =
+        std::max(stats.max_thread_recording_ns, counters.recording_ns);
+    stats.threads.push_back(thread);
+  }
+  return stats;
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,177 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_CPU_RECORDING_STATS_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_CPU_RECORDING_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "layer_utils.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// The CPU-side work of recording and submitting commands, counted on one
+// thread or on all of them.
+struct CpuRecordingCounters {
+  // Adds the counts of |other|, and keeps the larger maximum.
+  void Add(const CpuRecordingCounters& other);
+
+  bool IsEmpty() const {
+    return recordings == 0 && pipeline_binds == 0 && draws == 0 &&
+           submits == 0 && descriptor_updates == 0;
+  }
+
+  // Command buffer recordings that ended, and the time from the start of each
+  // vkBeginCommandBuffer to the end of its vkEndCommandBuffer.
+  uint64_t recordings = 0;
+  uint64_t recording_ns = 0;
+  // The largest number of draws and dispatches recorded into a single
+  // command buffer recording that ended on the thread.
+  uint64_t max_recording_draws = 0;
+  uint64_t pipeline_binds = 0;
+  // Draws and dispatches.
+  uint64_t draws = 0;
+  // vkQueueSubmit calls, and the time spent in them.
+  uint64_t submits = 0;
+  uint64_t submit_ns = 0;
+  // vkUpdateDescriptorSets calls, the descriptor writes and copies they made,
+  // and the time spent in them.
+  uint64_t descriptor_updates = 0;
+  uint64_t descriptor_writes = 0;
+  uint64_t descriptor_update_ns = 0;
+};
+
+// The counters of one thread over a frame.
+struct ThreadRecordingStats {
+  uint32_t thread_id = 0;
+  CpuRecordingCounters counters;
+};
+
+// The counters of all the threads over a frame.
+struct CpuFrameStats {
+  // The threads that did any of the counted work, in the order they first did.
+  std::vector<ThreadRecordingStats> threads;
+  CpuRecordingCounters total;
+  // The largest recording time of a single thread. Together with
+  // |total.recording_ns|, tells how well the recording is spread over the
+  // threads.
+  uint64_t max_thread_recording_ns = 0;
+};
+
+// Counts and times the CPU-side work of recording command buffers, submitting
+// them and updating descriptor sets, per thread.
+//
+// Each thread updates counters of its own, which the thread finds through a
+// thread-local pointer, so that counting a command does not take any lock or
+// share a cache line with the other threads. The counters of all the threads
+// are taken and reset at the end of each frame by |TakeFrameStats|.
+//
+// A recording may begin and end on different threads, and a thread may record
+// several command buffers at once, so the state of each open recording is a
+// |Recording| kept by the caller along with the other state of its command
+// buffer. The recording is counted by the thread that ends it.
+//
+// This class is thread safe.
+class CpuRecordingStats {
+ public:
+  // The state of a command buffer recording. Only accessed by the thread
+  // recording the command buffer.
+  struct Recording {
+    DurationClock::time_point begin;
+    // Draws and dispatches recorded so far.
+    uint64_t draws = 0;
+    bool open = false;
+  };
+
+  CpuRecordingStats();
+  CpuRecordingStats(const CpuRecordingStats&) = delete;
+  CpuRecordingStats& operator=(const CpuRecordingStats&) = delete;
+
+  // Starts |recording| at |now|. Beginning a command buffer again implicitly
+  // ends its previous recording, which is not counted.
+  static void BeginRecording(Recording* recording,
+                             DurationClock::time_point now) {
+    *recording = {now, /*draws=*/0, /*open=*/true};
+  }
+
+  // Ends |recording| at |now|, and counts it on the calling thread. Does
+  // nothing if |recording| is null or not open.
+  void EndRecording(Recording* recording, DurationClock::time_point now);
+
+  void RecordPipelineBind() { AddCount(&ThreadState::pipeline_binds, 1); }
+
+  // Records a draw or dispatch command into |recording|, which is null if the
+  // recording of the command buffer is not tracked.
+  void RecordDraw(Recording* recording) {
+    AddCount(&ThreadState::draws, 1);
+    if (recording) {
+      ++recording->draws;
+    }
+  }
+
+  // Records a vkQueueSubmit call that took |duration|.
+  void RecordSubmit(DurationClock::duration duration);
+
+  // Records a vkUpdateDescriptorSets call with |write_count| writes and
+  // |copy_count| copies that took |duration|.
+  void RecordDescriptorUpdate(uint32_t write_count, uint32_t copy_count,
+                              DurationClock::duration duration);
+
+  // Returns the counters of the threads since the previous call, and resets
+  // them.
+  CpuFrameStats TakeFrameStats();
+
+ private:
+  // Aligned so that the counters of different threads never share a cache
+  // line.
+  struct alignas(64) ThreadState {
+    explicit ThreadState(uint32_t thread_id) : thread_id(thread_id) {}
+
+    const uint32_t thread_id;
+    // Updated by the thread, and taken by |TakeFrameStats|.
+    std::atomic<uint64_t> recordings = 0;
+    std::atomic<uint64_t> recording_ns = 0;
+    std::atomic<uint64_t> max_recording_draws = 0;
+    std::atomic<uint64_t> pipeline_binds = 0;
+    std::atomic<uint64_t> draws = 0;
+    std::atomic<uint64_t> submits = 0;
+    std::atomic<uint64_t> submit_ns = 0;
+    std::atomic<uint64_t> descriptor_updates = 0;
+    std::atomic<uint64_t> descriptor_writes = 0;
+    std::atomic<uint64_t> descriptor_update_ns = 0;
+  };
+
+  // Returns the counters of the calling thread, creating them on the first
+  // call from the thread. The counters of a thread are kept after it exits.
+  ThreadState& GetThreadState();
+
+  void AddCount(std::atomic<uint64_t> ThreadState::*counter, uint64_t count) {
+    (GetThreadState().*counter).fetch_add(count, std::memory_order_relaxed);
+  }
+
+  // Tells the instances apart in the thread-local caches, even if one is
+  // allocated where a destroyed instance was.
+  const uint64_t id_;
+  absl::Mutex lock_;
+  std::vector<std::unique_ptr<ThreadState>> threads_ ABSL_GUARDED_BY(lock_);
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_CPU_RECORDING_STATS_H_
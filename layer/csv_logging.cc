@@ -14,100 +14,79 @@
 
 #include "csv_logging.h"
 
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
 
 #include "debug_logging.h"
 #include "event_logging.h"
 #include "layer_utils.h"
 
 namespace performancelayers {
-std::string ValueToCSVString(const bool value) { return std::to_string(value); }
+void AppendCSVValue(bool value, std::string *out) {
+  out->push_back(value ? '1' : '0');
+}
 
-std::string ValueToCSVString(const std::string &value) { return value; }
+void AppendCSVValue(int64_t value, std::string *out) {
+  absl::StrAppend(out, value);
+}
 
-std::string ValueToCSVString(const int64_t value) {
-  return std::to_string(value);
+void AppendCSVValue(std::string_view value, std::string *out) {
+  out->append(value.data(), value.size());
 }
 
-std::string ValueToCSVString(const std::vector<int64_t> &values) {
-  std::ostringstream csv_string;
-  csv_string << "\"[";
-  size_t e = values.size();
-  for (size_t i = 0; i != e; ++i) {
-    const char *delimiter = i < e - 1 ? "," : "";
-    csv_string << "0x" << std::hex << values[i] << delimiter;
+void AppendCSVValue(absl::Span<const int64_t> values, std::string *out) {
+  out->append("\"[");
+  for (size_t i = 0, e = values.size(); i != e; ++i) {
+    if (i != 0) out->push_back(',');
+    absl::StrAppend(out, "0x", absl::Hex(values[i]));
   }
-  csv_string << "]\"";
-  return csv_string.str();
+  out->append("]\"");
 }
 
-std::string ValueToCSVString(DurationClock::duration value) {
-  return std::to_string(ToInt64Nanoseconds(value));
+void AppendCSVValue(DurationClock::duration value, std::string *out) {
+  absl::StrAppend(out, ToInt64Nanoseconds(value));
 }
 
-std::string ValueToCSVString(TimestampClock::time_point value) {
-  return std::to_string(ToUnixNanos(value));
+void AppendCSVValue(TimestampClock::time_point value, std::string *out) {
+  absl::StrAppend(out, ToUnixNanos(value));
 }
 
-// Takes an `Event` instance as an input and generates a csv string containing
-// `event`'s name and attribute values.
 // TODO(miladhakimi): Differentiate hashes and other integers. Hashes
 // should be displayed in hex.
-std::string EventToCSVString(Event &event) {
-  const std::vector<Attribute *> &attributes = event.GetAttributes();
+void AppendCSVAttributeValue(const Attribute &attribute, std::string *out) {
+  VisitAttributeValue(attribute,
+                      [out](const auto &value) { AppendCSVValue(value, out); });
+}
 
-  std::ostringstream csv_str;
+void AppendEventToCSV(Event &event, std::string *out) {
+  absl::Span<Attribute *const> attributes = event.GetAttributes();
   for (size_t i = 0, e = attributes.size(); i != e; ++i) {
-    switch (attributes[i]->GetValueType()) {
-      case ValueType::kTimestamp: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<TimestampAttr>()->GetValue());
-        break;
-      }
-      case ValueType::kDuration: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<DurationAttr>()->GetValue());
-        break;
-      }
-      case ValueType::kBool: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<BoolAttr>()->GetValue());
-        break;
-      }
-      case ValueType::kInt64: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<Int64Attr>()->GetValue());
-        break;
-      }
-      case ValueType::kString: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<StringAttr>()->GetValue());
-        break;
-      }
-      case ValueType::kVectorInt64: {
-        csv_str << ValueToCSVString(
-            attributes[i]->cast<VectorInt64Attr>()->GetValue());
-        break;
-      }
-    }
-    if (i + 1 != e) csv_str << ",";
+    if (i != 0) out->push_back(',');
+    AppendCSVAttributeValue(*attributes[i], out);
   }
-  return csv_str.str();
+}
+
+std::string EventToCSVString(Event &event) {
+  std::string csv_str;
+  AppendEventToCSV(event, &csv_str);
+  return csv_str;
 }
 
 CSVLogger::CSVLogger(const char *csv_header, const char *filename)
     : header_(csv_header) {
+  FILE *out = stderr;
   if (filename) {
-    out_ = fopen(filename, "w");
-    if (!out_) {
+    out = fopen(filename, "w");
+    if (!out) {
       SPL_LOG(ERROR) << "Failed to open " << filename
                      << ". Using stderr as the alternative output.";
-      out_ = stderr;
+      out = stderr;
     }
-  } else {
-    out_ = stderr;
   }
+  out_ = std::make_unique<BufferedWriter>(out);
 }
 
 }  // namespace performancelayers
@@ -16,34 +16,66 @@
 #define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_CSV_LOGGING_H_
 
 #include <cassert>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "absl/types/span.h"
+#include "buffered_writer.h"
 #include "event_logging.h"
 #include "layer_utils.h"
 
 namespace performancelayers {
-std::string ValueToCSVString(const std::string &value);
+// Appends the CSV representation of a value to `out`. These reuse the memory
+// of `out` and do not allocate any temporaries, so a caller that keeps `out`
+// around formats events without allocating.
+void AppendCSVValue(bool value, std::string *out);
 
-std::string ValueToCSVString(const int64_t value);
+void AppendCSVValue(int64_t value, std::string *out);
 
-std::string ValueToCSVString(const std::vector<int64_t> &values);
+void AppendCSVValue(std::string_view value, std::string *out);
 
-// Converts a `DurationClock::duration` to its nanoseconds representation.
-std::string ValueToCSVString(DurationClock::duration value);
+// Prevents string literals from being appended as `bool`s.
+inline void AppendCSVValue(const char *value, std::string *out) {
+  AppendCSVValue(std::string_view(value), out);
+}
 
-// Converts a `TimestampClock::time_point` to its nanoseconds representation.
-std::string ValueToCSVString(TimestampClock::time_point value);
+// Appends the values in hex, as a quoted list: `"[0x1,0x2]"`.
+void AppendCSVValue(absl::Span<const int64_t> values, std::string *out);
+
+// Appends the nanoseconds representation of a `DurationClock::duration`.
+void AppendCSVValue(DurationClock::duration value, std::string *out);
+
+// Appends the nanoseconds representation of a `TimestampClock::time_point`.
+void AppendCSVValue(TimestampClock::time_point value, std::string *out);
+
+// Appends the CSV representation of the value of `attribute` to `out`.
+void AppendCSVAttributeValue(const Attribute &attribute, std::string *out);
+
+// Appends the attribute values of `event`, separated by commas, to `out`. The
+// duration values are logged in nanoseconds.
+void AppendEventToCSV(Event &event, std::string *out);
+
+// Returns the CSV representation of a value. See `AppendCSVValue`.
+template <typename T>
+std::string ValueToCSVString(const T &value) {
+  std::string str;
+  AppendCSVValue(value, &str);
+  return str;
+}
 
 // Takes an `Event` instance as an input and generates a csv string containing
 // `event`'s name and attribute values. The duration values will be logged in
-// nanoseconds.
+// nanoseconds. Prefer `AppendEventToCSV` in hot paths.
 std::string EventToCSVString(Event &event);
 
 // CSVLogger logs the events in the CSV format to the output given in its
 // constructor.
 // There is no need to add '\n' at the end of the csv_header in the constructor.
 // This is handled by the implementation. `filename` can be nullptr. In this
-// case, the output will be written to stderr.
+// case, the output will be written to stderr. The events are buffered and
+// written in batches by a `BufferedWriter`; `Flush()` writes them right away.
 // The only valid methods after calling `EndLog()` is `EndLog()`.
 class CSVLogger : public EventLogger {
  public:
@@ -51,30 +83,28 @@ class CSVLogger : public EventLogger {
 
   void AddEvent(Event *event) override {
     assert(out_);
-    std::string event_str = EventToCSVString(*event);
-    WriteLnAndFlush(out_, event_str);
+    thread_local std::string event_str;
+    event_str.clear();
+    AppendEventToCSV(*event, &event_str);
+    out_->WriteLine(event_str);
   }
 
   // Writes the CSV header given in the constructor to the output.
   void StartLog() override {
     assert(out_);
-    WriteLnAndFlush(out_, header_);
+    out_->WriteLine(header_);
   }
 
-  void EndLog() override {
-    if (out_ && out_ != stderr) {
-      fclose(out_);
-      out_ = nullptr;
-    }
-  }
+  // Writes the buffered events and closes the output.
+  void EndLog() override { out_.reset(); }
 
   void Flush() override {
     assert(out_);
-    fflush(out_);
+    out_->Flush();
   }
 
  private:
-  FILE *out_ = nullptr;
+  std::unique_ptr<BufferedWriter> out_;
   const char *header_ = nullptr;
 };
 
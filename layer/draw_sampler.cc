@@ -0,0 +1,138 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "draw_sampler.h"
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+
+namespace performancelayers {
+namespace {
+uint64_t GetFractionThreshold(const DrawSamplingConfig& config) {
+  if (config.policy != DrawSamplingConfig::Policy::kFraction ||
+      config.fraction >= 1.0) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return static_cast<uint64_t>(std::ldexp(config.fraction, 64));
+}
+}  // namespace
+
+absl::StatusOr<DrawSamplingConfig> ParseDrawSamplingConfig(
+    absl::string_view config_str) {
+  DrawSamplingConfig config;
+  if (config_str.empty() || config_str == "all") {
+    return config;
+  }
+  if (absl::ConsumePrefix(&config_str, "every:")) {
+    if (!absl::SimpleAtoi(config_str, &config.period) || config.period == 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid sampling period: ", config_str));
+    }
+    config.policy = DrawSamplingConfig::Policy::kEveryNth;
+    return config;
+  }
+  if (absl::ConsumePrefix(&config_str, "fraction:")) {
+    if (!absl::SimpleAtod(config_str, &config.fraction) ||
+        !(config.fraction > 0.0 && config.fraction <= 1.0)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid sampling fraction: ", config_str));
+    }
+    config.policy = DrawSamplingConfig::Policy::kFraction;
+    return config;
+  }
+  if (absl::ConsumePrefix(&config_str, "budget:")) {
+    if (!absl::SimpleAtoi(config_str, &config.budget) || config.budget == 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid sampling budget: ", config_str));
+    }
+    config.policy = DrawSamplingConfig::Policy::kPipelineBudget;
+    return config;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown sampling policy: ", config_str));
+}
+
+DrawSampler::DrawSampler(const DrawSamplingConfig& config)
+    : config_(config), fraction_threshold_(GetFractionThreshold(config)) {}
+
+void DrawSampler::Reset(uint64_t seed) {
+  random_state_ = seed;
+  counts_.clear();
+  current_ = nullptr;
+}
+
+void DrawSampler::BindPipeline(VkPipeline pipeline) {
+  current_ = &counts_[pipeline];
+}
+
+uint64_t DrawSampler::NextRandom() {
+  // SplitMix64.
+  uint64_t z = (random_state_ += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+bool DrawSampler::SampleDraw() {
+  if (!current_) {
+    // Draws without a bound pipeline are invalid; don't measure them.
+    return false;
+  }
+  const uint32_t draw = current_->draws++;
+  bool sample = true;
+  switch (config_.policy) {
+    case DrawSamplingConfig::Policy::kAll:
+      break;
+    case DrawSamplingConfig::Policy::kEveryNth:
+      sample = draw % config_.period == 0;
+      break;
+    case DrawSamplingConfig::Policy::kFraction:
+      sample = NextRandom() < fraction_threshold_;
+      break;
+    case DrawSamplingConfig::Policy::kPipelineBudget:
+      sample = current_->measured < config_.budget;
+      break;
+  }
+  if (sample) {
+    ++current_->measured;
+  }
+  return sample;
+}
+
+void DrawSampler::DropSample() {
+  assert(current_ && current_->measured != 0);
+  if (current_ && current_->measured != 0) {
+    --current_->measured;
+  }
+}
+
+std::vector<DrawSampler::PipelineDraws> DrawSampler::GetPipelineDraws()
+    const {
+  std::vector<PipelineDraws> pipeline_draws;
+  pipeline_draws.reserve(counts_.size());
+  for (const auto& [pipeline, counts] : counts_) {
+    if (counts.draws != 0) {
+      pipeline_draws.push_back({pipeline, counts.draws, counts.measured});
+    }
+  }
+  return pipeline_draws;
+}
+
+}  // namespace performancelayers
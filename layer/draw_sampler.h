@@ -0,0 +1,120 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_DRAW_SAMPLER_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_DRAW_SAMPLER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// Which draws and dispatches the runtime layer measures. Set with the
+// VK_RUNTIME_SAMPLING environment variable.
+struct DrawSamplingConfig {
+  enum class Policy {
+    // Unset or "all": Every draw is measured.
+    kAll,
+    // "every:<N>": The first draw of each pipeline in a recording, and every
+    // <N>-th draw of the pipeline after it, are measured.
+    kEveryNth,
+    // "fraction:<p>": Each draw is measured with probability <p>.
+    kFraction,
+    // "budget:<K>": The first <K> draws of each pipeline in a recording are
+    // measured.
+    kPipelineBudget,
+  };
+
+  Policy policy = Policy::kAll;
+  // The <N> of |Policy::kEveryNth|.
+  uint32_t period = 1;
+  // The <p> of |Policy::kFraction|, in (0, 1].
+  double fraction = 1.0;
+  // The <K> of |Policy::kPipelineBudget|.
+  uint32_t budget = 0;
+
+  bool SamplesAll() const { return policy == Policy::kAll; }
+};
+
+// Parses the value of VK_RUNTIME_SAMPLING.
+absl::StatusOr<DrawSamplingConfig> ParseDrawSamplingConfig(
+    absl::string_view config_str);
+
+// Decides which draws of a command buffer recording get measured, and counts
+// the draws of each pipeline, so that the measured draws can be weighted to
+// estimate the time of all of them.
+//
+// The weight of a measured draw is the number of draws of its pipeline in the
+// recording divided by the number of measured ones. Draws that are not sampled
+// only cost a counter increment.
+//
+// This class is not thread safe: use one per command buffer.
+class DrawSampler {
+ public:
+  // The draws of a pipeline in a recording.
+  struct PipelineDraws {
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    uint32_t draws = 0;
+    uint32_t measured = 0;
+
+    // Returns the number of draws each measured draw stands for.
+    double GetWeight() const {
+      return measured == 0 ? 0.0 : static_cast<double>(draws) / measured;
+    }
+  };
+
+  explicit DrawSampler(const DrawSamplingConfig& config = {});
+
+  // Starts a new recording, with |seed| for the random choices of
+  // |Policy::kFraction|.
+  void Reset(uint64_t seed);
+
+  // Makes |pipeline| the pipeline of the next draws.
+  void BindPipeline(VkPipeline pipeline);
+
+  // Counts a draw of the bound pipeline, and returns whether to measure it.
+  bool SampleDraw();
+
+  // Takes back the last sampled draw, which could not be measured.
+  void DropSample();
+
+  // Returns the draws of each pipeline in the recording.
+  std::vector<PipelineDraws> GetPipelineDraws() const;
+
+ private:
+  struct Counts {
+    uint32_t draws = 0;
+    uint32_t measured = 0;
+  };
+
+  // Returns the next random number of the recording.
+  uint64_t NextRandom();
+
+  const DrawSamplingConfig config_;
+  // |config_.fraction| scaled to the range of |NextRandom()|.
+  const uint64_t fraction_threshold_;
+  uint64_t random_state_ = 0;
+  absl::flat_hash_map<VkPipeline, Counts> counts_;
+  // The counts of the bound pipeline, in |counts_|.
+  Counts* current_ = nullptr;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_DRAW_SAMPLER_H_
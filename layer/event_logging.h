@@ -16,9 +16,12 @@
 #define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_EVENT_LOGGING_H_
 
 #include <cstdint>
+#include <initializer_list>
 #include <string>
 #include <vector>
 
+#include "absl/container/inlined_vector.h"
+#include "absl/types/span.h"
 #include "layer_utils.h"
 
 namespace performancelayers {
@@ -42,15 +45,15 @@ class Attribute {
   // Checks if the `Attribute` is an instance of the given class. Used for
   // safely casting an `Attribute` to a proper derived class.
   template <class T>
-  bool isa() {
+  bool isa() const {
     return value_type_ == T::id_;
   }
 
   // Safely casts the Attribute to the given class (T). Valid typenames should
   // be derived from Attribute and have an ValueType `id_` field.
   template <class T>
-  const T *cast() {
-    return isa<T>() ? static_cast<T *>(this) : nullptr;
+  const T *cast() const {
+    return isa<T>() ? static_cast<const T *>(this) : nullptr;
   };
 
   const char *GetName() const { return name_; }
@@ -80,6 +83,10 @@ class AttributeImpl : public Attribute {
 
   const T &GetValue() const { return value_; }
 
+  // Returns the value to update in place, which keeps the memory of a string
+  // value when the attribute is reused.
+  T *MutableValue() { return &value_; }
+
  protected:
   T &GetValue() { return value_; }
 
@@ -100,6 +107,8 @@ class DurationAttr : public Attribute {
 
   DurationClock::duration GetValue() const { return value_; };
 
+  void SetValue(DurationClock::duration value) { value_ = value; }
+
  private:
   DurationClock::duration value_;
 };
@@ -113,7 +122,7 @@ class TimestampAttr : public Attribute {
   static constexpr ValueType id_ = ValueType::kTimestamp;
 
   TimestampAttr(const char *name, const TimestampClock::time_point &value)
-      : Attribute(name, ValueType::kDuration), value_(value) {}
+      : Attribute(name, ValueType::kTimestamp), value_(value) {}
 
   TimestampClock::time_point GetValue() const { return value_; };
 
@@ -121,23 +130,83 @@ class TimestampAttr : public Attribute {
   TimestampClock::time_point value_;
 };
 
-using VectorInt64Attr =
-    AttributeImpl<std::vector<int64_t>, ValueType::kVectorInt64>;
+// An attribute that keeps a list of integers, typically the hashes of the
+// shader modules of a pipeline. Short lists are stored inline, without
+// allocating. The values can be given as unsigned integers, e.g., as the
+// `LayerData::HashVector` of a pipeline, and are then stored as their two's
+// complement.
+class VectorInt64Attr : public Attribute {
+ public:
+  static constexpr ValueType id_ = ValueType::kVectorInt64;
+
+  VectorInt64Attr(const char *name, std::initializer_list<int64_t> values)
+      : Attribute(name, ValueType::kVectorInt64), value_(values) {}
+
+  VectorInt64Attr(const char *name, absl::Span<const int64_t> values)
+      : Attribute(name, ValueType::kVectorInt64),
+        value_(values.begin(), values.end()) {}
+
+  VectorInt64Attr(const char *name, absl::Span<const uint64_t> values)
+      : Attribute(name, ValueType::kVectorInt64),
+        value_(values.begin(), values.end()) {}
+
+  absl::Span<const int64_t> GetValue() const { return value_; }
+
+  // Replaces the values, reusing the memory of the previous ones.
+  void SetValue(absl::Span<const uint64_t> values) {
+    value_.assign(values.begin(), values.end());
+  }
+
+ private:
+  absl::InlinedVector<int64_t, 4> value_;
+};
+
 using StringAttr = AttributeImpl<std::string, ValueType::kString>;
 using Int64Attr = AttributeImpl<int64_t, ValueType::kInt64>;
 using BoolAttr = AttributeImpl<bool, ValueType::kBool>;
 
+// Calls `visitor` with the value of `attribute`, as the type given by its
+// `ValueType`. The loggers serialize the attributes with a set of overloads of
+// `visitor`, instead of each switching on the value types.
+template <typename Visitor>
+void VisitAttributeValue(const Attribute &attribute, Visitor &&visitor) {
+  switch (attribute.GetValueType()) {
+    case ValueType::kBool:
+      visitor(attribute.cast<BoolAttr>()->GetValue());
+      return;
+    case ValueType::kDuration:
+      visitor(attribute.cast<DurationAttr>()->GetValue());
+      return;
+    case ValueType::kInt64:
+      visitor(attribute.cast<Int64Attr>()->GetValue());
+      return;
+    case ValueType::kString:
+      visitor(attribute.cast<StringAttr>()->GetValue());
+      return;
+    case ValueType::kTimestamp:
+      visitor(attribute.cast<TimestampAttr>()->GetValue());
+      return;
+    case ValueType::kVectorInt64:
+      visitor(attribute.cast<VectorInt64Attr>()->GetValue());
+      return;
+  }
+}
+
 // Event represents the base struct for a loggable event. It contains the
 // event's name and the level of importance. The derived structs must define and
-// initialize their own set of attributes.
+// initialize their own set of attributes. The attributes are kept inline, so
+// constructing an event does not allocate unless it has more than
+// `kInlineAttributes` attributes.
 class Event {
  public:
+  static constexpr size_t kInlineAttributes = 12;
+
   Event(const char *name, LogLevel log_level)
       : name_(name), log_level_(log_level) {}
 
   virtual ~Event() = default;
 
-  const std::vector<Attribute *> &GetAttributes() { return attributes_; };
+  absl::Span<Attribute *const> GetAttributes() const { return attributes_; };
 
   size_t GetNumAttributes() const { return attributes_.size(); };
 
@@ -147,13 +216,16 @@ class Event {
 
  protected:
   void InitAttributes(std::initializer_list<Attribute *> attrs) {
-    attributes_ = {attrs.begin(), attrs.end()};
+    attributes_.assign(attrs.begin(), attrs.end());
   }
 
+  // Renames the event, for events that are reused.
+  void SetEventName(const char *name) { name_ = name; }
+
  private:
   const char *name_;
   LogLevel log_level_;
-  std::vector<Attribute *> attributes_;
+  absl::InlinedVector<Attribute *, kInlineAttributes> attributes_;
 };
 
 // An `Event` for the CreateShaderModule function.
@@ -189,7 +261,7 @@ class CreateGraphicsPipelinesEvent : public Event {
  public:
   CreateGraphicsPipelinesEvent(const char *name,
                                TimestampClock::time_point timestamp,
-                               VectorInt64Attr &hash_values,
+                               const VectorInt64Attr &hash_values,
                                DurationClock::duration duration,
                                LogLevel log_level)
       : Event(name, log_level),
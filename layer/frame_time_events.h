@@ -0,0 +1,137 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_FRAME_TIME_EVENTS_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_FRAME_TIME_EVENTS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "event_logging.h"
+#include "frame_time_stats.h"
+#include "hitch_detector.h"
+#include "layer_utils.h"
+
+namespace performancelayers {
+
+// The events logged by the frame time layer.
+
+// The time since the previous present.
+class FrameTimeEvent : public Event {
+ public:
+  FrameTimeEvent(const char* name, DurationClock::duration time_delta,
+                 bool started)
+      : Event(name, LogLevel::kHigh),
+        time_delta_("frame_time", time_delta),
+        started_("started", started) {
+    InitAttributes({&time_delta_, &started_});
+  }
+
+ private:
+  DurationAttr time_delta_;
+  BoolAttr started_;
+};
+
+// A frame that took longer than the hitch limits, with the work that happened
+// during the frame. The pipelines and shader modules are ';'-separated lists
+// of <hash>@<thread id>:<duration (ns)> entries. The hash of a pipeline lists
+// the hashes of its shader modules, separated by '+'.
+class HitchEvent : public Event {
+ public:
+  HitchEvent(const char* name, const Hitch& hitch, const std::string& pipelines,
+             const std::string& shader_modules)
+      : Event(name, LogLevel::kHigh),
+        frame_time_("frame_time", hitch.frame_time),
+        limit_("limit", hitch.limit),
+        pipelines_("pipelines", pipelines),
+        shader_modules_("shader_modules", shader_modules),
+        allocation_count_(
+            "allocation_count",
+            static_cast<int64_t>(hitch.activity.allocation_count)),
+        allocation_size_("allocation_size",
+                         static_cast<int64_t>(hitch.activity.allocation_size)),
+        dropped_records_("dropped_records",
+                         static_cast<int64_t>(hitch.activity.dropped_records)) {
+    InitAttributes({&frame_time_, &limit_, &pipelines_, &shader_modules_,
+                    &allocation_count_, &allocation_size_, &dropped_records_});
+  }
+
+ private:
+  DurationAttr frame_time_;
+  DurationAttr limit_;
+  StringAttr pipelines_;
+  StringAttr shader_modules_;
+  Int64Attr allocation_count_;
+  Int64Attr allocation_size_;
+  Int64Attr dropped_records_;
+};
+
+// The first occurrence of a benchmark phase marker in the benchmark watch file,
+// and the frame during which the layer saw it.
+class BenchmarkPhaseEvent : public Event {
+ public:
+  BenchmarkPhaseEvent(const char* name, const std::string& pattern,
+                      uint64_t line_num, uint64_t frame_num)
+      : Event(name, LogLevel::kHigh),
+        pattern_("pattern", pattern),
+        line_num_("line", static_cast<int64_t>(line_num)),
+        frame_num_("frame", static_cast<int64_t>(frame_num)) {
+    InitAttributes({&pattern_, &line_num_, &frame_num_});
+  }
+
+ private:
+  StringAttr pattern_;
+  Int64Attr line_num_;
+  Int64Attr frame_num_;
+};
+
+// The statistics of the frames of one benchmark state, over a window of frames
+// or the whole run.
+class FrameTimeSummaryEvent : public Event {
+ public:
+  FrameTimeSummaryEvent(const char* name, const FrameTimeSummary& summary,
+                        bool started)
+      : Event(name, LogLevel::kHigh),
+        started_("started", started),
+        frame_count_("frame_count", static_cast<int64_t>(summary.frame_count)),
+        mean_("mean", summary.mean),
+        min_("min", summary.min),
+        max_("max", summary.max),
+        p50_("p50", summary.p50),
+        p90_("p90", summary.p90),
+        p99_("p99", summary.p99),
+        p999_("p99_9", summary.p999),
+        one_percent_low_("one_percent_low", summary.one_percent_low),
+        jitter_("jitter", summary.jitter) {
+    InitAttributes({&started_, &frame_count_, &mean_, &min_, &max_, &p50_,
+                    &p90_, &p99_, &p999_, &one_percent_low_, &jitter_});
+  }
+
+ private:
+  BoolAttr started_;
+  Int64Attr frame_count_;
+  DurationAttr mean_;
+  DurationAttr min_;
+  DurationAttr max_;
+  DurationAttr p50_;
+  DurationAttr p90_;
+  DurationAttr p99_;
+  DurationAttr p999_;
+  DurationAttr one_percent_low_;
+  DurationAttr jitter_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_FRAME_TIME_EVENTS_H_
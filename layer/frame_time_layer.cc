@@ -14,15 +14,26 @@
 
 #include <inttypes.h>
 
+#include <atomic>
 #include <cstdint>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
 #include <string>
 #include <type_traits>
-
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
+#include "capture_window.h"
 #include "debug_logging.h"
 #include "event_logging.h"
+#include "frame_time_events.h"
+#include "frame_time_stats.h"
+#include "hitch_detector.h"
 #include "layer_data.h"
 #include "layer_utils.h"
 #include "log_scanner.h"
@@ -44,42 +55,119 @@ constexpr char kBenchmarkWatchFileEnvVar[] =
     "VK_FRAME_TIME_BENCHMARK_WATCH_FILE";
 constexpr char kBenchmarkStartStringEnvVar[] =
     "VK_FRAME_TIME_BENCHMARK_START_STRING";
+constexpr char kBenchmarkPhaseStringsEnvVar[] =
+    "VK_FRAME_TIME_BENCHMARK_PHASE_STRINGS";
+constexpr char kHitchThresholdEnvVar[] = "VK_FRAME_TIME_HITCH_THRESHOLD_MS";
+constexpr char kHitchPercentileEnvVar[] = "VK_FRAME_TIME_HITCH_PERCENTILE";
+constexpr char kLogFramesEnvVar[] = "VK_FRAME_TIME_LOG_FRAMES";
+constexpr char kSummaryIntervalEnvVar[] =
+    "VK_FRAME_TIME_SUMMARY_INTERVAL_FRAMES";
+
+// How often the benchmark watch file is scanned for new lines.
+constexpr absl::Duration kBenchmarkWatchInterval = absl::Milliseconds(50);
 
 const char* StrOrEmpty(const char* str_or_null) {
   return str_or_null ? str_or_null : "";
 }
 
-class FrameTimeEvent : public Event {
- public:
-  FrameTimeEvent(const char* name, DurationClock::duration time_delta,
-                 bool started)
-      : Event(name, LogLevel::kHigh),
-        time_delta_("frame_time", time_delta),
-        started_("started", started) {
-    InitAttributes({&time_delta_, &started_});
+// Returns the hitch limits set by |kHitchThresholdEnvVar| and
+// |kHitchPercentileEnvVar|.
+HitchDetectorConfig GetHitchDetectorConfig() {
+  HitchDetectorConfig config;
+  if (const char* threshold_ms = getenv(kHitchThresholdEnvVar)) {
+    double value = 0.0;
+    if (absl::SimpleAtod(threshold_ms, &value) && value > 0.0) {
+      config.threshold = std::chrono::duration_cast<DurationClock::duration>(
+          std::chrono::duration<double, std::milli>(value));
+    } else {
+      SPL_LOG(WARNING) << "Invalid " << kHitchThresholdEnvVar << ": "
+                       << threshold_ms;
+    }
+  }
+  if (const char* percentile = getenv(kHitchPercentileEnvVar)) {
+    double value = 0.0;
+    if (absl::SimpleAtod(percentile, &value) && value > 0.0 && value < 100.0) {
+      config.percentile = value;
+    } else {
+      SPL_LOG(WARNING) << "Invalid " << kHitchPercentileEnvVar << ": "
+                       << percentile;
+    }
   }
+  return config;
+}
 
- private:
-  DurationAttr time_delta_;
-  BoolAttr started_;
-};
+// Returns whether each frame time is logged, which |kLogFramesEnvVar| set to
+// "0" disables.
+bool ShouldLogFrames() {
+  const char* log_frames = getenv(kLogFramesEnvVar);
+  return !log_frames || strcmp(log_frames, "0") != 0;
+}
+
+// Returns the number of frames per periodic summary set by
+// |kSummaryIntervalEnvVar|, or 0 if there are no periodic summaries.
+uint64_t GetSummaryInterval() {
+  const char* interval_str = getenv(kSummaryIntervalEnvVar);
+  if (!interval_str) return 0;
+  uint64_t interval = 0;
+  if (!absl::SimpleAtoi(interval_str, &interval)) {
+    SPL_LOG(WARNING) << "Invalid " << kSummaryIntervalEnvVar << ": "
+                     << interval_str;
+    return 0;
+  }
+  return interval;
+}
+
+// Returns the ';'-separated list of |records| used by |HitchEvent|.
+std::string FormatCompileRecords(const std::vector<CompileRecord>& records) {
+  return absl::StrJoin(
+      records, ";", [](std::string* out, const CompileRecord& record) {
+        absl::StrAppend(out, record.hash, "@", record.thread_id, ":",
+                        ToInt64Nanoseconds(record.duration));
+      });
+}
+
+// Returns the hash of a pipeline as listed by |HitchEvent|.
+std::string FormatPipelineHash(const LayerData::HashVector& hashes) {
+  return absl::StrJoin(hashes, "+", [](std::string* out, uint64_t hash) {
+    LayerData::AppendShaderHash(hash, out);
+  });
+}
 
 class FrameTimeLayerData : public LayerDataWithEventLogger {
  public:
   FrameTimeLayerData(char* log_filename, uint64_t exit_frame_num_or_invalid,
                      const char* benchmark_watch_filename,
-                     const char* benchmark_start_string)
+                     const char* benchmark_start_string,
+                     const char* benchmark_phase_strings,
+                     const HitchDetectorConfig& hitch_config,
+                     bool log_frames, uint64_t summary_interval)
       : LayerDataWithEventLogger(log_filename,
                                  "Frame Time (ns),Benchmark State"),
         exit_frame_num_or_invalid_(exit_frame_num_or_invalid),
-        benchmark_start_pattern_(StrOrEmpty(benchmark_start_string)) {
+        benchmark_start_pattern_(StrOrEmpty(benchmark_start_string)),
+        benchmark_started_(benchmark_start_pattern_.empty()),
+        hitch_detector_(hitch_config),
+        log_frames_(log_frames),
+        summary_interval_(summary_interval) {
     LogEventOnly("frame_time_layer_init");
     if (!benchmark_watch_filename || strlen(benchmark_watch_filename) == 0)
       return;
 
-    benchmark_log_scanner_ = LogScanner::FromFilename(benchmark_watch_filename);
-    if (benchmark_log_scanner_)
-      benchmark_log_scanner_->RegisterWatchedPattern(benchmark_start_pattern_);
+    std::optional<LogScanner> scanner =
+        LogScanner::FromFilename(benchmark_watch_filename);
+    if (!scanner) {
+      benchmark_started_ = true;
+      return;
+    }
+    if (!benchmark_start_pattern_.empty())
+      scanner->RegisterWatchedPattern(benchmark_start_pattern_);
+    for (absl::string_view phase :
+         absl::StrSplit(StrOrEmpty(benchmark_phase_strings), ';',
+                        absl::SkipEmpty()))
+      scanner->RegisterWatchedPattern(std::string(phase));
+    if (scanner->GetPatternCount() == 0) return;
+    benchmark_log_watcher_.emplace(*std::move(scanner),
+                                   kBenchmarkWatchInterval);
   }
 
   ~FrameTimeLayerData() override;
@@ -93,15 +181,73 @@ class FrameTimeLayerData : public LayerDataWithEventLogger {
   // Returns true if the benchmark gameplay start has been detected.
   // If benchmark start detection is not configured (through env vars),
   // assumes that the benchmarks begins with the first frame.
+  // The benchmark watch file is scanned by a background thread, so this only
+  // checks an atomic counter, unless new phase markers were seen.
   bool HasBenchmarkStarted();
 
+  // Returns whether each frame time is logged, rather than only the summaries.
+  bool ShouldLogFrames() const { return log_frames_; }
+
+  // Adds the frame that took |frame_time| to the statistics, and logs the
+  // summaries of the last |summary_interval_| frames when the window is full.
+  void RecordFrameTime(DurationClock::duration frame_time,
+                       bool benchmark_started);
+
+  // Logs the summaries of all the frames recorded so far.
+  void LogFinalSummary();
+
+  // Records the pipelines, shader modules, and memory allocations of each
+  // frame when hitch detection is enabled.
+  HitchDetector& GetHitchDetector() { return hitch_detector_; }
+
+  // Ends the frame that took |frame_time|, and logs a hitch event if it was
+  // too long.
+  void EndFrame(DurationClock::duration frame_time) {
+    if (!hitch_detector_.IsEnabled()) return;
+    std::optional<Hitch> hitch = hitch_detector_.EndFrame(frame_time);
+    if (!hitch) return;
+
+    const std::string pipelines =
+        FormatCompileRecords(hitch->activity.pipelines);
+    const std::string shader_modules =
+        FormatCompileRecords(hitch->activity.shader_modules);
+    HitchEvent event("hitch", *hitch, pipelines, shader_modules);
+    LogEvent(&event);
+    LogEventOnly("hitch",
+                 CsvCat(ToInt64Nanoseconds(hitch->frame_time),
+                        ToInt64Nanoseconds(hitch->limit), pipelines,
+                        shader_modules, hitch->activity.allocation_count,
+                        hitch->activity.allocation_size,
+                        hitch->activity.dropped_records));
+  }
+
  private:
   const uint64_t exit_frame_num_or_invalid_;
   uint64_t current_frame_num_ = 0;
 
-  uint32_t benchmark_state_idx_ = 0;
+  // Logs a benchmark phase event for each phase marker seen since the last
+  // call, and notes when the benchmark starts.
+  void LogNewBenchmarkPhases();
+
   std::string benchmark_start_pattern_;
-  std::optional<LogScanner> benchmark_log_scanner_;
+  std::atomic<bool> benchmark_started_;
+  std::optional<LogWatcher> benchmark_log_watcher_;
+  absl::Mutex benchmark_phases_lock_;
+  absl::flat_hash_set<std::string> logged_benchmark_phases_
+      ABSL_GUARDED_BY(benchmark_phases_lock_);
+  std::atomic<size_t> logged_benchmark_phase_count_ = 0;
+
+  HitchDetector hitch_detector_;
+
+  // Logs the summary of |series| as a |name| event, unless it has no frames.
+  void LogSummary(const char* name, const FrameTimeSeries& series,
+                  bool benchmark_started);
+
+  const bool log_frames_;
+  const uint64_t summary_interval_;
+  absl::Mutex stats_lock_;
+  FrameTimeStats stats_ ABSL_GUARDED_BY(stats_lock_);
+  uint64_t window_frame_count_ ABSL_GUARDED_BY(stats_lock_) = 0;
 };
 
 FrameTimeLayerData* GetLayerData() {
@@ -119,7 +265,9 @@ FrameTimeLayerData* GetLayerData() {
   // Don't use new -- make the destructor run when the layer gets unloaded.
   static FrameTimeLayerData layer_data(
       getenv(kLogFilenameEnvVar), GetExitAfterFrameVal(),
-      getenv(kBenchmarkWatchFileEnvVar), getenv(kBenchmarkStartStringEnvVar));
+      getenv(kBenchmarkWatchFileEnvVar), getenv(kBenchmarkStartStringEnvVar),
+      getenv(kBenchmarkPhaseStringsEnvVar), GetHitchDetectorConfig(),
+      ShouldLogFrames(), GetSummaryInterval());
   return &layer_data;
 }
 
@@ -146,20 +294,71 @@ void CreateFinishIndicatorFile(const char* finishCause) {
 }
 
 bool FrameTimeLayerData::HasBenchmarkStarted() {
-  if (benchmark_state_idx_ > 0 || benchmark_start_pattern_.empty()) return true;
+  if (benchmark_log_watcher_ &&
+      benchmark_log_watcher_->GetSeenPatternCount() !=
+          logged_benchmark_phase_count_.load(std::memory_order_relaxed))
+    LogNewBenchmarkPhases();
+
+  return benchmark_started_.load(std::memory_order_relaxed);
+}
 
-  if (!benchmark_log_scanner_) return true;
+void FrameTimeLayerData::LogNewBenchmarkPhases() {
+  absl::MutexLock lock(&benchmark_phases_lock_);
+  for (const auto& [pattern, line_num] :
+       benchmark_log_watcher_->GetSeenPatterns()) {
+    if (!logged_benchmark_phases_.insert(pattern).second) continue;
+    BenchmarkPhaseEvent event("benchmark_phase", pattern, line_num,
+                              current_frame_num_);
+    LogEvent(&event);
+    LogEventOnly("benchmark_phase",
+                 CsvCat(pattern, line_num, current_frame_num_));
+    if (pattern == benchmark_start_pattern_) benchmark_started_ = true;
+  }
+  logged_benchmark_phase_count_.store(logged_benchmark_phases_.size(),
+                                      std::memory_order_relaxed);
+}
+
+void FrameTimeLayerData::LogSummary(const char* name,
+                                    const FrameTimeSeries& series,
+                                    bool benchmark_started) {
+  if (series.GetFrameCount() == 0) return;
+  const FrameTimeSummary summary = series.GetSummary();
+  FrameTimeSummaryEvent event(name, summary, benchmark_started);
+  LogEvent(&event);
+  LogEventOnly(
+      name,
+      CsvCat(benchmark_started ? "1" : "0", summary.frame_count,
+             ToInt64Nanoseconds(summary.mean), ToInt64Nanoseconds(summary.min),
+             ToInt64Nanoseconds(summary.max), ToInt64Nanoseconds(summary.p50),
+             ToInt64Nanoseconds(summary.p90), ToInt64Nanoseconds(summary.p99),
+             ToInt64Nanoseconds(summary.p999),
+             ToInt64Nanoseconds(summary.one_percent_low),
+             ToInt64Nanoseconds(summary.jitter)));
+}
 
-  if (benchmark_log_scanner_->ConsumeNewLines()) {
-    benchmark_state_idx_ = 1;
-    benchmark_log_scanner_.reset();
-    return true;
+void FrameTimeLayerData::RecordFrameTime(DurationClock::duration frame_time,
+                                         bool benchmark_started) {
+  absl::MutexLock lock(&stats_lock_);
+  stats_.Record(frame_time, benchmark_started);
+  if (summary_interval_ == 0 || ++window_frame_count_ < summary_interval_) {
+    return;
   }
+  for (bool started : {false, true}) {
+    LogSummary("frame_time_summary", stats_.GetWindow(started), started);
+  }
+  stats_.ResetWindows();
+  window_frame_count_ = 0;
+}
 
-  return false;
+void FrameTimeLayerData::LogFinalSummary() {
+  absl::MutexLock lock(&stats_lock_);
+  for (bool started : {false, true}) {
+    LogSummary("frame_time_final_summary", stats_.GetTotal(started), started);
+  }
 }
 
 FrameTimeLayerData::~FrameTimeLayerData() {
+  LogFinalSummary();
   CreateFinishIndicatorFile("APPLICATION_EXIT");
   LogEventOnly("frame_time_layer_exit", "application_exit");
 }
@@ -176,17 +375,24 @@ FrameTimeLayerData::~FrameTimeLayerData() {
 SPL_FRAME_TIME_LAYER_FUNC(VkResult, QueuePresentKHR,
                           (VkQueue queue,
                            const VkPresentInfoKHR* present_info)) {
+  ScopedCapturePresent capture_present;
   auto* layer_data = GetLayerData();
 
+  // The frame ending now is only measured if it is in the capture window.
   DurationClock::duration logged_delta = layer_data->GetTimeDelta();
-  if (logged_delta != DurationClock::duration::min()) {
-    layer_data->LogEventOnly(
-        "frame_present", CsvCat(ToInt64Nanoseconds(logged_delta),
-                                layer_data->HasBenchmarkStarted() ? "1" : "0"));
-
-    FrameTimeEvent event("frame_present", logged_delta,
-                         layer_data->HasBenchmarkStarted());
-    layer_data->LogEvent(&event);
+  if (logged_delta != DurationClock::duration::min() &&
+      IsCaptureWindowOpen()) {
+    const bool benchmark_started = layer_data->HasBenchmarkStarted();
+    if (layer_data->ShouldLogFrames()) {
+      layer_data->LogEventOnly(
+          "frame_present", CsvCat(ToInt64Nanoseconds(logged_delta),
+                                  benchmark_started ? "1" : "0"));
+
+      FrameTimeEvent event("frame_present", logged_delta, benchmark_started);
+      layer_data->LogEvent(&event);
+    }
+    layer_data->RecordFrameTime(logged_delta, benchmark_started);
+    layer_data->EndFrame(logged_delta);
   }
 
   uint64_t frames_elapsed = layer_data->IncrementFrameNum();
@@ -198,10 +404,13 @@ SPL_FRAME_TIME_LAYER_FUNC(VkResult, QueuePresentKHR,
         << frames_elapsed;
 
     // _Exit will bring down the parent Vulkan application without running any
-    // cleanup. Resources will be reclaimed by the operating system.
-    CreateFinishIndicatorFile("FRAME_TIME_LAYER_TERMINATED");
+    // cleanup. Resources will be reclaimed by the operating system, but the
+    // buffered logs would be lost, so write them out first.
+    layer_data->LogFinalSummary();
     layer_data->LogEventOnly("frame_time_layer_exit",
                              absl::StrCat("terminated,frame:", frames_elapsed));
+    layer_data->FlushLogs();
+    CreateFinishIndicatorFile("FRAME_TIME_LAYER_TERMINATED");
     std::_Exit(99);
   }
 
@@ -248,6 +457,143 @@ SPL_FRAME_TIME_LAYER_FUNC(VkResult, CreateInstance,
 //  Implementation of the device function we want to override.
 //////////////////////////////////////////////////////////////////////////////
 
+// Override for vkAllocateMemory. Records the allocation for hitch detection.
+SPL_FRAME_TIME_LAYER_FUNC(VkResult, AllocateMemory,
+                          (VkDevice device,
+                           const VkMemoryAllocateInfo* allocate_info,
+                           const VkAllocationCallbacks* allocator,
+                           VkDeviceMemory* memory)) {
+  auto* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::AllocateMemory);
+  const VkResult result = next_proc(device, allocate_info, allocator, memory);
+  HitchDetector& hitch_detector = layer_data->GetHitchDetector();
+  if (result == VK_SUCCESS && hitch_detector.IsEnabled() &&
+      IsCaptureWindowOpen()) {
+    hitch_detector.RecordAllocation(allocate_info->allocationSize);
+  }
+  return result;
+}
+
+// Override for vkCreateComputePipelines. Records the pipelines for hitch
+// detection, with the duration of the whole call.
+SPL_FRAME_TIME_LAYER_FUNC(VkResult, CreateComputePipelines,
+                          (VkDevice device, VkPipelineCache pipeline_cache,
+                           uint32_t create_info_count,
+                           const VkComputePipelineCreateInfo* create_infos,
+                           const VkAllocationCallbacks* alloc_callbacks,
+                           VkPipeline* pipelines)) {
+  auto* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::CreateComputePipelines);
+  HitchDetector& hitch_detector = layer_data->GetHitchDetector();
+  if (!hitch_detector.IsEnabled() || !IsCaptureWindowOpen()) {
+    return next_proc(device, pipeline_cache, create_info_count, create_infos,
+                     alloc_callbacks, pipelines);
+  }
+
+  DurationClock::time_point start = Now();
+  const VkResult result = next_proc(device, pipeline_cache, create_info_count,
+                                    create_infos, alloc_callbacks, pipelines);
+  DurationClock::duration duration = Now() - start;
+  const uint32_t thread_id = GetThreadId();
+  for (uint32_t i = 0; i != create_info_count; ++i) {
+    if (pipelines[i] == VK_NULL_HANDLE) continue;
+    auto hashes =
+        layer_data->HashComputePipeline(pipelines[i], create_infos[i]);
+    hitch_detector.RecordPipelineCreation(
+        {FormatPipelineHash(hashes), thread_id, duration});
+  }
+  return result;
+}
+
+// Override for vkCreateGraphicsPipelines. Records the pipelines for hitch
+// detection, with the duration of the whole call.
+SPL_FRAME_TIME_LAYER_FUNC(VkResult, CreateGraphicsPipelines,
+                          (VkDevice device, VkPipelineCache pipeline_cache,
+                           uint32_t create_info_count,
+                           const VkGraphicsPipelineCreateInfo* create_infos,
+                           const VkAllocationCallbacks* alloc_callbacks,
+                           VkPipeline* pipelines)) {
+  auto* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::CreateGraphicsPipelines);
+  HitchDetector& hitch_detector = layer_data->GetHitchDetector();
+  if (!hitch_detector.IsEnabled() || !IsCaptureWindowOpen()) {
+    return next_proc(device, pipeline_cache, create_info_count, create_infos,
+                     alloc_callbacks, pipelines);
+  }
+
+  DurationClock::time_point start = Now();
+  const VkResult result = next_proc(device, pipeline_cache, create_info_count,
+                                    create_infos, alloc_callbacks, pipelines);
+  DurationClock::duration duration = Now() - start;
+  const uint32_t thread_id = GetThreadId();
+  for (uint32_t i = 0; i != create_info_count; ++i) {
+    if (pipelines[i] == VK_NULL_HANDLE) continue;
+    auto hashes =
+        layer_data->HashGraphicsPipeline(pipelines[i], create_infos[i]);
+    hitch_detector.RecordPipelineCreation(
+        {FormatPipelineHash(hashes), thread_id, duration});
+  }
+  return result;
+}
+
+// Override for vkCreateShaderModule. Records the hash of the shader module for
+// hitch detection. The shader modules created outside of the capture window
+// are hashed too, for the pipelines created in the window.
+SPL_FRAME_TIME_LAYER_FUNC(VkResult, CreateShaderModule,
+                          (VkDevice device,
+                           const VkShaderModuleCreateInfo* create_info,
+                           const VkAllocationCallbacks* allocator,
+                           VkShaderModule* shader_module)) {
+  auto* layer_data = GetLayerData();
+  HitchDetector& hitch_detector = layer_data->GetHitchDetector();
+  if (!hitch_detector.IsEnabled()) {
+    auto next_proc = layer_data->GetNextDeviceProcAddr(
+        device, &VkLayerDispatchTable::CreateShaderModule);
+    return next_proc(device, create_info, allocator, shader_module);
+  }
+
+  const LayerData::ShaderModuleCreateResult res =
+      layer_data->CreateShaderModule(device, create_info, allocator,
+                                     shader_module);
+  if (res.result == VK_SUCCESS && IsCaptureWindowOpen()) {
+    hitch_detector.RecordShaderModuleCreation(
+        {LayerData::ShaderHashToString(res.shader_hash), GetThreadId(),
+         res.create_end - res.create_start});
+  }
+  return res.result;
+}
+
+// Override for vkDestroyShaderModule. Erases the shader module from the layer
+// data.
+SPL_FRAME_TIME_LAYER_FUNC(void, DestroyShaderModule,
+                          (VkDevice device, VkShaderModule shader_module,
+                           const VkAllocationCallbacks* allocator)) {
+  auto* layer_data = GetLayerData();
+  if (!layer_data->GetHitchDetector().IsEnabled()) {
+    auto next_proc = layer_data->GetNextDeviceProcAddr(
+        device, &VkLayerDispatchTable::DestroyShaderModule);
+    return next_proc(device, shader_module, allocator);
+  }
+  return layer_data->DestroyShaderModule(device, shader_module, allocator);
+}
+
+// Override for vkDestroyPipeline. Erases the hash of the pipeline from the
+// layer data.
+SPL_FRAME_TIME_LAYER_FUNC(void, DestroyPipeline,
+                          (VkDevice device, VkPipeline pipeline,
+                           const VkAllocationCallbacks* allocator)) {
+  auto* layer_data = GetLayerData();
+  if (!layer_data->GetHitchDetector().IsEnabled()) {
+    auto next_proc = layer_data->GetNextDeviceProcAddr(
+        device, &VkLayerDispatchTable::DestroyPipeline);
+    return next_proc(device, pipeline, allocator);
+  }
+  return layer_data->DestroyPipeline(device, pipeline, allocator);
+}
+
 // Override for vkDestroyDevice.  Removes the dispatch table for the device from
 // the layer data.
 SPL_FRAME_TIME_LAYER_FUNC(void, DestroyDevice,
@@ -274,6 +620,12 @@ SPL_FRAME_TIME_LAYER_FUNC(VkResult, CreateDevice,
     SPL_DISPATCH_DEVICE_FUNC(DestroyDevice);
     SPL_DISPATCH_DEVICE_FUNC(GetDeviceProcAddr);
     SPL_DISPATCH_DEVICE_FUNC(QueuePresentKHR);
+    SPL_DISPATCH_DEVICE_FUNC(AllocateMemory);
+    SPL_DISPATCH_DEVICE_FUNC(CreateComputePipelines);
+    SPL_DISPATCH_DEVICE_FUNC(CreateGraphicsPipelines);
+    SPL_DISPATCH_DEVICE_FUNC(CreateShaderModule);
+    SPL_DISPATCH_DEVICE_FUNC(DestroyShaderModule);
+    SPL_DISPATCH_DEVICE_FUNC(DestroyPipeline);
     return dispatch_table;
   };
 
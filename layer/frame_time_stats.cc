@@ -0,0 +1,160 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "frame_time_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace performancelayers {
+namespace {
+// Returns floor(log2(value)) for a non-zero `value`.
+uint32_t GetHighestBit(uint64_t value) {
+  uint32_t bit = 0;
+  while (value >>= 1) {
+    ++bit;
+  }
+  return bit;
+}
+
+DurationClock::duration FromNanos(double nanos) {
+  return std::chrono::duration_cast<DurationClock::duration>(
+      std::chrono::nanoseconds(static_cast<int64_t>(std::llround(nanos))));
+}
+}  // namespace
+
+size_t LogLinearHistogram::GetBucketIndex(uint64_t value) {
+  if (value < kSubBucketCount) {
+    return static_cast<size_t>(value);
+  }
+  const uint32_t highest_bit = std::min(GetHighestBit(value), kMaxValueBits);
+  if (highest_bit == kMaxValueBits) {
+    return kBucketCount - 1;
+  }
+  const uint32_t shift = highest_bit - kSubBucketBits;
+  return static_cast<size_t>((shift + 1) * kSubBucketCount +
+                             ((value >> shift) - kSubBucketCount));
+}
+
+uint64_t LogLinearHistogram::GetBucketLowerBound(size_t index) {
+  if (index < kSubBucketCount) {
+    return index;
+  }
+  const uint64_t shift = index / kSubBucketCount - 1;
+  return (index % kSubBucketCount + kSubBucketCount) << shift;
+}
+
+uint64_t LogLinearHistogram::GetBucketWidth(size_t index) {
+  if (index < kSubBucketCount) {
+    return 1;
+  }
+  return uint64_t(1) << (index / kSubBucketCount - 1);
+}
+
+void LogLinearHistogram::Record(uint64_t value) {
+  ++buckets_[GetBucketIndex(value)];
+  ++count_;
+  sum_ += value;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+}
+
+uint64_t LogLinearHistogram::GetBucketValue(size_t index) const {
+  const uint64_t middle =
+      GetBucketLowerBound(index) + GetBucketWidth(index) / 2;
+  return std::clamp(middle, GetMin(), max_);
+}
+
+uint64_t LogLinearHistogram::GetPercentile(double percentile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  const double clamped = std::clamp(percentile, 0.0, 100.0);
+  // The rank of the value, starting at 1.
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * count_)));
+  uint64_t seen = 0;
+  for (size_t index = 0; index != kBucketCount; ++index) {
+    seen += buckets_[index];
+    if (seen >= rank) {
+      return GetBucketValue(index);
+    }
+  }
+  return max_;
+}
+
+double LogLinearHistogram::GetMeanOfLargest(double fraction) const {
+  if (count_ == 0) {
+    return 0.0;
+  }
+  const uint64_t wanted = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::clamp(fraction, 0.0, 1.0) * count_));
+  uint64_t taken = 0;
+  double sum = 0.0;
+  for (size_t index = kBucketCount; index-- != 0 && taken != wanted;) {
+    const uint64_t take = std::min(buckets_[index], wanted - taken);
+    sum += static_cast<double>(take) * GetBucketValue(index);
+    taken += take;
+  }
+  return sum / taken;
+}
+
+void FrameTimeSeries::Record(DurationClock::duration frame_time) {
+  const uint64_t nanos = static_cast<uint64_t>(
+      std::max<int64_t>(0, ToInt64Nanoseconds(frame_time)));
+  histogram_.Record(nanos);
+  if (previous_frame_time_ns_) {
+    jitter_sum_ns_ += nanos > *previous_frame_time_ns_
+                          ? nanos - *previous_frame_time_ns_
+                          : *previous_frame_time_ns_ - nanos;
+    ++jitter_count_;
+  }
+  previous_frame_time_ns_ = nanos;
+}
+
+FrameTimeSummary FrameTimeSeries::GetSummary() const {
+  FrameTimeSummary summary;
+  summary.frame_count = histogram_.GetCount();
+  if (summary.frame_count == 0) {
+    return summary;
+  }
+  summary.mean = FromNanos(histogram_.GetMean());
+  summary.min = FromNanos(histogram_.GetMin());
+  summary.max = FromNanos(histogram_.GetMax());
+  summary.p50 = FromNanos(histogram_.GetPercentile(50.0));
+  summary.p90 = FromNanos(histogram_.GetPercentile(90.0));
+  summary.p99 = FromNanos(histogram_.GetPercentile(99.0));
+  summary.p999 = FromNanos(histogram_.GetPercentile(99.9));
+  summary.one_percent_low = FromNanos(histogram_.GetMeanOfLargest(0.01));
+  if (jitter_count_ != 0) {
+    summary.jitter =
+        FromNanos(static_cast<double>(jitter_sum_ns_) / jitter_count_);
+  }
+  return summary;
+}
+
+void FrameTimeStats::Record(DurationClock::duration frame_time,
+                            bool benchmark_started) {
+  windows_[benchmark_started].Record(frame_time);
+  totals_[benchmark_started].Record(frame_time);
+}
+
+void FrameTimeStats::ResetWindows() {
+  for (FrameTimeSeries& window : windows_) {
+    window.Reset();
+  }
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,138 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_FRAME_TIME_STATS_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_FRAME_TIME_STATS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "layer_utils.h"
+
+namespace performancelayers {
+
+// A histogram of non-negative integers with a constant memory footprint and a
+// bounded relative error. Values below `kSubBucketCount` get their own bucket.
+// Above that, each power of two range is split into `kSubBucketCount` linear
+// buckets, so a value is known to within 1/`kSubBucketCount` of itself.
+// Values of 2^`kMaxValueBits` and above share the last bucket.
+class LogLinearHistogram {
+ public:
+  static constexpr uint32_t kSubBucketBits = 5;
+  static constexpr uint64_t kSubBucketCount = uint64_t(1) << kSubBucketBits;
+  // 2^42 ns is more than an hour.
+  static constexpr uint32_t kMaxValueBits = 42;
+  static constexpr size_t kBucketCount =
+      (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+
+  // Returns the index of the bucket of `value`.
+  static size_t GetBucketIndex(uint64_t value);
+  // Returns the smallest value of the bucket `index`.
+  static uint64_t GetBucketLowerBound(size_t index);
+  // Returns the number of values of the bucket `index`.
+  static uint64_t GetBucketWidth(size_t index);
+
+  void Record(uint64_t value);
+  void Reset() { *this = {}; }
+
+  uint64_t GetCount() const { return count_; }
+  uint64_t GetMin() const { return count_ ? min_ : 0; }
+  uint64_t GetMax() const { return max_; }
+  double GetMean() const {
+    return count_ ? static_cast<double>(sum_) / count_ : 0.0;
+  }
+
+  // Returns the `percentile`, in [0, 100], of the recorded values: the middle
+  // of a bucket, clamped to the recorded range. Returns 0 when empty.
+  uint64_t GetPercentile(double percentile) const;
+
+  // Returns the mean of the largest `fraction`, in (0, 1], of the recorded
+  // values, and at least of the largest value. Returns 0 when empty.
+  double GetMeanOfLargest(double fraction) const;
+
+ private:
+  // Returns the middle of the bucket `index`, clamped to the recorded range.
+  uint64_t GetBucketValue(size_t index) const;
+
+  std::array<uint64_t, kBucketCount> buckets_ = {};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t min_ = UINT64_MAX;
+  uint64_t max_ = 0;
+};
+
+// The statistics of a series of frame times.
+struct FrameTimeSummary {
+  uint64_t frame_count = 0;
+  DurationClock::duration mean = DurationClock::duration::zero();
+  DurationClock::duration min = DurationClock::duration::zero();
+  DurationClock::duration max = DurationClock::duration::zero();
+  DurationClock::duration p50 = DurationClock::duration::zero();
+  DurationClock::duration p90 = DurationClock::duration::zero();
+  DurationClock::duration p99 = DurationClock::duration::zero();
+  DurationClock::duration p999 = DurationClock::duration::zero();
+  // The mean of the slowest 1% of the frames, whose inverse is the "1% low"
+  // frame rate.
+  DurationClock::duration one_percent_low = DurationClock::duration::zero();
+  // The mean absolute difference between consecutive frame times, which is
+  // large when frames are paced unevenly even at a good average frame rate.
+  DurationClock::duration jitter = DurationClock::duration::zero();
+};
+
+// Keeps the statistics of a series of frame times in constant memory.
+class FrameTimeSeries {
+ public:
+  void Record(DurationClock::duration frame_time);
+  void Reset() { *this = {}; }
+
+  uint64_t GetFrameCount() const { return histogram_.GetCount(); }
+  FrameTimeSummary GetSummary() const;
+
+ private:
+  LogLinearHistogram histogram_;
+  std::optional<uint64_t> previous_frame_time_ns_;
+  uint64_t jitter_sum_ns_ = 0;
+  uint64_t jitter_count_ = 0;
+};
+
+// Keeps the frame time statistics of the whole run and of the current window,
+// split by whether the benchmark has started.
+//
+// This class is not thread safe.
+class FrameTimeStats {
+ public:
+  void Record(DurationClock::duration frame_time, bool benchmark_started);
+
+  // Returns the statistics of the frames since the window started.
+  const FrameTimeSeries& GetWindow(bool benchmark_started) const {
+    return windows_[benchmark_started];
+  }
+  // Returns the statistics of all the frames.
+  const FrameTimeSeries& GetTotal(bool benchmark_started) const {
+    return totals_[benchmark_started];
+  }
+
+  // Starts a new window.
+  void ResetWindows();
+
+ private:
+  std::array<FrameTimeSeries, 2> windows_;
+  std::array<FrameTimeSeries, 2> totals_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_FRAME_TIME_STATS_H_
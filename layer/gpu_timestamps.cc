@@ -0,0 +1,37 @@
+// Copyright 2020-2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gpu_timestamps.h"
+
+#include <cassert>
+
+namespace performancelayers {
+
+int64_t TimestampCalibration::ToHostNanos(uint64_t gpu_timestamp) const {
+  assert(calibrated_);
+  const uint64_t mask = properties_.Mask();
+  const uint64_t ticks_after = properties_.TicksBetween(gpu_timestamp_,
+                                                        gpu_timestamp);
+  // Timestamps written before the calibration are close to wrapping around.
+  if (ticks_after <= mask / 2) {
+    return host_nanos_ +
+           static_cast<int64_t>(properties_.ToNanoseconds(ticks_after));
+  }
+  const uint64_t ticks_before =
+      properties_.TicksBetween(gpu_timestamp, gpu_timestamp_);
+  return host_nanos_ -
+         static_cast<int64_t>(properties_.ToNanoseconds(ticks_before));
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,84 @@
+// Copyright 2020-2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_GPU_TIMESTAMPS_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_GPU_TIMESTAMPS_H_
+
+#include <cstdint>
+
+namespace performancelayers {
+
+// Describes the timestamps written by the queues of a device, as reported by
+// VkPhysicalDeviceLimits::timestampPeriod and
+// VkQueueFamilyProperties::timestampValidBits.
+struct TimestampProperties {
+  // Nanoseconds per timestamp tick.
+  double period = 1.0;
+  // Number of meaningful low bits of the timestamps. The remaining bits are
+  // undefined, and the timestamps wrap around at 2^valid_bits.
+  uint32_t valid_bits = 64;
+
+  // Returns the mask of the meaningful bits of the timestamps.
+  uint64_t Mask() const {
+    return valid_bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits) - 1;
+  }
+
+  // Returns the number of ticks from |begin| to |end|, where |end| was written
+  // after |begin|. Accounts for the timestamps wrapping around once.
+  uint64_t TicksBetween(uint64_t begin, uint64_t end) const {
+    return (end - begin) & Mask();
+  }
+
+  // Converts |ticks| to nanoseconds.
+  uint64_t ToNanoseconds(uint64_t ticks) const {
+    return static_cast<uint64_t>(static_cast<double>(ticks) * period + 0.5);
+  }
+};
+
+// Places GPU timestamps on the host timeline, based on pairs of GPU and host
+// timestamps taken at the same time, e.g., with
+// vkGetCalibratedTimestampsEXT. The GPU and host clocks drift apart, so the
+// calibration should be taken again periodically.
+class TimestampCalibration {
+ public:
+  explicit TimestampCalibration(const TimestampProperties& properties)
+      : properties_(properties) {}
+
+  const TimestampProperties& GetProperties() const { return properties_; }
+
+  // Records that the GPU clock of the device read |gpu_timestamp| when the
+  // host clock read |host_nanos|.
+  void Calibrate(uint64_t gpu_timestamp, int64_t host_nanos) {
+    gpu_timestamp_ = gpu_timestamp & properties_.Mask();
+    host_nanos_ = host_nanos;
+    calibrated_ = true;
+  }
+
+  bool IsCalibrated() const { return calibrated_; }
+
+  // Returns the host time at which the GPU wrote |gpu_timestamp|. Timestamps
+  // are assumed to be less than half the wrap-around period away from the
+  // calibration. Must only be called once calibrated.
+  int64_t ToHostNanos(uint64_t gpu_timestamp) const;
+
+ private:
+  TimestampProperties properties_;
+  bool calibrated_ = false;
+  uint64_t gpu_timestamp_ = 0;
+  int64_t host_nanos_ = 0;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_GPU_TIMESTAMPS_H_
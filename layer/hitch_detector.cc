@@ -0,0 +1,94 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hitch_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace performancelayers {
+
+HitchDetector::HitchDetector(const HitchDetectorConfig& config)
+    : config_(config) {}
+
+bool HitchDetector::IsEnabled() const {
+  return config_.threshold > DurationClock::duration::zero() ||
+         config_.percentile > 0.0;
+}
+
+void HitchDetector::AddRecord(CompileRecord record,
+                              std::vector<CompileRecord>* records) {
+  if (records->size() == kMaxRecordsPerFrame) {
+    ++activity_.dropped_records;
+    return;
+  }
+  records->push_back(std::move(record));
+}
+
+void HitchDetector::RecordPipelineCreation(CompileRecord record) {
+  absl::MutexLock lock(&lock_);
+  AddRecord(std::move(record), &activity_.pipelines);
+}
+
+void HitchDetector::RecordShaderModuleCreation(CompileRecord record) {
+  absl::MutexLock lock(&lock_);
+  AddRecord(std::move(record), &activity_.shader_modules);
+}
+
+void HitchDetector::RecordAllocation(uint64_t size) {
+  absl::MutexLock lock(&lock_);
+  ++activity_.allocation_count;
+  activity_.allocation_size += size;
+}
+
+std::optional<DurationClock::duration> HitchDetector::GetLimit() const {
+  std::optional<DurationClock::duration> limit;
+  if (config_.threshold > DurationClock::duration::zero()) {
+    limit = config_.threshold;
+  }
+  if (config_.percentile > 0.0 && frame_times_.size() >= kMinWindowSize) {
+    std::vector<DurationClock::duration> sorted = frame_times_;
+    const double rank =
+        std::ceil(config_.percentile / 100.0 * sorted.size()) - 1.0;
+    const size_t index = std::min(
+        sorted.size() - 1, static_cast<size_t>(std::max(rank, 0.0)));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    limit = limit ? std::min(*limit, sorted[index]) : sorted[index];
+  }
+  return limit;
+}
+
+std::optional<Hitch> HitchDetector::EndFrame(
+    DurationClock::duration frame_time) {
+  absl::MutexLock lock(&lock_);
+  FrameActivity activity = std::exchange(activity_, {});
+  // Compare against the preceding frames only.
+  const std::optional<DurationClock::duration> limit = GetLimit();
+  if (config_.percentile > 0.0) {
+    if (frame_times_.size() < kWindowSize) {
+      frame_times_.push_back(frame_time);
+    } else {
+      frame_times_[next_frame_time_] = frame_time;
+      next_frame_time_ = (next_frame_time_ + 1) % kWindowSize;
+    }
+  }
+
+  if (!limit || frame_time <= *limit) {
+    return std::nullopt;
+  }
+  return Hitch{frame_time, *limit, std::move(activity)};
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,118 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_HITCH_DETECTOR_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_HITCH_DETECTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "layer_utils.h"
+
+namespace performancelayers {
+
+// When a frame counts as a hitch. Frames that exceed any of the enabled limits
+// are hitches.
+struct HitchDetectorConfig {
+  // Frames that take longer than this are hitches. Zero disables the limit.
+  DurationClock::duration threshold = DurationClock::duration::zero();
+  // Frames that take longer than this percentile, in (0, 100), of the
+  // preceding frames are hitches. Zero disables the limit.
+  double percentile = 0.0;
+};
+
+// A pipeline or shader module created during a frame.
+struct CompileRecord {
+  // The hash of the pipeline or shader module.
+  std::string hash;
+  // The thread that created it.
+  uint32_t thread_id = 0;
+  DurationClock::duration duration = DurationClock::duration::zero();
+};
+
+// The work done by the application during a frame that may have caused a
+// hitch.
+struct FrameActivity {
+  std::vector<CompileRecord> pipelines;
+  std::vector<CompileRecord> shader_modules;
+  uint64_t allocation_count = 0;
+  uint64_t allocation_size = 0;
+  // The pipelines and shader modules left out because the frame had more
+  // than `HitchDetector::kMaxRecordsPerFrame` of them.
+  uint64_t dropped_records = 0;
+};
+
+// A frame that exceeded the limits of the `HitchDetectorConfig`.
+struct Hitch {
+  DurationClock::duration frame_time = DurationClock::duration::zero();
+  // The lowest limit the frame exceeded.
+  DurationClock::duration limit = DurationClock::duration::zero();
+  FrameActivity activity;
+};
+
+// Attributes long frames to the pipelines compiled, the shader modules
+// created, and the memory allocated while they were rendered. The activity is
+// recorded as it happens, on any thread, and is assigned to the frame during
+// which it completed.
+//
+// This class is thread safe.
+class HitchDetector {
+ public:
+  // The number of preceding frames the percentile is computed over.
+  static constexpr size_t kWindowSize = 256;
+  // The number of frames to wait for before using the percentile.
+  static constexpr size_t kMinWindowSize = 32;
+  // Bounds the memory used by frames with many pipeline or shader module
+  // creations, e.g., loading screens.
+  static constexpr size_t kMaxRecordsPerFrame = 64;
+
+  explicit HitchDetector(const HitchDetectorConfig& config);
+  HitchDetector(const HitchDetector&) = delete;
+  HitchDetector& operator=(const HitchDetector&) = delete;
+
+  // Returns true if the config enables any limit. Nothing needs to be
+  // recorded otherwise.
+  bool IsEnabled() const;
+
+  void RecordPipelineCreation(CompileRecord record);
+  void RecordShaderModuleCreation(CompileRecord record);
+  void RecordAllocation(uint64_t size);
+
+  // Ends the current frame, which took `frame_time`, and starts the next one.
+  // Returns the frame with its activity if it is a hitch.
+  std::optional<Hitch> EndFrame(DurationClock::duration frame_time);
+
+ private:
+  // Returns the lowest enabled limit, or nullopt if there is none yet.
+  std::optional<DurationClock::duration> GetLimit() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  void AddRecord(CompileRecord record, std::vector<CompileRecord>* records)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  const HitchDetectorConfig config_;
+  mutable absl::Mutex lock_;
+  FrameActivity activity_ ABSL_GUARDED_BY(lock_);
+  // A ring of the last `kWindowSize` frame times.
+  std::vector<DurationClock::duration> frame_times_ ABSL_GUARDED_BY(lock_);
+  size_t next_frame_time_ ABSL_GUARDED_BY(lock_) = 0;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_HITCH_DETECTOR_H_
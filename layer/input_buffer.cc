@@ -123,6 +123,17 @@ class UnixMemMappedInputBufferImpl : public InputBuffer::InputBufferImplBase {
     return absl::MakeConstSpan(buffer_start_, buffer_size_);
   }
 
+  void Prefetch() const override {
+    if (buffer_size_ == 0) {
+      return;
+    }
+    // Both only start the readahead: the pages are read asynchronously.
+    posix_fadvise(file_descriptor_, 0, 0, POSIX_FADV_WILLNEED);
+    if (madvise(buffer_start_, buffer_size_, MADV_WILLNEED) != 0) {
+      SPL_LOG(WARNING) << "Failed to prefetch mmapped file";
+    }
+  }
+
   UnixMemMappedInputBufferImpl(UnixMemMappedInputBufferImpl&& other)
       : file_descriptor_(other.file_descriptor_),
         buffer_start_(other.buffer_start_),
@@ -55,10 +55,19 @@ class InputBuffer {
 
   size_t GetBufferSize() const { return GetBuffer().size(); }
 
+  // Hints the platform to start reading the buffer contents in the background,
+  // so that they are resident by the time they are accessed. Does not block.
+  // A no-op for buffers that are already read into memory.
+  void Prefetch() const {
+    assert(concrete_impl_);
+    concrete_impl_->Prefetch();
+  }
+
   class InputBufferImplBase {
    public:
     virtual ~InputBufferImplBase() = default;
     virtual absl::Span<const uint8_t> GetBuffer() const = 0;
+    virtual void Prefetch() const {}
   };
 
  private:
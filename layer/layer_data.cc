@@ -14,27 +14,40 @@
 
 #include "layer_data.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <cstdint>
-#include <iomanip>
+#include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_cat.h"
-#include "absl/strings/str_format.h"
 #include "absl/synchronization/mutex.h"
+#include "binary_logging.h"
 #include "debug_logging.h"
 #include "layer_utils.h"
+#include "shader_hash_cache.h"
+#include "shared_memory_ring.h"
 
 namespace performancelayers {
 namespace {
 constexpr char kEventLogFileEnvVar[] = "VK_PERFORMANCE_LAYERS_EVENT_LOG_FILE";
-
-// Returns event log file row prefix with ','-separated |event_type| and
-// |timestamp|.
-std::string MakeEventLogPrefix(
-    std::string_view event_type,
-    TimestampClock::time_point timestamp = GetTimestamp()) {
-  return CsvCat(event_type, ToUnixNanos(timestamp));
+constexpr char kLogFormatEnvVar[] = "VK_PERFORMANCE_LAYERS_LOG_FORMAT";
+constexpr char kEventRingEnvVar[] = "VK_PERFORMANCE_LAYERS_EVENT_RING";
+
+// Returns the event log file row with ','-separated |event_type|, |timestamp|
+// and |content|, if not empty. The row is kept in a buffer of the calling
+// thread, reused by the next call.
+std::string_view MakeEventLogLine(std::string_view event_type,
+                                  TimestampClock::time_point timestamp,
+                                  std::string_view content) {
+  thread_local std::string line;
+  line.clear();
+  absl::StrAppend(&line, event_type, ",", ToUnixNanos(timestamp));
+  if (!content.empty()) {
+    absl::StrAppend(&line, ",", content);
+  }
+  return line;
 }
 
 // Returns the first create info of type
@@ -74,62 +87,210 @@ VkLayerDeviceCreateInfo* FindDeviceCreateInfo(
 
   return device_create_info;
 }
+
+// Returns true if the instance extension |extension_name| is enabled in
+// |create_info|.
+bool IsInstanceExtensionEnabled(const VkInstanceCreateInfo* create_info,
+                                std::string_view extension_name) {
+  for (uint32_t i = 0; i != create_info->enabledExtensionCount; ++i) {
+    if (extension_name == create_info->ppEnabledExtensionNames[i]) {
+      return true;
+    }
+  }
+  return false;
+}
 }  // namespace
 
+ExtendedDeviceCreateInfo::ExtendedDeviceCreateInfo(
+    const VkDeviceCreateInfo& create_info)
+    : create_info_(create_info),
+      extension_names_(create_info.ppEnabledExtensionNames,
+                       create_info.ppEnabledExtensionNames +
+                           create_info.enabledExtensionCount) {
+  create_info_.ppEnabledExtensionNames = extension_names_.data();
+}
+
+bool ExtendedDeviceCreateInfo::IsExtensionEnabled(
+    std::string_view extension_name) const {
+  return absl::c_any_of(extension_names_, [extension_name](const char* name) {
+    return extension_name == name;
+  });
+}
+
+void ExtendedDeviceCreateInfo::EnableExtension(const char* extension_name) {
+  if (IsExtensionEnabled(extension_name)) {
+    return;
+  }
+  extension_names_.push_back(extension_name);
+  create_info_.enabledExtensionCount =
+      static_cast<uint32_t>(extension_names_.size());
+  create_info_.ppEnabledExtensionNames = extension_names_.data();
+}
+
+void ExtendedDeviceCreateInfo::PrependToChain(VkBaseOutStructure* structure) {
+  assert(structure);
+  structure->pNext = const_cast<VkBaseOutStructure*>(
+      static_cast<const VkBaseOutStructure*>(create_info_.pNext));
+  create_info_.pNext = structure;
+}
+
 LayerData::LayerData() {
   if (const char* event_log_file = getenv(kEventLogFileEnvVar)) {
     // The underlying log file can be written to by multiple layers from
     // multiple threads. All contentens have to be written in whole lines(s)
     // at a time to ensure there is no unintended interleaving within a single
-    // line.
-    event_log_ = fopen(event_log_file, "a");
+    // line. The buffered writer only writes whole lines.
+    if (FILE* event_log = fopen(event_log_file, "a")) {
+      event_log_ = std::make_unique<BufferedWriter>(event_log);
+    }
   }
 }
 
 LayerData::LayerData(char* log_filename, const char* header) {
+  FILE* out = stderr;
   if (log_filename) {
-    out_ = fopen(log_filename, "w");
-    if (out_ == nullptr) {
+    out = fopen(log_filename, "w");
+    if (out == nullptr) {
       SPL_LOG(ERROR) << "Failed to open " << log_filename
                      << ", output will be to STDERR.";
-      out_ = stderr;
+      out = stderr;
     }
-  } else {
-    out_ = stderr;
   }
-
-  WriteLnAndFlush(out_, header);
+  out_ = std::make_unique<BufferedWriter>(out);
+  out_->WriteLine(header);
 
   if (const char* event_log_file = getenv(kEventLogFileEnvVar)) {
     // The underlying log file can be written to by multiple layers from
     // multiple threads. All contentens have to be written in whole lines(s)
     // at a time to ensure there is no unintended interleaving within a single
-    // line.
-    event_log_ = fopen(event_log_file, "a");
+    // line. The buffered writer only writes whole lines.
+    if (FILE* event_log = fopen(event_log_file, "a")) {
+      event_log_ = std::make_unique<BufferedWriter>(event_log);
+    }
+  }
+}
+
+bool LayerData::IsDeviceExtensionSupported(
+    VkPhysicalDevice physical_device, std::string_view extension_name) const {
+  auto enumerate_extensions = GetNextInstanceProcAddrOrNull(
+      physical_device,
+      &VkLayerInstanceDispatchTable::EnumerateDeviceExtensionProperties);
+  if (!enumerate_extensions) {
+    return false;
+  }
+
+  uint32_t count = 0;
+  if (enumerate_extensions(physical_device, nullptr, &count, nullptr) !=
+      VK_SUCCESS) {
+    return false;
+  }
+  std::vector<VkExtensionProperties> extensions(count);
+  VkResult result = enumerate_extensions(physical_device, nullptr, &count,
+                                         extensions.data());
+  if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+    return false;
+  }
+  extensions.resize(count);
+  return absl::c_any_of(extensions, [extension_name](
+                                        const VkExtensionProperties& ext) {
+    return extension_name == ext.extensionName;
+  });
+}
+
+bool LayerData::GetPhysicalDeviceFeatures2(
+    VkPhysicalDevice physical_device,
+    VkPhysicalDeviceFeatures2* features) const {
+  const InstanceEntry* entry = instances_.Find(InstanceKey(physical_device));
+  if (!entry) {
+    return false;
+  }
+  PFN_vkGetPhysicalDeviceFeatures2 get_features = nullptr;
+  if (entry->properties.api_version >= VK_API_VERSION_1_1) {
+    get_features = entry->dispatch_table.GetPhysicalDeviceFeatures2;
+  } else if (entry->properties.physical_device_properties2_enabled) {
+    get_features = entry->dispatch_table.GetPhysicalDeviceFeatures2KHR;
+  }
+  if (!get_features) {
+    return false;
   }
+  get_features(physical_device, features);
+  return true;
 }
 
-void LayerData::RemoveInstance(VkInstance instance) {
-  InstanceKey key(instance);
-  absl::MutexLock lock(&instance_dispatch_lock_);
-  instance_dispatch_map_.erase(key);
-  instance_keys_map_.erase(key);
+bool LayerData::GetPhysicalDeviceMemoryProperties2(
+    VkPhysicalDevice physical_device,
+    VkPhysicalDeviceMemoryProperties2* properties) const {
+  const InstanceEntry* entry = instances_.Find(InstanceKey(physical_device));
+  if (!entry) {
+    return false;
+  }
+  PFN_vkGetPhysicalDeviceMemoryProperties2 get_properties = nullptr;
+  if (entry->properties.api_version >= VK_API_VERSION_1_1) {
+    get_properties = entry->dispatch_table.GetPhysicalDeviceMemoryProperties2;
+  } else if (entry->properties.physical_device_properties2_enabled) {
+    get_properties =
+        entry->dispatch_table.GetPhysicalDeviceMemoryProperties2KHR;
+  }
+  if (!get_properties) {
+    return false;
+  }
+  get_properties(physical_device, properties);
+  return true;
+}
+
+TimestampProperties LayerData::QueryTimestampProperties(
+    VkPhysicalDevice physical_device,
+    const VkDeviceCreateInfo& create_info) const {
+  TimestampProperties timestamp_properties;
+  auto get_properties = GetNextInstanceProcAddrOrNull(
+      physical_device,
+      &VkLayerInstanceDispatchTable::GetPhysicalDeviceProperties);
+  auto get_queue_family_properties = GetNextInstanceProcAddrOrNull(
+      physical_device,
+      &VkLayerInstanceDispatchTable::GetPhysicalDeviceQueueFamilyProperties);
+  if (!get_properties || !get_queue_family_properties) {
+    return timestamp_properties;
+  }
+
+  VkPhysicalDeviceProperties properties = {};
+  get_properties(physical_device, &properties);
+  if (properties.limits.timestampPeriod > 0.0f) {
+    timestamp_properties.period = properties.limits.timestampPeriod;
+  }
+
+  uint32_t family_count = 0;
+  get_queue_family_properties(physical_device, &family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  get_queue_family_properties(physical_device, &family_count, families.data());
+  // Queue families without timestamp support report 0 valid bits, and cannot
+  // write timestamps at all.
+  for (uint32_t i = 0; i != create_info.queueCreateInfoCount; ++i) {
+    const uint32_t family = create_info.pQueueCreateInfos[i].queueFamilyIndex;
+    if (family < family_count && families[family].timestampValidBits != 0) {
+      timestamp_properties.valid_bits = std::min(
+          timestamp_properties.valid_bits, families[family].timestampValidBits);
+    }
+  }
+  return timestamp_properties;
 }
 
 void LayerData::LogLine(std::string_view event_type, std::string_view line,
                         TimestampClock::time_point timestamp) const {
-  WriteLnAndFlush(out_, line);
+  assert(out_);
+  out_->WriteLine(line);
   if (event_log_)
-    WriteLnAndFlush(event_log_,
-                    CsvCat(MakeEventLogPrefix(event_type, timestamp), line));
+    event_log_->WriteLine(MakeEventLogLine(event_type, timestamp, line));
 }
 
 void LayerData::Log(std::string_view event_type, const HashVector& pipeline,
                     std::string_view prefix) const {
   // Quote the comma-separated hash value array to always create 2 CSV cells.
-  std::stringstream pipeline_hash_str;
-  pipeline_hash_str << std::quoted(PipelineHashToString(pipeline));
-  std::string pipeline_and_content = CsvCat(pipeline_hash_str.str(), prefix);
+  // The line is kept in a buffer of the calling thread, reused by the next
+  // call.
+  thread_local std::string pipeline_and_content;
+  pipeline_and_content.clear();
+  AppendQuotedPipelineHash(pipeline, &pipeline_and_content);
+  absl::StrAppend(&pipeline_and_content, ",", prefix);
   LogLine(event_type, pipeline_and_content);
 }
 
@@ -150,25 +311,49 @@ DurationClock::duration LayerData::GetTimeDelta() {
 void LayerData::LogEventOnly(std::string_view event_type,
                              std::string_view extra_content) const {
   if (event_log_) {
-    const std::string prefix = MakeEventLogPrefix(event_type);
-    WriteLnAndFlush(event_log_, extra_content.empty()
-                                    ? prefix
-                                    : CsvCat(prefix, extra_content));
+    event_log_->WriteLine(
+        MakeEventLogLine(event_type, GetTimestamp(), extra_content));
   }
 }
 
+void LayerData::FlushLogs() {
+  if (out_) out_->Flush();
+  if (event_log_) event_log_->Flush();
+}
+
 std::string LayerData::ShaderHashToString(uint64_t hash) {
-  return absl::StrFormat("%#x", hash);
+  std::string str;
+  AppendShaderHash(hash, &str);
+  return str;
+}
+
+void LayerData::AppendShaderHash(uint64_t hash, std::string* out) {
+  // Same as the "%#x" format, which has no prefix for zero.
+  if (hash != 0) out->append("0x");
+  absl::StrAppend(out, absl::Hex(hash));
 }
 
 std::string LayerData::PipelineHashToString(const HashVector& pipeline) const {
-  return absl::StrCat("[",
-                      absl::StrJoin(pipeline, ",",
-                                    [](std::string* out, uint64_t hash) {
-                                      return absl::StrAppend(
-                                          out, ShaderHashToString(hash));
-                                    }),
-                      "]");
+  std::string str;
+  AppendPipelineHash(pipeline, &str);
+  return str;
+}
+
+void LayerData::AppendPipelineHash(const HashVector& pipeline,
+                                   std::string* out) {
+  out->push_back('[');
+  for (size_t i = 0, e = pipeline.size(); i != e; ++i) {
+    if (i != 0) out->push_back(',');
+    AppendShaderHash(pipeline[i], out);
+  }
+  out->push_back(']');
+}
+
+void LayerData::AppendQuotedPipelineHash(const HashVector& pipeline,
+                                         std::string* out) {
+  out->push_back('"');
+  AppendPipelineHash(pipeline, out);
+  out->push_back('"');
 }
 
 VkResult LayerData::CreateInstance(
@@ -198,11 +383,18 @@ VkResult LayerData::CreateInstance(
   VkLayerInstanceDispatchTable dispatch_table =
       get_dispatch_table(get_proc_addr);
 
+  InstanceProperties properties;
+  if (create_info->pApplicationInfo &&
+      create_info->pApplicationInfo->apiVersion != 0) {
+    properties.api_version = create_info->pApplicationInfo->apiVersion;
+  }
+  properties.physical_device_properties2_enabled = IsInstanceExtensionEnabled(
+      create_info, "VK_KHR_get_physical_device_properties2");
+
   // Add the dispatch table to the dispatch map.
-  if (!AddInstance(*instance, dispatch_table)) {
+  if (!AddInstance(*instance, dispatch_table, properties)) {
     return VK_ERROR_OUT_OF_HOST_MEMORY;
   }
-
   return VK_SUCCESS;
 }
 
@@ -244,7 +436,8 @@ VkResult LayerData::CreateDevice(
       get_dispatch_table(get_device_proc_addr);
 
   // Add the dispatch_table to the dispatch map.
-  if (!AddDevice(*device, dispatch_table)) {
+  if (!AddDevice(*device, dispatch_table,
+                 QueryTimestampProperties(physical_device, *create_info))) {
     return VK_ERROR_OUT_OF_HOST_MEMORY;
   }
   return VK_SUCCESS;
@@ -255,12 +448,15 @@ LayerData::ShaderModuleCreateResult LayerData::CreateShaderModule(
     const VkAllocationCallbacks* allocator, VkShaderModule* shader_module) {
   auto next_proc =
       GetNextDeviceProcAddr(device, &VkLayerDispatchTable::CreateShaderModule);
+  // Keep the hash acquired while the next layers run, so that they reuse it.
+  ScopedShaderHash hash(create_info->pCode, create_info->codeSize);
   DurationClock::time_point start = Now();
   VkResult result = next_proc(device, create_info, allocator, shader_module);
   DurationClock::time_point end = Now();
-  uint64_t hash =
-      HashShader(*shader_module, create_info->pCode, create_info->codeSize);
-  return {result, hash, start, end};
+  if (result == VK_SUCCESS) {
+    SetShaderHash(*shader_module, hash.GetHash());
+  }
+  return {result, hash.GetHash(), start, end};
 }
 
 void LayerData::DestroyShaderModule(VkDevice device,
@@ -271,4 +467,38 @@ void LayerData::DestroyShaderModule(VkDevice device,
   EraseShader(shader_module);
   next_proc(device, shader_module, allocator);
 }
+
+void LayerData::DestroyPipeline(VkDevice device, VkPipeline pipeline,
+                                const VkAllocationCallbacks* allocator) {
+  auto next_proc =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::DestroyPipeline);
+  ErasePipeline(pipeline);
+  next_proc(device, pipeline, allocator);
+}
+
+std::unique_ptr<EventLogger> LayerDataWithEventLogger::CreatePrivateLogger(
+    char* log_filename, const char* header) {
+  const char* format_or_null = getenv(kLogFormatEnvVar);
+  const std::string_view format = format_or_null ? format_or_null : "";
+  if (format == "binary") {
+    return std::make_unique<BinaryLogger>(header, log_filename);
+  }
+  if (!format.empty() && format != "csv") {
+    SPL_LOG(WARNING) << "Unknown log format " << format << ", using csv.";
+  }
+  return std::make_unique<CSVLogger>(header, log_filename);
+}
+
+std::unique_ptr<EventLogger> LayerDataWithEventLogger::CreateRingLogger() {
+  const char* ring_name = getenv(kEventRingEnvVar);
+  if (!ring_name || ring_name[0] == '\0') {
+    return nullptr;
+  }
+  auto logger = std::make_unique<SharedMemoryRingLogger>(ring_name);
+  if (!logger->IsAttached()) {
+    return nullptr;
+  }
+  return logger;
+}
+
 }  // namespace performancelayers
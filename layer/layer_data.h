@@ -21,17 +21,20 @@
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
-#include "absl/container/inlined_vector.h"
 #include "absl/strings/str_join.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "buffered_writer.h"
+#include "copy_on_write_map.h"
 #include "csv_logging.h"
 #include "event_logging.h"
-#include "farmhash.h"
+#include "gpu_timestamps.h"
 #include "layer_utils.h"
+#include "pipeline_hash_map.h"
 #include "vulkan/vk_layer.h"
 #include "vulkan/vulkan.h"
 #include "vulkan/vulkan_core.h"
@@ -127,6 +130,50 @@ struct hash<performancelayers::DeviceKey> {
 
 namespace performancelayers {
 
+// A shallow copy of an application's VkDeviceCreateInfo that a layer can add
+// device extensions and feature structures to, without modifying the
+// application's structures. The copy shares the pNext chain of the original,
+// including the loader's layer link info, and can be passed to
+// |LayerData::CreateDevice| in place of the original.
+class ExtendedDeviceCreateInfo {
+ public:
+  explicit ExtendedDeviceCreateInfo(const VkDeviceCreateInfo& create_info);
+
+  ExtendedDeviceCreateInfo(const ExtendedDeviceCreateInfo&) = delete;
+  ExtendedDeviceCreateInfo& operator=(const ExtendedDeviceCreateInfo&) = delete;
+
+  // Returns true if the device extension |extension_name| is enabled.
+  bool IsExtensionEnabled(std::string_view extension_name) const;
+
+  // Enables the device extension |extension_name|, unless already enabled.
+  // |extension_name| must outlive this object.
+  void EnableExtension(const char* extension_name);
+
+  // Returns the first structure of type |s_type| in the pNext chain, or
+  // nullptr if there is none.
+  template <typename StructT>
+  const StructT* FindInChain(VkStructureType s_type) const {
+    return performancelayers::FindInChain<StructT>(create_info_.pNext, s_type);
+  }
+
+  // Inserts |structure| at the front of the pNext chain. |structure| must
+  // outlive this object.
+  void PrependToChain(VkBaseOutStructure* structure);
+
+  const VkDeviceCreateInfo* get() const { return &create_info_; }
+
+ private:
+  VkDeviceCreateInfo create_info_;
+  std::vector<const char*> extension_names_;
+};
+
+// Instance properties that determine which physical device functions can be
+// called.
+struct InstanceProperties {
+  uint32_t api_version = VK_API_VERSION_1_0;
+  bool physical_device_properties2_enabled = false;
+};
+
 // A class that contains all of the data that is needed for the functions
 // that this layer will override.
 //
@@ -135,81 +182,61 @@ namespace performancelayers {
 // log file.
 class LayerData {
  public:
-  using InstanceDispatchMap =
-      absl::flat_hash_map<InstanceKey, VkLayerInstanceDispatchTable>;
-  using DeviceDispatchMap =
-      absl::flat_hash_map<DeviceKey, VkLayerDispatchTable>;
-  using HashVector = absl::InlinedVector<uint64_t, 3>;
+  using HashVector = PipelineHashVector;
 
   LayerData();
 
   LayerData(char* log_filename, const char* header);
 
-  virtual ~LayerData() {
-    if (out_ && out_ != stderr) {
-      fclose(out_);
-    }
-  }
+  virtual ~LayerData() = default;
 
-  // Records the dispatch table and instance key that is associated with
-  // |instance|.
+  // Records the dispatch table, properties and instance key that are
+  // associated with |instance|.
   bool AddInstance(VkInstance instance,
-                   const VkLayerInstanceDispatchTable& dispatch_table) {
-    InstanceKey key(instance);
-
-    absl::MutexLock lock(&instance_dispatch_lock_);
-    const bool inserted =
-        instance_dispatch_map_.insert({key, dispatch_table}).second;
-    if (inserted) {
-      instance_keys_map_[key] = instance;
-    }
-    return inserted;
+                   const VkLayerInstanceDispatchTable& dispatch_table,
+                   const InstanceProperties& properties = {}) {
+    return instances_.Insert(InstanceKey(instance),
+                             {instance, dispatch_table, properties});
   }
 
   // Removes the dispatch table and physical devices associated with |instance|.
-  void RemoveInstance(VkInstance instance);
+  void RemoveInstance(VkInstance instance) {
+    instances_.Erase(InstanceKey(instance));
+  }
 
   // Returns the instance associated with |instance_key|, or a null handle if
   // there is none.
   VkInstance GetInstance(InstanceKey instance_key) const {
-    absl::MutexLock lock(&instance_dispatch_lock_);
-    if (auto it = instance_keys_map_.find(instance_key);
-        it != instance_keys_map_.end()) {
-      return it->second;
-    }
-    return VK_NULL_HANDLE;
+    const InstanceEntry* entry = instances_.Find(instance_key);
+    return entry ? entry->instance : VK_NULL_HANDLE;
   }
 
-  // Records the dispatch table and device key associated with
-  // |device|.
-  bool AddDevice(VkDevice device, const VkLayerDispatchTable& dispatch_table) {
-    DeviceKey key(device);
-    absl::MutexLock dispatch_table_lock(&device_dispatch_lock_);
-    const bool inserted =
-        device_dispatch_map_.insert({key, dispatch_table}).second;
-    if (inserted) {
-      device_keys_map_[key] = device;
-    }
-    return inserted;
+  // Records the dispatch table, timestamp properties and device key
+  // associated with |device|.
+  bool AddDevice(VkDevice device, const VkLayerDispatchTable& dispatch_table,
+                 const TimestampProperties& timestamp_properties = {}) {
+    return devices_.Insert(DeviceKey(device),
+                           {device, dispatch_table, timestamp_properties});
   }
 
   // Removes the dispatch table associated with |device|.
-  void RemoveDevice(VkDevice device) {
-    DeviceKey key(device);
-    absl::MutexLock lock(&device_dispatch_lock_);
-    device_dispatch_map_.erase(key);
-    device_keys_map_.erase(key);
+  void RemoveDevice(VkDevice device) { devices_.Erase(DeviceKey(device)); }
+
+  // Returns the properties of the timestamps written by the queues of the
+  // device of |device_key|. These are only known if the instance dispatch
+  // table contains GetPhysicalDeviceProperties and
+  // GetPhysicalDeviceQueueFamilyProperties when the device is created;
+  // otherwise, timestamps are assumed to be full 64-bit nanoseconds.
+  TimestampProperties GetTimestampProperties(DeviceKey device_key) const {
+    const DeviceEntry* entry = devices_.Find(device_key);
+    return entry ? entry->timestamp_properties : TimestampProperties();
   }
 
   // Returns the device associated with |device_key|, or a null handle if
   // there is none.
   VkDevice GetDevice(DeviceKey device_key) const {
-    absl::MutexLock lock(&device_dispatch_lock_);
-    if (auto it = device_keys_map_.find(device_key);
-        it != device_keys_map_.end()) {
-      return it->second;
-    }
-    return VK_NULL_HANDLE;
+    const DeviceEntry* entry = devices_.Find(device_key);
+    return entry ? entry->device : VK_NULL_HANDLE;
   }
 
   // Returns the function pointer for the function |funct_ptr| for the next
@@ -219,15 +246,36 @@ class LayerData {
   template <typename DispatchableInstanceHandleT, typename TFuncPtr>
   auto GetNextInstanceProcAddr(DispatchableInstanceHandleT instance_handle,
                                TFuncPtr func_ptr) const {
-    absl::MutexLock lock(&instance_dispatch_lock_);
-    auto instance_dispatch_iter =
-        instance_dispatch_map_.find(InstanceKey(instance_handle));
-    assert(instance_dispatch_iter != instance_dispatch_map_.end());
-    auto proc_addr = instance_dispatch_iter->second.*func_ptr;
+    auto proc_addr = GetNextInstanceProcAddrOrNull(instance_handle, func_ptr);
     assert(proc_addr);
     return proc_addr;
   }
 
+  // Same as |GetNextInstanceProcAddr|, but returns nullptr instead of
+  // asserting when the next layer does not provide |func_ptr|. Use this for
+  // functions from optional extensions and newer Vulkan versions.
+  template <typename DispatchableInstanceHandleT, typename TFuncPtr>
+  auto GetNextInstanceProcAddrOrNull(
+      DispatchableInstanceHandleT instance_handle, TFuncPtr func_ptr) const {
+    const InstanceEntry* entry = instances_.Find(InstanceKey(instance_handle));
+    assert(entry);
+    return entry->dispatch_table.*func_ptr;
+  }
+
+  // Returns the dispatch table of the next layer in the device.
+  // |device_handle| must be one of: VkDevice, VkQueue, or VkCommandBuffer.
+  // Looking up the table once is cheaper than calling |GetNextDeviceProcAddr|
+  // for each of the functions needed by an intercepted function. The table
+  // stays valid for the lifetime of the layer data, even after the device is
+  // removed.
+  template <typename DispatchableDeviceHandleT>
+  const VkLayerDispatchTable& GetDeviceDispatchTable(
+      DispatchableDeviceHandleT device_handle) const {
+    const DeviceEntry* entry = devices_.Find(DeviceKey(device_handle));
+    assert(entry);
+    return entry->dispatch_table;
+  }
+
   // Returns the function pointer for the function |funct_ptr| for the next
   // layer in the device. |device_handle| must be one of: VkDevice, VkQueue, or
   // VkCommandBuffer. This is can be used only with functions declared in the
@@ -235,15 +283,50 @@ class LayerData {
   template <typename DispatchableDeviceHandleT, typename TFuncPtr>
   auto GetNextDeviceProcAddr(DispatchableDeviceHandleT device_handle,
                              TFuncPtr func_ptr) const {
-    absl::MutexLock lock(&device_dispatch_lock_);
-    auto device_dispatch_iter =
-        device_dispatch_map_.find(DeviceKey(device_handle));
-    assert(device_dispatch_iter != device_dispatch_map_.end());
-    auto proc_addr = device_dispatch_iter->second.*func_ptr;
+    auto proc_addr = GetNextDeviceProcAddrOrNull(device_handle, func_ptr);
     assert(proc_addr);
     return proc_addr;
   }
 
+  // Same as |GetNextDeviceProcAddr|, but returns nullptr instead of asserting
+  // when the next layer does not provide |func_ptr|. Use this for functions
+  // from optional extensions.
+  template <typename DispatchableDeviceHandleT, typename TFuncPtr>
+  auto GetNextDeviceProcAddrOrNull(DispatchableDeviceHandleT device_handle,
+                                   TFuncPtr func_ptr) const {
+    return GetDeviceDispatchTable(device_handle).*func_ptr;
+  }
+
+  // Returns true if |physical_device| supports the device extension
+  // |extension_name|. The instance dispatch table must contain
+  // EnumerateDeviceExtensionProperties, otherwise returns false.
+  bool IsDeviceExtensionSupported(VkPhysicalDevice physical_device,
+                                  std::string_view extension_name) const;
+
+  // Queries the features of |physical_device| with
+  // vkGetPhysicalDeviceFeatures2, or vkGetPhysicalDeviceFeatures2KHR when the
+  // instance API version is 1.0. Returns false if neither function can be used
+  // with the instance of |physical_device|, or is missing from the instance
+  // dispatch table.
+  bool GetPhysicalDeviceFeatures2(VkPhysicalDevice physical_device,
+                                  VkPhysicalDeviceFeatures2* features) const;
+
+  // Queries the memory properties of |physical_device| with
+  // vkGetPhysicalDeviceMemoryProperties2, or the KHR variant, like
+  // |GetPhysicalDeviceFeatures2|. Returns false if neither function can be
+  // used.
+  bool GetPhysicalDeviceMemoryProperties2(
+      VkPhysicalDevice physical_device,
+      VkPhysicalDeviceMemoryProperties2* properties) const;
+
+  // Returns the properties of the timestamps written by the queues created
+  // with |create_info| on |physical_device|. Returns the defaults if the
+  // instance dispatch table lacks GetPhysicalDeviceProperties or
+  // GetPhysicalDeviceQueueFamilyProperties.
+  TimestampProperties QueryTimestampProperties(
+      VkPhysicalDevice physical_device,
+      const VkDeviceCreateInfo& create_info) const;
+
   // Removes a previously created shader module from the LayerData. This is
   // called while destroying the shader module.
   void EraseShader(VkShaderModule shader_module) {
@@ -252,16 +335,11 @@ class LayerData {
     shader_to_code_hash_.erase(shader_module);
   }
 
-  // Records the hash of |code|, whose size is |size|, and associates it with
-  // |shader_module|. This must be called before you can call |GetShaderHash|
-  // with |shader_module|. Returns the calculated hash value.
-  uint64_t HashShader(VkShaderModule shader_module, const uint32_t* code,
-                      uint32_t size) {
-    const char* c = reinterpret_cast<const char*>(code);
-    uint64_t hash_value = util::Fingerprint64(c, size);
+  // Associates |hash| with |shader_module|. This must be called before you can
+  // call |GetShaderHash| with |shader_module|.
+  void SetShaderHash(VkShaderModule shader_module, uint64_t hash) {
     absl::MutexLock lock(&shader_hash_lock_);
-    shader_to_code_hash_.insert_or_assign(shader_module, hash_value);
-    return hash_value;
+    shader_to_code_hash_.insert_or_assign(shader_module, hash);
   }
 
   // Return the hash associated with |shader_module|.
@@ -276,9 +354,9 @@ class LayerData {
   HashVector HashComputePipeline(
       VkPipeline pipeline, const VkComputePipelineCreateInfo& create_info) {
     HashVector hashes = {GetShaderHash(create_info.stage.module)};
-
-    absl::MutexLock lock(&pipeline_hash_lock_);
-    pipeline_hash_map_.insert_or_assign(pipeline, hashes);
+    if (pipeline != VK_NULL_HANDLE) {
+      pipeline_hashes_.Insert(pipeline, hashes);
+    }
     return hashes;
   }
 
@@ -291,19 +369,24 @@ class LayerData {
       uint64_t h = GetShaderHash(create_info.pStages[j].module);
       hashes.push_back(h);
     }
-
-    absl::MutexLock lock(&pipeline_hash_lock_);
-    pipeline_hash_map_.insert_or_assign(pipeline, hashes);
+    if (pipeline != VK_NULL_HANDLE) {
+      pipeline_hashes_.Insert(pipeline, hashes);
+    }
     return hashes;
   }
 
-  // Returns the cached hash of the pipeline |pipeline|.
-  const HashVector& GetPipelineHash(VkPipeline pipeline) const {
-    absl::MutexLock lock(&pipeline_hash_lock_);
-    assert(pipeline_hash_map_.count(pipeline) != 0);
-    return pipeline_hash_map_.at(pipeline);
+  // Returns the cached hash of the pipeline |pipeline|, or an empty vector if
+  // |pipeline| was erased. The hash is returned by value, as another thread
+  // may erase |pipeline| at any time.
+  HashVector GetPipelineHash(VkPipeline pipeline) const {
+    return pipeline_hashes_.Get(pipeline);
   }
 
+  // Removes the cached hash of |pipeline|, which is being destroyed. Each call
+  // to |HashComputePipeline| or |HashGraphicsPipeline| with |pipeline| must be
+  // matched by one call to this.
+  void ErasePipeline(VkPipeline pipeline) { pipeline_hashes_.Erase(pipeline); }
+
   // Logs one line to the log file, and to the event log file, if enabled.
   void LogLine(std::string_view event_type, std::string_view line,
                TimestampClock::time_point timestamp = GetTimestamp()) const;
@@ -335,12 +418,27 @@ class LayerData {
   void LogEventOnly(std::string_view event_type,
                     std::string_view extra_content = "") const;
 
+  // Writes all the buffered log lines to the log files. Call this before
+  // terminating the application without running the destructors.
+  virtual void FlushLogs();
+
   // Returns a string representation of |hash|.
   static std::string ShaderHashToString(uint64_t hash);
 
+  // Appends the string representation of |hash| to |out|.
+  static void AppendShaderHash(uint64_t hash, std::string* out);
+
   // Returns a string identifier of |pipeline|.
   std::string PipelineHashToString(const HashVector& pipeline) const;
 
+  // Appends the string identifier of |pipeline| to |out|.
+  static void AppendPipelineHash(const HashVector& pipeline, std::string* out);
+
+  // Appends the string identifier of |pipeline| to |out| in quotes, so that the
+  // comma-separated hashes form a single CSV cell.
+  static void AppendQuotedPipelineHash(const HashVector& pipeline,
+                                       std::string* out);
+
   // Sets the dispatch table for |device| to the one returned by
   // |get_dispatch_table|, and calls |CreateDevice| for the next layer.
   VkResult CreateDevice(
@@ -378,47 +476,56 @@ class LayerData {
   void DestroyShaderModule(VkDevice device, VkShaderModule shader_module,
                            const VkAllocationCallbacks* allocator);
 
+  // Removes the pipeline by calling |DestroyPipeline| for the next layer.
+  // Also, removes the cached hash of the pipeline from the LayerData.
+  void DestroyPipeline(VkDevice device, VkPipeline pipeline,
+                       const VkAllocationCallbacks* allocator);
+
  private:
-  mutable absl::Mutex instance_dispatch_lock_;
-  // A map from a VkInstance to its VkLayerInstanceDispatchTable.
-  InstanceDispatchMap instance_dispatch_map_
-      ABSL_GUARDED_BY(instance_dispatch_lock_);
-  // A map from an InstanceKey to its VkInstance.
-  absl::flat_hash_map<InstanceKey, VkInstance> instance_keys_map_;
-  ABSL_GUARDED_BY(instance_dispatch_lock_)
-
-  mutable absl::Mutex device_dispatch_lock_;
-  // A map from a VkDevice to its VkLayerDispatchTable.
-  DeviceDispatchMap device_dispatch_map_ ABSL_GUARDED_BY(device_dispatch_lock_);
-  // A map from a DeviceKey to its VkDevice.
-  absl::flat_hash_map<DeviceKey, VkDevice> device_keys_map_;
-  ABSL_GUARDED_BY(device_dispatch_lock_)
+  struct InstanceEntry {
+    VkInstance instance;
+    VkLayerInstanceDispatchTable dispatch_table;
+    InstanceProperties properties;
+  };
+  struct DeviceEntry {
+    VkDevice device;
+    VkLayerDispatchTable dispatch_table;
+    TimestampProperties timestamp_properties;
+  };
+
+  // The instances and devices, looked up without locking by the intercepted
+  // functions.
+  CopyOnWriteMap<InstanceKey, InstanceEntry> instances_;
+  CopyOnWriteMap<DeviceKey, DeviceEntry> devices_;
 
   mutable absl::Mutex shader_hash_lock_;
   // The map from a shader module to the result of its hash.
   absl::flat_hash_map<VkShaderModule, uint64_t> shader_to_code_hash_
       ABSL_GUARDED_BY(shader_hash_lock_);
 
-  mutable absl::Mutex pipeline_hash_lock_;
-  // The map from a pipeline to the result of its hash.
-  absl::flat_hash_map<VkPipeline, HashVector> pipeline_hash_map_
-      ABSL_GUARDED_BY(pipeline_hash_lock_);
+  // The map from a live pipeline to the result of its hash.
+  PipelineHashMap pipeline_hashes_;
 
-  // A pointer to the log file to use.
-  FILE* out_ = nullptr;
+  // The writer of the log file to use.
+  std::unique_ptr<BufferedWriter> out_;
   mutable absl::Mutex log_time_lock_;
   // The last time LogTimeDelta was called. A monotonic time_point to calculate
   // log time delta.
   DurationClock::time_point last_log_time_ ABSL_GUARDED_BY(log_time_lock_) =
       DurationClock::time_point::min();
 
-  // Event log file appended to by multiple layers, or nullptr.
-  FILE* event_log_ = nullptr;
+  // The writer of the event log file appended to by multiple layers, or
+  // nullptr.
+  std::unique_ptr<BufferedWriter> event_log_;
 };
 
 // This class adds a CSV logger to the `LayerData`. The logger writes to the
-// layer's private file. The constructor and destructor are responsible for
-// starting and ending the logger respectively. Sample use case:
+// layer's private file. Setting the VK_PERFORMANCE_LAYERS_LOG_FORMAT
+// environment variable to `binary` makes it a `BinaryLogger` instead. Setting
+// VK_PERFORMANCE_LAYERS_EVENT_RING to the name of a `SharedMemoryRing` also
+// streams the events to that ring. The constructor and destructor are
+// responsible for starting and ending the loggers respectively. Sample use
+// case:
 // ```c++
 // LayerDataWithEventLogger layer_data(csv_filename, csv_header);
 // Event event = ...;
@@ -427,23 +534,42 @@ class LayerData {
 class LayerDataWithEventLogger : public LayerData {
  public:
   LayerDataWithEventLogger(char* log_filename, const char* header)
-      : private_logger_(CSVLogger(header, log_filename)),
-        private_logger_filter_(
-            FilterLogger(&private_logger_, LogLevel::kHigh)) {
+      : private_logger_(CreatePrivateLogger(log_filename, header)),
+        private_logger_filter_(private_logger_.get(), LogLevel::kHigh),
+        ring_logger_(CreateRingLogger()) {
     private_logger_filter_.StartLog();
+    if (ring_logger_) ring_logger_->StartLog();
   }
 
-  ~LayerDataWithEventLogger() { private_logger_filter_.EndLog(); }
+  ~LayerDataWithEventLogger() {
+    private_logger_filter_.EndLog();
+    if (ring_logger_) ring_logger_->EndLog();
+  }
 
-  // Logs the incoming `MemoryUsage` event to the layer log file.
+  // Logs the incoming `MemoryUsage` event to the layer log file. The event is
+  // buffered; see `FlushLogs()`.
   void LogEvent(Event* event) {
     private_logger_filter_.AddEvent(event);
+    if (ring_logger_) ring_logger_->AddEvent(event);
+  }
+
+  void FlushLogs() override {
+    LayerData::FlushLogs();
     private_logger_filter_.Flush();
   }
 
  private:
-  CSVLogger private_logger_;
+  // Creates the logger of the format selected by the environment.
+  static std::unique_ptr<EventLogger> CreatePrivateLogger(char* log_filename,
+                                                          const char* header);
+
+  // Returns the logger streaming to the ring selected by the environment, or
+  // nullptr if there is none.
+  static std::unique_ptr<EventLogger> CreateRingLogger();
+
+  std::unique_ptr<EventLogger> private_logger_;
   FilterLogger private_logger_filter_;
+  std::unique_ptr<EventLogger> ring_logger_;
 };
 
 }  // namespace performancelayers
@@ -16,7 +16,27 @@
 
 #include <cassert>
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__unix__)
+#include <dlfcn.h>
+#endif
+
 namespace performancelayers {
+namespace {
+// The libraries that may share state with the other layer libraries.
+constexpr const char* kLayerLibraryNames[] = {
+    "libVkLayer_stadia_frame_time.so",
+    "libVkLayer_stadia_memory_usage.so",
+    "libVkLayer_stadia_pipeline_cache_sideload.so",
+    "libVkLayer_stadia_pipeline_compile_time.so",
+    "libVkLayer_stadia_pipeline_runtime.so",
+};
+}  // namespace
+
 TimestampClock::time_point GetTimestamp() { return TimestampClock::now(); }
 
 DurationClock::time_point Now() { return DurationClock::now(); }
@@ -29,10 +49,34 @@ int64_t ToUnixNanos(TimestampClock::time_point time) {
   return std::chrono::nanoseconds(time.time_since_epoch()).count();
 }
 
-void WriteLnAndFlush(FILE* file, std::string_view content) {
-  assert(file);
-  fprintf(file, "%.*s\n", static_cast<int>(content.size()), content.data());
-  fflush(file);
+uint32_t GetThreadId() {
+#if defined(__linux__)
+  // The thread ID never changes, and the system call is not free.
+  thread_local const uint32_t thread_id =
+      static_cast<uint32_t>(syscall(SYS_gettid));
+  return thread_id;
+#else
+  return 0;
+#endif
+}
+
+bool FindInOtherLayerLibraries(const char* symbol, void* own_address,
+                               const std::function<bool(void*)>& accept) {
+#if defined(__unix__)
+  for (const char* library : kLayerLibraryNames) {
+    void* handle = dlopen(library, RTLD_NOW | RTLD_NOLOAD);
+    if (!handle) {
+      continue;
+    }
+    void* address = dlsym(handle, symbol);
+    if (address && address != own_address && accept(address)) {
+      // Keep the library loaded for as long as its state may be used.
+      return true;
+    }
+    dlclose(handle);
+  }
+#endif
+  return false;
 }
 
 FunctionInterceptor::FunctionInterceptor(
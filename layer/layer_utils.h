@@ -18,6 +18,7 @@
 #include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <functional>
 #include <string>
 
 #include "absl/container/flat_hash_map.h"
@@ -79,8 +80,28 @@ int64_t ToInt64Nanoseconds(DurationClock::duration duration);
 // Converts a chrono time_point to a Unix int64 nanoseconds representation.
 int64_t ToUnixNanos(TimestampClock::time_point time);
 
-// Writes |content| to |file| and flushes it.
-void WriteLnAndFlush(FILE* file, std::string_view content);
+// Returns the operating system's identifier of the calling thread, or 0 when
+// the platform is not supported.
+uint32_t GetThreadId();
+
+// Calls |accept| with the address of |symbol| in each of the layer libraries of
+// this project loaded in the process, except for |own_address|, the address of
+// |symbol| in the calling library, until |accept| returns true. The accepted
+// library stays loaded. Returns false if no library is accepted, which is
+// always the case on platforms without `dlopen`.
+bool FindInOtherLayerLibraries(const char* symbol, void* own_address,
+                               const std::function<bool(void*)>& accept);
+
+// Returns the first structure of type |s_type| in the Vulkan structure chain
+// starting at |next|, or nullptr if there is none.
+template <typename StructT>
+const StructT* FindInChain(const void* next, VkStructureType s_type) {
+  for (auto* base = static_cast<const VkBaseInStructure*>(next); base;
+       base = base->pNext) {
+    if (base->sType == s_type) return reinterpret_cast<const StructT*>(base);
+  }
+  return nullptr;
+}
 
 // Represents a type-erased layer function pointer intercepting a known
 // Vulkan function. Should be constructed with the type safe |Create|
@@ -0,0 +1,483 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "log_analyzer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "binary_logging.h"
+#include "debug_logging.h"
+#include "input_buffer.h"
+
+namespace performancelayers {
+namespace {
+constexpr std::string_view kFrameTimeHeader = "Frame Time (ns),Benchmark State";
+constexpr std::string_view kCompileTimeHeaderPrefix =
+    "Pipeline,Compile Time (ns)";
+constexpr std::string_view kFramePresentEvent = "frame_present";
+constexpr double kNanosPerSecond = 1e9;
+constexpr double kNanosPerMilli = 1e6;
+
+// The frames and pipeline creations read from a log.
+struct LogContents {
+  struct Frame {
+    int64_t time_ns;
+    int64_t state;
+  };
+
+  void AddPipelineCompile(int64_t duration_ns) {
+    ++pipeline_compiles.calls;
+    pipeline_compiles.total_ns += duration_ns;
+    pipeline_compiles.max_ns = std::max(pipeline_compiles.max_ns, duration_ns);
+  }
+
+  std::vector<Frame> frames;
+  PipelineCompileTotals pipeline_compiles;
+};
+
+bool IsPipelineCreation(std::string_view event_name) {
+  return event_name == "create_graphics_pipelines" ||
+         event_name == "create_compute_pipelines";
+}
+
+// Splits the CSV |line| into |cells|. Quoted cells, such as the arrays of
+// hashes, may contain commas, and are returned without the quotes. The layers
+// never log quotes within cells.
+void SplitCsvLine(std::string_view line, std::vector<std::string_view>* cells) {
+  cells->clear();
+  size_t begin = 0;
+  while (begin <= line.size()) {
+    size_t end = 0;
+    if (begin < line.size() && line[begin] == '"') {
+      const size_t quote = line.find('"', begin + 1);
+      const size_t cell_end =
+          quote == std::string_view::npos ? line.size() : quote;
+      cells->push_back(line.substr(begin + 1, cell_end - begin - 1));
+      end = line.find(',', cell_end);
+    } else {
+      end = line.find(',', begin);
+      cells->push_back(line.substr(begin, end == std::string_view::npos
+                                              ? std::string_view::npos
+                                              : end - begin));
+    }
+    if (end == std::string_view::npos) {
+      break;
+    }
+    begin = end + 1;
+  }
+}
+
+enum class CsvLogKind { kFrameTime, kCompileTime, kEvents };
+
+// Adds the values of one line of a CSV log of |kind| to |contents|. Returns
+// false if the line cannot be parsed.
+bool ReadCsvCells(CsvLogKind kind, const std::vector<std::string_view>& cells,
+                  LogContents* contents) {
+  switch (kind) {
+    case CsvLogKind::kFrameTime: {
+      LogContents::Frame frame = {};
+      if (cells.size() != 2 || !absl::SimpleAtoi(cells[0], &frame.time_ns) ||
+          !absl::SimpleAtoi(cells[1], &frame.state)) {
+        return false;
+      }
+      contents->frames.push_back(frame);
+      return true;
+    }
+    case CsvLogKind::kCompileTime: {
+      int64_t duration_ns = 0;
+      if (cells.size() < 2 || !absl::SimpleAtoi(cells[1], &duration_ns)) {
+        return false;
+      }
+      contents->AddPipelineCompile(duration_ns);
+      return true;
+    }
+    case CsvLogKind::kEvents:
+      break;
+  }
+
+  // Event log lines are the event name, the timestamp, and the values.
+  if (cells.size() < 2) {
+    return false;
+  }
+  if (cells[0] == kFramePresentEvent) {
+    LogContents::Frame frame = {};
+    if (cells.size() < 4 || !absl::SimpleAtoi(cells[2], &frame.time_ns) ||
+        !absl::SimpleAtoi(cells[3], &frame.state)) {
+      return false;
+    }
+    contents->frames.push_back(frame);
+  } else if (IsPipelineCreation(cells[0])) {
+    int64_t duration_ns = 0;
+    if (cells.size() < 4 || !absl::SimpleAtoi(cells[3], &duration_ns)) {
+      return false;
+    }
+    contents->AddPipelineCompile(duration_ns);
+  }
+  return true;
+}
+
+absl::Status ReadCsvLog(std::string_view data, LogContents* contents) {
+  CsvLogKind kind = CsvLogKind::kEvents;
+  std::vector<std::string_view> cells;
+  size_t line_number = 0;
+  for (size_t begin = 0; begin < data.size();) {
+    size_t end = data.find('\n', begin);
+    const bool terminated = end != std::string_view::npos;
+    if (!terminated) {
+      end = data.size();
+    }
+    std::string_view line = data.substr(begin, end - begin);
+    begin = end + 1;
+    ++line_number;
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+
+    if (line_number == 1) {
+      if (line == kFrameTimeHeader) {
+        kind = CsvLogKind::kFrameTime;
+        continue;
+      }
+      if (line.substr(0, kCompileTimeHeaderPrefix.size()) ==
+          kCompileTimeHeaderPrefix) {
+        kind = CsvLogKind::kCompileTime;
+        continue;
+      }
+    }
+    if (line.empty()) {
+      continue;
+    }
+    SplitCsvLine(line, &cells);
+    // The last line may have been cut short by the termination of the
+    // application.
+    if (!ReadCsvCells(kind, cells, contents) && terminated) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Cannot parse line ", line_number, ": ", line));
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Returns the value named |name| of |event|, or nullptr if there is none.
+const DecodedValue* FindValue(const DecodedEvent& event,
+                              std::string_view name) {
+  for (const DecodedValue& value : event.values) {
+    if (value.name == name) {
+      return &value;
+    }
+  }
+  return nullptr;
+}
+
+absl::Status ReadBinaryLog(std::string_view data, LogContents* contents) {
+  absl::StatusOr<BinaryLogDecoder> decoder = BinaryLogDecoder::Create(data);
+  if (!decoder.ok()) {
+    return decoder.status();
+  }
+  DecodedEvent event;
+  while (true) {
+    absl::StatusOr<bool> decoded = decoder->Next(&event);
+    if (!decoded.ok()) {
+      SPL_LOG(WARNING) << decoded.status() << ", dropping the last record.";
+      break;
+    }
+    if (!*decoded) {
+      break;
+    }
+    if (event.name == kFramePresentEvent) {
+      const DecodedValue* frame_time = FindValue(event, "frame_time");
+      const DecodedValue* started = FindValue(event, "started");
+      if (frame_time) {
+        contents->frames.push_back(
+            {frame_time->int64_value, started ? started->int64_value : 0});
+      }
+    } else if (IsPipelineCreation(event.name)) {
+      if (const DecodedValue* duration = FindValue(event, "duration")) {
+        contents->AddPipelineCompile(duration->int64_value);
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Returns the frames of |frames| selected by |options|, in the same way as
+// scripts/analyze_frametimes.py.
+std::vector<LogContents::Frame> SelectFrames(
+    const std::vector<LogContents::Frame>& frames,
+    const LogAnalysisOptions& options) {
+  std::vector<LogContents::Frame> selected;
+  selected.reserve(frames.size());
+  for (const LogContents::Frame& frame : frames) {
+    if (!options.gameplay_state || frame.state == *options.gameplay_state) {
+      selected.push_back(frame);
+    }
+  }
+
+  if (options.drop_front_s) {
+    // Drops the frames that end before the dropped time.
+    const double drop_ns = *options.drop_front_s * kNanosPerSecond;
+    int64_t duration_ns = 0;
+    auto first_kept = selected.begin();
+    for (; first_kept != selected.end(); ++first_kept) {
+      duration_ns += first_kept->time_ns;
+      if (duration_ns >= drop_ns) {
+        break;
+      }
+    }
+    selected.erase(selected.begin(), first_kept);
+  }
+
+  if (options.duration_s) {
+    // Keeps the frames up to the first one that ends after the duration.
+    const double target_ns = *options.duration_s * kNanosPerSecond;
+    int64_t duration_ns = 0;
+    auto first_discarded = selected.begin();
+    while (first_discarded != selected.end()) {
+      duration_ns += first_discarded->time_ns;
+      ++first_discarded;
+      if (duration_ns > target_ns) {
+        break;
+      }
+    }
+    selected.erase(first_discarded, selected.end());
+  }
+  return selected;
+}
+
+// Returns the |percentile| of the sorted |values|, interpolated linearly
+// between the closest ranks like numpy.percentile.
+double Percentile(const std::vector<int64_t>& values, double percentile) {
+  const double rank = percentile / 100 * (values.size() - 1);
+  const size_t lower = static_cast<size_t>(rank);
+  const size_t upper = std::min(lower + 1, values.size() - 1);
+  const double fraction = rank - lower;
+  return values[lower] + (values[upper] - values[lower]) * fraction;
+}
+
+LogSummary Summarize(const LogContents& contents,
+                     const LogAnalysisOptions& options) {
+  LogSummary summary;
+  summary.pipeline_compiles = contents.pipeline_compiles;
+  for (const LogContents::Frame& frame : contents.frames) {
+    summary.state_duration_ns[frame.state] += frame.time_ns;
+  }
+
+  const std::vector<LogContents::Frame> frames =
+      SelectFrames(contents.frames, options);
+  if (frames.empty()) {
+    return summary;
+  }
+
+  std::vector<int64_t> frame_times;
+  frame_times.reserve(frames.size());
+  const double target_frame_time_ns = kNanosPerSecond / options.target_fps;
+  uint64_t missed_frames = 0;
+  for (const LogContents::Frame& frame : frames) {
+    frame_times.push_back(frame.time_ns);
+    summary.total_duration_ns += frame.time_ns;
+    if (frame.time_ns > target_frame_time_ns) {
+      ++missed_frames;
+    }
+  }
+  summary.frame_count = frames.size();
+  summary.average_frame_time_ns =
+      static_cast<double>(summary.total_duration_ns) / frames.size();
+  summary.missed_frames_percent = 100.0 * missed_frames / frames.size();
+
+  std::sort(frame_times.begin(), frame_times.end());
+  summary.percentile_frame_time_ns.reserve(100);
+  for (int percentile = 0; percentile != 100; ++percentile) {
+    summary.percentile_frame_time_ns.push_back(
+        Percentile(frame_times, percentile));
+  }
+
+  // One bin per started second, holding the state of its last frame.
+  summary.fps_over_time.resize(
+      static_cast<size_t>(summary.total_duration_ns / kNanosPerSecond) + 1);
+  int64_t elapsed_ns = 0;
+  for (const LogContents::Frame& frame : frames) {
+    elapsed_ns += frame.time_ns;
+    const size_t second = std::min(
+        static_cast<size_t>(std::max<int64_t>(elapsed_ns, 0) / kNanosPerSecond),
+        summary.fps_over_time.size() - 1);
+    ++summary.fps_over_time[second].frames;
+    summary.fps_over_time[second].state = frame.state;
+  }
+  return summary;
+}
+
+void AppendJsonString(std::string_view value, std::string* out) {
+  out->push_back('"');
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      absl::StrAppendFormat(out, "\\u%04x", static_cast<int>(c));
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+void AppendCsvString(std::string_view value, std::string* out) {
+  out->push_back('"');
+  for (char c : value) {
+    if (c == '"') {
+      out->push_back('"');
+    }
+    out->push_back(c);
+  }
+  out->push_back('"');
+}
+
+void AppendMillis(double nanos, std::string* out) {
+  absl::StrAppendFormat(out, "%.6f", nanos / kNanosPerMilli);
+}
+
+// Returns the |percentile| of the frame times of |summary|, or 0 if there are
+// no frames.
+double GetPercentile(const LogSummary& summary, int percentile) {
+  return summary.percentile_frame_time_ns.empty()
+             ? 0
+             : summary.percentile_frame_time_ns[percentile];
+}
+}  // namespace
+
+absl::StatusOr<LogSummary> AnalyzeLog(std::string_view data,
+                                      const LogAnalysisOptions& options) {
+  LogContents contents;
+  const absl::Status status =
+      data.substr(0, sizeof(kBinaryLogMagic) - 1) == kBinaryLogMagic
+          ? ReadBinaryLog(data, &contents)
+          : ReadCsvLog(data, &contents);
+  if (!status.ok()) {
+    return status;
+  }
+  return Summarize(contents, options);
+}
+
+absl::StatusOr<LogSummary> AnalyzeLogFile(const std::string& path,
+                                          const LogAnalysisOptions& options) {
+  absl::StatusOr<InputBuffer> buffer = InputBuffer::Create(path);
+  if (!buffer.ok()) {
+    return buffer.status();
+  }
+  buffer->Prefetch();
+  absl::Span<const uint8_t> data = buffer->GetBuffer();
+  return AnalyzeLog(
+      std::string_view(reinterpret_cast<const char*>(data.data()), data.size()),
+      options);
+}
+
+std::vector<absl::StatusOr<LogSummary>> AnalyzeLogFiles(
+    const std::vector<std::string>& paths, const LogAnalysisOptions& options,
+    uint32_t thread_count) {
+  std::vector<absl::StatusOr<LogSummary>> summaries(paths.size());
+  if (paths.empty()) {
+    return summaries;
+  }
+  // Each thread takes the next file until all of them are taken. A file is
+  // analyzed by a single thread, as the selected frames depend on all the
+  // frames before them.
+  std::atomic<size_t> next_path = 0;
+  auto analyze = [&] {
+    for (size_t i = next_path++; i < paths.size(); i = next_path++) {
+      summaries[i] = AnalyzeLogFile(paths[i], options);
+    }
+  };
+  thread_count = std::clamp(thread_count, uint32_t{1},
+                            static_cast<uint32_t>(paths.size()));
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    threads.emplace_back(analyze);
+  }
+  analyze();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return summaries;
+}
+
+void AppendLogSummaryJson(std::string_view dataset, std::string_view path,
+                          const LogSummary& summary, std::string* out) {
+  out->append("{\"dataset\":");
+  AppendJsonString(dataset, out);
+  out->append(",\"path\":");
+  AppendJsonString(path, out);
+  absl::StrAppend(out, ",\"frames\":", summary.frame_count,
+                  ",\"duration_ms\":");
+  AppendMillis(summary.total_duration_ns, out);
+  out->append(",\"average_frame_time_ms\":");
+  AppendMillis(summary.average_frame_time_ns, out);
+  out->append(",\"percentile_frame_time_ms\":[");
+  for (size_t i = 0; i != summary.percentile_frame_time_ns.size(); ++i) {
+    if (i != 0) out->push_back(',');
+    AppendMillis(summary.percentile_frame_time_ns[i], out);
+  }
+  absl::StrAppendFormat(out, "],\"missed_frames_percent\":%.6f",
+                        summary.missed_frames_percent);
+  out->append(",\"state_duration_ms\":{");
+  for (auto it = summary.state_duration_ns.begin();
+       it != summary.state_duration_ns.end(); ++it) {
+    if (it != summary.state_duration_ns.begin()) out->push_back(',');
+    absl::StrAppend(out, "\"", it->first, "\":");
+    AppendMillis(it->second, out);
+  }
+  out->append("},\"fps_over_time\":[");
+  for (size_t i = 0; i != summary.fps_over_time.size(); ++i) {
+    if (i != 0) out->push_back(',');
+    absl::StrAppend(out, "[", summary.fps_over_time[i].frames, ",",
+                    summary.fps_over_time[i].state, "]");
+  }
+  const PipelineCompileTotals& compiles = summary.pipeline_compiles;
+  absl::StrAppend(out, "],\"pipeline_compiles\":{\"calls\":", compiles.calls,
+                  ",\"total_ms\":");
+  AppendMillis(compiles.total_ns, out);
+  out->append(",\"max_ms\":");
+  AppendMillis(compiles.max_ns, out);
+  out->append("}}");
+}
+
+void AppendLogSummaryCsv(std::string_view dataset, std::string_view path,
+                         const LogSummary& summary, std::string* out) {
+  AppendCsvString(dataset, out);
+  out->push_back(',');
+  AppendCsvString(path, out);
+  absl::StrAppend(out, ",", summary.frame_count, ",");
+  for (double nanos :
+       {static_cast<double>(summary.total_duration_ns),
+        summary.average_frame_time_ns, GetPercentile(summary, 50),
+        GetPercentile(summary, 90), GetPercentile(summary, 95),
+        GetPercentile(summary, 99)}) {
+    AppendMillis(nanos, out);
+    out->push_back(',');
+  }
+  absl::StrAppendFormat(out, "%.6f,%d,", summary.missed_frames_percent,
+                        summary.pipeline_compiles.calls);
+  AppendMillis(summary.pipeline_compiles.total_ns, out);
+  out->push_back(',');
+  AppendMillis(summary.pipeline_compiles.max_ns, out);
+}
+
+}  // namespace performancelayers
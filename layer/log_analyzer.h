@@ -0,0 +1,110 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_LOG_ANALYZER_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_LOG_ANALYZER_H_
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+namespace performancelayers {
+
+// Selects the frames that the frame time statistics of a log are computed
+// over, like the options of scripts/analyze_frametimes.py.
+struct LogAnalysisOptions {
+  // Only the frames in this benchmark state, if set.
+  std::optional<int64_t> gameplay_state;
+  // Discards the frames after this many seconds, if set.
+  std::optional<double> duration_s;
+  // Discards the frames of this many initial seconds, if set.
+  std::optional<double> drop_front_s;
+  // Frames longer than 1/|target_fps| seconds are missed.
+  double target_fps = 45;
+};
+
+// The frames presented during one second of a log.
+struct FramesInSecond {
+  uint64_t frames = 0;
+  // The benchmark state of the last frame of the second.
+  int64_t state = 0;
+};
+
+// The pipeline creation calls of a log.
+struct PipelineCompileTotals {
+  uint64_t calls = 0;
+  int64_t total_ns = 0;
+  int64_t max_ns = 0;
+};
+
+// The summary of a frame time, compile time, or event log.
+struct LogSummary {
+  // The number of frames the frame time statistics are computed over.
+  uint64_t frame_count = 0;
+  int64_t total_duration_ns = 0;
+  double average_frame_time_ns = 0;
+  // The 0th to the 99th percentile of the frame times, interpolated linearly
+  // like numpy.percentile. Empty if there are no frames.
+  std::vector<double> percentile_frame_time_ns;
+  double missed_frames_percent = 0;
+  // The total time spent in each benchmark state, over all the frames of the
+  // log regardless of the options.
+  std::map<int64_t, int64_t> state_duration_ns;
+  std::vector<FramesInSecond> fps_over_time;
+  PipelineCompileTotals pipeline_compiles;
+};
+
+// Summarizes the log in |data|. The log is either a binary log, or a CSV log
+// told apart by its header: a frame time log, a compile time log, or else an
+// event log with the event name and timestamp in front of each line. Returns
+// an error if a CSV line cannot be parsed. Like scripts/binary_log.py, binary
+// logs are read up to the first record that cannot be decoded, which is
+// usually a record cut short by the termination of the application.
+absl::StatusOr<LogSummary> AnalyzeLog(std::string_view data,
+                                      const LogAnalysisOptions& options);
+
+// Summarizes the log file at |path|, which is memory-mapped where supported.
+absl::StatusOr<LogSummary> AnalyzeLogFile(const std::string& path,
+                                          const LogAnalysisOptions& options);
+
+// Summarizes the log files at |paths| on up to |thread_count| threads. Returns
+// the summaries in the order of |paths|.
+std::vector<absl::StatusOr<LogSummary>> AnalyzeLogFiles(
+    const std::vector<std::string>& paths, const LogAnalysisOptions& options,
+    uint32_t thread_count);
+
+// Appends |summary| to |out| as a JSON object, with the durations in
+// milliseconds. |dataset| and |path| are included as strings.
+void AppendLogSummaryJson(std::string_view dataset, std::string_view path,
+                          const LogSummary& summary, std::string* out);
+
+// The header of the lines of |AppendLogSummaryCsv|.
+inline constexpr char kLogSummaryCsvHeader[] =
+    "Dataset,Path,Frames,Duration (ms),Average (ms),Median (ms),P90 (ms),P95 "
+    "(ms),P99 (ms),Missed Frames (%),Pipeline Compiles,Pipeline Compile Time "
+    "(ms),Max Pipeline Compile Time (ms)";
+
+// Appends the scalar values of |summary| to |out| as a CSV line, without the
+// line break. |dataset| and |path| are quoted.
+void AppendLogSummaryCsv(std::string_view dataset, std::string_view path,
+                         const LogSummary& summary, std::string* out);
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_LOG_ANALYZER_H_
@@ -17,7 +17,6 @@
 #include <algorithm>
 #include <cassert>
 
-#include "absl/strings/match.h"
 #include "debug_logging.h"
 
 namespace performancelayers {
@@ -33,20 +32,42 @@ std::optional<LogScanner> LogScanner::FromFilename(
   return LogScanner(std::move(file));
 }
 
+void LogScanner::RegisterWatchedPattern(const std::string& pattern) {
+  if (!pattern_to_line_num_.try_emplace(pattern, 0).second) return;
+  patterns_.push_back(pattern);
+  matcher_.reset();
+}
+
 bool LogScanner::ConsumeNewLines() {
-  if (!file_.is_open() || pattern_to_line_num_.empty()) return false;
+  if (!file_.is_open() || patterns_.empty()) return false;
+
+  if (!matcher_) {
+    matcher_.emplace(patterns_);
+    matcher_state_ = PatternMatcher::kInitialState;
+  }
+  read_buffer_.resize(kReadSize);
 
   bool new_patterns_found = false;
-  std::string buffer;
-  while (std::getline(file_, buffer)) {
-    ++current_line_num_;
-
-    for (auto& pattern_to_line_pair : pattern_to_line_num_)
-      if (pattern_to_line_pair.second == 0 &&
-          absl::StrContains(buffer, pattern_to_line_pair.first)) {
-        pattern_to_line_pair.second = current_line_num_;
-        new_patterns_found = true;
+  while (file_.read(read_buffer_.data(), read_buffer_.size()) ||
+         file_.gcount() > 0) {
+    const size_t size = static_cast<size_t>(file_.gcount());
+    for (size_t i = 0; i != size; ++i) {
+      const char c = read_buffer_[i];
+      if (c == '\n') {
+        ++current_line_num_;
+        matcher_state_ = PatternMatcher::kInitialState;
+        continue;
+      }
+      matcher_state_ = matcher_->Next(matcher_state_, c);
+      for (uint32_t pattern_index : matcher_->GetMatches(matcher_state_)) {
+        uint64_t& line_num = pattern_to_line_num_[patterns_[pattern_index]];
+        if (line_num == 0) {
+          line_num = current_line_num_ + 1;
+          ++seen_pattern_count_;
+          new_patterns_found = true;
+        }
       }
+    }
   }
 
   if (file_.eof()) file_.clear();
@@ -77,4 +98,43 @@ std::vector<LogScanner::PatternLineNumPair> LogScanner::GetSeenPatterns()
   return seen_patterns;
 }
 
+LogWatcher::LogWatcher(LogScanner scanner, absl::Duration poll_interval)
+    : poll_interval_(poll_interval), scanner_(std::move(scanner)) {
+  watcher_ = std::thread([this] { RunWatcher(); });
+}
+
+LogWatcher::~LogWatcher() {
+  {
+    absl::MutexLock lock(&state_lock_);
+    stop_ = true;
+  }
+  watcher_.join();
+}
+
+std::vector<LogScanner::PatternLineNumPair> LogWatcher::GetSeenPatterns()
+    const {
+  absl::MutexLock lock(&scanner_lock_);
+  return scanner_.GetSeenPatterns();
+}
+
+void LogWatcher::RunWatcher() {
+  while (true) {
+    {
+      absl::MutexLock lock(&scanner_lock_);
+      if (scanner_.ConsumeNewLines()) {
+        seen_pattern_count_.store(scanner_.GetSeenPatternCount(),
+                                  std::memory_order_release);
+      }
+      if (scanner_.GetSeenPatternCount() == scanner_.GetPatternCount()) {
+        return;
+      }
+    }
+    absl::MutexLock lock(&state_lock_);
+    if (state_lock_.AwaitWithTimeout(
+            absl::Condition(this, &LogWatcher::ShouldStop), poll_interval_)) {
+      return;
+    }
+  }
+}
+
 }  // namespace performancelayers
@@ -15,18 +15,26 @@
 #ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_LOG_SCANNER_H_
 #define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_LOG_SCANNER_H_
 
+#include <atomic>
 #include <cstdint>
 #include <fstream>
 #include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "pattern_matcher.h"
 
 namespace performancelayers {
 
 // Scans files looking for registered patterns. Assumes that log files will
 // be appended to, but not modified in the middle.
+//
+// The file is read in large chunks and all the patterns are matched in a
+// single pass over each chunk, without copying the lines.
 class LogScanner {
  public:
   // Opens |filename| and returns a LogScanner object on success,
@@ -40,10 +48,8 @@ class LogScanner {
 
   // Registers |pattern| as a watched pattern. No-op if pattern has
   // already been registered.
-  // Patterns are matched using exact (full) maching only.
-  void RegisterWatchedPattern(const std::string& pattern) {
-    pattern_to_line_num_.try_emplace(pattern, 0);
-  }
+  // Patterns are matched using exact (full) maching only, within a line.
+  void RegisterWatchedPattern(const std::string& pattern);
 
   // Returns the first line where |pattern| was seen, or 0 if not seen yet.
   uint64_t GetFirstOccurrenceLineNum(const std::string& pattern) const;
@@ -52,11 +58,72 @@ class LogScanner {
   // Returns all seen patterns, sorted by the line of occurrence in asc. order.
   std::vector<PatternLineNumPair> GetSeenPatterns() const;
 
+  // Returns the number of registered patterns, and of those seen so far.
+  size_t GetPatternCount() const { return patterns_.size(); }
+  size_t GetSeenPatternCount() const { return seen_pattern_count_; }
+
  private:
+  static constexpr size_t kReadSize = 64 * 1024;
+
   LogScanner(std::ifstream file) : file_(std::move(file)) {}
   std::ifstream file_;
+  // The number of newlines read so far.
   uint64_t current_line_num_ = 0;
   absl::flat_hash_map<std::string, uint64_t> pattern_to_line_num_;
+
+  // The registered patterns, in the order of the matcher.
+  std::vector<std::string> patterns_;
+  size_t seen_pattern_count_ = 0;
+  // Rebuilt when the patterns change. The state is kept across calls to
+  // |ConsumeNewLines|, so that patterns are found in lines that were being
+  // written while the file was last read.
+  std::optional<PatternMatcher> matcher_;
+  PatternMatcher::State matcher_state_ = PatternMatcher::kInitialState;
+  std::string read_buffer_;
+};
+
+// Scans a log file for its patterns from a background thread, every
+// |poll_interval|, so that checking for the patterns never waits for the file.
+// The thread stops polling once all the patterns are seen.
+//
+// This class is thread safe.
+class LogWatcher {
+ public:
+  LogWatcher(LogScanner scanner, absl::Duration poll_interval);
+
+  LogWatcher(const LogWatcher&) = delete;
+  LogWatcher& operator=(const LogWatcher&) = delete;
+
+  // Stops the background thread.
+  ~LogWatcher();
+
+  // Returns the number of patterns seen so far. Never blocks, so it can be
+  // polled on every frame, and only once it changes do the seen patterns need
+  // to be queried.
+  size_t GetSeenPatternCount() const {
+    return seen_pattern_count_.load(std::memory_order_acquire);
+  }
+
+  // Returns all seen patterns, sorted by the line of occurrence in asc. order.
+  std::vector<LogScanner::PatternLineNumPair> GetSeenPatterns() const;
+
+ private:
+  // The body of the background thread.
+  void RunWatcher();
+
+  bool ShouldStop() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(state_lock_) {
+    return stop_;
+  }
+
+  const absl::Duration poll_interval_;
+
+  mutable absl::Mutex scanner_lock_;
+  LogScanner scanner_ ABSL_GUARDED_BY(scanner_lock_);
+  std::atomic<size_t> seen_pattern_count_ = 0;
+
+  absl::Mutex state_lock_;
+  bool stop_ ABSL_GUARDED_BY(state_lock_) = false;
+  std::thread watcher_;
 };
 }  // namespace performancelayers
 
@@ -0,0 +1,143 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_MEMORY_USAGE_EVENTS_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_MEMORY_USAGE_EVENTS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "event_logging.h"
+#include "memory_usage_tracker.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// An event that holds memory allocation information (current and peak
+// allocated, the number of allocations and frees since the previous event, and
+// the usage of the heaps and memory types of a device) and can be logged both
+// in the private and common files. The per-heap and per-memory-type values
+// are lists of numbers separated by ';', with the VkMemoryHeapFlags of each
+// heap in `heap_flags`. The heap budget and usage reported by
+// VK_EXT_memory_budget are empty when the extension is not supported.
+//
+// The event is logged every frame, so it is reused with |Update|, which keeps
+// the memory of the lists.
+class MemoryUsageEvent : public Event {
+ public:
+  MemoryUsageEvent()
+      : Event("memory_usage", LogLevel::kHigh),
+        current_({"current", 0}),
+        peak_({"peak", 0}),
+        allocations_({"allocations", 0}),
+        frees_({"frees", 0}),
+        heap_flags_({"heap_flags", ""}),
+        heap_current_({"heap_current", ""}),
+        heap_peak_({"heap_peak", ""}),
+        heap_budget_({"heap_budget", ""}),
+        heap_usage_({"heap_usage", ""}),
+        memory_type_current_({"memory_type_current", ""}),
+        allocation_sizes_({"allocation_sizes", ""}) {
+    InitAttributes({&current_, &peak_, &allocations_, &frees_, &heap_flags_,
+                    &heap_current_, &heap_peak_, &heap_budget_, &heap_usage_,
+                    &memory_type_current_, &allocation_sizes_});
+  }
+
+  // Sets the name and the values of the event.
+  void Update(const char* name, int64_t current, int64_t peak,
+              const MemoryChurn& churn, const DeviceMemoryUsage& usage,
+              const VkPhysicalDeviceMemoryBudgetPropertiesEXT* budget) {
+    SetEventName(name);
+    *current_.MutableValue() = current;
+    *peak_.MutableValue() = peak;
+    *allocations_.MutableValue() = static_cast<int64_t>(churn.allocations);
+    *frees_.MutableValue() = static_cast<int64_t>(churn.frees);
+    SetHeapValues(usage, &MemoryHeapUsage::flags, &heap_flags_);
+    SetHeapValues(usage, &MemoryHeapUsage::current, &heap_current_);
+    SetHeapValues(usage, &MemoryHeapUsage::peak, &heap_peak_);
+    SetBudgetValues(usage, budget ? budget->heapBudget : nullptr,
+                    &heap_budget_);
+    SetBudgetValues(usage, budget ? budget->heapUsage : nullptr, &heap_usage_);
+    std::string* types = memory_type_current_.MutableValue();
+    types->clear();
+    AppendValues(usage.GetMemoryTypeCurrent(), types);
+    std::string* sizes = allocation_sizes_.MutableValue();
+    sizes->clear();
+    AppendSizeHistogram(usage.size_histogram, sizes);
+  }
+
+ private:
+  // Appends the non-empty buckets of |size_histogram| to |out| as
+  // "<bucket lower bound>:<allocation count>" pairs separated by ';'.
+  static void AppendSizeHistogram(absl::Span<const uint64_t> size_histogram,
+                                  std::string* out) {
+    bool first = true;
+    for (size_t bucket = 0, e = size_histogram.size(); bucket != e; ++bucket) {
+      if (size_histogram[bucket] == 0) continue;
+      absl::StrAppend(out, first ? "" : ";", uint64_t(1) << bucket, ":",
+                      size_histogram[bucket]);
+      first = false;
+    }
+  }
+
+  // Appends |values| to |out|, separated by ';'.
+  template <typename T>
+  static void AppendValues(absl::Span<const T> values, std::string* out) {
+    for (size_t i = 0, e = values.size(); i != e; ++i) {
+      absl::StrAppend(out, i == 0 ? "" : ";", values[i]);
+    }
+  }
+
+  // Sets |attr| to the |value| of each heap of |usage|.
+  template <typename T>
+  static void SetHeapValues(const DeviceMemoryUsage& usage,
+                            T MemoryHeapUsage::*value, StringAttr* attr) {
+    std::string* out = attr->MutableValue();
+    out->clear();
+    absl::Span<const MemoryHeapUsage> heaps = usage.GetHeaps();
+    for (size_t i = 0, e = heaps.size(); i != e; ++i) {
+      absl::StrAppend(out, i == 0 ? "" : ";", heaps[i].*value);
+    }
+  }
+
+  // Sets |attr| to the first |usage.heap_count| entries of |values|, or to an
+  // empty string if |values| is null.
+  static void SetBudgetValues(const DeviceMemoryUsage& usage,
+                              const VkDeviceSize* values, StringAttr* attr) {
+    std::string* out = attr->MutableValue();
+    out->clear();
+    if (values) {
+      AppendValues(absl::MakeConstSpan(values, usage.heap_count), out);
+    }
+  }
+
+  Int64Attr current_;
+  Int64Attr peak_;
+  Int64Attr allocations_;
+  Int64Attr frees_;
+  StringAttr heap_flags_;
+  StringAttr heap_current_;
+  StringAttr heap_peak_;
+  StringAttr heap_budget_;
+  StringAttr heap_usage_;
+  StringAttr memory_type_current_;
+  StringAttr allocation_sizes_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_MEMORY_USAGE_EVENTS_H_
@@ -15,13 +15,20 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <string>
 #include <vector>
 
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+
+#include "capture_window.h"
 #include "csv_logging.h"
 #include "debug_logging.h"
 #include "event_logging.h"
 #include "layer_data.h"
 #include "layer_utils.h"
+#include "memory_usage_events.h"
+#include "memory_usage_tracker.h"
 
 namespace performancelayers {
 namespace {
@@ -34,82 +41,78 @@ constexpr char kLayerName[] = "VK_LAYER_STADIA_memory_usage";
 constexpr char kLayerDescription[] = "Stadia Memory Usage Measuring Layer";
 constexpr char kLogFilenameEnvVar[] = "VK_MEMORY_USAGE_LOG";
 
-// An event that holds memory allocation information (current and peak
-// allocated) and can be logged both in the private and common files.
-class MemoryUsageEvent : public Event {
- public:
-  MemoryUsageEvent(const char* name, int64_t current, int64_t peak)
-      : Event(name, LogLevel::kHigh),
-        current_({"current", current}),
-        peak_({"peak", peak}) {
-    InitAttributes({&current_, &peak_});
-  }
-
- private:
-  Int64Attr current_;
-  Int64Attr peak_;
-};
-
 class MemoryUsageLayerData : public LayerDataWithEventLogger {
  public:
   explicit MemoryUsageLayerData(char* log_filename)
-      : LayerDataWithEventLogger(log_filename,
-                                 "Current (bytes), peak (bytes)") {
+      : LayerDataWithEventLogger(
+            log_filename,
+            "Current (bytes), peak (bytes), allocations, frees, heap flags, "
+            "heap current (bytes), heap peak (bytes), heap budget (bytes), "
+            "heap usage (bytes), memory type current (bytes), allocation "
+            "sizes") {
     LogEventOnly("memory_usage_layer_init");
   }
 
-  void RecordAllocateMemory(VkDevice device, VkDeviceMemory memory,
-                            VkDeviceSize size) {
-    absl::MutexLock lock(&memory_hash_lock_);
-    bool inserted;
-    std::tie(std::ignore, inserted) =
-        memory_hash_map_.try_emplace({device, memory}, size);
-    assert(inserted);
-    current_allocation_size_ += size;
-    peak_allocation_size_ =
-        std::max(peak_allocation_size_, current_allocation_size_);
+  MemoryUsageTracker& GetTracker() { return tracker_; }
+
+  // Starts tracking the memory of |device|, created on |physical_device|.
+  void AddMemoryDevice(VkPhysicalDevice physical_device, VkDevice device) {
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+    if (auto get_memory_properties = GetNextInstanceProcAddrOrNull(
+            physical_device,
+            &VkLayerInstanceDispatchTable::GetPhysicalDeviceMemoryProperties)) {
+      get_memory_properties(physical_device, &memory_properties);
+    }
+    tracker_.AddDevice(device, memory_properties);
+    if (IsDeviceExtensionSupported(physical_device,
+                                   VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+      budget_devices_.Insert(device, physical_device);
+    }
   }
 
-  void RecordFreeMemory(VkDevice device, VkDeviceMemory memory) {
-    absl::MutexLock lock(&memory_hash_lock_);
-    auto it = memory_hash_map_.find({device, memory});
-    assert(it != memory_hash_map_.end());
-    VkDeviceSize size = it->second;
-    memory_hash_map_.erase(it);
+  // Stops tracking the memory of |device|.
+  void RemoveMemoryDevice(VkDevice device) {
+    tracker_.RecordDestroyDevice(device);
+    budget_devices_.Erase(device);
+  }
 
-    assert(size <= current_allocation_size_);
-    current_allocation_size_ -= size;
+  // Logs the memory usage of all devices, with the heaps and memory types of
+  // |device| in detail. |usage| is the usage of |device|.
+  void LogMemoryUsage(const char* event_name, VkDevice device,
+                      const DeviceMemoryUsage& usage) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+    const bool has_budget = QueryMemoryBudget(device, &budget);
+    // Reused, so that logging every frame does not allocate.
+    thread_local MemoryUsageEvent event;
+    thread_local std::string csv_line;
+    event.Update(event_name, tracker_.GetCurrentAllocationSize(),
+                 tracker_.GetPeakAllocationSize(), tracker_.TakeChurn(), usage,
+                 has_budget ? &budget : nullptr);
+    csv_line.clear();
+    AppendEventToCSV(event, &csv_line);
+    LogEventOnly(event_name, csv_line);
+    LogEvent(&event);
   }
 
-  void RecordDestroyDeviceMemory(VkDevice device) {
-    absl::MutexLock lock(&memory_hash_lock_);
-    VkDeviceSize size = 0;
-    for (auto it = memory_hash_map_.begin(); it != memory_hash_map_.end();
-         ++it) {
-      if (it->first.first == device) {
-        size += it->second;
-        // Note that absl::flat_hash_map does not invalidate iterators on erase.
-        memory_hash_map_.erase(it);
-      }
+ private:
+  // Queries the memory budget of the physical device of |device| with
+  // VK_EXT_memory_budget. Returns false if it is not supported.
+  bool QueryMemoryBudget(VkDevice device,
+                         VkPhysicalDeviceMemoryBudgetPropertiesEXT* budget) {
+    const VkPhysicalDevice* physical_device = budget_devices_.Find(device);
+    if (!physical_device) {
+      return false;
     }
-    assert(size <= current_allocation_size_);
-    current_allocation_size_ -= size;
+    VkPhysicalDeviceMemoryProperties2 properties = {
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2};
+    properties.pNext = budget;
+    return GetPhysicalDeviceMemoryProperties2(*physical_device, &properties);
   }
 
-  uint64_t GetPeakAllocationSize() const { return peak_allocation_size_; }
-
-  uint64_t GetCurrentAllocationSize() const { return current_allocation_size_; }
-
- private:
-  mutable absl::Mutex memory_hash_lock_;
-  // The map from device, memory tuple to its allocation size. TODO: Should be a
-  // two-level map, so that per-device data can be purged easily on
-  // DestroyDevice.
-  absl::flat_hash_map<std::pair<VkDevice, VkDeviceMemory>, VkDeviceSize>
-      memory_hash_map_ ABSL_GUARDED_BY(memory_hash_lock_);
-
-  VkDeviceSize current_allocation_size_ ABSL_GUARDED_BY(memory_hash_lock_) = 0;
-  VkDeviceSize peak_allocation_size_ ABSL_GUARDED_BY(memory_hash_lock_) = 0;
+  MemoryUsageTracker tracker_;
+  // The physical devices of the devices that support VK_EXT_memory_budget.
+  CopyOnWriteMap<VkDevice, VkPhysicalDevice> budget_devices_;
 };
 
 MemoryUsageLayerData* GetLayerData() {
@@ -145,8 +148,14 @@ SPL_MEMORY_USAGE_LAYER_FUNC(VkResult, CreateDevice,
     SPL_DISPATCH_DEVICE_FUNC(QueuePresentKHR);
     return dispatch_table;
   };
-  return GetLayerData()->CreateDevice(physical_device, create_info, allocator,
-                                      device, build_dispatch_table);
+  MemoryUsageLayerData* layer_data = GetLayerData();
+  VkResult result =
+      layer_data->CreateDevice(physical_device, create_info, allocator, device,
+                               build_dispatch_table);
+  if (result == VK_SUCCESS) {
+    layer_data->AddMemoryDevice(physical_device, *device);
+  }
+  return result;
 }
 
 // Override for vkDestroyInstance.  Deletes the entry for |instance| from the
@@ -176,6 +185,10 @@ SPL_MEMORY_USAGE_LAYER_FUNC(VkResult, CreateInstance,
         // override.
         SPL_DISPATCH_INSTANCE_FUNC(DestroyInstance);
         SPL_DISPATCH_INSTANCE_FUNC(GetInstanceProcAddr);
+        SPL_DISPATCH_INSTANCE_FUNC(EnumerateDeviceExtensionProperties);
+        SPL_DISPATCH_INSTANCE_FUNC(GetPhysicalDeviceMemoryProperties);
+        SPL_DISPATCH_INSTANCE_FUNC(GetPhysicalDeviceMemoryProperties2);
+        SPL_DISPATCH_INSTANCE_FUNC(GetPhysicalDeviceMemoryProperties2KHR);
         return dispatch_table;
       };
 
@@ -193,16 +206,13 @@ SPL_MEMORY_USAGE_LAYER_FUNC(void, DestroyDevice,
                             (VkDevice device,
                              const VkAllocationCallbacks* allocator)) {
   MemoryUsageLayerData* layer_data = GetLayerData();
+  // The heaps and memory types of the device show the memory the application
+  // did not free before destroying the device.
+  DeviceMemoryUsage usage =
+      layer_data->GetTracker().GetDeviceMemoryUsage(device);
   // Remove memory allocation records for the device being destroyed.
-  layer_data->RecordDestroyDeviceMemory(device);
-
-  int64_t current_alloc = layer_data->GetCurrentAllocationSize();
-  int64_t peak_alloc = layer_data->GetPeakAllocationSize();
-  layer_data->LogEventOnly("memory_usage_destroy_device",
-                           CsvCat(current_alloc, peak_alloc));
-  MemoryUsageEvent event("memory_usage_destroy_device", current_alloc,
-                         peak_alloc);
-  layer_data->LogEvent(&event);
+  layer_data->RemoveMemoryDevice(device);
+  layer_data->LogMemoryUsage("memory_usage_destroy_device", device, usage);
 
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       device, &VkLayerDispatchTable::DestroyDevice);
@@ -210,18 +220,20 @@ SPL_MEMORY_USAGE_LAYER_FUNC(void, DestroyDevice,
   next_proc(device, allocator);
 }
 
-// Override for vkQueuePresentKHR. Used to log memory usage once per frame.
+// Override for vkQueuePresentKHR. Used to log memory usage once per frame in
+// the capture window. The allocations are tracked outside of the window too,
+// so that the usage is right once the window opens.
 SPL_MEMORY_USAGE_LAYER_FUNC(VkResult, QueuePresentKHR,
                             (VkQueue queue,
                              const VkPresentInfoKHR* present_info)) {
+  ScopedCapturePresent capture_present;
   MemoryUsageLayerData* layer_data = GetLayerData();
-
-  int64_t current_alloc = layer_data->GetCurrentAllocationSize();
-  int64_t peak_alloc = layer_data->GetPeakAllocationSize();
-  layer_data->LogEventOnly("memory_usage_present",
-                           CsvCat(current_alloc, peak_alloc));
-  MemoryUsageEvent event("memory_usage_present", current_alloc, peak_alloc);
-  layer_data->LogEvent(&event);
+  if (IsCaptureWindowOpen()) {
+    VkDevice device = layer_data->GetDevice(DeviceKey(queue));
+    layer_data->LogMemoryUsage(
+        "memory_usage_present", device,
+        layer_data->GetTracker().GetDeviceMemoryUsage(device));
+  }
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       queue, &VkLayerDispatchTable::QueuePresentKHR);
   return next_proc(queue, present_info);
@@ -241,8 +253,9 @@ SPL_MEMORY_USAGE_LAYER_FUNC(VkResult, AllocateMemory,
 
   if (result == VK_SUCCESS) {
     // TODO: Also records failed allocations in some way?
-    layer_data->RecordAllocateMemory(device, *pMemory,
-                                     pAllocateInfo->allocationSize);
+    layer_data->GetTracker().RecordAllocateMemory(
+        device, *pMemory, pAllocateInfo->allocationSize,
+        pAllocateInfo->memoryTypeIndex);
   }
   return result;
 }
@@ -255,7 +268,7 @@ SPL_MEMORY_USAGE_LAYER_FUNC(void, FreeMemory,
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       device, &VkLayerDispatchTable::FreeMemory);
 
-  layer_data->RecordFreeMemory(device, memory);
+  layer_data->GetTracker().RecordFreeMemory(device, memory);
 
   next_proc(device, memory, pAllocator);
 }
@@ -0,0 +1,242 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "memory_usage_tracker.h"
+
+#include <algorithm>
+#include <cassert>
+#include <tuple>
+#include <utility>
+
+#include "absl/hash/hash.h"
+
+namespace performancelayers {
+namespace {
+// Sets `max` to `value` if `value` is larger.
+void UpdateMax(std::atomic<uint64_t> &max, uint64_t value) {
+  uint64_t previous = max.load(std::memory_order_relaxed);
+  while (previous < value && !max.compare_exchange_weak(
+                                 previous, value, std::memory_order_relaxed)) {
+  }
+}
+
+// Returns floor(log2(size)), clamped to the range of size buckets.
+size_t GetSizeBucket(VkDeviceSize size) {
+  size_t bucket = 0;
+  while (size > 1 && bucket != MemoryUsageTracker::kNumSizeBuckets - 1) {
+    size >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+}  // namespace
+
+void MemoryUsageTracker::DeviceAllocations::AddUsage(
+    uint32_t memory_type_index, uint64_t size) {
+  if (memory_type_index >= VK_MAX_MEMORY_TYPES) {
+    return;
+  }
+  memory_type_current[memory_type_index].fetch_add(size,
+                                                   std::memory_order_relaxed);
+  if (memory_type_index >= memory_properties.memoryTypeCount) {
+    return;
+  }
+  const uint32_t heap =
+      memory_properties.memoryTypes[memory_type_index].heapIndex;
+  if (heap < VK_MAX_MEMORY_HEAPS) {
+    UpdateMax(heap_peak[heap],
+              heap_current[heap].fetch_add(size, std::memory_order_relaxed) +
+                  size);
+  }
+}
+
+void MemoryUsageTracker::DeviceAllocations::SubtractUsage(
+    uint32_t memory_type_index, uint64_t size) {
+  if (memory_type_index >= VK_MAX_MEMORY_TYPES) {
+    return;
+  }
+  memory_type_current[memory_type_index].fetch_sub(size,
+                                                   std::memory_order_relaxed);
+  if (memory_type_index >= memory_properties.memoryTypeCount) {
+    return;
+  }
+  const uint32_t heap =
+      memory_properties.memoryTypes[memory_type_index].heapIndex;
+  if (heap < VK_MAX_MEMORY_HEAPS) {
+    heap_current[heap].fetch_sub(size, std::memory_order_relaxed);
+  }
+}
+
+void MemoryUsageTracker::AddDevice(
+    VkDevice device,
+    const VkPhysicalDeviceMemoryProperties &memory_properties) {
+  GetOrAddDevice(device, memory_properties);
+}
+
+MemoryUsageTracker::DeviceAllocations *MemoryUsageTracker::GetOrAddDevice(
+    VkDevice device,
+    const VkPhysicalDeviceMemoryProperties &memory_properties) {
+  if (const auto *allocations = devices_.Find(device)) {
+    return allocations->get();
+  }
+  // Another thread may add the device first, in which case `Insert` keeps its
+  // allocations.
+  devices_.Insert(device,
+                  std::make_shared<DeviceAllocations>(memory_properties));
+  return devices_.Find(device)->get();
+}
+
+MemoryUsageTracker::Shard &MemoryUsageTracker::GetShard(
+    DeviceAllocations *allocations, VkDeviceMemory memory) {
+  return allocations->shards[absl::Hash<VkDeviceMemory>{}(memory) %
+                             kNumShards];
+}
+
+void MemoryUsageTracker::AddToTotal(VkDeviceSize size) {
+  const uint64_t previous =
+      current_allocation_size_.fetch_add(size, std::memory_order_relaxed);
+  UpdateMax(peak_allocation_size_, previous + size);
+}
+
+void MemoryUsageTracker::SubtractFromTotal(VkDeviceSize size) {
+  [[maybe_unused]] const uint64_t previous =
+      current_allocation_size_.fetch_sub(size, std::memory_order_relaxed);
+  assert(size <= previous);
+}
+
+void MemoryUsageTracker::RecordAllocateMemory(VkDevice device,
+                                              VkDeviceMemory memory,
+                                              VkDeviceSize size,
+                                              uint32_t memory_type_index) {
+  DeviceAllocations *allocations = GetOrAddDevice(device, {});
+  Shard &shard = GetShard(allocations, memory);
+  {
+    absl::MutexLock lock(&shard.lock);
+    [[maybe_unused]] bool inserted;
+    std::tie(std::ignore, inserted) = shard.allocations.try_emplace(
+        memory, Allocation{size, memory_type_index});
+    assert(inserted);
+  }
+  allocations->allocation_size.fetch_add(size, std::memory_order_relaxed);
+  allocations->AddUsage(memory_type_index, size);
+  allocations->size_histogram[GetSizeBucket(size)].fetch_add(
+      1, std::memory_order_relaxed);
+  allocation_count_.fetch_add(1, std::memory_order_relaxed);
+  AddToTotal(size);
+}
+
+void MemoryUsageTracker::RecordFreeMemory(VkDevice device,
+                                          VkDeviceMemory memory) {
+  if (memory == VK_NULL_HANDLE) {
+    return;
+  }
+  const auto *allocations = devices_.Find(device);
+  assert(allocations);
+  if (!allocations) {
+    return;
+  }
+  Shard &shard = GetShard(allocations->get(), memory);
+  Allocation allocation;
+  {
+    absl::MutexLock lock(&shard.lock);
+    auto it = shard.allocations.find(memory);
+    assert(it != shard.allocations.end());
+    if (it == shard.allocations.end()) {
+      return;
+    }
+    allocation = it->second;
+    shard.allocations.erase(it);
+  }
+  (*allocations)
+      ->allocation_size.fetch_sub(allocation.size, std::memory_order_relaxed);
+  (*allocations)->SubtractUsage(allocation.memory_type_index, allocation.size);
+  free_count_.fetch_add(1, std::memory_order_relaxed);
+  SubtractFromTotal(allocation.size);
+}
+
+void MemoryUsageTracker::RecordDestroyDevice(VkDevice device) {
+  const auto *found = devices_.Find(device);
+  if (!found) {
+    return;
+  }
+  std::shared_ptr<DeviceAllocations> allocations = *found;
+  devices_.Erase(device);
+
+  // The snapshots of `devices_` keep `allocations` alive, so release the
+  // memory of the maps now.
+  for (Shard &shard : allocations->shards) {
+    absl::MutexLock lock(&shard.lock);
+    absl::flat_hash_map<VkDeviceMemory, Allocation>().swap(shard.allocations);
+  }
+  SubtractFromTotal(
+      allocations->allocation_size.exchange(0, std::memory_order_relaxed));
+}
+
+uint64_t MemoryUsageTracker::GetDeviceAllocationSize(VkDevice device) const {
+  if (const auto *allocations = devices_.Find(device)) {
+    return (*allocations)->allocation_size.load(std::memory_order_relaxed);
+  }
+  return 0;
+}
+
+DeviceMemoryUsage MemoryUsageTracker::GetDeviceMemoryUsage(
+    VkDevice device) const {
+  DeviceMemoryUsage usage;
+  const auto *found = devices_.Find(device);
+  if (!found) {
+    return usage;
+  }
+  const DeviceAllocations &allocations = **found;
+  const VkPhysicalDeviceMemoryProperties &properties =
+      allocations.memory_properties;
+  const uint32_t heap_count =
+      std::min<uint32_t>(properties.memoryHeapCount, VK_MAX_MEMORY_HEAPS);
+  for (uint32_t heap = 0; heap != heap_count; ++heap) {
+    usage.heaps[heap] = {
+        properties.memoryHeaps[heap].flags,
+        allocations.heap_current[heap].load(std::memory_order_relaxed),
+        allocations.heap_peak[heap].load(std::memory_order_relaxed)};
+  }
+  usage.heap_count = heap_count;
+
+  // Without the memory properties, report the memory types used so far.
+  uint32_t type_count =
+      std::min<uint32_t>(properties.memoryTypeCount, VK_MAX_MEMORY_TYPES);
+  if (type_count == 0) {
+    for (uint32_t type = 0; type != VK_MAX_MEMORY_TYPES; ++type) {
+      if (allocations.memory_type_current[type].load(
+              std::memory_order_relaxed) != 0) {
+        type_count = type + 1;
+      }
+    }
+  }
+  for (uint32_t type = 0; type != type_count; ++type) {
+    usage.memory_type_current[type] =
+        allocations.memory_type_current[type].load(std::memory_order_relaxed);
+  }
+  usage.memory_type_count = type_count;
+
+  for (size_t bucket = 0; bucket != kNumSizeBuckets; ++bucket) {
+    usage.size_histogram[bucket] =
+        allocations.size_histogram[bucket].load(std::memory_order_relaxed);
+  }
+  return usage;
+}
+
+MemoryChurn MemoryUsageTracker::TakeChurn() {
+  return {allocation_count_.exchange(0, std::memory_order_relaxed),
+          free_count_.exchange(0, std::memory_order_relaxed)};
+}
+
+}  // namespace performancelayers
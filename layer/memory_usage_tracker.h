@@ -0,0 +1,194 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_MEMORY_USAGE_TRACKER_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_MEMORY_USAGE_TRACKER_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "copy_on_write_map.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// The memory usage of one memory heap of a device.
+struct MemoryHeapUsage {
+  VkMemoryHeapFlags flags = 0;
+  // The total size of the allocations from the memory types of the heap.
+  uint64_t current = 0;
+  // The largest value `current` ever had.
+  uint64_t peak = 0;
+};
+
+// A snapshot of the memory usage of a device. Kept in fixed-size arrays, so
+// that taking a snapshot every frame does not allocate.
+struct DeviceMemoryUsage {
+  // Allocations up to 2^47 bytes get their own bucket.
+  static constexpr size_t kNumSizeBuckets = 48;
+
+  // Returns one entry per heap of the device, none if the memory properties of
+  // the device are unknown.
+  absl::Span<const MemoryHeapUsage> GetHeaps() const {
+    return absl::MakeConstSpan(heaps.data(), heap_count);
+  }
+
+  // Returns the total size of the allocations of each memory type.
+  absl::Span<const uint64_t> GetMemoryTypeCurrent() const {
+    return absl::MakeConstSpan(memory_type_current.data(), memory_type_count);
+  }
+
+  uint32_t heap_count = 0;
+  std::array<MemoryHeapUsage, VK_MAX_MEMORY_HEAPS> heaps = {};
+  uint32_t memory_type_count = 0;
+  std::array<uint64_t, VK_MAX_MEMORY_TYPES> memory_type_current = {};
+  // The number of allocations ever made per size, on a log2 scale: bucket `i`
+  // counts the allocations of [2^i, 2^(i+1)) bytes, except for the first and
+  // the last bucket that also count the smaller and larger allocations.
+  std::array<uint64_t, kNumSizeBuckets> size_histogram = {};
+};
+
+// The number of allocations and frees since the previous call to
+// `MemoryUsageTracker::TakeChurn()`.
+struct MemoryChurn {
+  uint64_t allocations = 0;
+  uint64_t frees = 0;
+};
+
+// Tracks the sizes of the device memory allocations of all devices, and the
+// current and peak total allocation size. Also breaks the usage of each device
+// down by memory type and memory heap, and counts the allocations by size.
+//
+// The allocations of each device are kept in their own map, split into
+// `kNumShards` shards with their own lock, so that threads allocating memory
+// concurrently rarely contend. The totals are atomic counters and can be read
+// without taking any lock. Destroying a device only visits the allocations of
+// that device.
+//
+// This class is thread safe.
+class MemoryUsageTracker {
+ public:
+  static constexpr size_t kNumShards = 16;
+  static constexpr size_t kNumSizeBuckets = DeviceMemoryUsage::kNumSizeBuckets;
+
+  MemoryUsageTracker() = default;
+  MemoryUsageTracker(const MemoryUsageTracker &) = delete;
+  MemoryUsageTracker &operator=(const MemoryUsageTracker &) = delete;
+
+  // Starts tracking the allocations of `device`, with the memory types and
+  // heaps of `memory_properties`. Calling this is optional: devices are also
+  // added on their first allocation, without any heaps.
+  void AddDevice(
+      VkDevice device,
+      const VkPhysicalDeviceMemoryProperties &memory_properties = {});
+
+  // Records that `memory` of `size` bytes was allocated on `device` from the
+  // memory type `memory_type_index`.
+  void RecordAllocateMemory(VkDevice device, VkDeviceMemory memory,
+                            VkDeviceSize size, uint32_t memory_type_index);
+
+  // Records that `memory` was freed. Freeing `VK_NULL_HANDLE` is a no-op.
+  void RecordFreeMemory(VkDevice device, VkDeviceMemory memory);
+
+  // Releases all the allocations of `device` and stops tracking it.
+  void RecordDestroyDevice(VkDevice device);
+
+  // Returns the total size of the allocations of all devices.
+  uint64_t GetCurrentAllocationSize() const {
+    return current_allocation_size_.load(std::memory_order_relaxed);
+  }
+
+  // Returns the largest value `GetCurrentAllocationSize()` ever had.
+  uint64_t GetPeakAllocationSize() const {
+    return peak_allocation_size_.load(std::memory_order_relaxed);
+  }
+
+  // Returns the total size of the allocations of `device`.
+  uint64_t GetDeviceAllocationSize(VkDevice device) const;
+
+  // Returns the memory usage of `device`, or an empty usage if `device` is not
+  // tracked.
+  DeviceMemoryUsage GetDeviceMemoryUsage(VkDevice device) const;
+
+  // Returns the allocations and frees of all devices since the previous call.
+  MemoryChurn TakeChurn();
+
+ private:
+  struct Allocation {
+    VkDeviceSize size;
+    uint32_t memory_type_index;
+  };
+
+  // Aligned to keep the locks of different shards in different cache lines.
+  struct alignas(64) Shard {
+    absl::Mutex lock;
+    absl::flat_hash_map<VkDeviceMemory, Allocation> allocations
+        ABSL_GUARDED_BY(lock);
+  };
+
+  struct DeviceAllocations {
+    explicit DeviceAllocations(
+        const VkPhysicalDeviceMemoryProperties &memory_properties)
+        : memory_properties(memory_properties) {}
+
+    // Adds `size` bytes to the usage of `memory_type_index` and its heap.
+    void AddUsage(uint32_t memory_type_index, uint64_t size);
+
+    // Subtracts `size` bytes from the usage of `memory_type_index` and its
+    // heap.
+    void SubtractUsage(uint32_t memory_type_index, uint64_t size);
+
+    const VkPhysicalDeviceMemoryProperties memory_properties;
+    std::array<Shard, kNumShards> shards;
+    std::atomic<uint64_t> allocation_size = 0;
+    std::array<std::atomic<uint64_t>, VK_MAX_MEMORY_TYPES>
+        memory_type_current = {};
+    std::array<std::atomic<uint64_t>, VK_MAX_MEMORY_HEAPS> heap_current = {};
+    std::array<std::atomic<uint64_t>, VK_MAX_MEMORY_HEAPS> heap_peak = {};
+    std::array<std::atomic<uint64_t>, kNumSizeBuckets> size_histogram = {};
+  };
+
+  // Returns the allocations of `device`, adding `device` with
+  // `memory_properties` if it is not tracked yet.
+  DeviceAllocations *GetOrAddDevice(
+      VkDevice device,
+      const VkPhysicalDeviceMemoryProperties &memory_properties);
+
+  static Shard &GetShard(DeviceAllocations *allocations,
+                         VkDeviceMemory memory);
+
+  void AddToTotal(VkDeviceSize size);
+  void SubtractFromTotal(VkDeviceSize size);
+
+  // Devices are only added and removed on device creation and destruction, so
+  // lookups don't need a lock. The values are shared pointers because the
+  // snapshots of the map copy them.
+  CopyOnWriteMap<VkDevice, std::shared_ptr<DeviceAllocations>> devices_;
+
+  std::atomic<uint64_t> current_allocation_size_ = 0;
+  std::atomic<uint64_t> peak_allocation_size_ = 0;
+  std::atomic<uint64_t> allocation_count_ = 0;
+  std::atomic<uint64_t> free_count_ = 0;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_MEMORY_USAGE_TRACKER_H_
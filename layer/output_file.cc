@@ -0,0 +1,69 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "output_file.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
+namespace performancelayers {
+
+absl::Status WriteFileAtomically(const std::string& path,
+                                 absl::Span<const uint8_t> data) {
+#if defined(__unix__)
+  // Unique per process, so that concurrent writers don't share a temporary
+  // file. The last rename wins.
+  const std::string tmp_path = absl::StrCat(path, ".tmp.", getpid());
+#else
+  const std::string tmp_path = absl::StrCat(path, ".tmp");
+#endif
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (!file) {
+    return absl::UnavailableError(absl::StrCat(
+        "Failed to open ", tmp_path, " for write: ", strerror(errno)));
+  }
+  bool written = data.empty() ||
+                 fwrite(data.data(), 1, data.size(), file) == data.size();
+  written = fflush(file) == 0 && written;
+#if defined(__unix__)
+  written = fsync(fileno(file)) == 0 && written;
+#endif
+  written = fclose(file) == 0 && written;
+  if (!written) {
+    remove(tmp_path.c_str());
+    return absl::UnavailableError(
+        absl::StrCat("Failed to write ", tmp_path, ": ", strerror(errno)));
+  }
+
+#if !defined(__unix__)
+  // rename does not replace existing files on all platforms.
+  remove(path.c_str());
+#endif
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    const int error = errno;
+    remove(tmp_path.c_str());
+    return absl::UnavailableError(absl::StrCat(
+        "Failed to rename ", tmp_path, " to ", path, ": ", strerror(error)));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace performancelayers
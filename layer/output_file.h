@@ -0,0 +1,36 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_OUTPUT_FILE_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_OUTPUT_FILE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+
+namespace performancelayers {
+
+// Replaces the contents of the |path| file with |data|. The data is written to
+// a temporary file next to |path| first, which is then renamed to |path|, so
+// that readers see either the previous or the new contents, but never a
+// partially written file. On Unix, the data is also synced to the disk before
+// the rename.
+absl::Status WriteFileAtomically(const std::string& path,
+                                 absl::Span<const uint8_t> data);
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_OUTPUT_FILE_H_
@@ -0,0 +1,86 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pattern_matcher.h"
+
+#include <deque>
+
+namespace performancelayers {
+namespace {
+constexpr uint32_t kNoState = UINT32_MAX;
+}  // namespace
+
+PatternMatcher::PatternMatcher(absl::Span<const std::string> patterns) {
+  // Build the trie of the patterns, with missing transitions for now.
+  transitions_.assign(kAlphabetSize, kNoState);
+  std::vector<std::vector<uint32_t>> state_matches(1);
+  for (uint32_t index = 0; index != patterns.size(); ++index) {
+    const std::string& pattern = patterns[index];
+    if (pattern.empty()) {
+      continue;
+    }
+    State state = kInitialState;
+    for (char c : pattern) {
+      const size_t transition = state * kAlphabetSize + static_cast<uint8_t>(c);
+      if (transitions_[transition] == kNoState) {
+        transitions_[transition] = static_cast<State>(state_matches.size());
+        state_matches.emplace_back();
+        transitions_.resize(transitions_.size() + kAlphabetSize, kNoState);
+      }
+      state = transitions_[transition];
+    }
+    state_matches[state].push_back(index);
+  }
+
+  // Visit the states in breadth-first order, so that the longest proper suffix
+  // of each state, its failure state, is complete before the state itself.
+  // Missing transitions become the transitions of the failure state, and each
+  // state also matches the patterns of its failure state.
+  std::vector<State> failure(state_matches.size(), kInitialState);
+  std::deque<State> queue;
+  for (size_t c = 0; c != kAlphabetSize; ++c) {
+    State& next = transitions_[c];
+    if (next == kNoState) {
+      next = kInitialState;
+    } else {
+      queue.push_back(next);
+    }
+  }
+  while (!queue.empty()) {
+    const State state = queue.front();
+    queue.pop_front();
+    const std::vector<uint32_t>& inherited = state_matches[failure[state]];
+    state_matches[state].insert(state_matches[state].end(), inherited.begin(),
+                                inherited.end());
+    for (size_t c = 0; c != kAlphabetSize; ++c) {
+      const State fallback = transitions_[failure[state] * kAlphabetSize + c];
+      State& next = transitions_[state * kAlphabetSize + c];
+      if (next == kNoState) {
+        next = fallback;
+      } else {
+        failure[next] = fallback;
+        queue.push_back(next);
+      }
+    }
+  }
+
+  match_offsets_.reserve(state_matches.size() + 1);
+  for (const std::vector<uint32_t>& state_match : state_matches) {
+    match_offsets_.push_back(static_cast<uint32_t>(matches_.size()));
+    matches_.insert(matches_.end(), state_match.begin(), state_match.end());
+  }
+  match_offsets_.push_back(static_cast<uint32_t>(matches_.size()));
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,86 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PATTERN_MATCHER_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PATTERN_MATCHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace performancelayers {
+
+// Finds all the occurrences of a set of patterns in a single pass over the
+// text, whatever the number of patterns, using the Aho-Corasick automaton of
+// the patterns. The text can be fed one character at a time, so matches can
+// span the chunks the text was read in.
+//
+// The automaton has one state per distinct pattern prefix, each with a
+// transition for every byte, so it is meant for a few short patterns, like the
+// markers written to a game log.
+class PatternMatcher {
+ public:
+  using State = uint32_t;
+  static constexpr State kInitialState = 0;
+
+  // Builds a matcher that never matches.
+  PatternMatcher() : PatternMatcher(absl::Span<const std::string>()) {}
+  // Builds the matcher of |patterns|, identified by their index. Empty
+  // patterns never match.
+  explicit PatternMatcher(absl::Span<const std::string> patterns);
+
+  // Returns the state after reading |c| in |state|.
+  State Next(State state, char c) const {
+    return transitions_[state * kAlphabetSize + static_cast<uint8_t>(c)];
+  }
+
+  // Returns the indices of the patterns that end at the character that led to
+  // |state|.
+  absl::Span<const uint32_t> GetMatches(State state) const {
+    return absl::MakeConstSpan(matches_.data() + match_offsets_[state],
+                               match_offsets_[state + 1] -
+                                   match_offsets_[state]);
+  }
+
+  // Calls |on_match(pattern_index, end_offset)| for each occurrence of a
+  // pattern in |text|, where |end_offset| is the offset one past its end.
+  template <typename OnMatch>
+  void FindAll(std::string_view text, OnMatch&& on_match) const {
+    State state = kInitialState;
+    for (size_t offset = 0; offset != text.size(); ++offset) {
+      state = Next(state, text[offset]);
+      for (uint32_t pattern_index : GetMatches(state)) {
+        on_match(pattern_index, offset + 1);
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kAlphabetSize = 256;
+
+  // |kAlphabetSize| transitions per state.
+  std::vector<State> transitions_;
+  // The patterns matched by state |s| are
+  // |matches_[match_offsets_[s]:match_offsets_[s + 1]]|.
+  std::vector<uint32_t> match_offsets_;
+  std::vector<uint32_t> matches_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PATTERN_MATCHER_H_
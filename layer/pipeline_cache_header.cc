@@ -0,0 +1,71 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline_cache_header.h"
+
+#include <cstring>
+
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+
+namespace performancelayers {
+namespace {
+std::string FormatUUID(const uint8_t (&uuid)[VK_UUID_SIZE]) {
+  return absl::BytesToHexString(
+      absl::string_view(reinterpret_cast<const char*>(uuid), VK_UUID_SIZE));
+}
+}  // namespace
+
+absl::Status ValidatePipelineCacheHeader(
+    absl::Span<const uint8_t> data,
+    const VkPhysicalDeviceProperties& properties) {
+  VkPipelineCacheHeaderVersionOne header = {};
+  if (data.size() < sizeof(header)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Pipeline cache too small for a header: ", data.size(),
+                     " B"));
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header.headerSize < sizeof(header) || header.headerSize > data.size()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Unsupported pipeline cache header (version: ", header.headerVersion,
+        ", size: ", header.headerSize, ")"));
+  }
+  if (header.vendorID != properties.vendorID ||
+      header.deviceID != properties.deviceID) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Pipeline cache for another device (vendor: ",
+        absl::Hex(header.vendorID), ", device: ", absl::Hex(header.deviceID),
+        ")"));
+  }
+  if (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+             VK_UUID_SIZE) != 0) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Pipeline cache for another driver (UUID: ",
+                     FormatUUID(header.pipelineCacheUUID), ")"));
+  }
+  return absl::OkStatus();
+}
+
+std::string GetPipelineCacheFileName(
+    const VkPhysicalDeviceProperties& properties) {
+  return absl::StrCat(absl::Hex(properties.vendorID), "-",
+                      absl::Hex(properties.deviceID), "-",
+                      absl::Hex(properties.driverVersion), "-",
+                      FormatUUID(properties.pipelineCacheUUID), ".bin");
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,44 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_CACHE_HEADER_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_CACHE_HEADER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// Returns OK if |data| starts with a valid VkPipelineCacheHeaderVersionOne
+// header whose vendor ID, device ID, and pipeline cache UUID match
+// |properties|. Drivers silently ignore the initial data of pipeline caches
+// that don't match, so such data is not worth passing to them.
+absl::Status ValidatePipelineCacheHeader(
+    absl::Span<const uint8_t> data,
+    const VkPhysicalDeviceProperties& properties);
+
+// Returns the name of the file that holds the pipeline cache of the devices
+// with |properties| in a pipeline cache directory, of the form
+// <vendorID>-<deviceID>-<driverVersion>-<pipelineCacheUUID>.bin, with all the
+// values in hexadecimal.
+std::string GetPipelineCacheFileName(
+    const VkPhysicalDeviceProperties& properties);
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_CACHE_HEADER_H_
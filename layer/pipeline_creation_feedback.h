@@ -0,0 +1,123 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_CREATION_FEEDBACK_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_CREATION_FEEDBACK_H_
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "layer_utils.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+inline uint32_t GetStageCount(const VkGraphicsPipelineCreateInfo& create_info) {
+  return create_info.stageCount;
+}
+
+inline uint32_t GetStageCount(const VkComputePipelineCreateInfo&) { return 1; }
+
+// Returns true if the driver filled in |feedback|.
+inline bool IsFeedbackValid(const VkPipelineCreationFeedbackEXT& feedback) {
+  return (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) != 0;
+}
+
+// Returns true if |feedback| reports a hit in the application's pipeline cache.
+inline bool IsPipelineCacheHit(const VkPipelineCreationFeedbackEXT& feedback) {
+  constexpr VkFlags kCacheHit =
+      VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT;
+  return (feedback.flags & kCacheHit) != 0;
+}
+
+// Requests the creation feedback of every pipeline of a vkCreate*Pipelines
+// call, without modifying the application's create infos. The create infos
+// are copied, and a VkPipelineCreationFeedbackCreateInfoEXT owned by this
+// object is prepended to the pNext chain of each copy. Create infos that
+// already chain a VkPipelineCreationFeedbackCreateInfoEXT are passed on
+// unchanged, and their feedback is read from the application's structures.
+//
+// The VK_EXT_pipeline_creation_feedback extension must be enabled on the device
+// that creates the pipelines.
+template <typename CreateInfoT>
+class PipelineCreationFeedbackRequest {
+ public:
+  PipelineCreationFeedbackRequest(const CreateInfoT* create_infos,
+                                  uint32_t create_info_count)
+      : create_infos_(create_infos, create_infos + create_info_count),
+        pipeline_feedbacks_(create_info_count),
+        layer_feedback_infos_(create_info_count),
+        feedback_infos_(create_info_count) {
+    uint32_t total_stage_count = 0;
+    for (const CreateInfoT& create_info : create_infos_) {
+      total_stage_count += GetStageCount(create_info);
+    }
+    // Allocated once, so that the pointers into it stay valid.
+    stage_feedbacks_.resize(total_stage_count);
+
+    VkPipelineCreationFeedbackEXT* stage_feedbacks = stage_feedbacks_.data();
+    for (uint32_t i = 0; i != create_info_count; ++i) {
+      CreateInfoT& create_info = create_infos_[i];
+      const auto* app_feedback =
+          FindInChain<VkPipelineCreationFeedbackCreateInfoEXT>(
+              create_info.pNext,
+              VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT);
+      if (app_feedback) {
+        feedback_infos_[i] = app_feedback;
+        continue;
+      }
+      const uint32_t stage_count = GetStageCount(create_info);
+      VkPipelineCreationFeedbackCreateInfoEXT& feedback_info =
+          layer_feedback_infos_[i];
+      feedback_info.sType =
+          VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+      feedback_info.pNext = create_info.pNext;
+      feedback_info.pPipelineCreationFeedback = &pipeline_feedbacks_[i];
+      feedback_info.pipelineStageCreationFeedbackCount = stage_count;
+      feedback_info.pPipelineStageCreationFeedbacks = stage_feedbacks;
+      stage_feedbacks += stage_count;
+      create_info.pNext = &feedback_info;
+      feedback_infos_[i] = &feedback_info;
+    }
+  }
+
+  PipelineCreationFeedbackRequest(const PipelineCreationFeedbackRequest&) =
+      delete;
+  PipelineCreationFeedbackRequest& operator=(
+      const PipelineCreationFeedbackRequest&) = delete;
+
+  // Returns the create infos to pass to the next layer in place of the
+  // application's.
+  const CreateInfoT* GetCreateInfos() const { return create_infos_.data(); }
+
+  // Returns the feedback of the pipeline |index|, filled in by the driver
+  // during the pipeline creation.
+  const VkPipelineCreationFeedbackCreateInfoEXT& GetFeedback(
+      uint32_t index) const {
+    assert(index < feedback_infos_.size());
+    return *feedback_infos_[index];
+  }
+
+ private:
+  std::vector<CreateInfoT> create_infos_;
+  std::vector<VkPipelineCreationFeedbackEXT> pipeline_feedbacks_;
+  std::vector<VkPipelineCreationFeedbackEXT> stage_feedbacks_;
+  std::vector<VkPipelineCreationFeedbackCreateInfoEXT> layer_feedback_infos_;
+  std::vector<const VkPipelineCreationFeedbackCreateInfoEXT*> feedback_infos_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_CREATION_FEEDBACK_H_
@@ -0,0 +1,76 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline_hash_map.h"
+
+#include <cassert>
+
+namespace performancelayers {
+
+void PipelineHashMap::Insert(VkPipeline pipeline,
+                             const PipelineHashVector& hashes) {
+  absl::MutexLock lock(&lock_);
+  const PipelineHashVector* interned = Intern(hashes);
+  auto [it, inserted] = pipelines_.try_emplace(pipeline, Entry{interned, 1});
+  if (!inserted) {
+    Release(it->second.hashes);
+    it->second.hashes = interned;
+    ++it->second.references;
+  }
+}
+
+void PipelineHashMap::Erase(VkPipeline pipeline) {
+  absl::MutexLock lock(&lock_);
+  auto it = pipelines_.find(pipeline);
+  if (it == pipelines_.end()) {
+    return;
+  }
+  if (--it->second.references == 0) {
+    Release(it->second.hashes);
+    pipelines_.erase(it);
+  }
+}
+
+PipelineHashVector PipelineHashMap::Get(VkPipeline pipeline) const {
+  absl::MutexLock lock(&lock_);
+  auto it = pipelines_.find(pipeline);
+  return it != pipelines_.end() ? *it->second.hashes : PipelineHashVector();
+}
+
+size_t PipelineHashMap::GetSize() const {
+  absl::MutexLock lock(&lock_);
+  return pipelines_.size();
+}
+
+size_t PipelineHashMap::GetInternedSize() const {
+  absl::MutexLock lock(&lock_);
+  return interned_.size();
+}
+
+const PipelineHashVector* PipelineHashMap::Intern(
+    const PipelineHashVector& hashes) {
+  auto it = interned_.try_emplace(hashes, 0).first;
+  ++it->second;
+  return &it->first;
+}
+
+void PipelineHashMap::Release(const PipelineHashVector* hashes) {
+  auto it = interned_.find(*hashes);
+  assert(it != interned_.end());
+  if (--it->second == 0) {
+    interned_.erase(it);
+  }
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,94 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_HASH_MAP_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_HASH_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// The hashes of the shader stages of a pipeline.
+using PipelineHashVector = absl::InlinedVector<uint64_t, 3>;
+
+// Maps the live pipelines to the hashes of their shader stages.
+//
+// Applications commonly create many pipelines from the same shaders, which
+// only differ in their fixed-function state. The hash vectors are interned, so
+// that the pipelines with identical stages share one copy, and each pipeline
+// only costs a pointer and a reference count. A hash vector is released once
+// the last pipeline using it is erased.
+//
+// Each pipeline is reference counted too: inserting a pipeline that is already
+// in the map replaces its hashes and takes another reference, and |Erase| only
+// removes the pipeline once all the references are released. This lets a layer
+// delay erasing a destroyed pipeline without losing a new pipeline that reuses
+// the same handle in the meantime.
+//
+// This class is thread safe.
+class PipelineHashMap {
+ public:
+  PipelineHashMap() = default;
+  PipelineHashMap(const PipelineHashMap&) = delete;
+  PipelineHashMap& operator=(const PipelineHashMap&) = delete;
+
+  // Associates |hashes| with |pipeline|, and takes a reference to |pipeline|.
+  void Insert(VkPipeline pipeline, const PipelineHashVector& hashes);
+
+  // Releases a reference to |pipeline|, and forgets its hashes once no
+  // reference is left. Erasing an unknown pipeline is a no-op.
+  void Erase(VkPipeline pipeline);
+
+  // Returns the hashes of |pipeline|, or an empty vector if |pipeline| is not
+  // in the map.
+  PipelineHashVector Get(VkPipeline pipeline) const;
+
+  // Returns the number of pipelines in the map.
+  size_t GetSize() const;
+
+  // Returns the number of distinct hash vectors used by the pipelines.
+  size_t GetInternedSize() const;
+
+ private:
+  struct Entry {
+    // Points to a key of |interned_|, which is stable in a node map.
+    const PipelineHashVector* hashes;
+    uint32_t references;
+  };
+
+  // Returns the interned copy of |hashes|, and takes a reference to it.
+  const PipelineHashVector* Intern(const PipelineHashVector& hashes)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Releases a reference to the interned |hashes|.
+  void Release(const PipelineHashVector* hashes)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  mutable absl::Mutex lock_;
+  absl::flat_hash_map<VkPipeline, Entry> pipelines_ ABSL_GUARDED_BY(lock_);
+  // The number of pipelines using each hash vector.
+  absl::node_hash_map<PipelineHashVector, uint32_t> interned_
+      ABSL_GUARDED_BY(lock_);
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_HASH_MAP_H_
@@ -0,0 +1,68 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline_runtime_aggregator.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_cat.h"
+
+namespace performancelayers {
+namespace {
+// Returns floor(log2(runtime_ns)), clamped to the range of histogram buckets.
+size_t GetHistogramBucket(uint64_t runtime_ns) {
+  size_t bucket = 0;
+  while (runtime_ns > 1 &&
+         bucket != PipelineRuntimeStats::kNumHistogramBuckets - 1) {
+    runtime_ns >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+}  // namespace
+
+void PipelineRuntimeStats::Add(uint64_t runtime_ns,
+                               uint64_t fragment_invocations,
+                               uint64_t compute_invocations,
+                               uint32_t draw_count, double weight) {
+  ++query_count;
+  this->draw_count += draw_count;
+  total_ns += runtime_ns;
+  min_ns = std::min(min_ns, runtime_ns);
+  max_ns = std::max(max_ns, runtime_ns);
+  estimated_total_ns += weight * static_cast<double>(runtime_ns);
+  this->fragment_invocations += fragment_invocations;
+  this->compute_invocations += compute_invocations;
+  ++histogram[GetHistogramBucket(runtime_ns)];
+}
+
+std::string PipelineRuntimeStats::FormatHistogram() const {
+  std::string out;
+  for (size_t bucket = 0; bucket != kNumHistogramBuckets; ++bucket) {
+    if (histogram[bucket] == 0) continue;
+    absl::StrAppend(&out, out.empty() ? "" : ";", uint64_t(1) << bucket, ":",
+                    histogram[bucket]);
+  }
+  return out;
+}
+
+std::vector<std::pair<VkPipeline, PipelineRuntimeStats>>
+PipelineRuntimeAggregator::TakeStats() {
+  std::vector<std::pair<VkPipeline, PipelineRuntimeStats>> stats(
+      stats_.begin(), stats_.end());
+  stats_.clear();
+  return stats;
+}
+
+}  // namespace performancelayers
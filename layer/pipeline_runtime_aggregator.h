@@ -0,0 +1,92 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_RUNTIME_AGGREGATOR_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_RUNTIME_AGGREGATOR_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "vulkan/vulkan.h"
+
+namespace performancelayers {
+
+// The GPU run times measured for a pipeline over some frames.
+struct PipelineRuntimeStats {
+  // Run times up to 2^39 ns, i.e., about 9 minutes, get their own bucket.
+  static constexpr size_t kNumHistogramBuckets = 40;
+
+  // Adds the results of a query measuring |draw_count| draws, which stands for
+  // |weight| times as many draws when the draws are sampled.
+  void Add(uint64_t runtime_ns, uint64_t fragment_invocations,
+           uint64_t compute_invocations, uint32_t draw_count, double weight);
+
+  // Returns the mean run time of a query, or 0 if there are none.
+  uint64_t GetMeanNs() const {
+    return query_count == 0 ? 0 : total_ns / query_count;
+  }
+
+  // Returns the non-empty buckets of |histogram| as
+  // "<bucket lower bound in ns>:<query count>" pairs separated by ';'.
+  std::string FormatHistogram() const;
+
+  uint64_t query_count = 0;
+  uint64_t draw_count = 0;
+  uint64_t total_ns = 0;
+  uint64_t min_ns = std::numeric_limits<uint64_t>::max();
+  uint64_t max_ns = 0;
+  // The sum of the run times multiplied by their weights, which estimates the
+  // run time of all the draws, including the ones that were not measured.
+  double estimated_total_ns = 0.0;
+  uint64_t fragment_invocations = 0;
+  uint64_t compute_invocations = 0;
+  // The number of queries per run time, on a log2 scale: bucket |i| counts the
+  // run times in [2^i, 2^(i+1)) ns, except for the last bucket that also
+  // counts the longer ones.
+  std::array<uint64_t, kNumHistogramBuckets> histogram = {};
+};
+
+// Accumulates the query results of each pipeline, so that the runtime layer
+// logs one line per pipeline and interval rather than one line per query.
+//
+// This class is not thread safe.
+class PipelineRuntimeAggregator {
+ public:
+  // Adds the results of a query of |pipeline|. See
+  // |PipelineRuntimeStats::Add()|.
+  void Add(VkPipeline pipeline, uint64_t runtime_ns,
+           uint64_t fragment_invocations, uint64_t compute_invocations,
+           uint32_t draw_count, double weight) {
+    stats_[pipeline].Add(runtime_ns, fragment_invocations, compute_invocations,
+                         draw_count, weight);
+  }
+
+  bool IsEmpty() const { return stats_.empty(); }
+
+  // Returns the stats of each pipeline, and forgets them.
+  std::vector<std::pair<VkPipeline, PipelineRuntimeStats>> TakeStats();
+
+ private:
+  absl::flat_hash_map<VkPipeline, PipelineRuntimeStats> stats_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_PIPELINE_RUNTIME_AGGREGATOR_H_
@@ -0,0 +1,151 @@
+// Copyright 2020-2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "query_slot_allocator.h"
+
+#include <cassert>
+
+#include "debug_logging.h"
+
+namespace performancelayers {
+
+QuerySlotAllocator::QuerySlotAllocator(
+    VkDevice device, PFN_vkCreateQueryPool create_query_pool,
+    PFN_vkDestroyQueryPool destroy_query_pool,
+    PFN_vkCmdResetQueryPool cmd_reset_query_pool,
+    PFN_vkResetQueryPool host_reset_query_pool)
+    : device_(device),
+      create_query_pool_(create_query_pool),
+      destroy_query_pool_(destroy_query_pool),
+      cmd_reset_query_pool_(cmd_reset_query_pool),
+      host_reset_query_pool_(host_reset_query_pool) {
+  assert(device_);
+  assert(create_query_pool_);
+  assert(destroy_query_pool_);
+  assert(cmd_reset_query_pool_);
+}
+
+QuerySlotAllocator::~QuerySlotAllocator() {
+  absl::MutexLock lock(&lock_);
+  for (VkQueryPool pool : query_pools_) {
+    destroy_query_pool_(device_, pool, nullptr);
+  }
+}
+
+bool QuerySlotAllocator::CreateBlock() {
+  VkQueryPoolCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  create_info.pNext = nullptr;
+  create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  create_info.queryCount = kSlotsPerBlock * kTimestampQueriesPerSlot;
+
+  VkQueryPool timestamp_pool = VK_NULL_HANDLE;
+  VkResult result =
+      create_query_pool_(device_, &create_info, nullptr, &timestamp_pool);
+  if (result != VK_SUCCESS) {
+    SPL_LOG(ERROR) << "Failed to create a timestamp query pool: " << result;
+    return false;
+  }
+
+  create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+  create_info.queryCount = kSlotsPerBlock;
+  create_info.pipelineStatistics =
+      VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+  VkQueryPool stat_pool = VK_NULL_HANDLE;
+  result = create_query_pool_(device_, &create_info, nullptr, &stat_pool);
+  if (result != VK_SUCCESS) {
+    SPL_LOG(ERROR) << "Failed to create a pipeline statistics query pool: "
+                   << result;
+    destroy_query_pool_(device_, timestamp_pool, nullptr);
+    return false;
+  }
+
+  if (host_reset_query_pool_) {
+    host_reset_query_pool_(device_, timestamp_pool, 0,
+                           kSlotsPerBlock * kTimestampQueriesPerSlot);
+    host_reset_query_pool_(device_, stat_pool, 0, kSlotsPerBlock);
+  }
+
+  query_pools_.push_back(timestamp_pool);
+  query_pools_.push_back(stat_pool);
+  for (uint32_t i = 0; i != kChunksPerBlock; ++i) {
+    auto chunk = std::make_unique<Chunk>();
+    chunk->timestamp_pool = timestamp_pool;
+    chunk->stat_pool = stat_pool;
+    chunk->first_slot = i * kSlotsPerChunk;
+    free_chunks_.push_back(chunk.get());
+    chunks_.push_back(std::move(chunk));
+  }
+  return true;
+}
+
+QuerySlotAllocator::Chunk* QuerySlotAllocator::AcquireChunk() {
+  absl::MutexLock lock(&lock_);
+  if (free_chunks_.empty() && !CreateBlock()) {
+    return nullptr;
+  }
+
+  Chunk* chunk = free_chunks_.back();
+  free_chunks_.pop_back();
+  chunk->used = 0;
+  chunk->references.store(1, std::memory_order_relaxed);
+  return chunk;
+}
+
+bool QuerySlotAllocator::TakeSlot(Chunk* chunk, Slot* slot) {
+  assert(chunk);
+  assert(slot);
+  if (chunk->used == kSlotsPerChunk) {
+    return false;
+  }
+
+  slot->chunk = chunk;
+  slot->index = chunk->first_slot + chunk->used;
+  ++chunk->used;
+  chunk->references.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void QuerySlotAllocator::Unreference(Chunk* chunk) {
+  assert(chunk);
+  const uint32_t previous =
+      chunk->references.fetch_sub(1, std::memory_order_acq_rel);
+  assert(previous != 0);
+  if (previous != 1) {
+    return;
+  }
+
+  if (host_reset_query_pool_) {
+    host_reset_query_pool_(device_, chunk->timestamp_pool,
+                           chunk->first_slot * kTimestampQueriesPerSlot,
+                           kSlotsPerChunk * kTimestampQueriesPerSlot);
+    host_reset_query_pool_(device_, chunk->stat_pool, chunk->first_slot,
+                           kSlotsPerChunk);
+  }
+
+  absl::MutexLock lock(&lock_);
+  free_chunks_.push_back(chunk);
+}
+
+void QuerySlotAllocator::RecordChunkReset(VkCommandBuffer cmd_buf,
+                                          const Chunk& chunk) const {
+  cmd_reset_query_pool_(cmd_buf, chunk.timestamp_pool,
+                        chunk.first_slot * kTimestampQueriesPerSlot,
+                        kSlotsPerChunk * kTimestampQueriesPerSlot);
+  cmd_reset_query_pool_(cmd_buf, chunk.stat_pool, chunk.first_slot,
+                        kSlotsPerChunk);
+}
+
+}  // namespace performancelayers
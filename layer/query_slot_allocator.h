@@ -0,0 +1,141 @@
+// Copyright 2020-2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_QUERY_SLOT_ALLOCATOR_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_QUERY_SLOT_ALLOCATOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "vulkan/vulkan.h"
+#include "vulkan/vulkan_core.h"
+
+namespace performancelayers {
+
+// Hands out query slots from a small number of large query pools owned by a
+// single device. Each slot consists of two timestamp queries (for the start
+// and the end of the measured commands) and one pipeline statistics query.
+//
+// Pools are created in blocks of |kSlotsPerBlock| slots when the free slots run
+// out, and are only destroyed together with the allocator. Slots are handed out
+// in chunks of |kSlotsPerChunk| consecutive slots: a command buffer recording
+// owns a chunk and fills it front to back. When host query reset is not
+// available, a whole chunk can be reset with one vkCmdResetQueryPool per pool
+// at the beginning of the recording.
+//
+// A chunk goes back to the free list once its owner retires it (e.g., when the
+// command buffer gets re-recorded) and the results of all slots taken from it
+// have been read back. With host query reset, chunks are reset on the host
+// right before they are put back on the free list.
+//
+// This class is thread safe.
+class QuerySlotAllocator {
+ public:
+  static constexpr uint32_t kSlotsPerChunk = 64;
+  static constexpr uint32_t kChunksPerBlock = 16;
+  static constexpr uint32_t kSlotsPerBlock = kSlotsPerChunk * kChunksPerBlock;
+  static constexpr uint32_t kTimestampQueriesPerSlot = 2;
+
+  struct Chunk {
+    VkQueryPool timestamp_pool = VK_NULL_HANDLE;
+    VkQueryPool stat_pool = VK_NULL_HANDLE;
+    // Index of the first slot of this chunk in |timestamp_pool| and
+    // |stat_pool|.
+    uint32_t first_slot = 0;
+    // Number of slots handed out since the chunk was acquired. Only accessed
+    // by the owner of the chunk.
+    uint32_t used = 0;
+    // One reference held by the owner, plus one reference per slot whose
+    // results have not been read back yet.
+    std::atomic<uint32_t> references = 0;
+  };
+
+  struct Slot {
+    Chunk* chunk = nullptr;
+    // Index of the slot in the pools of |chunk|.
+    uint32_t index = 0;
+
+    VkQueryPool timestamp_pool() const { return chunk->timestamp_pool; }
+    VkQueryPool stat_pool() const { return chunk->stat_pool; }
+    uint32_t first_timestamp_query() const {
+      return index * kTimestampQueriesPerSlot;
+    }
+    uint32_t stat_query() const { return index; }
+  };
+
+  // Creates an allocator for |device|. |host_reset_query_pool| must be either
+  // null or the vkResetQueryPool(EXT) function for |device|. When null, the
+  // user is responsible for resetting the query pools with
+  // |RecordChunkReset|.
+  QuerySlotAllocator(VkDevice device,
+                     PFN_vkCreateQueryPool create_query_pool,
+                     PFN_vkDestroyQueryPool destroy_query_pool,
+                     PFN_vkCmdResetQueryPool cmd_reset_query_pool,
+                     PFN_vkResetQueryPool host_reset_query_pool);
+
+  ~QuerySlotAllocator();
+
+  QuerySlotAllocator(const QuerySlotAllocator&) = delete;
+  QuerySlotAllocator& operator=(const QuerySlotAllocator&) = delete;
+
+  VkDevice GetDevice() const { return device_; }
+
+  // Returns true if slots are reset on the host and don't need
+  // |RecordChunkReset| before use.
+  bool UsesHostReset() const { return host_reset_query_pool_ != nullptr; }
+
+  // Returns a free chunk owned by the caller, creating new query pools if
+  // necessary. Returns nullptr if the query pools could not be created.
+  Chunk* AcquireChunk();
+
+  // Drops the owner reference of |chunk|. The chunk becomes free once all the
+  // results of its slots have been read back.
+  void RetireChunk(Chunk* chunk) { Unreference(chunk); }
+
+  // Takes the next unused slot of |chunk| and stores it in |slot|. Must only be
+  // called by the owner of |chunk|. Returns false if all slots of |chunk| are
+  // in use.
+  static bool TakeSlot(Chunk* chunk, Slot* slot);
+
+  // Marks the results of |slot| as read back.
+  void ReleaseSlot(const Slot& slot) { Unreference(slot.chunk); }
+
+  // Records commands resetting all queries of |chunk| into |cmd_buf|. Must be
+  // called outside of a render pass.
+  void RecordChunkReset(VkCommandBuffer cmd_buf, const Chunk& chunk) const;
+
+ private:
+  // Creates one new block of query pools and adds its chunks to the free list.
+  bool CreateBlock() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  void Unreference(Chunk* chunk);
+
+  VkDevice device_;
+  PFN_vkCreateQueryPool create_query_pool_;
+  PFN_vkDestroyQueryPool destroy_query_pool_;
+  PFN_vkCmdResetQueryPool cmd_reset_query_pool_;
+  PFN_vkResetQueryPool host_reset_query_pool_;
+
+  absl::Mutex lock_;
+  std::vector<VkQueryPool> query_pools_ ABSL_GUARDED_BY(lock_);
+  std::vector<std::unique_ptr<Chunk>> chunks_ ABSL_GUARDED_BY(lock_);
+  std::vector<Chunk*> free_chunks_ ABSL_GUARDED_BY(lock_);
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_QUERY_SLOT_ALLOCATOR_H_
@@ -16,8 +16,10 @@
 #include <cstdint>
 #include <cstring>
 #include <functional>
+#include <optional>
 #include <string>
 
+#include "capture_window.h"
 #include "debug_logging.h"
 #include "layer_utils.h"
 #include "runtime_layer_data.h"
@@ -32,11 +34,23 @@ constexpr char kLayerName[] = "VK_LAYER_STADIA_pipeline_runtime";
 constexpr char kLayerDescription[] =
     "Stadia Pipeline Pipeline Runtime Measuring Layer";
 constexpr char kLogFilenameEnvVar[] = "VK_RUNTIME_LOG";
+constexpr char kModeEnvVar[] = "VK_RUNTIME_MODE";
+constexpr char kSamplingEnvVar[] = "VK_RUNTIME_SAMPLING";
+constexpr char kAggregateFramesEnvVar[] = "VK_RUNTIME_AGGREGATE_FRAMES";
+constexpr char kCpuStatsEnvVar[] = "VK_RUNTIME_CPU_STATS";
 
 performancelayers::RuntimeLayerData* GetLayerData() {
+  static const performancelayers::RuntimeMode mode =
+      performancelayers::ParseRuntimeMode(getenv(kModeEnvVar));
   // Don't use new -- make the destructor run when the layer gets unloaded.
   static performancelayers::RuntimeLayerData layer_data =
-      performancelayers::RuntimeLayerData(getenv(kLogFilenameEnvVar));
+      performancelayers::RuntimeLayerData(
+          getenv(kLogFilenameEnvVar), mode,
+          performancelayers::ParseRuntimeSampling(getenv(kSamplingEnvVar),
+                                                  mode),
+          performancelayers::ParseRuntimeAggregateFrames(
+              getenv(kAggregateFramesEnvVar)),
+          performancelayers::ParseRuntimeCpuStats(getenv(kCpuStatsEnvVar)));
   return &layer_data;
 }
 
@@ -76,6 +90,15 @@ SPL_RUNTIME_LAYER_FUNC(VkResult, CreateInstance,
         // override.
         SPL_DISPATCH_INSTANCE_FUNC(DestroyInstance);
         SPL_DISPATCH_INSTANCE_FUNC(GetInstanceProcAddr);
+        // Get the next layer's instance of the instance functions we will use
+        // to decide which device extensions and features to enable.
+        SPL_DISPATCH_INSTANCE_FUNC(EnumerateDeviceExtensionProperties);
+        SPL_DISPATCH_INSTANCE_FUNC(GetPhysicalDeviceFeatures2);
+        SPL_DISPATCH_INSTANCE_FUNC(GetPhysicalDeviceFeatures2KHR);
+        SPL_DISPATCH_INSTANCE_FUNC(GetPhysicalDeviceProperties);
+        SPL_DISPATCH_INSTANCE_FUNC(GetPhysicalDeviceQueueFamilyProperties);
+        SPL_DISPATCH_INSTANCE_FUNC(
+            GetPhysicalDeviceCalibrateableTimeDomainsEXT);
         return dispatch_table;
       };
 
@@ -136,7 +159,8 @@ SPL_RUNTIME_LAYER_FUNC(VkResult, CreateGraphicsPipelines,
 }
 
 // Override for vkCmdBindPipeline.  Records the pipeline as the last pipeline
-// bound for the command buffer.
+// bound for the command buffer, and ends the measured region when the pipeline
+// changes.
 SPL_RUNTIME_LAYER_FUNC(void, CmdBindPipeline,
                        (VkCommandBuffer command_buffer,
                         VkPipelineBindPoint pipeline_bind_point,
@@ -144,66 +168,107 @@ SPL_RUNTIME_LAYER_FUNC(void, CmdBindPipeline,
   performancelayers::RuntimeLayerData* layer_data = GetLayerData();
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       command_buffer, &VkLayerDispatchTable::CmdBindPipeline);
+  if (auto* cpu_stats = layer_data->GetCpuStats()) {
+    cpu_stats->RecordPipelineBind();
+  }
+  if (!layer_data->ShouldTrackCommands()) {
+    next_proc(command_buffer, pipeline_bind_point, pipeline);
+    return;
+  }
+  layer_data->EndRegion(command_buffer, pipeline);
   next_proc(command_buffer, pipeline_bind_point, pipeline);
 
   layer_data->BindPipeline(command_buffer, pipeline);
 }
 
-// Override for vkCmdDispatch.  Adds commands to write timestamps before and
-// after the dispatch command that will be added.
-SPL_RUNTIME_LAYER_FUNC(void, CmdDispatch,
-                       (VkCommandBuffer command_buffer, uint32_t group_count_x,
-                        uint32_t group_count_y, uint32_t group_count_z)) {
+// Override for vkBeginCommandBuffer.  Prepares query slots for the new
+// recording of the command buffer, and starts timing the recording when the
+// CPU-side work is counted.
+SPL_RUNTIME_LAYER_FUNC(VkResult, BeginCommandBuffer,
+                       (VkCommandBuffer command_buffer,
+                        const VkCommandBufferBeginInfo* begin_info)) {
   performancelayers::RuntimeLayerData* layer_data = GetLayerData();
   auto next_proc = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdDispatch);
-
-  VkQueryPool timestamp_query_pool = VK_NULL_HANDLE;
-  VkQueryPool stat_query_pool = VK_NULL_HANDLE;
-  if (!layer_data->GetNewQueryInfo(command_buffer, &timestamp_query_pool,
-                                   &stat_query_pool)) {
-    // Couldn't allocate query pool - continue as if no tracing is in place.
-    next_proc(command_buffer, group_count_x, group_count_y, group_count_z);
-    return;
+      command_buffer, &VkLayerDispatchTable::BeginCommandBuffer);
+  auto* cpu_stats = layer_data->GetCpuStats();
+  const performancelayers::DurationClock::time_point begin =
+      cpu_stats ? performancelayers::Now()
+                : performancelayers::DurationClock::time_point();
+  VkResult result = next_proc(command_buffer, begin_info);
+  if (result == VK_SUCCESS) {
+    layer_data->BeginCommandBuffer(
+        command_buffer, *begin_info,
+        cpu_stats ? std::make_optional(begin) : std::nullopt);
   }
-  auto write_timestamp_function = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdWriteTimestamp);
-  auto begin_query_function = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdBeginQuery);
-  auto end_query_function = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdEndQuery);
-  auto pipeline_barrier_function = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdPipelineBarrier);
+  return result;
+}
 
-  // Ensure any previous commands have completed.
-  VkMemoryBarrier full_memory_barrier = {
-      VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr,
-      VK_ACCESS_MEMORY_WRITE_BIT | VK_ACCESS_MEMORY_READ_BIT,
-      VK_ACCESS_MEMORY_WRITE_BIT | VK_ACCESS_MEMORY_READ_BIT};
-  (pipeline_barrier_function)(
-      command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-      /*dependencyFlags=*/0,
-      /*memoryBarrierCount=*/1, &full_memory_barrier, 0, nullptr, 0, nullptr);
-  (begin_query_function)(command_buffer, stat_query_pool, /*queryIndex=*/0,
-                         /*flags=*/0);
+// Override for vkResetCommandBuffer.  Retires the query slots used by the
+// command buffer.
+SPL_RUNTIME_LAYER_FUNC(VkResult, ResetCommandBuffer,
+                       (VkCommandBuffer command_buffer,
+                        VkCommandBufferResetFlags flags)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      command_buffer, &VkLayerDispatchTable::ResetCommandBuffer);
+  layer_data->ResetCommandBuffer(command_buffer, /*freed=*/false);
+  return next_proc(command_buffer, flags);
+}
 
-  next_proc(command_buffer, group_count_x, group_count_y, group_count_z);
+// Override for vkFreeCommandBuffers.  Retires the query slots used by the
+// command buffers.
+SPL_RUNTIME_LAYER_FUNC(void, FreeCommandBuffers,
+                       (VkDevice device, VkCommandPool command_pool,
+                        uint32_t command_buffer_count,
+                        const VkCommandBuffer* command_buffers)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::FreeCommandBuffers);
+  layer_data->FreeCommandBuffers(command_pool, command_buffer_count,
+                                 command_buffers);
+  next_proc(device, command_pool, command_buffer_count, command_buffers);
+}
 
-  // Get the timestamp when the dispatch starts.
-  (write_timestamp_function)(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                             timestamp_query_pool, 0);
-  // Ensure the command has completed.
-  (pipeline_barrier_function)(
-      command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-      /*dependencyFlags=*/0,
-      /*memoryBarrierCount=*/1, &full_memory_barrier, 0, nullptr, 0, nullptr);
-  // Get the timestamp after the dispatch ends.
-  (write_timestamp_function)(command_buffer,
-                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                             timestamp_query_pool, 1);
-  (end_query_function)(command_buffer, stat_query_pool, /*queryIndex=*/0);
+// Override for vkAllocateCommandBuffers.  Records the command pool of the
+// command buffers, so that they can be reset along with it.
+SPL_RUNTIME_LAYER_FUNC(VkResult, AllocateCommandBuffers,
+                       (VkDevice device,
+                        const VkCommandBufferAllocateInfo* allocate_info,
+                        VkCommandBuffer* command_buffers)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::AllocateCommandBuffers);
+  VkResult result = next_proc(device, allocate_info, command_buffers);
+  if (result == VK_SUCCESS) {
+    layer_data->AllocateCommandBuffers(allocate_info->commandPool,
+                                       allocate_info->commandBufferCount,
+                                       command_buffers);
+  }
+  return result;
+}
+
+// Override for vkResetCommandPool.  Retires the query slots used by the
+// command buffers of the pool.
+SPL_RUNTIME_LAYER_FUNC(VkResult, ResetCommandPool,
+                       (VkDevice device, VkCommandPool command_pool,
+                        VkCommandPoolResetFlags flags)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::ResetCommandPool);
+  layer_data->ResetCommandPool(command_pool, /*destroyed=*/false);
+  return next_proc(device, command_pool, flags);
+}
+
+// Override for vkDestroyCommandPool.  Retires the query slots used by the
+// command buffers of the pool, which are freed along with it.
+SPL_RUNTIME_LAYER_FUNC(void, DestroyCommandPool,
+                       (VkDevice device, VkCommandPool command_pool,
+                        const VkAllocationCallbacks* allocator)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::DestroyCommandPool);
+  layer_data->ResetCommandPool(command_pool, /*destroyed=*/true);
+  next_proc(device, command_pool, allocator);
 }
 
 template <typename TFuncPtr, typename... Args>
@@ -211,24 +276,55 @@ static void WrapCallWithTimestamp(TFuncPtr func_ptr,
                                   VkCommandBuffer command_buffer,
                                   Args&&... args) {
   performancelayers::RuntimeLayerData* layer_data = GetLayerData();
-  auto next_proc = layer_data->GetNextDeviceProcAddr(command_buffer, func_ptr);
+  // Look up the dispatch table once for all the functions called below.
+  const VkLayerDispatchTable& dispatch_table =
+      layer_data->GetDeviceDispatchTable(command_buffer);
+  auto next_proc = dispatch_table.*func_ptr;
+  assert(next_proc);
+  if (auto* cpu_stats = layer_data->GetCpuStats()) {
+    cpu_stats->RecordDraw(layer_data->GetCpuRecording(command_buffer));
+  }
+  if (!layer_data->ShouldTrackCommands()) {
+    next_proc(command_buffer, std::forward<Args>(args)...);
+    return;
+  }
+  const performancelayers::RuntimeMode mode = layer_data->GetMode();
 
-  VkQueryPool timestamp_query_pool = VK_NULL_HANDLE;
-  VkQueryPool stat_query_pool = VK_NULL_HANDLE;
-  if (!layer_data->GetNewQueryInfo(command_buffer, &timestamp_query_pool,
-                                   &stat_query_pool)) {
-    // Couldn't allocate query pool - continue as if no tracing is in place.
+  if (performancelayers::RuntimeLayerData::IsRegionMode(mode)) {
+    // The timestamps are written when the region begins and ends.
+    layer_data->AddDrawToRegion(command_buffer);
     next_proc(command_buffer, std::forward<Args>(args)...);
     return;
   }
-  auto write_timestamp_function = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdWriteTimestamp);
-  auto pipeline_barrier_function = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdPipelineBarrier);
-  auto begin_query_function = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdBeginQuery);
-  auto end_query_function = layer_data->GetNextDeviceProcAddr(
-      command_buffer, &VkLayerDispatchTable::CmdEndQuery);
+
+  performancelayers::QuerySlotAllocator::Slot query_slot;
+  if (!layer_data->GetNewQueryInfo(command_buffer, &query_slot)) {
+    // Couldn't get a query slot - continue as if no tracing is in place.
+    next_proc(command_buffer, std::forward<Args>(args)...);
+    return;
+  }
+  auto write_timestamp_function = dispatch_table.CmdWriteTimestamp;
+  auto pipeline_barrier_function = dispatch_table.CmdPipelineBarrier;
+  auto begin_query_function = dispatch_table.CmdBeginQuery;
+  auto end_query_function = dispatch_table.CmdEndQuery;
+
+  if (mode == performancelayers::RuntimeMode::kPipelined) {
+    // Only mark the start and the end of the command, and let it overlap with
+    // the neighbouring commands.
+    (begin_query_function)(command_buffer, query_slot.stat_pool(),
+                           query_slot.stat_query(), /*flags=*/0);
+    (write_timestamp_function)(
+        command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        query_slot.timestamp_pool(), query_slot.first_timestamp_query());
+    next_proc(command_buffer, std::forward<Args>(args)...);
+    (write_timestamp_function)(command_buffer,
+                               VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                               query_slot.timestamp_pool(),
+                               query_slot.first_timestamp_query() + 1);
+    (end_query_function)(command_buffer, query_slot.stat_pool(),
+                         query_slot.stat_query());
+    return;
+  }
 
   // Ensure any previous commands have completed.
   VkMemoryBarrier full_memory_barrier = {
@@ -240,14 +336,15 @@ static void WrapCallWithTimestamp(TFuncPtr func_ptr,
       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
       /*dependencyFlags=*/0,
       /*memoryBarrierCount=*/1, &full_memory_barrier, 0, nullptr, 0, nullptr);
-  (begin_query_function)(command_buffer, stat_query_pool, /*queryIndex=*/0,
-                         /*flags=*/0);
+  (begin_query_function)(command_buffer, query_slot.stat_pool(),
+                         query_slot.stat_query(), /*flags=*/0);
 
   next_proc(command_buffer, std::forward<Args>(args)...);
 
   // Get the timestamp when the dispatch starts.
   (write_timestamp_function)(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                             timestamp_query_pool, 0);
+                             query_slot.timestamp_pool(),
+                             query_slot.first_timestamp_query());
   // Ensure the command has completed.
   (pipeline_barrier_function)(
       command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
@@ -257,8 +354,121 @@ static void WrapCallWithTimestamp(TFuncPtr func_ptr,
   // Get the timestamp after the dispatch ends.
   (write_timestamp_function)(command_buffer,
                              VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                             timestamp_query_pool, 1);
-  (end_query_function)(command_buffer, stat_query_pool, /*queryIndex=*/0);
+                             query_slot.timestamp_pool(),
+                             query_slot.first_timestamp_query() + 1);
+  (end_query_function)(command_buffer, query_slot.stat_pool(),
+                       query_slot.stat_query());
+}
+
+// Override for vkEndCommandBuffer.  Ends the measured region, if any, and the
+// measured recording.
+SPL_RUNTIME_LAYER_FUNC(VkResult, EndCommandBuffer,
+                       (VkCommandBuffer command_buffer)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      command_buffer, &VkLayerDispatchTable::EndCommandBuffer);
+  if (layer_data->ShouldTrackCommands()) {
+    layer_data->EndRegion(command_buffer);
+    layer_data->EndCommandBuffer(command_buffer);
+  }
+  VkResult result = next_proc(command_buffer);
+  // The recording is counted even if the capture window closed since it
+  // began.
+  if (auto* cpu_stats = layer_data->GetCpuStatsIgnoringCaptureWindow()) {
+    cpu_stats->EndRecording(layer_data->GetCpuRecording(command_buffer),
+                            performancelayers::Now());
+  }
+  return result;
+}
+
+// Calls the next layer's |func_ptr| after ending the measured region of
+// |command_buffer|. Queries cannot span render passes, subpasses, and executed
+// secondary command buffers, so regions end at these boundaries.
+template <typename TFuncPtr, typename... Args>
+static void EndRegionAndCall(TFuncPtr func_ptr, VkCommandBuffer command_buffer,
+                             Args&&... args) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(command_buffer, func_ptr);
+  if (layer_data->ShouldTrackCommands()) {
+    layer_data->EndRegion(command_buffer);
+  }
+  next_proc(command_buffer, std::forward<Args>(args)...);
+}
+
+// Override for vkCmdBeginRenderPass.  Ends the measured region, if any.
+SPL_RUNTIME_LAYER_FUNC(void, CmdBeginRenderPass,
+                       (VkCommandBuffer command_buffer,
+                        const VkRenderPassBeginInfo* render_pass_begin,
+                        VkSubpassContents contents)) {
+  EndRegionAndCall(&VkLayerDispatchTable::CmdBeginRenderPass, command_buffer,
+                   render_pass_begin, contents);
+}
+
+// Override for vkCmdNextSubpass.  Ends the measured region, if any.
+SPL_RUNTIME_LAYER_FUNC(void, CmdNextSubpass,
+                       (VkCommandBuffer command_buffer,
+                        VkSubpassContents contents)) {
+  EndRegionAndCall(&VkLayerDispatchTable::CmdNextSubpass, command_buffer,
+                   contents);
+}
+
+// Override for vkCmdEndRenderPass.  Ends the measured region, if any.
+SPL_RUNTIME_LAYER_FUNC(void, CmdEndRenderPass,
+                       (VkCommandBuffer command_buffer)) {
+  EndRegionAndCall(&VkLayerDispatchTable::CmdEndRenderPass, command_buffer);
+}
+
+// Override for vkCmdBeginRendering.  Ends the measured region, if any.
+SPL_RUNTIME_LAYER_FUNC(void, CmdBeginRendering,
+                       (VkCommandBuffer command_buffer,
+                        const VkRenderingInfo* rendering_info)) {
+  EndRegionAndCall(&VkLayerDispatchTable::CmdBeginRendering, command_buffer,
+                   rendering_info);
+}
+
+// Override for vkCmdEndRendering.  Ends the measured region, if any.
+SPL_RUNTIME_LAYER_FUNC(void, CmdEndRendering,
+                       (VkCommandBuffer command_buffer)) {
+  EndRegionAndCall(&VkLayerDispatchTable::CmdEndRendering, command_buffer);
+}
+
+// Override for vkCmdBeginRenderingKHR.  Ends the measured region, if any.
+SPL_RUNTIME_LAYER_FUNC(void, CmdBeginRenderingKHR,
+                       (VkCommandBuffer command_buffer,
+                        const VkRenderingInfo* rendering_info)) {
+  EndRegionAndCall(&VkLayerDispatchTable::CmdBeginRenderingKHR,
+                   command_buffer, rendering_info);
+}
+
+// Override for vkCmdEndRenderingKHR.  Ends the measured region, if any.
+SPL_RUNTIME_LAYER_FUNC(void, CmdEndRenderingKHR,
+                       (VkCommandBuffer command_buffer)) {
+  EndRegionAndCall(&VkLayerDispatchTable::CmdEndRenderingKHR, command_buffer);
+}
+
+// Override for vkCmdExecuteCommands.  Ends the measured region, if any, and
+// records the executed command buffers, so that their queries get attributed to
+// the submissions of |command_buffer|.
+SPL_RUNTIME_LAYER_FUNC(void, CmdExecuteCommands,
+                       (VkCommandBuffer command_buffer,
+                        uint32_t command_buffer_count,
+                        const VkCommandBuffer* command_buffers)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  if (layer_data->ShouldTrackCommands()) {
+    layer_data->ExecuteCommands(command_buffer, command_buffer_count,
+                                command_buffers);
+  }
+  EndRegionAndCall(&VkLayerDispatchTable::CmdExecuteCommands, command_buffer,
+                   command_buffer_count, command_buffers);
+}
+
+// Override for vkCmdDispatch.  Adds commands to write timestamps before and
+// after the dispatch command that will be added.
+SPL_RUNTIME_LAYER_FUNC(void, CmdDispatch,
+                       (VkCommandBuffer command_buffer, uint32_t group_count_x,
+                        uint32_t group_count_y, uint32_t group_count_z)) {
+  WrapCallWithTimestamp(&VkLayerDispatchTable::CmdDispatch, command_buffer,
+                        group_count_x, group_count_y, group_count_z);
 }
 
 // Override for vkCmdDraw.  Adds commands to write timestamps before and
@@ -303,28 +513,100 @@ SPL_RUNTIME_LAYER_FUNC(void, CmdDrawIndexedIndirect,
                         command_buffer, buffer, offset, draw_count, stride);
 }
 
-// Override for vkDeviceWaitIdle. Checks for timestamps that are available after
-// waiting.
+// Override for vkDeviceWaitIdle. Wakes up the collector thread of the device,
+// as timestamps are likely available after waiting.
 SPL_RUNTIME_LAYER_FUNC(VkResult, DeviceWaitIdle, (VkDevice device)) {
   performancelayers::RuntimeLayerData* layer_data = GetLayerData();
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       device, &VkLayerDispatchTable::DeviceWaitIdle);
   VkResult result = next_proc(device);
-  layer_data->LogAndRemoveQueryPools();
+  layer_data->WakeUpQueryCollector(performancelayers::DeviceKey(device));
   return result;
 }
 
-// Override for vkQueueWaitIdle.  Checks for timestamps that are available after
-// waiting.
+// Override for vkQueueWaitIdle.  Wakes up the collector thread of the device,
+// as timestamps are likely available after waiting.
 SPL_RUNTIME_LAYER_FUNC(VkResult, QueueWaitIdle, (VkQueue queue)) {
   performancelayers::RuntimeLayerData* layer_data = GetLayerData();
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       queue, &VkLayerDispatchTable::QueueWaitIdle);
   VkResult result = next_proc(queue);
-  layer_data->LogAndRemoveQueryPools();
+  layer_data->WakeUpQueryCollector(performancelayers::DeviceKey(queue));
   return result;
 }
 
+// Override for vkQueueSubmit.  Tracks the submitted command buffers, so that
+// their results can be read once the submission has finished, and times the
+// submission when the CPU-side work is counted.
+SPL_RUNTIME_LAYER_FUNC(VkResult, QueueSubmit,
+                       (VkQueue queue, uint32_t submit_count,
+                        const VkSubmitInfo* submits, VkFence fence)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      queue, &VkLayerDispatchTable::QueueSubmit);
+  return layer_data->QueueSubmit(queue, submit_count, submits, fence,
+                                 next_proc);
+}
+
+// Override for vkQueueSubmit2.  Same as vkQueueSubmit.
+SPL_RUNTIME_LAYER_FUNC(VkResult, QueueSubmit2,
+                       (VkQueue queue, uint32_t submit_count,
+                        const VkSubmitInfo2* submits, VkFence fence)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      queue, &VkLayerDispatchTable::QueueSubmit2);
+  return layer_data->QueueSubmit2(queue, submit_count, submits, fence,
+                                  next_proc);
+}
+
+// Override for vkQueueSubmit2KHR.  Same as vkQueueSubmit.
+SPL_RUNTIME_LAYER_FUNC(VkResult, QueueSubmit2KHR,
+                       (VkQueue queue, uint32_t submit_count,
+                        const VkSubmitInfo2* submits, VkFence fence)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      queue, &VkLayerDispatchTable::QueueSubmit2KHR);
+  return layer_data->QueueSubmit2(queue, submit_count, submits, fence,
+                                  next_proc);
+}
+
+// Override for vkQueuePresentKHR.  Starts a new frame, and ends the frame of
+// the capture window once the present returns.
+SPL_RUNTIME_LAYER_FUNC(VkResult, QueuePresentKHR,
+                       (VkQueue queue, const VkPresentInfoKHR* present_info)) {
+  performancelayers::ScopedCapturePresent capture_present;
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      queue, &VkLayerDispatchTable::QueuePresentKHR);
+  layer_data->Present(queue);
+  return next_proc(queue, present_info);
+}
+
+// Override for vkUpdateDescriptorSets.  Times the update when the CPU-side
+// work is counted.
+SPL_RUNTIME_LAYER_FUNC(void, UpdateDescriptorSets,
+                       (VkDevice device, uint32_t descriptor_write_count,
+                        const VkWriteDescriptorSet* descriptor_writes,
+                        uint32_t descriptor_copy_count,
+                        const VkCopyDescriptorSet* descriptor_copies)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::UpdateDescriptorSets);
+  auto* cpu_stats = layer_data->GetCpuStats();
+  if (!cpu_stats) {
+    next_proc(device, descriptor_write_count, descriptor_writes,
+              descriptor_copy_count, descriptor_copies);
+    return;
+  }
+  const performancelayers::DurationClock::time_point start =
+      performancelayers::Now();
+  next_proc(device, descriptor_write_count, descriptor_writes,
+            descriptor_copy_count, descriptor_copies);
+  cpu_stats->RecordDescriptorUpdate(descriptor_write_count,
+                                    descriptor_copy_count,
+                                    performancelayers::Now() - start);
+}
+
 // Override for vkCreateShaderModule.  Records the hash of the shader module in
 // the layer data.
 SPL_RUNTIME_LAYER_FUNC(VkResult, CreateShaderModule,
@@ -345,20 +627,35 @@ SPL_RUNTIME_LAYER_FUNC(void, DestroyShaderModule,
   return GetLayerData()->DestroyShaderModule(device, shader_module, allocator);
 }
 
-// Override for vkDestroyDevice.  Removes the dispatch table for the device from
-// the layer data.
+// Override for vkDestroyPipeline.  Erases the hash of the pipeline from the
+// layer data, once the results measured with the pipeline have been logged.
+SPL_RUNTIME_LAYER_FUNC(void, DestroyPipeline,
+                       (VkDevice device, VkPipeline pipeline,
+                        const VkAllocationCallbacks* allocator)) {
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  auto next_proc = layer_data->GetNextDeviceProcAddr(
+      device, &VkLayerDispatchTable::DestroyPipeline);
+  layer_data->DestroyPipeline(device, pipeline);
+  next_proc(device, pipeline, allocator);
+}
+
+// Override for vkDestroyDevice.  Destroys the query pools of the device and
+// removes the dispatch table for the device from the layer data.
 SPL_RUNTIME_LAYER_FUNC(void, DestroyDevice,
                        (VkDevice device,
                         const VkAllocationCallbacks* allocator)) {
   performancelayers::RuntimeLayerData* layer_data = GetLayerData();
   auto next_proc = layer_data->GetNextDeviceProcAddr(
       device, &VkLayerDispatchTable::DestroyDevice);
+  layer_data->DestroyQuerySlots(device);
   layer_data->RemoveDevice(device);
   next_proc(device, allocator);
 }
 
 // Override for vkCreateDevice.  Builds the dispatch table for the new device
-// and add it to the layer data.
+// and add it to the layer data. Enables host query reset, calibrated
+// timestamps and timeline semaphores, when supported, and creates the query
+// slot allocator for the device.
 SPL_RUNTIME_LAYER_FUNC(VkResult, CreateDevice,
                        (VkPhysicalDevice physical_device,
                         const VkDeviceCreateInfo* create_info,
@@ -375,6 +672,7 @@ SPL_RUNTIME_LAYER_FUNC(VkResult, CreateDevice,
     SPL_DISPATCH_DEVICE_FUNC(CreateGraphicsPipelines);
     SPL_DISPATCH_DEVICE_FUNC(CreateShaderModule);
     SPL_DISPATCH_DEVICE_FUNC(DestroyShaderModule);
+    SPL_DISPATCH_DEVICE_FUNC(DestroyPipeline);
     SPL_DISPATCH_DEVICE_FUNC(CmdBindPipeline);
     SPL_DISPATCH_DEVICE_FUNC(CmdDispatch);
     SPL_DISPATCH_DEVICE_FUNC(CmdDraw);
@@ -382,6 +680,26 @@ SPL_RUNTIME_LAYER_FUNC(VkResult, CreateDevice,
     SPL_DISPATCH_DEVICE_FUNC(CmdDrawIndirect);
     SPL_DISPATCH_DEVICE_FUNC(CmdDrawIndexedIndirect);
     SPL_DISPATCH_DEVICE_FUNC(QueueWaitIdle);
+    SPL_DISPATCH_DEVICE_FUNC(QueueSubmit);
+    SPL_DISPATCH_DEVICE_FUNC(QueueSubmit2);
+    SPL_DISPATCH_DEVICE_FUNC(QueueSubmit2KHR);
+    SPL_DISPATCH_DEVICE_FUNC(UpdateDescriptorSets);
+    SPL_DISPATCH_DEVICE_FUNC(QueuePresentKHR);
+    SPL_DISPATCH_DEVICE_FUNC(BeginCommandBuffer);
+    SPL_DISPATCH_DEVICE_FUNC(EndCommandBuffer);
+    SPL_DISPATCH_DEVICE_FUNC(ResetCommandBuffer);
+    SPL_DISPATCH_DEVICE_FUNC(FreeCommandBuffers);
+    SPL_DISPATCH_DEVICE_FUNC(AllocateCommandBuffers);
+    SPL_DISPATCH_DEVICE_FUNC(ResetCommandPool);
+    SPL_DISPATCH_DEVICE_FUNC(DestroyCommandPool);
+    SPL_DISPATCH_DEVICE_FUNC(CmdBeginRenderPass);
+    SPL_DISPATCH_DEVICE_FUNC(CmdNextSubpass);
+    SPL_DISPATCH_DEVICE_FUNC(CmdEndRenderPass);
+    SPL_DISPATCH_DEVICE_FUNC(CmdBeginRendering);
+    SPL_DISPATCH_DEVICE_FUNC(CmdEndRendering);
+    SPL_DISPATCH_DEVICE_FUNC(CmdBeginRenderingKHR);
+    SPL_DISPATCH_DEVICE_FUNC(CmdEndRenderingKHR);
+    SPL_DISPATCH_DEVICE_FUNC(CmdExecuteCommands);
     // Get the next layer's instance of the device functions we will use. We do
     // not call these Vulkan functions directly to avoid re-entering the Vulkan
     // loader and confusing it.
@@ -393,11 +711,44 @@ SPL_RUNTIME_LAYER_FUNC(VkResult, CreateDevice,
     SPL_DISPATCH_DEVICE_FUNC(CreateQueryPool);
     SPL_DISPATCH_DEVICE_FUNC(DestroyQueryPool);
     SPL_DISPATCH_DEVICE_FUNC(GetQueryPoolResults);
+    SPL_DISPATCH_DEVICE_FUNC(CreateFence);
+    SPL_DISPATCH_DEVICE_FUNC(DestroyFence);
+    SPL_DISPATCH_DEVICE_FUNC(ResetFences);
+    SPL_DISPATCH_DEVICE_FUNC(GetFenceStatus);
+    SPL_DISPATCH_DEVICE_FUNC(CreateSemaphore);
+    SPL_DISPATCH_DEVICE_FUNC(DestroySemaphore);
+    // Only available when timeline semaphores are enabled.
+    SPL_DISPATCH_DEVICE_FUNC(GetSemaphoreCounterValue);
+    SPL_DISPATCH_DEVICE_FUNC(GetSemaphoreCounterValueKHR);
+    // Only available when VK_EXT_calibrated_timestamps is enabled.
+    SPL_DISPATCH_DEVICE_FUNC(GetCalibratedTimestampsEXT);
+    // These are only available when host query reset is enabled.
+    SPL_DISPATCH_DEVICE_FUNC(ResetQueryPool);
+    SPL_DISPATCH_DEVICE_FUNC(ResetQueryPoolEXT);
     return dispatch_table;
   };
 
-  return GetLayerData()->CreateDevice(physical_device, create_info, allocator,
-                                      device, build_dispatch_table);
+  performancelayers::RuntimeLayerData* layer_data = GetLayerData();
+  performancelayers::ExtendedDeviceCreateInfo extended_create_info(
+      *create_info);
+  VkPhysicalDeviceHostQueryResetFeaturesEXT host_query_reset_features = {};
+  const bool host_query_reset = layer_data->EnableHostQueryReset(
+      physical_device, &extended_create_info, &host_query_reset_features);
+  const bool calibrated_timestamps = layer_data->EnableCalibratedTimestamps(
+      physical_device, &extended_create_info);
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_features =
+      {};
+  const bool timeline_semaphores = layer_data->EnableTimelineSemaphores(
+      physical_device, &extended_create_info, &timeline_semaphore_features);
+
+  VkResult result =
+      layer_data->CreateDevice(physical_device, extended_create_info.get(),
+                               allocator, device, build_dispatch_table);
+  if (result == VK_SUCCESS) {
+    layer_data->InitQuerySlots(*device, host_query_reset,
+                               calibrated_timestamps, timeline_semaphores);
+  }
+  return result;
 }
 
 SPL_RUNTIME_LAYER_FUNC(VkResult, EnumerateInstanceLayerProperties,
@@ -16,133 +16,1468 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+#include <utility>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
 #include "debug_logging.h"
 
 namespace performancelayers {
+namespace {
+// How often the collector threads check for query results when nothing wakes
+// them up.
+constexpr absl::Duration kQueryCollectorInterval = absl::Milliseconds(10);
+// How often the GPU clocks are calibrated against the host clock, to account
+// for drift.
+constexpr auto kTimestampCalibrationInterval = std::chrono::seconds(1);
 
-bool RuntimeLayerData::GetNewQueryInfo(VkCommandBuffer cmd_buf,
-                                       VkQueryPool* timestamp_query_pool,
-                                       VkQueryPool* stat_query_pool) {
-  VkQueryPoolCreateInfo createInfo = {};
-  createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-  createInfo.pNext = nullptr;
-  createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
-  createInfo.queryCount = 2;
-
-  auto create_query_pool_function =
-      GetNextDeviceProcAddr(cmd_buf, &VkLayerDispatchTable::CreateQueryPool);
-
-  VkDevice device = GetDevice(DeviceKey(cmd_buf));
-  auto ret = (create_query_pool_function)(device, &createInfo, nullptr,
-                                          timestamp_query_pool);
-  if (ret != VK_SUCCESS) {
+// Changes whenever the recording state of a command buffer gets erased, which
+// invalidates the entries cached by the threads recording command buffers.
+std::atomic<uint64_t> cmd_buf_info_generation = 0;
+
+// Returns true if |domains| contains |domain|.
+bool HasTimeDomain(const std::vector<VkTimeDomainEXT>& domains,
+                   VkTimeDomainEXT domain) {
+  return std::find(domains.begin(), domains.end(), domain) != domains.end();
+}
+
+// Returns the number of command buffers of |batch|, and the |index|th one.
+uint32_t GetCommandBufferCount(const VkSubmitInfo& batch) {
+  return batch.commandBufferCount;
+}
+VkCommandBuffer GetCommandBuffer(const VkSubmitInfo& batch, uint32_t index) {
+  return batch.pCommandBuffers[index];
+}
+uint32_t GetCommandBufferCount(const VkSubmitInfo2& batch) {
+  return batch.commandBufferInfoCount;
+}
+VkCommandBuffer GetCommandBuffer(const VkSubmitInfo2& batch, uint32_t index) {
+  return batch.pCommandBufferInfos[index].commandBuffer;
+}
+
+// A copy of the batches of a submission, the last of which also signals a
+// timeline semaphore of the layer.
+template <typename SubmitInfoT>
+class SignalingBatches;
+
+template <>
+class SignalingBatches<VkSubmitInfo> {
+ public:
+  SignalingBatches(uint32_t batch_count, const VkSubmitInfo* batches,
+                   VkSemaphore semaphore, uint64_t value)
+      : batches_(batches, batches + batch_count) {
+    assert(batch_count != 0);
+    const VkSubmitInfo& last = batches_.back();
+    timeline_info_.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    if (FindInChain<VkTimelineSemaphoreSubmitInfo>(
+            last.pNext, VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO)) {
+      // The structure can only be chained once, so signal from one more batch
+      // rather than from the last batch of the application.
+      VkSubmitInfo signaling = {};
+      signaling.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      batches_.push_back(signaling);
+    } else {
+      semaphores_.assign(last.pSignalSemaphores,
+                         last.pSignalSemaphores + last.signalSemaphoreCount);
+      // The values of binary semaphores are ignored.
+      values_.assign(semaphores_.size(), 0);
+      timeline_info_.pNext = last.pNext;
+    }
+    semaphores_.push_back(semaphore);
+    values_.push_back(value);
+    timeline_info_.signalSemaphoreValueCount =
+        static_cast<uint32_t>(values_.size());
+    timeline_info_.pSignalSemaphoreValues = values_.data();
+
+    VkSubmitInfo& signaling = batches_.back();
+    signaling.pNext = &timeline_info_;
+    signaling.signalSemaphoreCount = static_cast<uint32_t>(semaphores_.size());
+    signaling.pSignalSemaphores = semaphores_.data();
+  }
+
+  SignalingBatches(const SignalingBatches&) = delete;
+  SignalingBatches& operator=(const SignalingBatches&) = delete;
+
+  uint32_t size() const { return static_cast<uint32_t>(batches_.size()); }
+  const VkSubmitInfo* data() const { return batches_.data(); }
+
+ private:
+  std::vector<VkSubmitInfo> batches_;
+  std::vector<VkSemaphore> semaphores_;
+  std::vector<uint64_t> values_;
+  VkTimelineSemaphoreSubmitInfo timeline_info_ = {};
+};
+
+template <>
+class SignalingBatches<VkSubmitInfo2> {
+ public:
+  SignalingBatches(uint32_t batch_count, const VkSubmitInfo2* batches,
+                   VkSemaphore semaphore, uint64_t value)
+      : batches_(batches, batches + batch_count) {
+    assert(batch_count != 0);
+    VkSubmitInfo2& last = batches_.back();
+    semaphores_.assign(
+        last.pSignalSemaphoreInfos,
+        last.pSignalSemaphoreInfos + last.signalSemaphoreInfoCount);
+    VkSemaphoreSubmitInfo& info = semaphores_.emplace_back();
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    info.semaphore = semaphore;
+    info.value = value;
+    info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    last.signalSemaphoreInfoCount = static_cast<uint32_t>(semaphores_.size());
+    last.pSignalSemaphoreInfos = semaphores_.data();
+  }
+
+  SignalingBatches(const SignalingBatches&) = delete;
+  SignalingBatches& operator=(const SignalingBatches&) = delete;
+
+  uint32_t size() const { return static_cast<uint32_t>(batches_.size()); }
+  const VkSubmitInfo2* data() const { return batches_.data(); }
+
+ private:
+  std::vector<VkSubmitInfo2> batches_;
+  std::vector<VkSemaphoreSubmitInfo> semaphores_;
+};
+}  // namespace
+
+RuntimeMode ParseRuntimeMode(const char* mode_name) {
+  if (mode_name == nullptr) {
+    return RuntimeMode::kSerialized;
+  }
+
+  std::string_view mode(mode_name);
+  if (mode == "serialized") return RuntimeMode::kSerialized;
+  if (mode == "pipelined") return RuntimeMode::kPipelined;
+  if (mode == "region") return RuntimeMode::kRegion;
+  if (mode == "render_pass") return RuntimeMode::kRenderPass;
+
+  SPL_LOG(WARNING) << "Unknown runtime mode '" << mode
+                   << "', using 'serialized'.";
+  return RuntimeMode::kSerialized;
+}
+
+DrawSamplingConfig ParseRuntimeSampling(const char* config_str,
+                                        RuntimeMode mode) {
+  if (config_str == nullptr) {
+    return {};
+  }
+
+  absl::StatusOr<DrawSamplingConfig> config =
+      ParseDrawSamplingConfig(config_str);
+  if (!config.ok()) {
+    SPL_LOG(WARNING) << "Invalid draw sampling '" << config_str
+                     << "': " << config.status() << ". Measuring all draws.";
+    return {};
+  }
+  if (!config->SamplesAll() && RuntimeLayerData::IsRegionMode(mode)) {
+    SPL_LOG(WARNING) << "Draw sampling is not supported in the region modes. "
+                        "Measuring all draws.";
+    return {};
+  }
+  return *config;
+}
+
+uint32_t ParseRuntimeAggregateFrames(const char* frames_str) {
+  if (frames_str == nullptr) {
+    return 0;
+  }
+  uint32_t frames = 0;
+  if (!absl::SimpleAtoi(frames_str, &frames)) {
+    SPL_LOG(WARNING) << "Invalid number of aggregated frames '" << frames_str
+                     << "'. Logging each result.";
+    return 0;
+  }
+  return frames;
+}
+
+RuntimeCpuStats ParseRuntimeCpuStats(const char* setting) {
+  if (setting == nullptr) {
+    return RuntimeCpuStats::kOff;
+  }
+
+  std::string_view value(setting);
+  if (value == "0") return RuntimeCpuStats::kOff;
+  if (value == "1") return RuntimeCpuStats::kOn;
+  if (value == "only") return RuntimeCpuStats::kOnly;
+
+  SPL_LOG(WARNING) << "Invalid CPU statistics setting '" << value
+                   << "'. Not counting the CPU-side work.";
+  return RuntimeCpuStats::kOff;
+}
+
+std::string RuntimeLayerData::GetLogHeader(RuntimeMode mode,
+                                           const DrawSamplingConfig& sampling,
+                                           uint32_t aggregate_frames) {
+  if (aggregate_frames != 0) {
+    return "Pipeline,Query Count,Draw Count,Total Run Time (ns),Min Run Time "
+           "(ns),Max Run Time (ns),Mean Run Time (ns),Estimated Run Time "
+           "(ns),Fragment Shader Invocations,Compute Shader Invocations,Run "
+           "Time Histogram,First Frame,Last Frame";
+  }
+  return absl::StrCat(
+      "Pipeline,Run Time (ns),Fragment Shader Invocations,Compute Shader "
+      "Invocations,",
+      IsRegionMode(mode) ? "Draw Count," : "", "Frame,Submit",
+      sampling.SamplesAll() ? "" : ",Sample Weight");
+}
+
+bool RuntimeLayerData::EnableHostQueryReset(
+    VkPhysicalDevice physical_device, ExtendedDeviceCreateInfo* create_info,
+    VkPhysicalDeviceHostQueryResetFeaturesEXT* features) const {
+  assert(create_info);
+  assert(features);
+  // The feature can only be specified once in the chain, so if the
+  // application has done that, use whatever it asked for.
+  if (auto* app_features =
+          create_info->FindInChain<VkPhysicalDeviceHostQueryResetFeaturesEXT>(
+              VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT)) {
+    return app_features->hostQueryReset == VK_TRUE;
+  }
+  if (auto* app_features =
+          create_info->FindInChain<VkPhysicalDeviceVulkan12Features>(
+              VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES)) {
+    return app_features->hostQueryReset == VK_TRUE;
+  }
+
+  if (!IsDeviceExtensionSupported(physical_device,
+                                  VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME)) {
+    return false;
+  }
+  VkPhysicalDeviceHostQueryResetFeaturesEXT supported_features = {};
+  supported_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features2 = {};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &supported_features;
+  if (!GetPhysicalDeviceFeatures2(physical_device, &features2) ||
+      supported_features.hostQueryReset != VK_TRUE) {
     return false;
   }
 
-  createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
-  createInfo.queryCount = 1;
-  createInfo.pipelineStatistics =
-      VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
-      VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
-  ret = (create_query_pool_function)(device, &createInfo, nullptr,
-                                     stat_query_pool);
-  if (ret != VK_SUCCESS) {
-    auto destroy_query_pool_function =
-        GetNextDeviceProcAddr(device, &VkLayerDispatchTable::DestroyQueryPool);
-    (destroy_query_pool_function)(device, *timestamp_query_pool, nullptr);
+  *features = {};
+  features->sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+  features->hostQueryReset = VK_TRUE;
+  create_info->EnableExtension(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME);
+  create_info->PrependToChain(reinterpret_cast<VkBaseOutStructure*>(features));
+  return true;
+}
+
+bool RuntimeLayerData::EnableTimelineSemaphores(
+    VkPhysicalDevice physical_device, ExtendedDeviceCreateInfo* create_info,
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR* features) const {
+  assert(create_info);
+  assert(features);
+  // The feature can only be specified once in the chain, so if the
+  // application has done that, use whatever it asked for.
+  using TimelineFeatures = VkPhysicalDeviceTimelineSemaphoreFeaturesKHR;
+  if (auto* app_features = create_info->FindInChain<TimelineFeatures>(
+          VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR)) {
+    return app_features->timelineSemaphore == VK_TRUE;
+  }
+  if (auto* app_features =
+          create_info->FindInChain<VkPhysicalDeviceVulkan12Features>(
+              VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES)) {
+    return app_features->timelineSemaphore == VK_TRUE;
+  }
+
+  if (!IsDeviceExtensionSupported(physical_device,
+                                  VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+    return false;
+  }
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR supported_features = {};
+  supported_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  VkPhysicalDeviceFeatures2 features2 = {};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &supported_features;
+  if (!GetPhysicalDeviceFeatures2(physical_device, &features2) ||
+      supported_features.timelineSemaphore != VK_TRUE) {
     return false;
   }
 
-  absl::MutexLock lock(&timestamp_queries_lock_);
-  timestamp_queries_.push_back(
-      {*timestamp_query_pool, *stat_query_pool, cmd_buf, GetPipeline(cmd_buf)});
+  *features = {};
+  features->sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  features->timelineSemaphore = VK_TRUE;
+  create_info->EnableExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+  create_info->PrependToChain(reinterpret_cast<VkBaseOutStructure*>(features));
+  return true;
+}
 
+bool RuntimeLayerData::EnableCalibratedTimestamps(
+    VkPhysicalDevice physical_device,
+    ExtendedDeviceCreateInfo* create_info) const {
+  assert(create_info);
+  auto get_time_domains = GetNextInstanceProcAddrOrNull(
+      physical_device, &VkLayerInstanceDispatchTable::
+                           GetPhysicalDeviceCalibrateableTimeDomainsEXT);
+  if (!get_time_domains ||
+      !IsDeviceExtensionSupported(physical_device,
+                                  VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+    return false;
+  }
+
+  uint32_t domain_count = 0;
+  if (get_time_domains(physical_device, &domain_count, nullptr) !=
+      VK_SUCCESS) {
+    return false;
+  }
+  std::vector<VkTimeDomainEXT> domains(domain_count);
+  if (get_time_domains(physical_device, &domain_count, domains.data()) !=
+      VK_SUCCESS) {
+    return false;
+  }
+  // The host timestamps are taken with CLOCK_MONOTONIC, which is what the
+  // steady clock uses where this domain is available.
+  if (!HasTimeDomain(domains, VK_TIME_DOMAIN_DEVICE_EXT) ||
+      !HasTimeDomain(domains, VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT)) {
+    return false;
+  }
+
+  create_info->EnableExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
   return true;
 }
 
-void RuntimeLayerData::LogAndRemoveQueryPools() {
-  absl::MutexLock lock(&timestamp_queries_lock_);
-  for (auto info = timestamp_queries_.begin();
-       info != timestamp_queries_.end();) {
-    VkCommandBuffer cmd_buf = info->command_buffer;
-    auto query_pool_results_function = GetNextDeviceProcAddr(
-        cmd_buf, &VkLayerDispatchTable::GetQueryPoolResults);
-    auto destroy_query_pool_function =
-        GetNextDeviceProcAddr(cmd_buf, &VkLayerDispatchTable::DestroyQueryPool);
-
-    constexpr uint64_t kInvalidValue = ~uint64_t(0);
-    uint64_t query_data[2] = {kInvalidValue, kInvalidValue};
-    VkDevice device = GetDevice(DeviceKey(cmd_buf));
-    VkResult result = (query_pool_results_function)(
-        device, info->timestamp_pool,
-        /*firstQuery=*/0, /*queryCount=*/2,
-        /*dataSize=*/sizeof(query_data), /*pData=*/&query_data,
-        /*stride=*/sizeof(uint64_t),
-        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
-
-    // FIXME: We should check timestampValidBits and use it to mask the results
-    // here. The current ICD always produces either 64 or 0 bit of results, so
-    // not masking at all seems fine for now.
-    const uint64_t& timestamp0 = query_data[0];
-    const uint64_t& timestamp1 = query_data[1];
-
-    const bool result_available =
-        (result == VK_SUCCESS && timestamp0 != 0 && timestamp1 != 0);
-    bool discard_result = false;
-    constexpr uint64_t kUnreasonablyLongRuntime = 10ull * 1000 * 1000 * 1000;
-
-    if (result != VK_SUCCESS && result != VK_NOT_READY) {
-      // This query failed for some reason. Remove it from the list so we do
-      // not keep checking it.  Write an error to stderr.
-      SPL_LOG(ERROR) << "Timestamp query failed for "
-                     << PipelineHashToString(GetPipelineHash(info->pipeline))
-                     << " with error " << result;
-      discard_result = true;
-    } else if (result_available &&
-               (timestamp0 == kInvalidValue || timestamp1 == kInvalidValue ||
-                timestamp1 <= timestamp0 ||
-                (timestamp1 - timestamp0 > kUnreasonablyLongRuntime))) {
-      // This query did not produce valid timestamps for some reason. Remove
-      // it from the list so we do not keep checking it.
-      SPL_LOG(ERROR) << "Timestamp query failed for "
-                     << PipelineHashToString(GetPipelineHash(info->pipeline))
-                     << " producing invalid timestamps: t0=" << timestamp0
-                     << ", t1=" << timestamp1;
-      discard_result = true;
-    }
-
-    if (!result_available && !discard_result) {
-      ++info;
+RuntimeLayerData::~RuntimeLayerData() {
+  absl::MutexLock lock(&device_queries_lock_);
+  // The devices may be gone already, so don't touch their queries, and leak
+  // their query pools.
+  for (auto& key_and_queries : device_queries_) {
+    StopQueryCollector(key_and_queries.second.get(), /*read_on_stop=*/false);
+    (void)key_and_queries.second->allocator.release();
+  }
+  cmd_buf_info_generation.fetch_add(1, std::memory_order_release);
+}
+
+void RuntimeLayerData::InitQuerySlots(VkDevice device, bool host_query_reset,
+                                      bool calibrated_timestamps,
+                                      bool timeline_semaphores) {
+  PFN_vkResetQueryPool host_reset_function = nullptr;
+  if (host_query_reset) {
+    host_reset_function = GetNextDeviceProcAddrOrNull(
+        device, &VkLayerDispatchTable::ResetQueryPoolEXT);
+    if (!host_reset_function) {
+      host_reset_function = GetNextDeviceProcAddrOrNull(
+          device, &VkLayerDispatchTable::ResetQueryPool);
+    }
+  }
+  if (!host_reset_function) {
+    SPL_LOG(WARNING) << "Host query reset is not available. Queries will be "
+                        "reset in command buffers, and the first recording of "
+                        "each command buffer will not be measured.";
+  }
+
+  auto queries = std::make_unique<DeviceQueries>();
+  queries->device = device;
+  queries->allocator = std::make_unique<QuerySlotAllocator>(
+      device,
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::CreateQueryPool),
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::DestroyQueryPool),
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::CmdResetQueryPool),
+      host_reset_function);
+  queries->get_query_pool_results =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::GetQueryPoolResults);
+  queries->create_fence =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::CreateFence);
+  queries->destroy_fence =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::DestroyFence);
+  queries->reset_fences =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::ResetFences);
+  queries->get_fence_status =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::GetFenceStatus);
+  queries->create_semaphore =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::CreateSemaphore);
+  queries->destroy_semaphore =
+      GetNextDeviceProcAddr(device, &VkLayerDispatchTable::DestroySemaphore);
+  if (timeline_semaphores) {
+    queries->get_semaphore_counter_value = GetNextDeviceProcAddrOrNull(
+        device, &VkLayerDispatchTable::GetSemaphoreCounterValueKHR);
+    if (!queries->get_semaphore_counter_value) {
+      queries->get_semaphore_counter_value = GetNextDeviceProcAddrOrNull(
+          device, &VkLayerDispatchTable::GetSemaphoreCounterValue);
+    }
+  }
+  if (calibrated_timestamps) {
+    queries->get_calibrated_timestamps = GetNextDeviceProcAddrOrNull(
+        device, &VkLayerDispatchTable::GetCalibratedTimestampsEXT);
+  }
+  queries->calibration =
+      TimestampCalibration(GetTimestampProperties(DeviceKey(device)));
+  DeviceQueries* queries_ptr = queries.get();
+  queries->collector =
+      std::thread([this, queries_ptr] { RunQueryCollector(queries_ptr); });
+
+  std::unique_ptr<DeviceQueries> previous;
+  {
+    absl::MutexLock lock(&device_queries_lock_);
+    std::unique_ptr<DeviceQueries>& entry = device_queries_[DeviceKey(device)];
+    previous = std::move(entry);
+    entry = std::move(queries);
+  }
+  if (previous) {
+    StopQueryCollector(previous.get(), /*read_on_stop=*/false);
+  }
+}
+
+void RuntimeLayerData::DestroyQuerySlots(VkDevice device) {
+  DeviceQueries* queries = GetDeviceQueries(DeviceKey(device));
+  if (!queries) {
+    return;
+  }
+
+  // The application has to wait for the device to finish its work before
+  // destroying it, so this logs all the results that are left.
+  StopQueryCollector(queries, /*read_on_stop=*/true);
+  {
+    absl::MutexLock lock(&queries->lock);
+    for (VkFence fence : queries->fences) {
+      queries->destroy_fence(device, fence, nullptr);
+    }
+    queries->fences.clear();
+    queries->free_fences.clear();
+    for (const auto& [queue, timeline] : queries->timelines) {
+      queries->destroy_semaphore(device, timeline.semaphore, nullptr);
+    }
+    queries->timelines.clear();
+  }
+  {
+    absl::MutexLock lock(&cmd_buf_info_lock_);
+    absl::erase_if(cmd_buf_info_, [this, queries](auto& cmd_buf_and_info) {
+      if (cmd_buf_and_info.second.device_queries != queries) {
+        return false;
+      }
+      StopMeasuring(&cmd_buf_and_info.second);
+      return true;
+    });
+    command_buffer_count_.store(cmd_buf_info_.size(),
+                                std::memory_order_relaxed);
+  }
+  cmd_buf_info_generation.fetch_add(1, std::memory_order_release);
+
+  absl::MutexLock lock(&device_queries_lock_);
+  device_queries_.erase(DeviceKey(device));
+}
+
+RuntimeLayerData::DeviceQueries* RuntimeLayerData::GetDeviceQueries(
+    DeviceKey key) const {
+  absl::MutexLock lock(&device_queries_lock_);
+  if (auto it = device_queries_.find(key); it != device_queries_.end()) {
+    return it->second.get();
+  }
+  return nullptr;
+}
+
+void RuntimeLayerData::StopQueryCollector(DeviceQueries* queries,
+                                          bool read_on_stop) {
+  {
+    absl::MutexLock lock(&queries->lock);
+    queries->stop = true;
+    queries->read_on_stop = read_on_stop;
+  }
+  if (queries->collector.joinable()) {
+    queries->collector.join();
+  }
+}
+
+void RuntimeLayerData::WakeUpQueryCollector(DeviceKey key) {
+  if (DeviceQueries* queries = GetDeviceQueries(key)) {
+    absl::MutexLock lock(&queries->lock);
+    queries->wake_up = true;
+  }
+}
+
+void RuntimeLayerData::BeginCommandBuffer(
+    VkCommandBuffer cmd_buf, const VkCommandBufferBeginInfo& begin_info,
+    std::optional<DurationClock::time_point> cpu_begin) {
+  // Beginning a command buffer implicitly resets it. Outside of the capture
+  // window, forget about the command buffer until it is recorded in the
+  // window again.
+  const bool capture = measures_gpu_ && IsCaptureWindowOpen();
+  ResetCommandBuffer(cmd_buf, /*freed=*/!capture && !cpu_begin);
+  if (!capture && !cpu_begin) {
+    return;
+  }
+
+  CommandBufferInfo* info = nullptr;
+  {
+    absl::MutexLock lock(&cmd_buf_info_lock_);
+    info = &cmd_buf_info_[cmd_buf];
+    command_buffer_count_.store(cmd_buf_info_.size(),
+                                std::memory_order_relaxed);
+  }
+  if (!info->device_queries) {
+    info->device_queries = GetDeviceQueries(DeviceKey(cmd_buf));
+  }
+  if (cpu_begin) {
+    CpuRecordingStats::BeginRecording(&info->cpu_recording, *cpu_begin);
+  }
+  if (!capture || !info->device_queries) {
+    return;
+  }
+  info->recording = info->device_queries->next_recording.fetch_add(
+      1, std::memory_order_relaxed);
+  info->measuring = true;
+  open_measured_recordings_.fetch_add(1, std::memory_order_relaxed);
+  if (!sampling_.SamplesAll()) {
+    if (!info->sampler) {
+      info->sampler.emplace(sampling_);
+    }
+    info->sampler->Reset(info->recording);
+  }
+  QuerySlotAllocator* allocator = info->device_queries->allocator.get();
+  // Queries reset on the host are only unavailable for the first execution,
+  // so a recording that may be submitted again must reset them itself.
+  info->host_reset_slots =
+      allocator->UsesHostReset() &&
+      (begin_info.flags & VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  if (info->host_reset_slots || info->slots_needed == 0) {
+    return;
+  }
+  // Secondary command buffers that continue a render pass cannot reset
+  // queries.
+  if (begin_info.flags & VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT) {
+    return;
+  }
+
+  const uint32_t chunk_count =
+      (info->slots_needed + QuerySlotAllocator::kSlotsPerChunk - 1) /
+      QuerySlotAllocator::kSlotsPerChunk;
+  for (uint32_t i = 0; i != chunk_count; ++i) {
+    QuerySlotAllocator::Chunk* chunk = allocator->AcquireChunk();
+    if (!chunk) {
+      break;
+    }
+    allocator->RecordChunkReset(cmd_buf, *chunk);
+    info->chunks.push_back(chunk);
+  }
+}
+
+void RuntimeLayerData::EndCommandBuffer(VkCommandBuffer cmd_buf) {
+  CommandBufferInfo* info = GetCommandBufferInfo(cmd_buf);
+  if (!info) {
+    return;
+  }
+  DeviceQueries* queries = info->device_queries;
+  if (queries && (info->sampler || !info->queries.empty())) {
+    RecordingDraws draws = {info->recording};
+    if (info->sampler) {
+      draws.pipeline_draws = info->sampler->GetPipelineDraws();
+    }
+    absl::MutexLock lock(&queries->lock);
+    queries->pending.insert(queries->pending.end(), info->queries.begin(),
+                            info->queries.end());
+    if (info->sampler) {
+      queries->recording_draws.push_back(std::move(draws));
+    }
+  }
+  info->queries.clear();
+  StopMeasuring(info);
+}
+
+void RuntimeLayerData::StopMeasuring(CommandBufferInfo* info) {
+  if (info->measuring) {
+    info->measuring = false;
+    open_measured_recordings_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+void RuntimeLayerData::ResetCommandBuffer(VkCommandBuffer cmd_buf,
+                                          bool freed) {
+  if (command_buffer_count_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  CommandBufferInfo* info = FindCommandBufferInfo(cmd_buf);
+  if (!info) {
+    return;
+  }
+
+  StopMeasuring(info);
+  DeviceQueries* queries = info->device_queries;
+  // The queries of an unfinished region will never be written.
+  if (info->region_open) {
+    queries->allocator->ReleaseSlot(info->region_slot);
+    info->region_open = false;
+  }
+  if (info->recording != 0) {
+    // The queries of a recording that did not end still hold their slots.
+    absl::MutexLock lock(&queries->lock);
+    queries->pending.insert(queries->pending.end(), info->queries.begin(),
+                            info->queries.end());
+    queries->retired_recordings.push_back(info->recording);
+    info->recording = 0;
+  }
+  info->queries.clear();
+  info->executed_recordings.clear();
+  uint32_t slots_used = 0;
+  for (QuerySlotAllocator::Chunk* chunk : info->chunks) {
+    slots_used += chunk->used;
+    queries->allocator->RetireChunk(chunk);
+  }
+  info->chunks.clear();
+  info->current_chunk = 0;
+  if (slots_used != 0 || info->slots_missed != 0) {
+    info->slots_needed = slots_used + info->slots_missed;
+  }
+  info->slots_missed = 0;
+  info->host_reset_slots = false;
+  info->pipeline = VK_NULL_HANDLE;
+  info->cpu_recording = {};
+
+  if (freed) {
+    absl::MutexLock lock(&cmd_buf_info_lock_);
+    cmd_buf_info_.erase(cmd_buf);
+    command_buffer_count_.store(cmd_buf_info_.size(),
+                                std::memory_order_relaxed);
+    cmd_buf_info_generation.fetch_add(1, std::memory_order_release);
+  }
+}
+
+void RuntimeLayerData::AllocateCommandBuffers(VkCommandPool pool,
+                                              uint32_t cmd_buf_count,
+                                              const VkCommandBuffer* cmd_bufs) {
+  absl::MutexLock lock(&command_pool_lock_);
+  command_pools_[pool].insert(cmd_bufs, cmd_bufs + cmd_buf_count);
+}
+
+void RuntimeLayerData::FreeCommandBuffers(VkCommandPool pool,
+                                          uint32_t cmd_buf_count,
+                                          const VkCommandBuffer* cmd_bufs) {
+  for (uint32_t i = 0; i != cmd_buf_count; ++i) {
+    if (cmd_bufs[i] != VK_NULL_HANDLE) {
+      ResetCommandBuffer(cmd_bufs[i], /*freed=*/true);
+    }
+  }
+  absl::MutexLock lock(&command_pool_lock_);
+  if (auto it = command_pools_.find(pool); it != command_pools_.end()) {
+    for (uint32_t i = 0; i != cmd_buf_count; ++i) {
+      it->second.erase(cmd_bufs[i]);
+    }
+  }
+}
+
+void RuntimeLayerData::ResetCommandPool(VkCommandPool pool, bool destroyed) {
+  absl::flat_hash_set<VkCommandBuffer> cmd_bufs;
+  {
+    absl::MutexLock lock(&command_pool_lock_);
+    auto it = command_pools_.find(pool);
+    if (it == command_pools_.end()) {
+      return;
+    }
+    if (destroyed) {
+      cmd_bufs = std::move(it->second);
+      command_pools_.erase(it);
+    } else {
+      cmd_bufs = it->second;
+    }
+  }
+  for (VkCommandBuffer cmd_buf : cmd_bufs) {
+    ResetCommandBuffer(cmd_buf, /*freed=*/destroyed);
+  }
+}
+
+void RuntimeLayerData::DestroyPipeline(VkDevice device, VkPipeline pipeline) {
+  if (pipeline == VK_NULL_HANDLE) {
+    return;
+  }
+  DeviceQueries* queries = GetDeviceQueries(DeviceKey(device));
+  if (!queries) {
+    ErasePipeline(pipeline);
+    return;
+  }
+  absl::MutexLock lock(&queries->lock);
+  queries->destroyed_pipelines.push_back(
+      {pipeline, queries->next_submit,
+       queries->frame.load(std::memory_order_relaxed)});
+}
+
+RuntimeLayerData::CommandBufferInfo* RuntimeLayerData::FindCommandBufferInfo(
+    VkCommandBuffer cmd_buf) {
+  // A thread usually records many commands into one command buffer in a row,
+  // so it caches the entry of the latest one. Entries have stable addresses
+  // until they are erased, which changes the generation.
+  struct CachedInfo {
+    const RuntimeLayerData* layer_data = nullptr;
+    VkCommandBuffer cmd_buf = VK_NULL_HANDLE;
+    uint64_t generation = 0;
+    CommandBufferInfo* info = nullptr;
+  };
+  thread_local CachedInfo cached;
+  const uint64_t generation =
+      cmd_buf_info_generation.load(std::memory_order_acquire);
+  if (cached.layer_data == this && cached.cmd_buf == cmd_buf &&
+      cached.generation == generation) {
+    return cached.info;
+  }
+
+  CommandBufferInfo* info = nullptr;
+  {
+    absl::MutexLock lock(&cmd_buf_info_lock_);
+    auto it = cmd_buf_info_.find(cmd_buf);
+    if (it == cmd_buf_info_.end()) {
+      return nullptr;
+    }
+    info = &it->second;
+  }
+  cached = {this, cmd_buf, generation, info};
+  return info;
+}
+
+RuntimeLayerData::CommandBufferInfo* RuntimeLayerData::GetCommandBufferInfo(
+    VkCommandBuffer cmd_buf) {
+  CommandBufferInfo* info = FindCommandBufferInfo(cmd_buf);
+  return info && info->measuring ? info : nullptr;
+}
+
+bool RuntimeLayerData::TakeQuerySlot(CommandBufferInfo* info,
+                                     QuerySlotAllocator::Slot* slot) {
+  if (!info->device_queries) {
+    return false;
+  }
+  QuerySlotAllocator* allocator = info->device_queries->allocator.get();
+
+  while (true) {
+    if (info->current_chunk < info->chunks.size()) {
+      if (QuerySlotAllocator::TakeSlot(info->chunks[info->current_chunk],
+                                       slot)) {
+        return true;
+      }
+      ++info->current_chunk;
       continue;
     }
 
-    uint64_t invocations[2] = {};
-    result = (query_pool_results_function)(
-        device, info->stat_pool,
-        /*firstQuery=*/0, /*queryCount=*/1,
-        /*dataSize=*/sizeof(invocations), /*pData=*/invocations,
-        /*stride=*/sizeof(invocations[0]),
-        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
-    if (result != VK_SUCCESS) {
-      discard_result = true;
+    // Slots reset by the recording itself can only be reset when it
+    // begins, so we cannot get new ones now.
+    QuerySlotAllocator::Chunk* chunk =
+        info->host_reset_slots ? allocator->AcquireChunk() : nullptr;
+    if (!chunk) {
+      ++info->slots_missed;
+      return false;
+    }
+    info->chunks.push_back(chunk);
+  }
+}
+
+bool RuntimeLayerData::GetNewQueryInfo(VkCommandBuffer cmd_buf,
+                                       QuerySlotAllocator::Slot* slot) {
+  CommandBufferInfo* info = GetCommandBufferInfo(cmd_buf);
+  if (!info || (info->sampler && !info->sampler->SampleDraw())) {
+    return false;
+  }
+  if (!TakeQuerySlot(info, slot)) {
+    if (info->sampler) {
+      info->sampler->DropSample();
+    }
+    return false;
+  }
+
+  assert(info->pipeline != VK_NULL_HANDLE);
+  info->queries.push_back(
+      {*slot, info->recording, info->pipeline, /*draw_count=*/1});
+  return true;
+}
+
+void RuntimeLayerData::AddDrawToRegion(VkCommandBuffer cmd_buf) {
+  assert(IsRegionMode(mode_));
+  CommandBufferInfo* info = GetCommandBufferInfo(cmd_buf);
+  if (!info) {
+    return;
+  }
+  if (info->region_open) {
+    ++info->region_draw_count;
+    return;
+  }
+
+  if (!TakeQuerySlot(info, &info->region_slot)) {
+    return;
+  }
+  info->region_open = true;
+  info->region_pipeline =
+      mode_ == RuntimeMode::kRegion ? info->pipeline : VK_NULL_HANDLE;
+  info->region_draw_count = 1;
+
+  const VkLayerDispatchTable& dispatch_table = GetDeviceDispatchTable(cmd_buf);
+  auto write_timestamp_function = dispatch_table.CmdWriteTimestamp;
+  auto begin_query_function = dispatch_table.CmdBeginQuery;
+  (write_timestamp_function)(cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             info->region_slot.timestamp_pool(),
+                             info->region_slot.first_timestamp_query());
+  (begin_query_function)(cmd_buf, info->region_slot.stat_pool(),
+                         info->region_slot.stat_query(), /*flags=*/0);
+}
+
+void RuntimeLayerData::EndRegion(VkCommandBuffer cmd_buf,
+                                 VkPipeline next_pipeline) {
+  if (!IsRegionMode(mode_)) {
+    return;
+  }
+  CommandBufferInfo* info = GetCommandBufferInfo(cmd_buf);
+  if (!info || !info->region_open) {
+    return;
+  }
+  if (next_pipeline != VK_NULL_HANDLE &&
+      (mode_ == RuntimeMode::kRenderPass ||
+       next_pipeline == info->region_pipeline)) {
+    return;
+  }
+
+  const VkLayerDispatchTable& dispatch_table = GetDeviceDispatchTable(cmd_buf);
+  auto write_timestamp_function = dispatch_table.CmdWriteTimestamp;
+  auto end_query_function = dispatch_table.CmdEndQuery;
+  (end_query_function)(cmd_buf, info->region_slot.stat_pool(),
+                       info->region_slot.stat_query());
+  (write_timestamp_function)(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                             info->region_slot.timestamp_pool(),
+                             info->region_slot.first_timestamp_query() + 1);
+  info->region_open = false;
+
+  info->queries.push_back({info->region_slot, info->recording,
+                           info->region_pipeline, info->region_draw_count});
+}
+
+void RuntimeLayerData::ExecuteCommands(VkCommandBuffer cmd_buf,
+                                       uint32_t secondary_count,
+                                       const VkCommandBuffer* secondaries) {
+  absl::MutexLock lock(&cmd_buf_info_lock_);
+  auto it = cmd_buf_info_.find(cmd_buf);
+  if (it == cmd_buf_info_.end() || !it->second.measuring) {
+    return;
+  }
+  CommandBufferInfo& info = it->second;
+  for (uint32_t i = 0; i != secondary_count; ++i) {
+    auto secondary_it = cmd_buf_info_.find(secondaries[i]);
+    if (secondary_it != cmd_buf_info_.end() &&
+        secondary_it->second.recording != 0) {
+      info.executed_recordings.push_back(secondary_it->second.recording);
     }
+  }
+}
+
+template <typename SubmitInfoT>
+RuntimeLayerData::DeviceQueries* RuntimeLayerData::GetSubmittedRecordings(
+    VkQueue queue, uint32_t submit_count, const SubmitInfoT* submits,
+    std::vector<uint64_t>* recordings) {
+  if (command_buffer_count_.load(std::memory_order_relaxed) == 0) {
+    return nullptr;
+  }
+  DeviceQueries* queries = GetDeviceQueries(DeviceKey(queue));
+  if (!queries) {
+    return nullptr;
+  }
 
-    if (!discard_result) {
-      // FIXME: We should adjust the elapsed units to account for the current
-      // GPU frequency. Calling vkGetPhysicalDeviceProperties here causes the
-      // driver to crash, however.
-      Log("pipeline_execution", GetPipelineHash(info->pipeline),
-          absl::StrCat(timestamp1 - timestamp0, ",", invocations[0], ",",
-                       invocations[1]));
+  absl::MutexLock lock(&cmd_buf_info_lock_);
+  for (uint32_t i = 0; i != submit_count; ++i) {
+    for (uint32_t j = 0; j != GetCommandBufferCount(submits[i]); ++j) {
+      auto it = cmd_buf_info_.find(GetCommandBuffer(submits[i], j));
+      if (it == cmd_buf_info_.end() || it->second.recording == 0) {
+        continue;
+      }
+      const CommandBufferInfo& info = it->second;
+      recordings->push_back(info.recording);
+      recordings->insert(recordings->end(), info.executed_recordings.begin(),
+                         info.executed_recordings.end());
     }
+  }
+  return recordings->empty() ? nullptr : queries;
+}
 
-    (destroy_query_pool_function)(device, info->timestamp_pool, nullptr);
-    (destroy_query_pool_function)(device, info->stat_pool, nullptr);
-    // Remove the current query from the queue.
-    using std::swap;
-    swap(*info, timestamp_queries_.back());
-    timestamp_queries_.pop_back();
+RuntimeLayerData::SubmitSignal RuntimeLayerData::PrepareSubmitSignal(
+    DeviceQueries* queries, VkQueue queue, uint32_t submit_count,
+    VkFence fence, SubmitRecord* record) {
+  if (fence == VK_NULL_HANDLE) {
+    record->fence = GetNewFence(queries);
+    return record->fence != VK_NULL_HANDLE ? SubmitSignal::kFence
+                                           : SubmitSignal::kNone;
   }
+
+  if (submit_count != 0 && queries->get_semaphore_counter_value) {
+    // Submissions to a queue are externally synchronized, so the values of
+    // its semaphore are signaled in the order they are handed out.
+    {
+      absl::MutexLock lock(&queries->lock);
+      if (auto it = queries->timelines.find(queue);
+          it != queries->timelines.end()) {
+        record->semaphore = it->second.semaphore;
+        record->semaphore_value = ++it->second.value;
+        return SubmitSignal::kTimeline;
+      }
+    }
+
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+    VkSemaphoreCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    create_info.pNext = &type_info;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VkResult result = queries->create_semaphore(queries->device, &create_info,
+                                                nullptr, &semaphore);
+    if (result == VK_SUCCESS) {
+      absl::MutexLock lock(&queries->lock);
+      queries->timelines[queue] = {semaphore, 1};
+      record->semaphore = semaphore;
+      record->semaphore_value = 1;
+      return SubmitSignal::kTimeline;
+    }
+    SPL_LOG(ERROR) << "Failed to create a timeline semaphore: " << result;
+  }
+
+  record->fence = GetNewFence(queries);
+  return record->fence != VK_NULL_HANDLE ? SubmitSignal::kEmptySubmit
+                                         : SubmitSignal::kNone;
+}
+
+void RuntimeLayerData::BeginSubmit(DeviceQueries* queries,
+                                   const SubmitRecord& record) {
+  absl::MutexLock lock(&queries->lock);
+  for (uint64_t recording : record.recordings) {
+    ++queries->submitting_recordings[recording];
+  }
+}
+
+void RuntimeLayerData::FinishSubmit(DeviceQueries* queries, bool tracked,
+                                    SubmitRecord record) {
+  absl::MutexLock lock(&queries->lock);
+  for (uint64_t recording : record.recordings) {
+    auto it = queries->submitting_recordings.find(recording);
+    assert(it != queries->submitting_recordings.end());
+    if (--it->second == 0) {
+      queries->submitting_recordings.erase(it);
+    }
+  }
+  if (!tracked) {
+    if (record.fence != VK_NULL_HANDLE) {
+      queries->free_fences.push_back(record.fence);
+    }
+    return;
+  }
+  record.frame = queries->frame.load(std::memory_order_relaxed);
+  record.submit = queries->next_submit++;
+  queries->submits.push_back(std::move(record));
+}
+
+template <typename SubmitInfoT, typename QueueSubmitT>
+VkResult RuntimeLayerData::TrackSubmit(VkQueue queue, uint32_t submit_count,
+                                       const SubmitInfoT* submits,
+                                       VkFence fence,
+                                       QueueSubmitT queue_submit) {
+  CpuRecordingStats* cpu_stats = GetCpuStats();
+  auto submit = [&](uint32_t batch_count, const SubmitInfoT* batches,
+                    VkFence submit_fence) {
+    const DurationClock::time_point start =
+        cpu_stats ? Now() : DurationClock::time_point();
+    VkResult result = queue_submit(queue, batch_count, batches, submit_fence);
+    if (cpu_stats) {
+      cpu_stats->RecordSubmit(Now() - start);
+    }
+    return result;
+  };
+
+  SubmitRecord record;
+  DeviceQueries* queries =
+      GetSubmittedRecordings(queue, submit_count, submits, &record.recordings);
+  const SubmitSignal signal =
+      queries
+          ? PrepareSubmitSignal(queries, queue, submit_count, fence, &record)
+          : SubmitSignal::kNone;
+  if (signal != SubmitSignal::kNone) {
+    BeginSubmit(queries, record);
+  }
+  VkResult result = VK_SUCCESS;
+  switch (signal) {
+    case SubmitSignal::kNone:
+    case SubmitSignal::kEmptySubmit:
+      result = submit(submit_count, submits, fence);
+      break;
+    case SubmitSignal::kFence:
+      result = submit(submit_count, submits, record.fence);
+      break;
+    case SubmitSignal::kTimeline: {
+      SignalingBatches<SubmitInfoT> batches(submit_count, submits,
+                                            record.semaphore,
+                                            record.semaphore_value);
+      result = submit(batches.size(), batches.data(), fence);
+      break;
+    }
+  }
+  if (signal == SubmitSignal::kNone) {
+    return result;
+  }
+
+  bool tracked = result == VK_SUCCESS;
+  if (tracked && signal == SubmitSignal::kEmptySubmit) {
+    // An empty submission signals its fence once all the work previously
+    // submitted to the queue has completed.
+    VkResult empty_result = queue_submit(queue, 0, nullptr, record.fence);
+    if (empty_result != VK_SUCCESS) {
+      SPL_LOG(WARNING) << "Failed to submit a fence after a queue submission: "
+                       << empty_result;
+      tracked = false;
+    }
+  }
+  FinishSubmit(queries, tracked, std::move(record));
+  return result;
+}
+
+VkResult RuntimeLayerData::QueueSubmit(VkQueue queue, uint32_t submit_count,
+                                       const VkSubmitInfo* submits,
+                                       VkFence fence,
+                                       PFN_vkQueueSubmit queue_submit) {
+  return TrackSubmit(queue, submit_count, submits, fence, queue_submit);
+}
+
+VkResult RuntimeLayerData::QueueSubmit2(VkQueue queue, uint32_t submit_count,
+                                        const VkSubmitInfo2* submits,
+                                        VkFence fence,
+                                        PFN_vkQueueSubmit2 queue_submit) {
+  return TrackSubmit(queue, submit_count, submits, fence, queue_submit);
+}
+
+void RuntimeLayerData::Present(VkQueue queue) {
+  if (DeviceQueries* queries = GetDeviceQueries(DeviceKey(queue))) {
+    queries->frame.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (!cpu_stats_) {
+    return;
+  }
+
+  const uint64_t frame = cpu_frame_.fetch_add(1, std::memory_order_relaxed);
+  const CpuFrameStats stats = cpu_stats_->TakeFrameStats();
+  if (stats.threads.empty()) {
+    return;
+  }
+  const CpuRecordingCounters& total = stats.total;
+  LogEventOnly("runtime_cpu_frame",
+               CsvCat(frame, stats.threads.size(), total.recordings,
+                      total.recording_ns, stats.max_thread_recording_ns,
+                      total.max_recording_draws, total.pipeline_binds,
+                      total.draws, total.submits, total.submit_ns,
+                      total.descriptor_updates, total.descriptor_writes,
+                      total.descriptor_update_ns));
+  for (const ThreadRecordingStats& thread : stats.threads) {
+    const CpuRecordingCounters& counters = thread.counters;
+    LogEventOnly("runtime_cpu_thread",
+                 CsvCat(frame, thread.thread_id, counters.recordings,
+                        counters.recording_ns, counters.max_recording_draws,
+                        counters.pipeline_binds, counters.draws,
+                        counters.submits, counters.submit_ns,
+                        counters.descriptor_updates, counters.descriptor_writes,
+                        counters.descriptor_update_ns));
+  }
+}
+
+VkFence RuntimeLayerData::GetNewFence(DeviceQueries* queries) {
+  {
+    absl::MutexLock lock(&queries->lock);
+    if (!queries->free_fences.empty()) {
+      VkFence fence = queries->free_fences.back();
+      queries->free_fences.pop_back();
+      return fence;
+    }
+  }
+
+  VkFenceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  VkFence fence = VK_NULL_HANDLE;
+  VkResult result =
+      queries->create_fence(queries->device, &create_info, nullptr, &fence);
+  if (result != VK_SUCCESS) {
+    SPL_LOG(ERROR) << "Failed to create a fence: " << result;
+    return VK_NULL_HANDLE;
+  }
+  absl::MutexLock lock(&queries->lock);
+  queries->fences.push_back(fence);
+  return fence;
+}
+
+VkResult RuntimeLayerData::GetSubmitStatus(const DeviceQueries& queries,
+                                           const SubmitRecord& submit) {
+  if (submit.fence != VK_NULL_HANDLE) {
+    return (queries.get_fence_status)(queries.device, submit.fence);
+  }
+  uint64_t value = 0;
+  VkResult result = (queries.get_semaphore_counter_value)(
+      queries.device, submit.semaphore, &value);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  return value >= submit.semaphore_value ? VK_SUCCESS : VK_NOT_READY;
+}
+
+void RuntimeLayerData::RunQueryCollector(DeviceQueries* queries) {
+  while (true) {
+    bool stop = false;
+    {
+      absl::MutexLock lock(&queries->lock);
+      queries->lock.AwaitWithTimeout(
+          absl::Condition(queries, &DeviceQueries::ShouldWakeUp),
+          kQueryCollectorInterval);
+      if (queries->stop && !queries->read_on_stop) {
+        return;
+      }
+      queries->wake_up = false;
+      stop = queries->stop;
+    }
+
+    CollectQueries(queries, /*last=*/stop);
+    if (stop) {
+      return;
+    }
+  }
+}
+
+void RuntimeLayerData::CalibrateTimestamps(DeviceQueries* queries) {
+  VkCalibratedTimestampInfoEXT infos[2] = {};
+  infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+  infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+  infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+  infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+  uint64_t timestamps[2] = {};
+  uint64_t max_deviation = 0;
+  VkResult result = (queries->get_calibrated_timestamps)(
+      queries->device, 2, infos, timestamps, &max_deviation);
+  // Events are logged with system clock timestamps, so move the monotonic
+  // host timestamp to the system clock.
+  const int64_t monotonic_to_unix_offset =
+      ToUnixNanos(GetTimestamp()) -
+      ToInt64Nanoseconds(Now().time_since_epoch());
+  queries->last_calibration = Now();
+  if (result != VK_SUCCESS) {
+    SPL_LOG(WARNING) << "Failed to get calibrated timestamps: " << result;
+    return;
+  }
+  queries->calibration.Calibrate(
+      timestamps[0],
+      static_cast<int64_t>(timestamps[1]) + monotonic_to_unix_offset);
+}
+
+int64_t RuntimeLayerData::GpuStartTime(const DeviceQueries& queries,
+                                       const GpuTime& gpu_time) {
+  if (!queries.calibration.IsCalibrated() || gpu_time.total == 0) {
+    return 0;
+  }
+  return gpu_time.first_timestamp;
+}
+
+void RuntimeLayerData::CollectQueries(DeviceQueries* queries, bool last) {
+  if (queries->get_calibrated_timestamps &&
+      (!queries->calibration.IsCalibrated() ||
+       Now() - queries->last_calibration >= kTimestampCalibrationInterval)) {
+    CalibrateTimestamps(queries);
+  }
+
+  // Frames before this one have been presented, and are complete once their
+  // submissions have finished.
+  const uint64_t current_frame = queries->frame.load(std::memory_order_relaxed);
+  std::vector<QueryInfo> pending;
+  std::vector<SubmitRecord> submits;
+  std::vector<uint64_t> retired;
+  std::vector<RecordingDraws> recording_draws;
+  std::vector<DestroyedPipeline> destroyed_pipelines;
+  {
+    // Take everything at once, so that the queries and weights of the
+    // submitted and retired recordings are known.
+    absl::MutexLock lock(&queries->lock);
+    std::swap(pending, queries->pending);
+    std::swap(submits, queries->submits);
+    // The recordings still being submitted are retired in a later
+    // collection, once their submissions have been handed over.
+    std::vector<uint64_t> submitting;
+    for (uint64_t recording : queries->retired_recordings) {
+      if (queries->submitting_recordings.contains(recording)) {
+        submitting.push_back(recording);
+      } else {
+        retired.push_back(recording);
+      }
+    }
+    queries->retired_recordings = std::move(submitting);
+    std::swap(recording_draws, queries->recording_draws);
+    std::swap(destroyed_pipelines, queries->destroyed_pipelines);
+  }
+
+  // The recordings are only known to the collector from their queries on, and
+  // forgotten once released. Everything else about unknown recordings is
+  // skipped, as they have nothing to read back.
+  for (const QueryInfo& info : pending) {
+    queries->recordings[info.recording].queries.push_back(info);
+  }
+  for (const RecordingDraws& draws : recording_draws) {
+    auto recording = queries->recordings.find(draws.recording);
+    if (recording == queries->recordings.end()) {
+      continue;
+    }
+    for (const DrawSampler::PipelineDraws& pipeline : draws.pipeline_draws) {
+      recording->second.weights[pipeline.pipeline] = pipeline.GetWeight();
+    }
+  }
+  queries->unlogged_pipelines.insert(queries->unlogged_pipelines.end(),
+                                     destroyed_pipelines.begin(),
+                                     destroyed_pipelines.end());
+  for (SubmitRecord& submit : submits) {
+    for (uint64_t recording : submit.recordings) {
+      if (auto it = queries->recordings.find(recording);
+          it != queries->recordings.end()) {
+        ++it->second.pending_submits;
+      }
+    }
+    FrameInfo& frame = queries->frames[submit.frame];
+    ++frame.pending_submits;
+    ++frame.submit_count;
+    queries->in_flight_submits.push_back(std::move(submit));
+  }
+  for (uint64_t recording : retired) {
+    auto it = queries->recordings.find(recording);
+    if (it == queries->recordings.end()) {
+      continue;
+    }
+    it->second.retired = true;
+    if (it->second.pending_submits == 0) {
+      ReleaseRecording(queries, recording);
+    }
+  }
+
+  std::vector<VkFence> finished_fences;
+  for (auto submit = queries->in_flight_submits.begin();
+       submit != queries->in_flight_submits.end();) {
+    VkResult result = GetSubmitStatus(*queries, *submit);
+    if (result == VK_NOT_READY) {
+      ++submit;
+      continue;
+    }
+
+    FrameInfo& frame = queries->frames[submit->frame];
+    if (result == VK_SUCCESS) {
+      GpuTime gpu_time;
+      uint32_t query_count = 0;
+      PipelineRuntimeAggregator* aggregator =
+          aggregate_frames_ != 0
+              ? &queries->intervals[submit->frame / aggregate_frames_]
+              : nullptr;
+      for (uint64_t recording : submit->recordings) {
+        auto it = queries->recordings.find(recording);
+        if (it == queries->recordings.end()) {
+          continue;
+        }
+        const RecordingQueries& recording_queries = it->second;
+        for (const QueryInfo& info : recording_queries.queries) {
+          if (LogQueryResults(*queries, info, *submit,
+                              recording_queries.GetWeight(info.pipeline),
+                              aggregator, &gpu_time)) {
+            ++query_count;
+          }
+        }
+      }
+      LogEventOnly("runtime_submit",
+                   CsvCat(submit->frame, submit->submit, query_count,
+                          gpu_time.total, gpu_time.Span(),
+                          GpuStartTime(*queries, gpu_time)));
+      frame.gpu_time.Add(gpu_time);
+    } else {
+      SPL_LOG(ERROR) << "Failed to get the status of a submission: " << result;
+    }
+
+    --frame.pending_submits;
+    for (uint64_t recording : submit->recordings) {
+      auto it = queries->recordings.find(recording);
+      if (it == queries->recordings.end()) {
+        continue;
+      }
+      if (--it->second.pending_submits == 0 && it->second.retired) {
+        ReleaseRecording(queries, recording);
+      }
+    }
+    if (submit->fence != VK_NULL_HANDLE) {
+      finished_fences.push_back(submit->fence);
+    }
+    submit = queries->in_flight_submits.erase(submit);
+  }
+
+  if (!finished_fences.empty()) {
+    (queries->reset_fences)(queries->device,
+                            static_cast<uint32_t>(finished_fences.size()),
+                            finished_fences.data());
+    absl::MutexLock lock(&queries->lock);
+    queries->free_fences.insert(queries->free_fences.end(),
+                                finished_fences.begin(), finished_fences.end());
+  }
+
+  for (auto frame = queries->frames.begin();
+       frame != queries->frames.end();) {
+    if ((frame->first >= current_frame && !last) ||
+        frame->second.pending_submits != 0) {
+      ++frame;
+      continue;
+    }
+    const GpuTime& gpu_time = frame->second.gpu_time;
+    LogEventOnly("runtime_frame",
+                 CsvCat(frame->first, frame->second.submit_count,
+                        gpu_time.total, gpu_time.Span(),
+                        GpuStartTime(*queries, gpu_time)));
+    frame = queries->frames.erase(frame);
+  }
+
+  if (aggregate_frames_ != 0) {
+    // The frames before the first unfinished one have all been logged.
+    uint64_t end_frame = current_frame;
+    if (last) {
+      end_frame = std::numeric_limits<uint64_t>::max();
+    } else if (!queries->frames.empty()) {
+      end_frame = std::min(end_frame, queries->frames.begin()->first);
+    }
+    LogIntervals(queries, end_frame);
+  }
+  EraseLoggedPipelines(queries, last);
+}
+
+void RuntimeLayerData::LogIntervals(DeviceQueries* queries,
+                                    uint64_t end_frame) const {
+  for (auto interval = queries->intervals.begin();
+       interval != queries->intervals.end();) {
+    const uint64_t first_frame = interval->first * aggregate_frames_;
+    const uint64_t last_frame = first_frame + aggregate_frames_ - 1;
+    if (last_frame >= end_frame) {
+      break;
+    }
+    for (const auto& [pipeline, stats] : interval->second.TakeStats()) {
+      const HashVector pipeline_hash = pipeline != VK_NULL_HANDLE
+                                           ? GetPipelineHash(pipeline)
+                                           : HashVector();
+      Log("pipeline_runtime_summary", pipeline_hash,
+          CsvCat(stats.query_count, stats.draw_count, stats.total_ns,
+                 stats.min_ns, stats.max_ns, stats.GetMeanNs(),
+                 std::llround(stats.estimated_total_ns),
+                 stats.fragment_invocations, stats.compute_invocations,
+                 stats.FormatHistogram(), first_frame, last_frame));
+    }
+    interval = queries->intervals.erase(interval);
+  }
+}
+
+void RuntimeLayerData::EraseLoggedPipelines(DeviceQueries* queries,
+                                            bool last) {
+  // The submissions are in flight in the order they were made.
+  const uint64_t first_unlogged_submit =
+      queries->in_flight_submits.empty()
+          ? std::numeric_limits<uint64_t>::max()
+          : queries->in_flight_submits.front().submit;
+  // The frames before the first unlogged interval have all been logged.
+  const uint64_t first_unlogged_frame =
+      aggregate_frames_ == 0 || queries->intervals.empty()
+          ? std::numeric_limits<uint64_t>::max()
+          : queries->intervals.begin()->first * aggregate_frames_;
+  std::vector<DestroyedPipeline>& pipelines = queries->unlogged_pipelines;
+  for (auto destroyed = pipelines.begin(); destroyed != pipelines.end();) {
+    if (!last && (destroyed->submit > first_unlogged_submit ||
+                  destroyed->frame >= first_unlogged_frame)) {
+      ++destroyed;
+      continue;
+    }
+    ErasePipeline(destroyed->pipeline);
+    destroyed = pipelines.erase(destroyed);
+  }
+}
+
+void RuntimeLayerData::ReleaseRecording(DeviceQueries* queries,
+                                        uint64_t recording) {
+  auto it = queries->recordings.find(recording);
+  if (it == queries->recordings.end()) {
+    return;
+  }
+  for (const QueryInfo& info : it->second.queries) {
+    queries->allocator->ReleaseSlot(info.slot);
+  }
+  queries->recordings.erase(it);
+}
+
+bool RuntimeLayerData::LogQueryResults(const DeviceQueries& queries,
+                                       const QueryInfo& info,
+                                       const SubmitRecord& submit,
+                                       double weight,
+                                       PipelineRuntimeAggregator* aggregator,
+                                       GpuTime* gpu_time) const {
+  constexpr uint64_t kInvalidValue = ~uint64_t(0);
+  uint64_t query_data[2] = {kInvalidValue, kInvalidValue};
+  VkResult result = (queries.get_query_pool_results)(
+      queries.device, info.slot.timestamp_pool(),
+      /*firstQuery=*/info.slot.first_timestamp_query(), /*queryCount=*/2,
+      /*dataSize=*/sizeof(query_data), /*pData=*/&query_data,
+      /*stride=*/sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+  const uint64_t& timestamp0 = query_data[0];
+  const uint64_t& timestamp1 = query_data[1];
+
+  // The submission has finished, so the results can only be missing if the
+  // queries were not executed, e.g., because the region was not closed, or
+  // have been reset by a later submission of the same recording.
+  if (result == VK_NOT_READY ||
+      (result == VK_SUCCESS && (timestamp0 == 0 || timestamp1 == 0))) {
+    return false;
+  }
+
+  // Queries of render pass regions are not attributed to a pipeline. The hash
+  // is only looked up when a line about the query is logged.
+  auto pipeline_hash = [this, &info] {
+    return info.pipeline != VK_NULL_HANDLE ? GetPipelineHash(info.pipeline)
+                                           : HashVector();
+  };
+  constexpr uint64_t kUnreasonablyLongRuntime = 10ull * 1000 * 1000 * 1000;
+  if (result != VK_SUCCESS) {
+    // This query failed for some reason. Write an error to stderr.
+    SPL_LOG(ERROR) << "Timestamp query failed for "
+                   << PipelineHashToString(pipeline_hash()) << " with error "
+                   << result;
+    return false;
+  }
+  const TimestampProperties& timestamp_properties =
+      queries.calibration.GetProperties();
+  const uint64_t runtime = timestamp_properties.ToNanoseconds(
+      timestamp_properties.TicksBetween(timestamp0, timestamp1));
+  if (timestamp0 == kInvalidValue || timestamp1 == kInvalidValue ||
+      runtime == 0 || runtime > kUnreasonablyLongRuntime) {
+    // This query did not produce valid timestamps for some reason.
+    SPL_LOG(ERROR) << "Timestamp query failed for "
+                   << PipelineHashToString(pipeline_hash())
+                   << " producing invalid timestamps: t0=" << timestamp0
+                   << ", t1=" << timestamp1;
+    return false;
+  }
+
+  uint64_t invocations[2] = {};
+  result = (queries.get_query_pool_results)(
+      queries.device, info.slot.stat_pool(),
+      /*firstQuery=*/info.slot.stat_query(), /*queryCount=*/1,
+      /*dataSize=*/sizeof(invocations), /*pData=*/invocations,
+      /*stride=*/sizeof(invocations[0]), VK_QUERY_RESULT_64_BIT);
+  if (result != VK_SUCCESS) {
+    return false;
+  }
+
+  if (aggregator) {
+    aggregator->Add(info.pipeline, runtime, invocations[0], invocations[1],
+                    info.draw_count, weight);
+  } else if (IsRegionMode(mode_)) {
+    Log("pipeline_region_execution", pipeline_hash(),
+        CsvCat(runtime, invocations[0], invocations[1], info.draw_count,
+               submit.frame, submit.submit));
+  } else if (sampling_.SamplesAll()) {
+    Log("pipeline_execution", pipeline_hash(),
+        CsvCat(runtime, invocations[0], invocations[1], submit.frame,
+               submit.submit));
+  } else {
+    Log("pipeline_execution", pipeline_hash(),
+        CsvCat(runtime, invocations[0], invocations[1], submit.frame,
+               submit.submit, weight));
+  }
+  const int64_t begin =
+      queries.calibration.IsCalibrated()
+          ? queries.calibration.ToHostNanos(timestamp0)
+          : static_cast<int64_t>(timestamp_properties.ToNanoseconds(
+                timestamp0 & timestamp_properties.Mask()));
+  gpu_time->Add(begin, begin + static_cast<int64_t>(runtime), weight);
+  return true;
 }
 
 }  // namespace performancelayers
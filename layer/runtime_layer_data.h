@@ -15,76 +15,685 @@
 #ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_RUNTIME_LAYER_DATA_H_
 #define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_RUNTIME_LAYER_DATA_H_
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "capture_window.h"
+#include "cpu_recording_stats.h"
+#include "draw_sampler.h"
+#include "gpu_timestamps.h"
 #include "layer_data.h"
+#include "pipeline_runtime_aggregator.h"
+#include "query_slot_allocator.h"
 
 namespace performancelayers {
 
+// Selects how the runtime layer measures GPU time. Set with the
+// "VK_RUNTIME_MODE" environment variable.
+enum class RuntimeMode {
+  // "serialized": Every draw and dispatch is timed separately, with full
+  // pipeline barriers around it. This gives exact per-draw attribution, but
+  // prevents the GPU from overlapping work.
+  kSerialized,
+  // "pipelined": Every draw and dispatch is timed separately, without
+  // barriers. Measurements include work of neighbouring commands that
+  // overlaps with the measured command.
+  kPipelined,
+  // "region": Consecutive draws and dispatches using the same pipeline are
+  // timed together. A region ends when a different pipeline gets bound, and at
+  // render pass, subpass and command buffer boundaries.
+  kRegion,
+  // "render_pass": All draws of a render pass subpass are timed together. The
+  // results are not attributed to pipelines.
+  kRenderPass,
+};
+
+// Returns the mode denoted by |mode_name|. Returns |RuntimeMode::kSerialized|
+// if |mode_name| is null, or is not a valid mode name.
+RuntimeMode ParseRuntimeMode(const char* mode_name);
+
+// Returns the draw sampling denoted by |config_str| for |mode|. Returns the
+// default of measuring every draw if |config_str| is null or invalid, and in
+// the region modes, which already measure few queries.
+DrawSamplingConfig ParseRuntimeSampling(const char* config_str,
+                                        RuntimeMode mode);
+
+// Returns the number of frames denoted by |frames_str| over which the results
+// of each pipeline are aggregated. Returns 0, i.e., no aggregation, if
+// |frames_str| is null or is not a valid number.
+uint32_t ParseRuntimeAggregateFrames(const char* frames_str);
+
+// Selects whether the runtime layer also counts the CPU-side work of
+// recording and submitting commands. Set with the "VK_RUNTIME_CPU_STATS"
+// environment variable.
+enum class RuntimeCpuStats {
+  // "0": Only the GPU time is measured.
+  kOff,
+  // "1": The CPU-side work is counted in addition to measuring the GPU time.
+  kOn,
+  // "only": The CPU-side work is counted, and the GPU time is not measured.
+  // The layer then records no commands of its own.
+  kOnly,
+};
+
+// Returns the CPU statistics setting denoted by |setting|. Returns
+// |RuntimeCpuStats::kOff| if |setting| is null or invalid.
+RuntimeCpuStats ParseRuntimeCpuStats(const char* setting);
+
 // A class that contains all of the data that is needed for the functions
 // that this layer will override.
 //
 // The filename for the log file will be retrieved from the environment variable
 // "VK_RUNTIME_LOG".  If it is unset, then stderr will be used as the
 // log file.
+//
+// Query results are read back by one collector thread per device. Threads
+// recording command buffers only queue the queries they record, and never
+// wait for the GPU. Each queue submission measured by the layer signals the
+// collector when the results of the submitted command buffers are available:
+// through a fence of the layer passed in place of the null fence of the
+// application, otherwise through a timeline semaphore of the layer per queue
+// signaled by the submission itself, and otherwise, without timeline
+// semaphores, through a fence of the layer signaled by an extra empty
+// submission. Results are attributed to the submission, and to the frame, that
+// is, the number of presents on the device before the submission.
+//
+// With aggregation, the results of each pipeline are accumulated over a number
+// of frames, and logged as a single summary line per pipeline once all the
+// frames have finished, instead of one line per query.
+//
+// With draw sampling, only some of the draws are measured, and each logged
+// result carries the number of draws of its pipeline it stands for. The GPU
+// times of the submissions and frames are estimated from these weights.
+//
+// Only the recordings that begin while the capture window is open are
+// measured. Once the window is closed and these recordings have ended, the
+// commands pass straight through to the next layer.
+//
+// The hash of a destroyed pipeline is kept until the results of the commands
+// that may have used it have been logged.
+//
+// With CPU statistics, the recordings, submissions and descriptor set updates
+// of each thread are counted and timed, and logged at each present of a frame
+// in the capture window.
 class RuntimeLayerData : public LayerData {
  private:
   struct QueryInfo {
-    VkQueryPool timestamp_pool;
-    VkQueryPool stat_pool;
-    VkCommandBuffer command_buffer;
+    QuerySlotAllocator::Slot slot;
+    // The recording of the command buffer in which the query was recorded.
+    uint64_t recording;
+    VkPipeline pipeline;
+    // Number of draws and dispatches measured by the query.
+    uint32_t draw_count;
+  };
+
+  // A queue submission of recordings with queries.
+  struct SubmitRecord {
+    // A fence of the layer, signaled once the GPU has finished the
+    // submission. Null if the submission is tracked with |semaphore|.
+    VkFence fence = VK_NULL_HANDLE;
+    // A timeline semaphore of the layer, which reaches |semaphore_value| once
+    // the GPU has finished the submission.
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint64_t semaphore_value = 0;
+    uint64_t frame = 0;
+    uint64_t submit = 0;
+    std::vector<uint64_t> recordings;
+  };
+
+  // How the layer learns that the GPU has finished a submission.
+  enum class SubmitSignal {
+    // The submission is not tracked.
+    kNone,
+    // A fence of the layer is passed to the submission, in place of the null
+    // fence of the application.
+    kFence,
+    // The last batch of the submission also signals a timeline semaphore of
+    // the layer.
+    kTimeline,
+    // An empty submission signals a fence of the layer right after the
+    // submission. Only used when none of the above is possible.
+    kEmptySubmit,
+  };
+
+  // The timeline semaphore signaled by the tracked submissions to a queue,
+  // and the value signaled by the latest one.
+  struct QueueTimeline {
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint64_t value = 0;
+  };
+
+  // A pipeline destroyed by the application. Its hash is kept until the
+  // results of the submissions and frames that may have used it are logged.
+  struct DestroyedPipeline {
     VkPipeline pipeline;
+    // The submissions before this one, and the frames up to this one, may
+    // have used the pipeline.
+    uint64_t submit;
+    uint64_t frame;
+  };
+
+  // The draws of each pipeline in a sampled recording.
+  struct RecordingDraws {
+    uint64_t recording;
+    std::vector<DrawSampler::PipelineDraws> pipeline_draws;
+  };
+
+  // The queries of a recording, as tracked by the collector thread.
+  struct RecordingQueries {
+    std::vector<QueryInfo> queries;
+    // The weights of the queries of each pipeline, if the recording was
+    // sampled.
+    absl::flat_hash_map<VkPipeline, double> weights;
+    // Number of submissions of the recording the collector waits for.
+    uint32_t pending_submits = 0;
+    // Set once the command buffer of the recording has been reset. The query
+    // slots are released once there are no pending submissions either.
+    bool retired = false;
+
+    // Returns the number of draws measured by each query of |pipeline|.
+    double GetWeight(VkPipeline pipeline) const {
+      auto it = weights.find(pipeline);
+      return it == weights.end() ? 1.0 : it->second;
+    }
+  };
+
+  // GPU time spent in the measured commands of a submission or a frame, in
+  // nanoseconds.
+  struct GpuTime {
+    // Sum of the measured intervals.
+    uint64_t total = 0;
+    // Earliest and latest measured timestamps. These are on the host timeline
+    // when the GPU clock is calibrated, and on the GPU timeline otherwise.
+    int64_t first_timestamp = std::numeric_limits<int64_t>::max();
+    int64_t last_timestamp = std::numeric_limits<int64_t>::min();
+
+    // Adds an interval measuring |weight| times its share of the total.
+    void Add(int64_t begin, int64_t end, double weight = 1.0) {
+      total += weight == 1.0 ? end - begin
+                             : std::llround(weight * (end - begin));
+      first_timestamp = std::min(first_timestamp, begin);
+      last_timestamp = std::max(last_timestamp, end);
+    }
+    void Add(const GpuTime& other) {
+      total += other.total;
+      first_timestamp = std::min(first_timestamp, other.first_timestamp);
+      last_timestamp = std::max(last_timestamp, other.last_timestamp);
+    }
+    // Time from the first to the last measured timestamp.
+    int64_t Span() const {
+      return last_timestamp > first_timestamp
+                 ? last_timestamp - first_timestamp
+                 : 0;
+    }
+  };
+
+  struct FrameInfo {
+    uint32_t pending_submits = 0;
+    uint32_t submit_count = 0;
+    GpuTime gpu_time;
+  };
+
+  // The queries of a device and the thread collecting their results.
+  struct DeviceQueries {
+    VkDevice device = VK_NULL_HANDLE;
+    std::unique_ptr<QuerySlotAllocator> allocator;
+    PFN_vkGetQueryPoolResults get_query_pool_results = nullptr;
+    PFN_vkCreateFence create_fence = nullptr;
+    PFN_vkDestroyFence destroy_fence = nullptr;
+    PFN_vkResetFences reset_fences = nullptr;
+    PFN_vkGetFenceStatus get_fence_status = nullptr;
+    PFN_vkCreateSemaphore create_semaphore = nullptr;
+    PFN_vkDestroySemaphore destroy_semaphore = nullptr;
+    // Null if timeline semaphores are not enabled.
+    PFN_vkGetSemaphoreCounterValue get_semaphore_counter_value = nullptr;
+    // Null if VK_EXT_calibrated_timestamps is not enabled.
+    PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps = nullptr;
+    // Source of the recording ids of the command buffers of the device.
+    std::atomic<uint64_t> next_recording = 1;
+    // Number of presents on the queues of the device.
+    std::atomic<uint64_t> frame = 0;
+
+    absl::Mutex lock;
+    // Queries that have not been handed to the collector yet.
+    std::vector<QueryInfo> pending ABSL_GUARDED_BY(lock);
+    // Submissions that have not been handed to the collector yet.
+    std::vector<SubmitRecord> submits ABSL_GUARDED_BY(lock);
+    // Draw counts of sampled recordings that have not been handed to the
+    // collector yet.
+    std::vector<RecordingDraws> recording_draws ABSL_GUARDED_BY(lock);
+    // Recordings that have been reset since the collector last looked at
+    // |pending| and |submits|.
+    std::vector<uint64_t> retired_recordings ABSL_GUARDED_BY(lock);
+    // The number of submissions of each recording that are being made and
+    // have not been handed to the collector yet. The collector keeps these
+    // recordings, and their query slots, even if they get retired meanwhile.
+    absl::flat_hash_map<uint64_t, uint32_t> submitting_recordings
+        ABSL_GUARDED_BY(lock);
+    // Pipelines destroyed since the collector last looked at |submits|.
+    std::vector<DestroyedPipeline> destroyed_pipelines ABSL_GUARDED_BY(lock);
+    uint64_t next_submit ABSL_GUARDED_BY(lock) = 0;
+    // All fences created for submissions, and the ones not in use.
+    std::vector<VkFence> fences ABSL_GUARDED_BY(lock);
+    std::vector<VkFence> free_fences ABSL_GUARDED_BY(lock);
+    absl::flat_hash_map<VkQueue, QueueTimeline> timelines ABSL_GUARDED_BY(lock);
+    bool wake_up ABSL_GUARDED_BY(lock) = false;
+    bool stop ABSL_GUARDED_BY(lock) = false;
+    // Tells whether the collector reads the available results one last time
+    // when stopped.
+    bool read_on_stop ABSL_GUARDED_BY(lock) = true;
+    std::thread collector;
+
+    // Only accessed by the collector thread.
+    TimestampCalibration calibration =
+        TimestampCalibration(TimestampProperties());
+    DurationClock::time_point last_calibration;
+    absl::flat_hash_map<uint64_t, RecordingQueries> recordings;
+    std::vector<SubmitRecord> in_flight_submits;
+    std::map<uint64_t, FrameInfo> frames;
+    // The aggregated results of the pipelines, by interval of frames.
+    std::map<uint64_t, PipelineRuntimeAggregator> intervals;
+    // Destroyed pipelines whose results may not have been logged yet.
+    std::vector<DestroyedPipeline> unlogged_pipelines;
+
+    bool ShouldWakeUp() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock) {
+      return wake_up || stop;
+    }
+  };
+
+  struct CommandBufferInfo {
+    // The latest pipeline bound to the command buffer.
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    // The queries of the device that owns the command buffer.
+    DeviceQueries* device_queries = nullptr;
+    // Identifies the current recording among the recordings of all command
+    // buffers of the device.
+    uint64_t recording = 0;
+    // Set while the current recording, which began while the capture window
+    // was open, is being measured.
+    bool measuring = false;
+    // The recordings of the secondary command buffers executed by the current
+    // recording.
+    std::vector<uint64_t> executed_recordings;
+    // The queries of the current recording, handed to the collector all at
+    // once when the recording ends or gets reset.
+    std::vector<QueryInfo> queries;
+    // Query slot chunks owned by the current recording. New slots are taken
+    // from |chunks[current_chunk]|.
+    std::vector<QuerySlotAllocator::Chunk*> chunks;
+    size_t current_chunk = 0;
+    // Set if the current recording takes its query slots from chunks reset
+    // on the host, as it goes. Only recordings submitted once can: the
+    // queries of a recording that may execute again have to be reset by the
+    // recording itself, when it begins.
+    bool host_reset_slots = false;
+    // Number of slots used by the previous recording. Determines how many
+    // slots get reserved upfront when the current recording resets its
+    // queries.
+    uint32_t slots_needed = 0;
+    // Number of slots that could not be handed out in the current recording.
+    uint32_t slots_missed = 0;
+    // The region being measured in |RuntimeMode::kRegion| and
+    // |RuntimeMode::kRenderPass|.
+    bool region_open = false;
+    QuerySlotAllocator::Slot region_slot;
+    VkPipeline region_pipeline = VK_NULL_HANDLE;
+    uint32_t region_draw_count = 0;
+    // Picks the measured draws, if only some of them are measured.
+    std::optional<DrawSampler> sampler;
+    // The CPU-side work of the current recording, if it is counted.
+    CpuRecordingStats::Recording cpu_recording;
   };
 
  public:
-  explicit RuntimeLayerData(char* log_filename)
+  RuntimeLayerData(char* log_filename, RuntimeMode mode,
+                   const DrawSamplingConfig& sampling = {},
+                   uint32_t aggregate_frames = 0,
+                   RuntimeCpuStats cpu_stats = RuntimeCpuStats::kOff)
       : LayerData(log_filename,
-                  "Pipeline,Run Time (ns),Fragment Shader Invocations,Compute "
-                  "Shader Invocations") {
+                  GetLogHeader(mode, sampling, aggregate_frames).c_str()),
+        mode_(mode),
+        sampling_(sampling),
+        aggregate_frames_(aggregate_frames),
+        measures_gpu_(cpu_stats != RuntimeCpuStats::kOnly),
+        cpu_stats_(cpu_stats == RuntimeCpuStats::kOff
+                       ? nullptr
+                       : std::make_unique<CpuRecordingStats>()) {
+    assert(!IsRegionMode(mode) || sampling.SamplesAll());
     LogEventOnly("runtime_layer_init");
   }
 
+  // Stops the collector threads of the devices that have not been destroyed.
+  ~RuntimeLayerData();
+
+  RuntimeMode GetMode() const { return mode_; }
+
+  // Returns true if draws are measured in regions rather than one by one.
+  static bool IsRegionMode(RuntimeMode mode) {
+    return mode == RuntimeMode::kRegion || mode == RuntimeMode::kRenderPass;
+  }
+
+  // Returns true if the commands being recorded may have to be measured,
+  // i.e., if the capture window is open or a recording that began while it was
+  // open has not ended yet. Otherwise, the commands are not tracked at all.
+  bool ShouldTrackCommands() const {
+    return (measures_gpu_ && IsCaptureWindowOpen()) ||
+           open_measured_recordings_.load(std::memory_order_relaxed) != 0;
+  }
+
+  // Returns the counters of the CPU-side work, or nullptr if the CPU-side
+  // work is not counted, or the capture window is closed.
+  CpuRecordingStats* GetCpuStats() const {
+    return cpu_stats_ && IsCaptureWindowOpen() ? cpu_stats_.get() : nullptr;
+  }
+
+  // Returns the counters of the CPU-side work, or nullptr if the CPU-side
+  // work is not counted. Ends the recordings that began in the capture window.
+  CpuRecordingStats* GetCpuStatsIgnoringCaptureWindow() const {
+    return cpu_stats_.get();
+  }
+
   // Records |pipeline| as the latest pipeline that has been bound to
-  // |cmd_buffer|.
+  // |cmd_buffer|, if the current recording of |cmd_buffer| is measured.
   void BindPipeline(VkCommandBuffer cmd_buffer, VkPipeline pipeline) {
-    absl::MutexLock lock(&cmd_buf_to_pipeline_lock_);
-    cmd_buf_to_pipeline_.insert_or_assign(cmd_buffer, pipeline);
+    if (CommandBufferInfo* info = FindCommandBufferInfo(cmd_buffer)) {
+      info->pipeline = pipeline;
+      if (info->sampler) {
+        info->sampler->BindPipeline(pipeline);
+      }
+    }
   }
 
   // Returns the latest pipeline that has been bound to |cmd_buffer|.
   VkPipeline GetPipeline(VkCommandBuffer cmd_buffer) const {
-    absl::MutexLock lock(&cmd_buf_to_pipeline_lock_);
-    assert(cmd_buf_to_pipeline_.count(cmd_buffer) != 0);
-    return cmd_buf_to_pipeline_.at(cmd_buffer);
+    absl::MutexLock lock(&cmd_buf_info_lock_);
+    assert(cmd_buf_info_.count(cmd_buffer) != 0);
+    return cmd_buf_info_.at(cmd_buffer).pipeline;
+  }
+
+  // Decides if the layer can reset its queries on the host for the device
+  // created with |create_info|. Keeps the configuration chosen by the
+  // application, if any. Otherwise, when |physical_device| supports it,
+  // enables VK_EXT_host_query_reset in |create_info| and chains |features|
+  // into it. |features| must outlive |create_info|.
+  bool EnableHostQueryReset(
+      VkPhysicalDevice physical_device, ExtendedDeviceCreateInfo* create_info,
+      VkPhysicalDeviceHostQueryResetFeaturesEXT* features) const;
+
+  // Decides if the layer can calibrate the GPU timestamps of the device
+  // created with |create_info| against the host clock. When |physical_device|
+  // supports it, enables VK_EXT_calibrated_timestamps in |create_info|.
+  bool EnableCalibratedTimestamps(VkPhysicalDevice physical_device,
+                                  ExtendedDeviceCreateInfo* create_info) const;
+
+  // Decides if the layer can track submissions with timeline semaphores on
+  // the device created with |create_info|. Keeps the configuration chosen by
+  // the application, if any. Otherwise, when |physical_device| supports it,
+  // enables VK_KHR_timeline_semaphore in |create_info| and chains |features|
+  // into it. |features| must outlive |create_info|.
+  bool EnableTimelineSemaphores(
+      VkPhysicalDevice physical_device, ExtendedDeviceCreateInfo* create_info,
+      VkPhysicalDeviceTimelineSemaphoreFeaturesKHR* features) const;
+
+  // Creates the query slot allocator for |device| and starts the thread
+  // collecting its query results. |host_query_reset|,
+  // |calibrated_timestamps| and |timeline_semaphores| tell if host query
+  // reset, VK_EXT_calibrated_timestamps and timeline semaphores are enabled
+  // for |device|.
+  void InitQuerySlots(VkDevice device, bool host_query_reset,
+                      bool calibrated_timestamps, bool timeline_semaphores);
+
+  // Stops the collector thread of |device| after it logs the results that are
+  // available, then destroys the query pools of |device| and drops the queries
+  // still pending. Must be called before |device| is destroyed.
+  void DestroyQuerySlots(VkDevice device);
+
+  // Starts a new recording of |cmd_buf|. Retires the query slots of the
+  // previous recording and, if there is no host query reset or the new
+  // recording may be submitted more than once, reserves and resets query
+  // slots for the new recording. The new recording is only measured if the
+  // capture window is open. |cpu_begin| is the time the recording began, if
+  // its CPU-side work is counted.
+  void BeginCommandBuffer(
+      VkCommandBuffer cmd_buf, const VkCommandBufferBeginInfo& begin_info,
+      std::optional<DurationClock::time_point> cpu_begin);
+
+  // Returns the CPU-side state of the current recording of |cmd_buf|, or
+  // nullptr if the CPU-side work of the recording is not counted.
+  CpuRecordingStats::Recording* GetCpuRecording(VkCommandBuffer cmd_buf) {
+    CommandBufferInfo* info = FindCommandBufferInfo(cmd_buf);
+    return info ? &info->cpu_recording : nullptr;
   }
 
-  // Allocates and returns a new query pool to be used in the command buffer
-  // |cmd_buf|.
-  bool GetNewQueryInfo(VkCommandBuffer cmd_buf,
-                       VkQueryPool* timestamp_query_pool,
-                       VkQueryPool* stat_query_pool);
+  // Ends the current recording of |cmd_buf|. Its queries are still collected
+  // once it gets submitted, weighted by the draws sampled in the recording.
+  void EndCommandBuffer(VkCommandBuffer cmd_buf);
+
+  // Retires the query slots of the current recording of |cmd_buf|. If
+  // |freed| is true, also forgets everything known about |cmd_buf|.
+  void ResetCommandBuffer(VkCommandBuffer cmd_buf, bool freed);
 
-  // Allocates a new fence object, and returns a handle to it.
-  VkFence GetNewFence(VkDevice device);
+  // Records that the |cmd_buf_count| command buffers of |cmd_bufs| have been
+  // allocated from |pool|, so that they can be reset along with |pool|.
+  void AllocateCommandBuffers(VkCommandPool pool, uint32_t cmd_buf_count,
+                              const VkCommandBuffer* cmd_bufs);
 
-  void LinkFence(VkFence fence, const VkCommandBuffer* cmd_buffers,
-                 uint32_t cmd_buffer_count);
+  // Forgets the |cmd_buf_count| command buffers of |cmd_bufs|, which are
+  // being freed from |pool|.
+  void FreeCommandBuffers(VkCommandPool pool, uint32_t cmd_buf_count,
+                          const VkCommandBuffer* cmd_bufs);
 
-  // Reads the time stamp in each query pool associated with |cmd_buf|, and logs
-  // the time spent running each pipeline.
-  void LogAndRemoveQueryPools();
+  // Retires the query slots of the current recordings of all the command
+  // buffers allocated from |pool|. If |destroyed| is true, also forgets
+  // everything known about |pool| and its command buffers.
+  void ResetCommandPool(VkCommandPool pool, bool destroyed);
+
+  // Forgets the hash of |pipeline|, which is being destroyed on |device|, once
+  // the results of the commands that may have used it have been logged.
+  void DestroyPipeline(VkDevice device, VkPipeline pipeline);
+
+  // Hands out a query slot to be used in the command buffer |cmd_buf|. Queries
+  // of the slot are ready to be written. Returns false if no slot is
+  // available, or if the draw about to be recorded is not sampled.
+  bool GetNewQueryInfo(VkCommandBuffer cmd_buf, QuerySlotAllocator::Slot* slot);
+
+  // Adds a draw or dispatch about to be recorded into |cmd_buf| to the
+  // measured region, opening a new region if needed. Only used in region
+  // modes.
+  void AddDrawToRegion(VkCommandBuffer cmd_buf);
+
+  // Ends the measured region of |cmd_buf|, if any. |next_pipeline| is the
+  // pipeline about to be bound, or null if the region should end regardless
+  // of the pipeline (e.g., at the end of a render pass).
+  void EndRegion(VkCommandBuffer cmd_buf,
+                 VkPipeline next_pipeline = VK_NULL_HANDLE);
+
+  // Records that the secondary command buffers |secondaries| get executed by
+  // the current recording of |cmd_buf|.
+  void ExecuteCommands(VkCommandBuffer cmd_buf, uint32_t secondary_count,
+                       const VkCommandBuffer* secondaries);
+
+  // Submits |submits| to |queue| with |queue_submit|, the next layer's
+  // vkQueueSubmit, and tracks their command buffers, so that the collector
+  // thread knows when their results are available. The submission signals
+  // a fence of the layer if |fence| is null, and a timeline semaphore of the
+  // layer otherwise. Also times the submission when the CPU-side work is
+  // counted.
+  VkResult QueueSubmit(VkQueue queue, uint32_t submit_count,
+                       const VkSubmitInfo* submits, VkFence fence,
+                       PFN_vkQueueSubmit queue_submit);
+
+  // Same as |QueueSubmit|, for vkQueueSubmit2 and vkQueueSubmit2KHR.
+  VkResult QueueSubmit2(VkQueue queue, uint32_t submit_count,
+                        const VkSubmitInfo2* submits, VkFence fence,
+                        PFN_vkQueueSubmit2 queue_submit);
+
+  // Starts a new frame on the device of |queue|, and logs the CPU statistics
+  // of the frame that ends.
+  void Present(VkQueue queue);
+
+  // Makes the collector thread of the device of |key| read the available
+  // query results now, rather than at its next periodic check. Does not wait
+  // for the results to be logged.
+  void WakeUpQueryCollector(DeviceKey key);
 
  private:
-  mutable absl::Mutex cmd_buf_to_pipeline_lock_;
-  // The map from a command buffer to its bound pipeline.
-  absl::flat_hash_map<VkCommandBuffer, VkPipeline> cmd_buf_to_pipeline_
-      ABSL_GUARDED_BY(cmd_buf_to_pipeline_lock_);
-
-  mutable absl::Mutex timestamp_queries_lock_;
-  // The set of query pools used for the time stamps and their corresponding
-  // pipelines.
-  std::vector<QueryInfo> timestamp_queries_
-      ABSL_GUARDED_BY(timestamp_queries_lock_);
+  // Returns the queries of the device of |key|, or nullptr if there are none.
+  DeviceQueries* GetDeviceQueries(DeviceKey key) const;
+
+  // Submits |submits| like |QueueSubmit|, with |queue_submit| being either
+  // vkQueueSubmit or vkQueueSubmit2.
+  template <typename SubmitInfoT, typename QueueSubmitT>
+  VkResult TrackSubmit(VkQueue queue, uint32_t submit_count,
+                       const SubmitInfoT* submits, VkFence fence,
+                       QueueSubmitT queue_submit);
+
+  // Returns the queries of the device of |queue|, and adds the measured
+  // recordings of |submits| to |recordings|. Returns nullptr if none of
+  // |submits| needs to be tracked.
+  template <typename SubmitInfoT>
+  DeviceQueries* GetSubmittedRecordings(VkQueue queue, uint32_t submit_count,
+                                        const SubmitInfoT* submits,
+                                        std::vector<uint64_t>* recordings);
+
+  // Decides how the collector thread of |queries| learns that a submission to
+  // |queue| of |submit_count| batches, with the application's |fence|, has
+  // finished. Sets the fence or the semaphore of |record| accordingly.
+  SubmitSignal PrepareSubmitSignal(DeviceQueries* queries, VkQueue queue,
+                                   uint32_t submit_count, VkFence fence,
+                                   SubmitRecord* record);
+
+  // Marks the recordings of |record| as being submitted, so that the collector
+  // of |queries| does not release them before |FinishSubmit|. Must be called
+  // before the submission is made: once the GPU has finished it, the
+  // application may reset the submitted command buffers right away.
+  static void BeginSubmit(DeviceQueries* queries, const SubmitRecord& record);
+
+  // Ends |BeginSubmit|. Hands |record| to the collector thread of |queries|
+  // if |tracked| is true. Otherwise, recycles the fence of |record|.
+  static void FinishSubmit(DeviceQueries* queries, bool tracked,
+                           SubmitRecord record);
+
+  // Returns VK_SUCCESS if the GPU has finished |submit|, and VK_NOT_READY
+  // if it has not.
+  static VkResult GetSubmitStatus(const DeviceQueries& queries,
+                                  const SubmitRecord& submit);
+
+  // Body of the collector thread of |queries|. Periodically reads the results
+  // of the pending queries without waiting for the GPU, logs the available
+  // ones, and recycles their query slots.
+  void RunQueryCollector(DeviceQueries* queries);
+
+  // Stops the collector thread of |queries| and waits for it to exit.
+  static void StopQueryCollector(DeviceQueries* queries, bool read_on_stop);
+
+  // Hands the queries, submissions and retired recordings queued for
+  // |queries| to the collector, logs the results of the finished submissions,
+  // and releases the query slots that are no longer needed. Called by the
+  // collector thread. |last| tells if this is the last collection for the
+  // device, in which case the frames that have not been presented yet are
+  // logged too.
+  void CollectQueries(DeviceQueries* queries, bool last);
+
+  // Logs the results of |info|, measured in |submit| and standing for |weight|
+  // draws, or adds them to |aggregator| if it is not null. Also adds them to
+  // |gpu_time|. Returns false if the results are not available.
+  bool LogQueryResults(const DeviceQueries& queries, const QueryInfo& info,
+                       const SubmitRecord& submit, double weight,
+                       PipelineRuntimeAggregator* aggregator,
+                       GpuTime* gpu_time) const;
+
+  // Logs the aggregated results of the intervals of |queries| that end before
+  // |end_frame|, and forgets them.
+  void LogIntervals(DeviceQueries* queries, uint64_t end_frame) const;
+
+  // Erases the hashes of the destroyed pipelines of |queries| whose results
+  // have all been logged. If |last| is true, erases all of them.
+  void EraseLoggedPipelines(DeviceQueries* queries, bool last);
+
+  // Returns the header of the log file.
+  static std::string GetLogHeader(RuntimeMode mode,
+                                  const DrawSamplingConfig& sampling,
+                                  uint32_t aggregate_frames);
+
+  // Returns the system clock time, in Unix nanoseconds, of the first
+  // timestamp of |gpu_time|, or 0 if the GPU clock of |queries| is not
+  // calibrated.
+  static int64_t GpuStartTime(const DeviceQueries& queries,
+                              const GpuTime& gpu_time);
+
+  // Takes a new pair of GPU and host timestamps for the calibration of
+  // |queries|.
+  static void CalibrateTimestamps(DeviceQueries* queries);
+
+  // Releases the query slots of |recording| and forgets about it.
+  static void ReleaseRecording(DeviceQueries* queries, uint64_t recording);
+
+  // Returns a fence of |queries| that is not in use, creating one if needed.
+  // Returns VK_NULL_HANDLE on failure.
+  static VkFence GetNewFence(DeviceQueries* queries);
+
+  // Returns the recording state of |cmd_buf|, or nullptr if |cmd_buf| is not
+  // tracked. Only takes |cmd_buf_info_lock_| when |cmd_buf| is not the
+  // command buffer the calling thread looked up last.
+  CommandBufferInfo* FindCommandBufferInfo(VkCommandBuffer cmd_buf);
+
+  // Returns the recording state of |cmd_buf|, or nullptr if the current
+  // recording of |cmd_buf| is not measured.
+  CommandBufferInfo* GetCommandBufferInfo(VkCommandBuffer cmd_buf);
+
+  // Stops measuring the current recording of a command buffer, if it is
+  // measured.
+  void StopMeasuring(CommandBufferInfo* info);
+
+  // Takes the next query slot for the current recording of a command buffer.
+  bool TakeQuerySlot(CommandBufferInfo* info, QuerySlotAllocator::Slot* slot);
+
+  const RuntimeMode mode_;
+  const DrawSamplingConfig sampling_;
+  // The number of frames over which results are aggregated, or 0 to log each
+  // result.
+  const uint32_t aggregate_frames_;
+  // False if only the CPU-side work is counted.
+  const bool measures_gpu_;
+  const std::unique_ptr<CpuRecordingStats> cpu_stats_;
+  // The number of presents, which number the frames of the CPU statistics.
+  std::atomic<uint64_t> cpu_frame_ = 0;
+
+  mutable absl::Mutex cmd_buf_info_lock_;
+  // The map from a command buffer to its recording state. The node map keeps
+  // the entries at stable addresses, so that the thread recording a command
+  // buffer can access its entry without holding the lock.
+  absl::node_hash_map<VkCommandBuffer, CommandBufferInfo> cmd_buf_info_
+      ABSL_GUARDED_BY(cmd_buf_info_lock_);
+  // The size of |cmd_buf_info_|, read without the lock so that command
+  // buffers are not looked up when none are tracked.
+  std::atomic<size_t> command_buffer_count_ = 0;
+  // The number of measured recordings that have not ended yet.
+  std::atomic<uint32_t> open_measured_recordings_ = 0;
+
+  mutable absl::Mutex command_pool_lock_;
+  // The command buffers allocated from each command pool.
+  absl::flat_hash_map<VkCommandPool, absl::flat_hash_set<VkCommandBuffer>>
+      command_pools_ ABSL_GUARDED_BY(command_pool_lock_);
+
+  mutable absl::Mutex device_queries_lock_;
+  // The query slot allocators and pending queries of the devices.
+  absl::flat_hash_map<DeviceKey, std::unique_ptr<DeviceQueries>>
+      device_queries_ ABSL_GUARDED_BY(device_queries_lock_);
 };
 
 }  // namespace performancelayers
@@ -0,0 +1,154 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shader_hash_cache.h"
+
+#include <atomic>
+#include <cassert>
+#include <tuple>
+
+#include "farmhash.h"
+
+namespace performancelayers {
+namespace {
+uint32_t GetLastWord(const uint32_t *code, size_t size) {
+  return size < sizeof(uint32_t) ? 0 : code[size / sizeof(uint32_t) - 1];
+}
+
+uint32_t GetFirstWord(const uint32_t *code, size_t size) {
+  return size < sizeof(uint32_t) ? 0 : code[0];
+}
+
+// Never destroyed, as other libraries may use it until the process exits.
+ShaderHashCache &GetLocalCache() {
+  static ShaderHashCache *cache = new ShaderHashCache();
+  return *cache;
+}
+
+bool LocalAcquire(const uint32_t *code, size_t size, uint64_t *hash) {
+  bool cached = false;
+  std::tie(*hash, cached) = GetLocalCache().Acquire(code, size);
+  return cached;
+}
+
+void LocalRelease(const uint32_t *code, size_t size) {
+  GetLocalCache().Release(code, size);
+}
+
+constexpr SplShaderHashCacheInterface kLocalInterface = {
+    kShaderHashCacheInterfaceVersion, &LocalAcquire, &LocalRelease};
+
+// The interface used by this library, once it is known.
+std::atomic<const SplShaderHashCacheInterface *> shared_interface = nullptr;
+
+// Returns the interface used by another loaded layer library, or nullptr if
+// there is none.
+const SplShaderHashCacheInterface *FindOtherInterface() {
+  const SplShaderHashCacheInterface *other = nullptr;
+  const bool found = FindInOtherLayerLibraries(
+      "SPL_GetShaderHashCacheInterface",
+      reinterpret_cast<void *>(&SPL_GetShaderHashCacheInterface),
+      [&other](void *address) {
+        using GetInterfaceFunc = const SplShaderHashCacheInterface *(*)();
+        other = reinterpret_cast<GetInterfaceFunc>(address)();
+        return other && other != &kLocalInterface &&
+               other->version >= kShaderHashCacheInterfaceVersion &&
+               other->acquire && other->release;
+      });
+  return found ? other : nullptr;
+}
+
+const SplShaderHashCacheInterface &GetSharedInterface() {
+  if (const auto *known = shared_interface.load(std::memory_order_acquire)) {
+    return *known;
+  }
+  const SplShaderHashCacheInterface *found = FindOtherInterface();
+  const SplShaderHashCacheInterface *expected = nullptr;
+  shared_interface.compare_exchange_strong(
+      expected, found ? found : &kLocalInterface, std::memory_order_acq_rel);
+  return *shared_interface.load(std::memory_order_acquire);
+}
+}  // namespace
+
+uint64_t ShaderHashCache::ComputeHash(const uint32_t *code, size_t size) {
+  return util::Fingerprint64(reinterpret_cast<const char *>(code), size);
+}
+
+std::pair<uint64_t, bool> ShaderHashCache::Acquire(const uint32_t *code,
+                                                   size_t size) {
+  const uint32_t first_word = GetFirstWord(code, size);
+  const uint32_t last_word = GetLastWord(code, size);
+  {
+    absl::MutexLock lock(&lock_);
+    if (auto it = entries_.find({code, size}); it != entries_.end()) {
+      Entry &entry = it->second;
+      if (entry.first_word != first_word || entry.last_word != last_word) {
+        // The code changed while the hash was acquired, which valid
+        // applications don't do. Don't share the hash of the new code.
+        return {ComputeHash(code, size), false};
+      }
+      ++entry.references;
+      return {entry.hash, true};
+    }
+  }
+
+  // Hash without holding the lock: shader modules can be megabytes large.
+  const uint64_t hash = ComputeHash(code, size);
+  absl::MutexLock lock(&lock_);
+  auto [it, inserted] =
+      entries_.try_emplace({code, size}, Entry{hash, first_word, last_word, 0});
+  if (!inserted && it->second.hash != hash) {
+    return {hash, false};
+  }
+  ++it->second.references;
+  return {hash, true};
+}
+
+void ShaderHashCache::Release(const uint32_t *code, size_t size) {
+  absl::MutexLock lock(&lock_);
+  auto it = entries_.find({code, size});
+  assert(it != entries_.end());
+  if (it == entries_.end()) {
+    return;
+  }
+  if (--it->second.references == 0) {
+    entries_.erase(it);
+  }
+}
+
+size_t ShaderHashCache::GetSize() const {
+  absl::MutexLock lock(&lock_);
+  return entries_.size();
+}
+
+ScopedShaderHash::ScopedShaderHash(const uint32_t *code, size_t size)
+    : code_(code), size_(size) {
+  cached_ = GetSharedInterface().acquire(code, size, &hash_);
+}
+
+ScopedShaderHash::~ScopedShaderHash() {
+  if (cached_) {
+    GetSharedInterface().release(code_, size_);
+  }
+}
+
+}  // namespace performancelayers
+
+const performancelayers::SplShaderHashCacheInterface *
+SPL_GetShaderHashCacheInterface() {
+  using performancelayers::kLocalInterface;
+  using performancelayers::shared_interface;
+  const auto *known = shared_interface.load(std::memory_order_acquire);
+  return known ? known : &kLocalInterface;
+}
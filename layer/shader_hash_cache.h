@@ -0,0 +1,117 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_SHADER_HASH_CACHE_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_SHADER_HASH_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "layer_utils.h"
+
+namespace performancelayers {
+
+// Shares the hashes of the SPIR-V code being passed to vkCreateShaderModule,
+// so that stacked layers hash each shader module once instead of once per
+// layer.
+//
+// The code passed to vkCreateShaderModule is only guaranteed to be valid and
+// unchanged during the call. A layer acquires the hash of the code before
+// calling the next layer, and releases it once the next layer returns. The
+// layers below it, which run while the hash is acquired, find the hash instead
+// of computing it again. Hashes are keyed by the address and size of the code,
+// and also check the first and last words of the code as a safeguard.
+//
+// This class is thread safe.
+class ShaderHashCache {
+ public:
+  ShaderHashCache() = default;
+  ShaderHashCache(const ShaderHashCache &) = delete;
+  ShaderHashCache &operator=(const ShaderHashCache &) = delete;
+
+  // Returns the hash of the `size` bytes of `code`, and computes it unless it
+  // is already acquired. Returns whether the hash was cached, in which case
+  // `Release()` must be called with the same arguments once `code` may change.
+  std::pair<uint64_t, bool> Acquire(const uint32_t *code, size_t size);
+
+  // Releases a hash cached by `Acquire()`.
+  void Release(const uint32_t *code, size_t size);
+
+  // Returns the number of acquired hashes.
+  size_t GetSize() const;
+
+  // Returns the hash of the `size` bytes of `code`.
+  static uint64_t ComputeHash(const uint32_t *code, size_t size);
+
+ private:
+  struct Entry {
+    uint64_t hash;
+    uint32_t first_word;
+    uint32_t last_word;
+    uint32_t references;
+  };
+
+  mutable absl::Mutex lock_;
+  absl::flat_hash_map<std::pair<const uint32_t *, size_t>, Entry> entries_
+      ABSL_GUARDED_BY(lock_);
+};
+
+// Acquires the hash of SPIR-V code from the `ShaderHashCache` shared by all
+// the layers in the process for the lifetime of this object.
+//
+// The cache is found through `SPL_GetShaderHashCacheInterface`, exported by
+// each layer library. The first library to look for the cache uses its own;
+// the libraries loaded later use that one. If the libraries fail to agree,
+// e.g., on platforms without `dlopen`, each library uses its own cache, which
+// is still correct but hashes the code once per library.
+class ScopedShaderHash {
+ public:
+  ScopedShaderHash(const uint32_t *code, size_t size);
+  ~ScopedShaderHash();
+
+  ScopedShaderHash(const ScopedShaderHash &) = delete;
+  ScopedShaderHash &operator=(const ScopedShaderHash &) = delete;
+
+  uint64_t GetHash() const { return hash_; }
+
+ private:
+  const uint32_t *code_;
+  size_t size_;
+  uint64_t hash_;
+  bool cached_;
+};
+
+// The C interface to a `ShaderHashCache` shared between the layer libraries,
+// which may have been built separately. Only extend it by appending members and
+// incrementing `kShaderHashCacheInterfaceVersion`.
+struct SplShaderHashCacheInterface {
+  uint32_t version;
+  // `ShaderHashCache::Acquire()`. Returns whether the hash was cached.
+  bool (*acquire)(const uint32_t *code, size_t size, uint64_t *hash);
+  // `ShaderHashCache::Release()`.
+  void (*release)(const uint32_t *code, size_t size);
+};
+
+inline constexpr uint32_t kShaderHashCacheInterfaceVersion = 1;
+
+}  // namespace performancelayers
+
+// Returns the interface of the shader hash cache used by this layer library.
+SPL_LAYER_ENTRY_POINT const performancelayers::SplShaderHashCacheInterface *
+SPL_GetShaderHashCacheInterface();
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_SHADER_HASH_CACHE_H_
@@ -0,0 +1,284 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shared_memory_ring.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "common_logging.h"
+#include "debug_logging.h"
+#include "layer_utils.h"
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace performancelayers {
+namespace {
+bool IsPowerOfTwo(uint64_t value) {
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+size_t GetMappingSize(uint64_t capacity, uint32_t record_size) {
+  return sizeof(SharedRingHeader) + capacity * record_size;
+}
+
+// Returns the payload bytes that follow the header of |slot|.
+char *GetPayload(SharedRingRecordHeader *slot) {
+  return reinterpret_cast<char *>(slot) + sizeof(SharedRingRecordHeader);
+}
+}  // namespace
+
+SharedMemoryRing::SharedMemoryRing(std::string name, void *mapping,
+                                   size_t mapping_size, bool owner)
+    : name_(std::move(name)),
+      header_(static_cast<SharedRingHeader *>(mapping)),
+      mapping_size_(mapping_size),
+      owner_(owner) {
+#if defined(__unix__)
+  process_id_ = static_cast<uint32_t>(getpid());
+#endif
+}
+
+SharedMemoryRing::SharedMemoryRing(SharedMemoryRing &&other)
+    : name_(std::move(other.name_)),
+      header_(std::exchange(other.header_, nullptr)),
+      mapping_size_(other.mapping_size_),
+      owner_(std::exchange(other.owner_, false)),
+      process_id_(other.process_id_),
+      read_index_(other.read_index_) {}
+
+SharedMemoryRing &SharedMemoryRing::operator=(SharedMemoryRing &&other) {
+  if (this != &other) {
+    Unmap();
+    name_ = std::move(other.name_);
+    header_ = std::exchange(other.header_, nullptr);
+    mapping_size_ = other.mapping_size_;
+    owner_ = std::exchange(other.owner_, false);
+    process_id_ = other.process_id_;
+    read_index_ = other.read_index_;
+  }
+  return *this;
+}
+
+SharedMemoryRing::~SharedMemoryRing() { Unmap(); }
+
+#if defined(__unix__)
+absl::StatusOr<SharedMemoryRing> SharedMemoryRing::Create(
+    const std::string &name, uint64_t capacity, uint32_t record_size) {
+  if (!IsPowerOfTwo(capacity)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Ring capacity must be a power of two: ", capacity));
+  }
+  if (record_size % 8 != 0 || record_size <= sizeof(SharedRingRecordHeader) ||
+      record_size - sizeof(SharedRingRecordHeader) > UINT16_MAX) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid ring record size: ", record_size));
+  }
+
+  // Start from an empty object, so that producers attached to a previous ring
+  // with the same name keep their own mapping.
+  shm_unlink(name.c_str());
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1) {
+    return absl::UnavailableError(absl::StrCat(
+        "Failed to create shared memory ", name, ": ", strerror(errno)));
+  }
+  const size_t mapping_size = GetMappingSize(capacity, record_size);
+  void *mapping = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(mapping_size)) == 0) {
+    mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+  }
+  const int error = errno;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return absl::UnavailableError(absl::StrCat(
+        "Failed to map shared memory ", name, ": ", strerror(error)));
+  }
+
+  auto *header = new (mapping) SharedRingHeader();
+  memcpy(header->magic, kSharedRingMagic, sizeof(header->magic));
+  header->version = kSharedRingVersion;
+  header->record_size = record_size;
+  header->capacity = capacity;
+  header->write_index.store(0, std::memory_order_relaxed);
+  header->dropped.store(0, std::memory_order_relaxed);
+  SharedMemoryRing ring(name, mapping, mapping_size, /*owner=*/true);
+  for (uint64_t i = 0; i != capacity; ++i) {
+    SharedRingRecordHeader *slot = new (ring.GetSlot(i))
+        SharedRingRecordHeader();
+    slot->sequence.store(i, std::memory_order_relaxed);
+  }
+  header->initialized.store(1, std::memory_order_release);
+  return ring;
+}
+
+absl::StatusOr<SharedMemoryRing> SharedMemoryRing::Attach(
+    const std::string &name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd == -1) {
+    return absl::NotFoundError(absl::StrCat("Failed to open shared memory ",
+                                            name, ": ", strerror(errno)));
+  }
+  struct stat file_stat = {};
+  if (fstat(fd, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(SharedRingHeader)) {
+    close(fd);
+    return absl::FailedPreconditionError(
+        absl::StrCat("Shared memory ", name, " is not a ring"));
+  }
+  const size_t mapping_size = static_cast<size_t>(file_stat.st_size);
+  void *mapping =
+      mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int error = errno;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return absl::UnavailableError(absl::StrCat(
+        "Failed to map shared memory ", name, ": ", strerror(error)));
+  }
+
+  SharedMemoryRing ring(name, mapping, mapping_size, /*owner=*/false);
+  const SharedRingHeader *header = ring.header_;
+  if (header->initialized.load(std::memory_order_acquire) != 1 ||
+      memcmp(header->magic, kSharedRingMagic, sizeof(header->magic)) != 0 ||
+      header->version != kSharedRingVersion ||
+      !IsPowerOfTwo(header->capacity) ||
+      header->record_size <= sizeof(SharedRingRecordHeader) ||
+      GetMappingSize(header->capacity, header->record_size) > mapping_size) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Shared memory ", name, " is not a supported ring"));
+  }
+  return ring;
+}
+
+void SharedMemoryRing::Unmap() {
+  if (!header_) {
+    return;
+  }
+  munmap(header_, mapping_size_);
+  header_ = nullptr;
+  if (owner_) {
+    shm_unlink(name_.c_str());
+    owner_ = false;
+  }
+}
+#else   // defined(__unix__)
+absl::StatusOr<SharedMemoryRing> SharedMemoryRing::Create(
+    const std::string &, uint64_t, uint32_t) {
+  return absl::UnimplementedError("Shared memory rings require Unix");
+}
+
+absl::StatusOr<SharedMemoryRing> SharedMemoryRing::Attach(
+    const std::string &) {
+  return absl::UnimplementedError("Shared memory rings require Unix");
+}
+
+void SharedMemoryRing::Unmap() { header_ = nullptr; }
+#endif  // defined(__unix__)
+
+SharedRingRecordHeader *SharedMemoryRing::GetSlot(uint64_t position) const {
+  char *slots = reinterpret_cast<char *>(header_) + sizeof(SharedRingHeader);
+  return reinterpret_cast<SharedRingRecordHeader *>(
+      slots + (position & (header_->capacity - 1)) * header_->record_size);
+}
+
+bool SharedMemoryRing::TryWrite(int64_t timestamp, std::string_view payload) {
+  assert(header_);
+  uint64_t position = header_->write_index.load(std::memory_order_relaxed);
+  SharedRingRecordHeader *slot = nullptr;
+  while (true) {
+    slot = GetSlot(position);
+    const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (header_->write_index.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < position) {
+      // The consumer has not read this slot since the last lap.
+      header_->dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      position = header_->write_index.load(std::memory_order_relaxed);
+    }
+  }
+
+  const size_t size = std::min(payload.size(), GetMaxPayloadSize());
+  slot->timestamp = timestamp;
+  slot->process_id = process_id_;
+  slot->size = static_cast<uint16_t>(size);
+  slot->flags = size < payload.size() ? kSharedRingRecordTruncated : 0;
+  memcpy(GetPayload(slot), payload.data(), size);
+  slot->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+bool SharedMemoryRing::TryRead(SharedRingRecord *record) {
+  assert(header_);
+  assert(owner_ && "Only the creator of the ring reads from it");
+  assert(record);
+  SharedRingRecordHeader *slot = GetSlot(read_index_);
+  if (slot->sequence.load(std::memory_order_acquire) != read_index_ + 1) {
+    return false;
+  }
+  record->timestamp = slot->timestamp;
+  record->process_id = slot->process_id;
+  record->truncated = (slot->flags & kSharedRingRecordTruncated) != 0;
+  const size_t size = std::min<size_t>(slot->size, GetMaxPayloadSize());
+  record->payload.assign(GetPayload(slot), size);
+  slot->sequence.store(read_index_ + header_->capacity,
+                       std::memory_order_release);
+  ++read_index_;
+  return true;
+}
+
+uint64_t SharedMemoryRing::GetDroppedCount() const {
+  assert(header_);
+  return header_->dropped.load(std::memory_order_relaxed);
+}
+
+SharedMemoryRingLogger::SharedMemoryRingLogger(const char *ring_name) {
+  assert(ring_name);
+  absl::StatusOr<SharedMemoryRing> ring = SharedMemoryRing::Attach(ring_name);
+  if (!ring.ok()) {
+    SPL_LOG(WARNING) << "Not streaming events: " << ring.status();
+    return;
+  }
+  ring_ = std::move(*ring);
+}
+
+void SharedMemoryRingLogger::AddEvent(Event *event) {
+  if (!ring_) {
+    return;
+  }
+  thread_local std::string payload;
+  payload.clear();
+  AppendEventToCommonLog(*event, &payload);
+  ring_->TryWrite(ToUnixNanos(GetTimestamp()), payload);
+}
+
+}  // namespace performancelayers
@@ -0,0 +1,185 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_SHARED_MEMORY_RING_H_
+#define STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_SHARED_MEMORY_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "absl/status/statusor.h"
+#include "event_logging.h"
+
+namespace performancelayers {
+// Shared memory ring layout
+//
+// The ring is a POSIX shared memory object made of a `SharedRingHeader`
+// followed by `capacity` slots of `record_size` bytes. Each slot starts with a
+// `SharedRingRecordHeader` followed by up to
+// `record_size - sizeof(SharedRingRecordHeader)` payload bytes. All integers
+// are in the native byte order, and the atomics are lock-free and 8-byte
+// aligned, so any process on the machine can map the ring.
+//
+// The slots form a bounded multi-producer, single-consumer queue. The
+// `sequence` of slot `i` starts at `i`. A producer claims position `p` by
+// incrementing `write_index` from `p` when the sequence of slot
+// `p % capacity` equals `p`, fills the slot, and publishes it by setting its
+// sequence to `p + 1`. The consumer reads position `p` once the sequence of
+// its slot is `p + 1`, and frees it by setting the sequence to
+// `p + capacity`. When the slot at `write_index` is not free yet, the ring is
+// full: producers increment `dropped` and give up instead of waiting.
+//
+// A producer terminated between claiming and publishing a slot stalls the
+// ring until it is created again.
+struct SharedRingHeader {
+  // `kSharedRingMagic`.
+  char magic[8];
+  uint32_t version;
+  // The size of each slot, a multiple of 8.
+  uint32_t record_size;
+  // The number of slots, a power of two.
+  uint64_t capacity;
+  // Set to 1 once the creator has initialized the ring.
+  std::atomic<uint32_t> initialized;
+  uint8_t reserved0[28];
+  // The next position to be claimed by a producer.
+  alignas(64) std::atomic<uint64_t> write_index;
+  uint8_t reserved1[56];
+  // The number of records dropped because the ring was full.
+  alignas(64) std::atomic<uint64_t> dropped;
+  uint8_t reserved2[56];
+};
+
+struct SharedRingRecordHeader {
+  std::atomic<uint64_t> sequence;
+  // The time at which the record was written, in Unix nanoseconds.
+  int64_t timestamp;
+  // The process that wrote the record.
+  uint32_t process_id;
+  // The number of payload bytes.
+  uint16_t size;
+  // `kSharedRingRecordTruncated` if the payload did not fit in the slot.
+  uint16_t flags;
+};
+
+inline constexpr char kSharedRingMagic[8] = "SPLRING";
+inline constexpr uint32_t kSharedRingVersion = 1;
+inline constexpr uint16_t kSharedRingRecordTruncated = 1;
+
+static_assert(sizeof(SharedRingHeader) == 192, "Unexpected header layout");
+static_assert(sizeof(SharedRingRecordHeader) == 24,
+              "Unexpected record header layout");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "Shared memory atomics must be lock-free");
+
+// A record read from the ring.
+struct SharedRingRecord {
+  int64_t timestamp = 0;
+  uint32_t process_id = 0;
+  bool truncated = false;
+  std::string payload;
+};
+
+// A mapping of a shared memory ring. See `SharedRingHeader` for the layout.
+// Only available on Unix.
+//
+// Writing is thread safe and never blocks. Reading must only be done by the
+// creator of the ring, from a single thread.
+class SharedMemoryRing {
+ public:
+  static constexpr uint32_t kDefaultRecordSize = 256;
+
+  // Creates the ring `name` (e.g., "/my_ring") with `capacity` slots of
+  // `record_size` bytes, replacing any existing ring with the same name. The
+  // creator reads the records, and removes the ring when destroyed.
+  // `capacity` must be a power of two, and `record_size` a multiple of 8 that
+  // leaves room for a payload.
+  static absl::StatusOr<SharedMemoryRing> Create(
+      const std::string &name, uint64_t capacity,
+      uint32_t record_size = kDefaultRecordSize);
+
+  // Maps the existing ring `name` to write records to it.
+  static absl::StatusOr<SharedMemoryRing> Attach(const std::string &name);
+
+  SharedMemoryRing(SharedMemoryRing &&other);
+  SharedMemoryRing &operator=(SharedMemoryRing &&other);
+  SharedMemoryRing(const SharedMemoryRing &) = delete;
+  SharedMemoryRing &operator=(const SharedMemoryRing &) = delete;
+
+  ~SharedMemoryRing();
+
+  // Writes a record with `payload`, truncated to `GetMaxPayloadSize()` bytes.
+  // Returns false, and counts the record as dropped, if the ring is full.
+  bool TryWrite(int64_t timestamp, std::string_view payload);
+
+  // Reads the next record into `record`. Returns false if there is none.
+  bool TryRead(SharedRingRecord *record);
+
+  // Returns the number of records dropped by all the producers.
+  uint64_t GetDroppedCount() const;
+
+  uint64_t GetCapacity() const { return header_->capacity; }
+
+  size_t GetMaxPayloadSize() const {
+    return header_->record_size - sizeof(SharedRingRecordHeader);
+  }
+
+ private:
+  SharedMemoryRing(std::string name, void *mapping, size_t mapping_size,
+                   bool owner);
+
+  SharedRingRecordHeader *GetSlot(uint64_t position) const;
+
+  void Unmap();
+
+  std::string name_;
+  SharedRingHeader *header_ = nullptr;
+  size_t mapping_size_ = 0;
+  // True for the creator, which unlinks the ring.
+  bool owner_ = false;
+  uint32_t process_id_ = 0;
+  // The next position to read. Only used by the creator.
+  uint64_t read_index_ = 0;
+};
+
+// Writes the events in the common log format to a shared memory ring created
+// by an external collector, e.g., a monitoring sidecar. Does not log anything
+// if the ring does not exist. The only valid methods after calling `EndLog()`
+// is `EndLog()`.
+class SharedMemoryRingLogger : public EventLogger {
+ public:
+  explicit SharedMemoryRingLogger(const char *ring_name);
+
+  void AddEvent(Event *event) override;
+
+  void StartLog() override {}
+
+  void EndLog() override { ring_.reset(); }
+
+  // Records are visible to the collector as soon as they are added.
+  void Flush() override {}
+
+  bool IsAttached() const { return ring_.has_value(); }
+
+ private:
+  std::optional<SharedMemoryRing> ring_;
+};
+
+}  // namespace performancelayers
+
+#endif  // STADIA_OPEN_SOURCE_PERFORMANCE_LAYERS_SHARED_MEMORY_RING_H_
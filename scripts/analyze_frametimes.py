@@ -9,10 +9,11 @@ Sample use:
         --dataset test /my/path/test/**/frame_times.log
 
 In a addition to stats printed to stdout, the above command produces CSV files with
-Frames per Second over time.
+Frames per Second over time. Binary frame time logs are read as well.
 """
 
 import argparse
+import binary_log
 import csv
 import subprocess
 import sys
@@ -61,25 +62,23 @@ class FrameTimeResult(object):
         result.run_name = parent_dir + '/' + base
         seen_states = set()
 
-        with open(full_path) as csvfile:
-            log_file = csv.reader(csvfile)
-            for i, row in enumerate(log_file):
-                if i == 0:
-                    continue
-                assert len(row) == 2
-
-                frametime_nanos = int(row[0])
-                frame_state = int(row[1])
-                seen_states.add(frame_state)
-                if frame_state not in result.state_to_duration_ms:
-                    result.state_to_duration_ms[frame_state] = 0
-
-                result.state_to_duration_ms[frame_state] += frametime_nanos / result.NonosPerMilli
-                if gameplay_state is not None and gameplay_state != frame_state:
-                    continue
-
-                result.raw_frametimes.append(frametime_nanos)
-                result.frame_states.append(frame_state)
+        for i, row in enumerate(binary_log.read_csv_rows(full_path)):
+            if i == 0:
+                continue
+            assert len(row) == 2
+
+            frametime_nanos = int(row[0])
+            frame_state = int(row[1])
+            seen_states.add(frame_state)
+            if frame_state not in result.state_to_duration_ms:
+                result.state_to_duration_ms[frame_state] = 0
+
+            result.state_to_duration_ms[frame_state] += frametime_nanos / result.NonosPerMilli
+            if gameplay_state is not None and gameplay_state != frame_state:
+                continue
+
+            result.raw_frametimes.append(frametime_nanos)
+            result.frame_states.append(frame_state)
 
         if drop_first_seconds is not None:
             drop_first_nanos = drop_first_seconds * result.NanosPerSecond
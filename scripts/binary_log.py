@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+# Copyright 2022 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+"""
+Decodes the binary logs written when VK_PERFORMANCE_LAYERS_LOG_FORMAT=binary.
+See layer/binary_logging.h for the format.
+
+Can be used as a module by the other scripts, or to convert a binary log to
+the CSV log the layer would have written otherwise (`--format csv`), or to
+event log rows with the event name and timestamp (`--format events`).
+
+Sample use:
+    binary_log.py frame_time.bin -o frame_time.csv
+"""
+
+import argparse
+import csv
+import sys
+
+MAGIC = b'SPLB'
+VERSION = 1
+
+RECORD_HEADER = 1
+RECORD_SCHEMA = 2
+RECORD_EVENT = 3
+
+# Matches performancelayers::ValueType.
+TYPE_BOOL = 0
+TYPE_DURATION = 1
+TYPE_INT64 = 2
+TYPE_STRING = 3
+TYPE_TIMESTAMP = 4
+TYPE_VECTOR_INT64 = 5
+
+
+class Event:
+    """A decoded event: its name, the Unix nanoseconds at which it was logged,
+    and the list of (attribute name, value type, value) tuples."""
+    def __init__(self, name, timestamp, attributes):
+        self.name = name
+        self.timestamp = timestamp
+        self.attributes = attributes
+
+    def csv_cells(self):
+        """Returns the attribute values formatted like the CSV logs."""
+        cells = []
+        for _name, value_type, value in self.attributes:
+            if value_type == TYPE_BOOL:
+                cells.append('1' if value else '0')
+            elif value_type == TYPE_VECTOR_INT64:
+                cells.append('[' + ','.join(hex(v) for v in value) + ']')
+            else:
+                cells.append(str(value))
+        return cells
+
+
+class _Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def at_end(self):
+        return self.pos == len(self.data)
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise EOFError('Binary log ends within a record')
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7f) << shift
+            if not byte & 0x80:
+                return value
+            shift += 7
+
+    def svarint(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def fixed64(self):
+        if self.pos + 8 > len(self.data):
+            raise EOFError('Binary log ends within a record')
+        value = int.from_bytes(self.data[self.pos:self.pos + 8], 'little')
+        self.pos += 8
+        # Hashes are logged as unsigned hex in the CSV logs.
+        return value
+
+    def string(self):
+        size = self.varint()
+        if self.pos + size > len(self.data):
+            raise EOFError('Binary log ends within a record')
+        value = self.data[self.pos:self.pos + size].decode('utf-8')
+        self.pos += size
+        return value
+
+
+def is_binary_log(path):
+    """Returns True if the file at |path| is a binary log."""
+    with open(path, 'rb') as log_file:
+        return log_file.read(len(MAGIC)) == MAGIC
+
+
+def read_binary_log(path):
+    """Returns the CSV header and the list of events of the binary log at
+    |path|. A truncated last record is dropped with a warning."""
+    with open(path, 'rb') as log_file:
+        data = log_file.read()
+    if data[:len(MAGIC)] != MAGIC:
+        raise ValueError(path + ' is not a binary log')
+    if data[len(MAGIC)] != VERSION:
+        raise ValueError('Unsupported binary log version %d' % data[len(MAGIC)])
+
+    reader = _Reader(data)
+    reader.pos = len(MAGIC) + 1
+    header = None
+    schemas = {}
+    events = []
+    last_timestamp = 0
+    try:
+        while not reader.at_end():
+            kind = reader.byte()
+            if kind == RECORD_HEADER:
+                header = reader.string()
+            elif kind == RECORD_SCHEMA:
+                schema_id = reader.varint()
+                name = reader.string()
+                attributes = []
+                for _ in range(reader.varint()):
+                    value_type = reader.byte()
+                    attributes.append((reader.string(), value_type))
+                schemas[schema_id] = (name, attributes)
+            elif kind == RECORD_EVENT:
+                name, schema = schemas[reader.varint()]
+                last_timestamp += reader.svarint()
+                timestamp = last_timestamp
+                attributes = []
+                for attribute_name, value_type in schema:
+                    if value_type == TYPE_BOOL:
+                        value = reader.byte() != 0
+                    elif value_type in (TYPE_DURATION, TYPE_INT64):
+                        value = reader.svarint()
+                    elif value_type == TYPE_STRING:
+                        value = reader.string()
+                    elif value_type == TYPE_TIMESTAMP:
+                        last_timestamp += reader.svarint()
+                        value = last_timestamp
+                    elif value_type == TYPE_VECTOR_INT64:
+                        value = [reader.fixed64() for _ in range(reader.varint())]
+                    else:
+                        raise ValueError('Unknown value type %d' % value_type)
+                    attributes.append((attribute_name, value_type, value))
+                events.append(Event(name, timestamp, attributes))
+            else:
+                raise ValueError('Unknown record kind %d' % kind)
+    except EOFError as error:
+        print('%s: %s, dropping the last record' % (path, error), file=sys.stderr)
+    return header, events
+
+
+def read_csv_rows(path):
+    """Returns the rows of the CSV log at |path|, or the equivalent rows of the
+    binary log at |path|, starting with the header row."""
+    if is_binary_log(path):
+        header, events = read_binary_log(path)
+        rows = [next(csv.reader([header]))] if header is not None else []
+        return rows + [event.csv_cells() for event in events]
+    with open(path) as csvfile:
+        return list(csv.reader(csvfile))
+
+
+def read_event_rows(path):
+    """Returns the rows of the event log at |path|, or the equivalent rows of
+    the binary log at |path|: the event name, the timestamp, and the values."""
+    if is_binary_log(path):
+        _header, events = read_binary_log(path)
+        return [[event.name, str(event.timestamp)] + event.csv_cells()
+                for event in events]
+    with open(path) as csvfile:
+        return list(csv.reader(csvfile))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Converts a binary layer log to CSV')
+    parser.add_argument('log_file', type=str, help='Binary log file')
+    parser.add_argument('--format', choices=['csv', 'events'], default='csv',
+                        help='csv: the CSV log of the layer; events: event log rows with the event names and timestamps')
+    parser.add_argument('-o', '--output', type=str, default=None, help='Output file name (default: stdout)')
+    args = parser.parse_args()
+
+    if args.format == 'csv':
+        rows = read_csv_rows(args.log_file)
+    else:
+        rows = read_event_rows(args.log_file)
+
+    output = open(args.output, 'w', newline='') if args.output else sys.stdout
+    writer = csv.writer(output, lineterminator='\n')
+    writer.writerows(rows)
+    if args.output:
+        output.close()
+
+
+if __name__ == '__main__':
+    main()
@@ -23,12 +23,14 @@ Sample use:
         --dataset B /my/path/B/events.log \
         -o timeline.png
 
+The datasets can also be binary layer logs; see binary_log.py.
+
 To see full command line options documentation, run:
   plot_timeline.py --help
 """
 
 import argparse
-import csv
+import binary_log
 import matplotlib
 matplotlib.use('Agg') # Allows to work without X dispaly
 import matplotlib.pyplot as plt
@@ -156,20 +158,18 @@ def main():
         duration_nanos = 0
         events_by_type = {}
 
-        with open(eventlog_filename) as input_file:
-            input_csv = csv.reader(input_file)
-            for i, row in enumerate(input_csv):
-                assert len(row) >= 2
-                event_type = row[0]
-                event_timestamp = int(row[1])
-                if i == 0:
-                    start_timestamp = event_timestamp
-                if event_type not in events_by_type:
-                    events_by_type[event_type] = []
-
-                nanos_since_start = event_timestamp - start_timestamp
-                duration_nanos = max(nanos_since_start, duration_nanos)
-                events_by_type[event_type].append((nanos_since_start,) + tuple(row[2:]))
+        for i, row in enumerate(binary_log.read_event_rows(eventlog_filename)):
+            assert len(row) >= 2
+            event_type = row[0]
+            event_timestamp = int(row[1])
+            if i == 0:
+                start_timestamp = event_timestamp
+            if event_type not in events_by_type:
+                events_by_type[event_type] = []
+
+            nanos_since_start = event_timestamp - start_timestamp
+            duration_nanos = max(nanos_since_start, duration_nanos)
+            events_by_type[event_type].append((nanos_since_start,) + tuple(row[2:]))
 
         duration_seconds = duration_nanos / nanos_per_second
         max_duration_seconds = max(max_duration_seconds, duration_seconds)
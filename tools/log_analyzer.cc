@@ -0,0 +1,161 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Summarizes frame time, compile time, and event logs, in CSV or binary
+// format, in parallel.
+//
+// Usage: log_analyzer [--<option>=<value>]... [--dataset=<name>] <log>...
+//
+// Computes the summaries of scripts/analyze_frametimes.py for each log: the
+// frame time average and percentiles, the missed frames, the time spent in
+// each benchmark state, and the frames per second over time, as well as the
+// number and total time of the pipeline compilations. The logs are
+// memory-mapped, and analyzed on --threads threads.
+//
+// Prints a JSON array with one object per log, or with --format=csv, one CSV
+// line per log with the scalar values. Each log belongs to the dataset named
+// by the last --dataset option before it.
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "log_analyzer.h"
+
+namespace performancelayers {
+namespace {
+struct Options {
+  bool csv = false;
+  std::string output;
+  uint32_t threads = std::thread::hardware_concurrency();
+  LogAnalysisOptions analysis;
+  // The logs, and the name of the dataset of each log.
+  std::vector<std::string> datasets;
+  std::vector<std::string> paths;
+};
+
+constexpr char kUsage[] =
+    "Usage: log_analyzer [--format=json|csv] [--output=<file>]\n"
+    "    [--threads=<n>] [--gameplay_state=<state>] [--duration=<seconds>]\n"
+    "    [--drop_front=<seconds>] [--target_fps=<fps>]\n"
+    "    [--dataset=<name>] <log>... [--dataset=<name> <log>...]...\n"
+    "The frame time statistics only include the frames in the gameplay\n"
+    "state, after the dropped seconds, and within the duration.\n";
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  std::string dataset;
+  for (int i = 1; i != argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg.substr(0, 2) != "--") {
+      options->datasets.push_back(dataset);
+      options->paths.push_back(std::string(arg));
+      continue;
+    }
+    if (arg.find('=') == std::string_view::npos) {
+      return false;
+    }
+    std::pair<std::string_view, std::string_view> flag =
+        absl::StrSplit(arg.substr(2), absl::MaxSplits('=', 1));
+    bool parsed = true;
+    if (flag.first == "format") {
+      parsed = flag.second == "json" || flag.second == "csv";
+      options->csv = flag.second == "csv";
+    } else if (flag.first == "output") {
+      options->output = std::string(flag.second);
+    } else if (flag.first == "dataset") {
+      dataset = std::string(flag.second);
+    } else if (flag.first == "threads") {
+      parsed = absl::SimpleAtoi(flag.second, &options->threads);
+    } else if (flag.first == "target_fps") {
+      parsed = absl::SimpleAtod(flag.second, &options->analysis.target_fps) &&
+               options->analysis.target_fps > 0;
+    } else if (flag.first == "gameplay_state") {
+      int64_t state = 0;
+      parsed = absl::SimpleAtoi(flag.second, &state);
+      options->analysis.gameplay_state = state;
+    } else if (flag.first == "duration" || flag.first == "drop_front") {
+      double seconds = 0;
+      parsed = absl::SimpleAtod(flag.second, &seconds);
+      (flag.first == "duration" ? options->analysis.duration_s
+                                : options->analysis.drop_front_s) = seconds;
+    } else {
+      parsed = false;
+    }
+    if (!parsed) {
+      return false;
+    }
+  }
+  return !options->paths.empty();
+}
+
+int RunAnalyzer(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    fputs(kUsage, stderr);
+    return 1;
+  }
+
+  const std::vector<absl::StatusOr<LogSummary>> summaries =
+      AnalyzeLogFiles(options.paths, options.analysis, options.threads);
+
+  int exit_code = 0;
+  std::string out = options.csv ? std::string(kLogSummaryCsvHeader) : "[";
+  bool first = true;
+  for (size_t i = 0; i != summaries.size(); ++i) {
+    if (!summaries[i].ok()) {
+      fprintf(stderr, "%s: %s\n", options.paths[i].c_str(),
+              summaries[i].status().ToString().c_str());
+      exit_code = 1;
+      continue;
+    }
+    if (options.csv) {
+      out.push_back('\n');
+      AppendLogSummaryCsv(options.datasets[i], options.paths[i], *summaries[i],
+                          &out);
+    } else {
+      out.append(first ? "\n" : ",\n");
+      AppendLogSummaryJson(options.datasets[i], options.paths[i],
+                           *summaries[i], &out);
+    }
+    first = false;
+  }
+  out.append(options.csv ? "\n" : "\n]\n");
+
+  FILE* file = stdout;
+  if (!options.output.empty()) {
+    file = fopen(options.output.c_str(), "w");
+    if (!file) {
+      fprintf(stderr, "Failed to open %s\n", options.output.c_str());
+      return 1;
+    }
+  }
+  fwrite(out.data(), 1, out.size(), file);
+  if (file != stdout) {
+    fclose(file);
+  }
+  return exit_code;
+}
+}  // namespace
+}  // namespace performancelayers
+
+int main(int argc, char** argv) {
+  return performancelayers::RunAnalyzer(argc, argv);
+}
@@ -0,0 +1,183 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "binary_logging.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+namespace fs = std::filesystem;
+
+// An event with an attribute of every `ValueType`.
+class AllTypesEvent : public Event {
+ public:
+  AllTypesEvent(bool bool_value, DurationClock::duration duration,
+                int64_t int64_value, const std::string &string_value,
+                TimestampClock::time_point timestamp,
+                const std::vector<int64_t> &vector_value)
+      : Event("all_types", LogLevel::kHigh),
+        bool_("bool", bool_value),
+        duration_("duration", duration),
+        int64_("int64", int64_value),
+        string_("string", string_value),
+        timestamp_("timestamp", timestamp),
+        vector_("vector", vector_value) {
+    InitAttributes(
+        {&bool_, &duration_, &int64_, &string_, &timestamp_, &vector_});
+  }
+
+ private:
+  BoolAttr bool_;
+  DurationAttr duration_;
+  Int64Attr int64_;
+  StringAttr string_;
+  TimestampAttr timestamp_;
+  VectorInt64Attr vector_;
+};
+
+class SingleValueEvent : public Event {
+ public:
+  SingleValueEvent(const char *name, int64_t value)
+      : Event(name, LogLevel::kHigh), value_("value", value) {
+    InitAttributes({&value_});
+  }
+
+ private:
+  Int64Attr value_;
+};
+
+std::string ReadFile(const fs::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// Logs `events` with a `BinaryLogger` and returns the contents of the log.
+std::string LogEvents(const std::vector<Event *> &events) {
+  const fs::path path = fs::temp_directory_path() / "binary_log_test.bin";
+  BinaryLogger logger("header,columns", path.c_str());
+  logger.StartLog();
+  for (Event *event : events) logger.AddEvent(event);
+  logger.EndLog();
+  return ReadFile(path);
+}
+
+TEST(BinaryLogger, RoundTripsAllValueTypes) {
+  const TimestampClock::time_point timestamp(
+      std::chrono::nanoseconds(1'650'000'000'123'456'789));
+  const std::vector<int64_t> hashes = {0x67d6fd0aaa78a6d8, -1, 0};
+  AllTypesEvent event(true, DurationClock::duration(-1234), -42, "text",
+                      timestamp, hashes);
+  AllTypesEvent empty_event(false, DurationClock::duration(0), 0, "",
+                            TimestampClock::time_point(), {});
+  const std::string log = LogEvents({&event, &empty_event});
+
+  absl::StatusOr<BinaryLogDecoder> decoder = BinaryLogDecoder::Create(log);
+  ASSERT_TRUE(decoder.ok()) << decoder.status();
+  DecodedEvent decoded;
+  ASSERT_EQ(decoder->Next(&decoded).value_or(false), true);
+  EXPECT_EQ(decoder->GetHeader(), "header,columns");
+  EXPECT_EQ(decoded.name, "all_types");
+  EXPECT_GT(decoded.timestamp, 0);
+  ASSERT_EQ(decoded.values.size(), 6u);
+  EXPECT_EQ(decoded.values[0].name, "bool");
+  EXPECT_EQ(decoded.values[0].type, ValueType::kBool);
+  EXPECT_EQ(decoded.values[0].int64_value, 1);
+  EXPECT_EQ(decoded.values[1].type, ValueType::kDuration);
+  EXPECT_EQ(decoded.values[1].int64_value, -1234);
+  EXPECT_EQ(decoded.values[2].type, ValueType::kInt64);
+  EXPECT_EQ(decoded.values[2].int64_value, -42);
+  EXPECT_EQ(decoded.values[3].type, ValueType::kString);
+  EXPECT_EQ(decoded.values[3].string_value, "text");
+  EXPECT_EQ(decoded.values[4].type, ValueType::kTimestamp);
+  EXPECT_EQ(decoded.values[4].int64_value, 1'650'000'000'123'456'789);
+  EXPECT_EQ(decoded.values[5].type, ValueType::kVectorInt64);
+  EXPECT_EQ(decoded.values[5].vector_value, hashes);
+
+  ASSERT_EQ(decoder->Next(&decoded).value_or(false), true);
+  ASSERT_EQ(decoded.values.size(), 6u);
+  EXPECT_EQ(decoded.values[0].int64_value, 0);
+  EXPECT_EQ(decoded.values[3].string_value, "");
+  EXPECT_EQ(decoded.values[4].int64_value, 0);
+  EXPECT_TRUE(decoded.values[5].vector_value.empty());
+
+  absl::StatusOr<bool> end = decoder->Next(&decoded);
+  ASSERT_TRUE(end.ok()) << end.status();
+  EXPECT_FALSE(*end);
+}
+
+TEST(BinaryLogger, SchemasPerEventName) {
+  SingleValueEvent first("first", 1);
+  SingleValueEvent second("second", 2);
+  SingleValueEvent first_again("first", 3);
+  const std::string log = LogEvents({&first, &second, &first_again});
+
+  absl::StatusOr<BinaryLogDecoder> decoder = BinaryLogDecoder::Create(log);
+  ASSERT_TRUE(decoder.ok()) << decoder.status();
+  DecodedEvent decoded;
+  for (int64_t value : {1, 2, 3}) {
+    ASSERT_EQ(decoder->Next(&decoded).value_or(false), true);
+    ASSERT_EQ(decoded.values.size(), 1u);
+    EXPECT_EQ(decoded.values[0].int64_value, value);
+  }
+  EXPECT_EQ(decoded.name, "first");
+}
+
+TEST(BinaryLogger, SchemaChangesForSameName) {
+  SingleValueEvent single("all_types", 5);
+  AllTypesEvent all_types(true, DurationClock::duration(1), 2, "3",
+                          TimestampClock::time_point(), {4});
+  const std::string log = LogEvents({&single, &all_types, &single});
+
+  absl::StatusOr<BinaryLogDecoder> decoder = BinaryLogDecoder::Create(log);
+  ASSERT_TRUE(decoder.ok()) << decoder.status();
+  DecodedEvent decoded;
+  for (size_t num_values : {1u, 6u, 1u}) {
+    ASSERT_EQ(decoder->Next(&decoded).value_or(false), true);
+    EXPECT_EQ(decoded.name, "all_types");
+    EXPECT_EQ(decoded.values.size(), num_values);
+  }
+}
+
+TEST(BinaryLogDecoder, RejectsOtherFiles) {
+  EXPECT_FALSE(BinaryLogDecoder::Create("").ok());
+  EXPECT_FALSE(BinaryLogDecoder::Create("name,value\n").ok());
+  const std::string future_version = std::string(kBinaryLogMagic) + '\x7f';
+  EXPECT_FALSE(BinaryLogDecoder::Create(future_version).ok());
+}
+
+TEST(BinaryLogDecoder, TruncatedLog) {
+  SingleValueEvent event("event", 1'000'000);
+  const std::string log = LogEvents({&event, &event});
+
+  absl::StatusOr<BinaryLogDecoder> decoder =
+      BinaryLogDecoder::Create(std::string_view(log).substr(0, log.size() - 1));
+  ASSERT_TRUE(decoder.ok()) << decoder.status();
+  DecodedEvent decoded;
+  EXPECT_EQ(decoder->Next(&decoded).value_or(false), true);
+  absl::StatusOr<bool> truncated = decoder->Next(&decoded);
+  EXPECT_EQ(truncated.status().code(), absl::StatusCode::kDataLoss);
+}
+
+}  // namespace
+}  // namespace performancelayers
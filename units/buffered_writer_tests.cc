@@ -0,0 +1,188 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "buffered_writer.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+namespace fs = std::filesystem;
+
+// Returns a writable file in the temporary directory, truncated if it already
+// exists.
+FILE* OpenTmpFile(const char* filename, fs::path* path) {
+  *path = fs::temp_directory_path() / filename;
+  return fopen(path->c_str(), "w");
+}
+
+std::string ReadFile(const fs::path& path) {
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+LogBufferingOptions MakeOptions(absl::Duration flush_interval,
+                                size_t flush_size) {
+  LogBufferingOptions options;
+  options.flush_interval = flush_interval;
+  options.flush_size = flush_size;
+  return options;
+}
+
+TEST(BufferedWriter, WritesOnClose) {
+  fs::path path;
+  BufferedWriter writer(OpenTmpFile("buffered_close.log", &path),
+                        MakeOptions(absl::Hours(1), 1 << 20));
+  writer.WriteLine("first");
+  writer.WriteLine("second");
+  EXPECT_EQ(ReadFile(path), "");
+
+  writer.Close();
+  EXPECT_EQ(ReadFile(path), "first\nsecond\n");
+  // Lines written after closing are dropped.
+  writer.WriteLine("third");
+  writer.Close();
+  EXPECT_EQ(ReadFile(path), "first\nsecond\n");
+}
+
+TEST(BufferedWriter, Flush) {
+  fs::path path;
+  BufferedWriter writer(OpenTmpFile("buffered_flush.log", &path),
+                        MakeOptions(absl::Hours(1), 1 << 20));
+  writer.WriteLine("first");
+  writer.Flush();
+  EXPECT_EQ(ReadFile(path), "first\n");
+  writer.WriteLine("second");
+  writer.Flush();
+  EXPECT_EQ(ReadFile(path), "first\nsecond\n");
+}
+
+TEST(BufferedWriter, Unbuffered) {
+  fs::path path;
+  BufferedWriter writer(OpenTmpFile("buffered_none.log", &path),
+                        MakeOptions(absl::ZeroDuration(), 1 << 20));
+  writer.WriteLine("first");
+  EXPECT_EQ(ReadFile(path), "first\n");
+  writer.WriteLine("second");
+  EXPECT_EQ(ReadFile(path), "first\nsecond\n");
+}
+
+TEST(BufferedWriter, WritesInBackground) {
+  fs::path path;
+  // The size limit wakes up the background thread early; the interval makes
+  // it write the remaining short line.
+  BufferedWriter writer(OpenTmpFile("buffered_background.log", &path),
+                        MakeOptions(absl::Milliseconds(10), 8));
+  const std::string long_line(16, 'x');
+  writer.WriteLine(long_line);
+  writer.WriteLine("short");
+  const std::string expected = absl::StrCat(long_line, "\nshort\n");
+  absl::Time deadline = absl::Now() + absl::Seconds(10);
+  while (ReadFile(path) != expected && absl::Now() < deadline) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  EXPECT_EQ(ReadFile(path), expected);
+}
+
+TEST(BufferedWriter, ConcurrentWriters) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumLines = 1000;
+  fs::path path;
+  {
+    BufferedWriter writer(OpenTmpFile("buffered_threads.log", &path),
+                          MakeOptions(absl::Milliseconds(1), 256));
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread != kNumThreads; ++thread) {
+      threads.emplace_back([&writer, thread] {
+        for (int line = 0; line != kNumLines; ++line) {
+          writer.WriteLine(absl::StrCat(thread, ",", line));
+        }
+      });
+    }
+    for (std::thread& thread : threads) thread.join();
+  }
+
+  // Every line is written in whole, and the lines of each thread are in order.
+  std::vector<int> next_line(kNumThreads, 0);
+  for (std::string_view line :
+       absl::StrSplit(ReadFile(path), '\n', absl::SkipEmpty())) {
+    std::vector<std::string> fields = absl::StrSplit(line, ',');
+    ASSERT_EQ(fields.size(), 2u);
+    const int thread = std::stoi(fields[0]);
+    ASSERT_GE(thread, 0);
+    ASSERT_LT(thread, kNumThreads);
+    EXPECT_EQ(std::stoi(fields[1]), next_line[thread]);
+    ++next_line[thread];
+  }
+  for (int lines : next_line) EXPECT_EQ(lines, kNumLines);
+}
+
+TEST(BufferedWriter, KeepsOrderAcrossThreads) {
+  fs::path path;
+  BufferedWriter writer(OpenTmpFile("buffered_order.log", &path),
+                        MakeOptions(absl::Hours(1), 1 << 20));
+  writer.WriteLine("first");
+  std::thread([&writer] { writer.WriteLine("second"); }).join();
+  writer.WriteLine("third");
+  writer.Flush();
+  EXPECT_EQ(ReadFile(path), "first\nsecond\nthird\n");
+}
+
+TEST(BufferedWriter, KeepsOrderAcrossBatches) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumLines = 1000;
+  fs::path path;
+  {
+    BufferedWriter writer(OpenTmpFile("buffered_batches.log", &path),
+                          MakeOptions(absl::Milliseconds(1), 256));
+    // The threads take turns, so the numbers are logged in increasing order.
+    absl::Mutex lock;
+    int next_number = 0;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread != kNumThreads; ++thread) {
+      threads.emplace_back([&writer, &lock, &next_number] {
+        for (int line = 0; line != kNumLines; ++line) {
+          absl::MutexLock number_lock(&lock);
+          writer.WriteLine(absl::StrCat(next_number++));
+        }
+      });
+    }
+    for (std::thread& thread : threads) thread.join();
+  }
+
+  int expected = 0;
+  for (std::string_view line :
+       absl::StrSplit(ReadFile(path), '\n', absl::SkipEmpty())) {
+    ASSERT_EQ(std::stoi(std::string(line)), expected);
+    ++expected;
+  }
+  EXPECT_EQ(expected, kNumThreads * kNumLines);
+}
+
+}  // namespace
+}  // namespace performancelayers
@@ -0,0 +1,185 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "capture_window.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+#include "gtest/gtest.h"
+
+namespace fs = std::filesystem;
+
+namespace performancelayers {
+namespace {
+
+// Ends |count| frames of |window|.
+void Present(CaptureWindow& window, int count) {
+  for (int i = 0; i != count; ++i) {
+    window.BeginPresent();
+    window.EndPresent();
+  }
+}
+
+TEST(CaptureWindowConfig, ParsesTriggers) {
+  absl::StatusOr<CaptureWindowConfig> config = ParseCaptureWindowConfig("");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->trigger, CaptureWindowConfig::Trigger::kAlways);
+  config = ParseCaptureWindowConfig("always");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->trigger, CaptureWindowConfig::Trigger::kAlways);
+  config = ParseCaptureWindowConfig("benchmark");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->trigger, CaptureWindowConfig::Trigger::kBenchmark);
+  config = ParseCaptureWindowConfig("signal");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->trigger, CaptureWindowConfig::Trigger::kSignal);
+  config = ParseCaptureWindowConfig("file:/tmp/capture");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->trigger, CaptureWindowConfig::Trigger::kControlFile);
+  EXPECT_EQ(config->control_file, "/tmp/capture");
+}
+
+TEST(CaptureWindowConfig, ParsesFrames) {
+  absl::StatusOr<CaptureWindowConfig> config =
+      ParseCaptureWindowConfig("frames:100-200");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->trigger, CaptureWindowConfig::Trigger::kFrames);
+  EXPECT_EQ(config->first_frame, 100u);
+  EXPECT_EQ(config->end_frame, 200u);
+
+  config = ParseCaptureWindowConfig("frames:100-");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->first_frame, 100u);
+  EXPECT_EQ(config->end_frame, UINT64_MAX);
+
+  config = ParseCaptureWindowConfig("frames:-200");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->first_frame, 0u);
+  EXPECT_EQ(config->end_frame, 200u);
+}
+
+TEST(CaptureWindowConfig, RejectsInvalidConfigs) {
+  EXPECT_FALSE(ParseCaptureWindowConfig("sometimes").ok());
+  EXPECT_FALSE(ParseCaptureWindowConfig("file:").ok());
+  EXPECT_FALSE(ParseCaptureWindowConfig("frames:100").ok());
+  EXPECT_FALSE(ParseCaptureWindowConfig("frames:a-b").ok());
+  EXPECT_FALSE(ParseCaptureWindowConfig("frames:200-100").ok());
+  EXPECT_FALSE(ParseCaptureWindowConfig("frames:100-100").ok());
+}
+
+TEST(CaptureWindow, AlwaysOpen) {
+  CaptureWindow window({});
+  EXPECT_TRUE(window.IsOpen());
+  Present(window, 3);
+  EXPECT_TRUE(window.IsOpen());
+  EXPECT_EQ(window.GetFrameCount(), 3u);
+}
+
+TEST(CaptureWindow, OpensForFrameRange) {
+  CaptureWindowConfig config;
+  config.trigger = CaptureWindowConfig::Trigger::kFrames;
+  config.first_frame = 2;
+  config.end_frame = 4;
+  CaptureWindow window(config);
+  EXPECT_FALSE(window.IsOpen());
+  Present(window, 1);
+  EXPECT_FALSE(window.IsOpen());
+  Present(window, 1);
+  EXPECT_TRUE(window.IsOpen());
+  Present(window, 1);
+  EXPECT_TRUE(window.IsOpen());
+  Present(window, 1);
+  EXPECT_FALSE(window.IsOpen());
+  Present(window, 10);
+  EXPECT_FALSE(window.IsOpen());
+}
+
+TEST(CaptureWindow, NestedPresentsEndOneFrame) {
+  CaptureWindowConfig config;
+  config.trigger = CaptureWindowConfig::Trigger::kFrames;
+  config.first_frame = 1;
+  CaptureWindow window(config);
+  window.BeginPresent();
+  window.BeginPresent();
+  window.EndPresent();
+  EXPECT_EQ(window.GetFrameCount(), 0u);
+  EXPECT_FALSE(window.IsOpen());
+  window.EndPresent();
+  EXPECT_EQ(window.GetFrameCount(), 1u);
+  EXPECT_TRUE(window.IsOpen());
+}
+
+TEST(CaptureWindow, BenchmarkWithoutScannerOpensAtFirstFrame) {
+  CaptureWindowConfig config;
+  config.trigger = CaptureWindowConfig::Trigger::kBenchmark;
+  CaptureWindow window(config);
+  EXPECT_TRUE(window.IsOpen());
+}
+
+TEST(CaptureWindow, TogglesAtFrameEnd) {
+  CaptureWindowConfig config;
+  config.trigger = CaptureWindowConfig::Trigger::kSignal;
+  CaptureWindow window(config);
+  EXPECT_FALSE(window.IsOpen());
+  window.RequestToggle();
+  EXPECT_FALSE(window.IsOpen());
+  Present(window, 1);
+  EXPECT_TRUE(window.IsOpen());
+  Present(window, 1);
+  EXPECT_TRUE(window.IsOpen());
+
+  // Toggles requested during the same frame cancel out.
+  window.RequestToggle();
+  window.RequestToggle();
+  Present(window, 1);
+  EXPECT_TRUE(window.IsOpen());
+  window.RequestToggle();
+  Present(window, 1);
+  EXPECT_FALSE(window.IsOpen());
+}
+
+TEST(CaptureWindow, OpenWhileControlFileExists) {
+  const fs::path path = fs::temp_directory_path() / "capture_window_control";
+  fs::remove(path);
+  CaptureWindowConfig config;
+  config.trigger = CaptureWindowConfig::Trigger::kControlFile;
+  config.control_file = path.string();
+  CaptureWindow window(config);
+  EXPECT_FALSE(window.IsOpen());
+
+  FILE* file = fopen(path.c_str(), "w");
+  ASSERT_NE(file, nullptr);
+  fclose(file);
+  EXPECT_FALSE(window.IsOpen());
+  Present(window, 1);
+  EXPECT_TRUE(window.IsOpen());
+
+  fs::remove(path);
+  Present(window, 1);
+  EXPECT_FALSE(window.IsOpen());
+}
+
+TEST(CaptureWindow, SharedWindowDefaultsToOpen) {
+  EXPECT_TRUE(IsCaptureWindowOpen());
+  const SplCaptureWindowInterface* interface = SPL_GetCaptureWindowInterface();
+  ASSERT_NE(interface, nullptr);
+  EXPECT_EQ(interface->version, kCaptureWindowInterfaceVersion);
+  { ScopedCapturePresent present; }
+  EXPECT_TRUE(IsCaptureWindowOpen());
+}
+
+}  // namespace
+}  // namespace performancelayers
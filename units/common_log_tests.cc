@@ -13,6 +13,10 @@
 // limitations under the License.
 
 #include "common_logging.h"
+
+#include <chrono>
+#include <string>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -36,5 +40,20 @@ TEST(CommonLogger, MethodCheck) {
   SUCCEED();
 }
 
+TEST(CommonLogger, EventToCommonLogStr) {
+  const TimestampClock::time_point timestamp(std::chrono::nanoseconds(10));
+  VectorInt64Attr hashes("hashes", {2, 3});
+  CreateGraphicsPipelinesEvent pipeline_event(
+      "create_graphics_pipeline", timestamp, hashes,
+      DurationClock::duration(4), LogLevel::kHigh);
+  EXPECT_EQ(EventToCommonLogStr(pipeline_event),
+            "create_graphics_pipeline,timestamp:10,hashes:\"[0x2,0x3]\","
+            "duration:4");
+
+  std::string out;
+  AppendEventToCommonLog(pipeline_event, &out);
+  EXPECT_EQ(out, EventToCommonLogStr(pipeline_event));
+}
+
 }  // namespace
 }  // namespace performancelayers
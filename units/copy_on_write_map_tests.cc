@@ -0,0 +1,127 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "copy_on_write_map.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+TEST(CopyOnWriteMap, Empty) {
+  CopyOnWriteMap<int, std::string> map;
+  EXPECT_EQ(map.Size(), 0u);
+  EXPECT_EQ(map.Find(1), nullptr);
+  EXPECT_FALSE(map.Contains(1));
+  EXPECT_FALSE(map.Erase(1));
+}
+
+TEST(CopyOnWriteMap, InsertFindErase) {
+  CopyOnWriteMap<int, std::string> map;
+  EXPECT_TRUE(map.Insert(1, "one"));
+  EXPECT_TRUE(map.Insert(2, "two"));
+  EXPECT_FALSE(map.Insert(1, "uno"));
+  EXPECT_EQ(map.Size(), 2u);
+  ASSERT_NE(map.Find(1), nullptr);
+  EXPECT_EQ(*map.Find(1), "one");
+  EXPECT_TRUE(map.Contains(2));
+
+  EXPECT_TRUE(map.Erase(1));
+  EXPECT_FALSE(map.Contains(1));
+  EXPECT_TRUE(map.Contains(2));
+  EXPECT_EQ(map.Size(), 1u);
+}
+
+TEST(CopyOnWriteMap, InsertOrAssign) {
+  CopyOnWriteMap<int, std::string> map;
+  map.InsertOrAssign(1, "one");
+  map.InsertOrAssign(1, "uno");
+  EXPECT_EQ(map.Size(), 1u);
+  EXPECT_EQ(*map.Find(1), "uno");
+}
+
+TEST(CopyOnWriteMap, FoundValuesOutliveModifications) {
+  CopyOnWriteMap<int, std::string> map;
+  map.Insert(1, "one");
+  const std::string* value = map.Find(1);
+  ASSERT_NE(value, nullptr);
+
+  map.InsertOrAssign(1, "uno");
+  for (int i = 2; i != 100; ++i) {
+    map.Insert(i, std::to_string(i));
+  }
+  map.Erase(1);
+  EXPECT_EQ(*value, "one");
+  EXPECT_EQ(map.Find(1), nullptr);
+}
+
+TEST(CopyOnWriteMap, ConcurrentReadersAndWriter) {
+  CopyOnWriteMap<int, int> map;
+  map.Insert(0, 0);
+  std::atomic<bool> done = false;
+  std::vector<std::thread> readers;
+  std::atomic<int> failures = 0;
+  for (int i = 0; i != 4; ++i) {
+    readers.emplace_back([&map, &done, &failures] {
+      while (!done.load()) {
+        // The key 0 is never erased, and every value matches its key.
+        const int* value = map.Find(0);
+        if (!value || *value != 0) ++failures;
+        for (int key = 1; key != 64; ++key) {
+          if (const int* other = map.Find(key); other && *other != key) {
+            ++failures;
+          }
+        }
+      }
+    });
+  }
+
+  for (int round = 0; round != 20; ++round) {
+    for (int key = 1; key != 64; ++key) map.InsertOrAssign(key, key);
+    for (int key = 1; key != 64; ++key) map.Erase(key);
+  }
+  done.store(true);
+  for (std::thread& reader : readers) reader.join();
+  EXPECT_EQ(failures.load(), 0);
+  EXPECT_EQ(map.Size(), 1u);
+}
+
+TEST(CopyOnWriteMap, ShortLivedReaders) {
+  CopyOnWriteMap<int, int> map;
+  map.Insert(0, 0);
+  std::atomic<int> failures = 0;
+  // Each thread claims a reader slot, which is reused by the next threads
+  // once it exits.
+  for (int round = 0; round != 50; ++round) {
+    std::thread reader([&map, &failures] {
+      for (int i = 0; i != 100; ++i) {
+        const int* value = map.Find(0);
+        if (!value || *value != 0) ++failures;
+      }
+    });
+    map.InsertOrAssign(round + 1, round + 1);
+    map.Erase(round + 1);
+    reader.join();
+  }
+  EXPECT_EQ(failures.load(), 0);
+  EXPECT_EQ(map.Size(), 1u);
+}
+
+}  // namespace
+}  // namespace performancelayers
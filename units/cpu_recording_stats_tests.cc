@@ -0,0 +1,206 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_recording_stats.h"
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+TEST(CpuRecordingStats, TimesRecordings) {
+  CpuRecordingStats stats;
+  CpuRecordingStats::Recording first;
+  CpuRecordingStats::Recording second;
+  const DurationClock::time_point begin = DurationClock::now();
+  CpuRecordingStats::BeginRecording(&first, begin);
+  CpuRecordingStats::BeginRecording(&second, begin);
+  stats.RecordPipelineBind();
+  stats.RecordDraw(&first);
+  stats.RecordDraw(&second);
+  stats.RecordDraw(&second);
+  stats.EndRecording(&first, begin + std::chrono::nanoseconds(100));
+  stats.RecordDraw(&second);
+  stats.EndRecording(&second, begin + std::chrono::nanoseconds(300));
+
+  const CpuFrameStats frame = stats.TakeFrameStats();
+  ASSERT_EQ(frame.threads.size(), 1u);
+  EXPECT_EQ(frame.threads[0].thread_id, GetThreadId());
+  const CpuRecordingCounters& total = frame.total;
+  EXPECT_EQ(total.recordings, 2u);
+  EXPECT_EQ(total.recording_ns, 400u);
+  EXPECT_EQ(total.max_recording_draws, 3u);
+  EXPECT_EQ(total.pipeline_binds, 1u);
+  EXPECT_EQ(total.draws, 4u);
+  EXPECT_EQ(frame.max_thread_recording_ns, 400u);
+}
+
+TEST(CpuRecordingStats, CountsDrawsOfInterleavedRecordings) {
+  CpuRecordingStats stats;
+  CpuRecordingStats::Recording first;
+  CpuRecordingStats::Recording second;
+  const DurationClock::time_point begin = DurationClock::now();
+  CpuRecordingStats::BeginRecording(&first, begin);
+  CpuRecordingStats::BeginRecording(&second, begin);
+  for (int i = 0; i < 3; ++i) {
+    stats.RecordDraw(&first);
+    stats.RecordDraw(&second);
+  }
+  stats.RecordDraw(&first);
+  stats.EndRecording(&second, begin);
+  stats.EndRecording(&first, begin);
+
+  const CpuRecordingCounters total = stats.TakeFrameStats().total;
+  EXPECT_EQ(total.recordings, 2u);
+  EXPECT_EQ(total.draws, 7u);
+  EXPECT_EQ(total.max_recording_draws, 4u);
+}
+
+TEST(CpuRecordingStats, CountsDrawsOutsideRecordings) {
+  CpuRecordingStats stats;
+  stats.RecordDraw(nullptr);
+  const CpuRecordingCounters total = stats.TakeFrameStats().total;
+  EXPECT_EQ(total.draws, 1u);
+  EXPECT_EQ(total.recordings, 0u);
+  EXPECT_EQ(total.max_recording_draws, 0u);
+}
+
+TEST(CpuRecordingStats, IgnoresEndWithoutBegin) {
+  CpuRecordingStats stats;
+  CpuRecordingStats::Recording recording;
+  stats.EndRecording(&recording, DurationClock::now());
+  stats.EndRecording(nullptr, DurationClock::now());
+  const CpuFrameStats frame = stats.TakeFrameStats();
+  EXPECT_TRUE(frame.threads.empty());
+  EXPECT_TRUE(frame.total.IsEmpty());
+}
+
+TEST(CpuRecordingStats, IgnoresSecondEnd) {
+  CpuRecordingStats stats;
+  CpuRecordingStats::Recording recording;
+  const DurationClock::time_point begin = DurationClock::now();
+  CpuRecordingStats::BeginRecording(&recording, begin);
+  stats.EndRecording(&recording, begin + std::chrono::nanoseconds(10));
+  stats.EndRecording(&recording, begin + std::chrono::nanoseconds(20));
+  const CpuRecordingCounters total = stats.TakeFrameStats().total;
+  EXPECT_EQ(total.recordings, 1u);
+  EXPECT_EQ(total.recording_ns, 10u);
+}
+
+TEST(CpuRecordingStats, CountsRecordingOnEndingThread) {
+  CpuRecordingStats stats;
+  CpuRecordingStats::Recording recording;
+  const DurationClock::time_point begin = DurationClock::now();
+  CpuRecordingStats::BeginRecording(&recording, begin);
+  stats.RecordDraw(&recording);
+  uint32_t ending_thread_id = 0;
+  std::thread([&] {
+    stats.RecordDraw(&recording);
+    stats.EndRecording(&recording, begin + std::chrono::nanoseconds(10));
+    ending_thread_id = GetThreadId();
+  }).join();
+
+  const CpuFrameStats frame = stats.TakeFrameStats();
+  ASSERT_EQ(frame.threads.size(), 2u);
+  EXPECT_EQ(frame.threads[0].counters.recordings, 0u);
+  EXPECT_EQ(frame.threads[1].thread_id, ending_thread_id);
+  EXPECT_EQ(frame.threads[1].counters.recordings, 1u);
+  EXPECT_EQ(frame.threads[1].counters.max_recording_draws, 2u);
+  EXPECT_EQ(frame.total.draws, 2u);
+  EXPECT_EQ(frame.total.recording_ns, 10u);
+}
+
+TEST(CpuRecordingStats, CountsSubmitsAndDescriptorUpdates) {
+  CpuRecordingStats stats;
+  stats.RecordSubmit(std::chrono::nanoseconds(50));
+  stats.RecordSubmit(std::chrono::nanoseconds(70));
+  stats.RecordDescriptorUpdate(3, 1, std::chrono::nanoseconds(20));
+
+  const CpuRecordingCounters total = stats.TakeFrameStats().total;
+  EXPECT_EQ(total.submits, 2u);
+  EXPECT_EQ(total.submit_ns, 120u);
+  EXPECT_EQ(total.descriptor_updates, 1u);
+  EXPECT_EQ(total.descriptor_writes, 4u);
+  EXPECT_EQ(total.descriptor_update_ns, 20u);
+}
+
+TEST(CpuRecordingStats, ResetsTakenCounters) {
+  CpuRecordingStats stats;
+  stats.RecordDraw(nullptr);
+  EXPECT_EQ(stats.TakeFrameStats().total.draws, 1u);
+  const CpuFrameStats frame = stats.TakeFrameStats();
+  EXPECT_TRUE(frame.threads.empty());
+  EXPECT_EQ(frame.total.draws, 0u);
+}
+
+TEST(CpuRecordingStats, KeepsRecordingsOpenAcrossFrames) {
+  CpuRecordingStats stats;
+  CpuRecordingStats::Recording recording;
+  const DurationClock::time_point begin = DurationClock::now();
+  CpuRecordingStats::BeginRecording(&recording, begin);
+  stats.RecordDraw(&recording);
+  EXPECT_EQ(stats.TakeFrameStats().total.recordings, 0u);
+  stats.EndRecording(&recording, begin + std::chrono::nanoseconds(10));
+  const CpuRecordingCounters total = stats.TakeFrameStats().total;
+  EXPECT_EQ(total.recordings, 1u);
+  EXPECT_EQ(total.max_recording_draws, 1u);
+}
+
+TEST(CpuRecordingStats, MergesThreads) {
+  constexpr int kNumThreads = 4;
+  constexpr int kDrawsPerThread = 1000;
+  CpuRecordingStats stats;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&stats, i] {
+      CpuRecordingStats::Recording recording;
+      const DurationClock::time_point begin = DurationClock::now();
+      CpuRecordingStats::BeginRecording(&recording, begin);
+      for (int draw = 0; draw < kDrawsPerThread; ++draw) {
+        stats.RecordDraw(&recording);
+      }
+      stats.EndRecording(&recording, begin + std::chrono::nanoseconds(i + 1));
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  const CpuFrameStats frame = stats.TakeFrameStats();
+  EXPECT_EQ(frame.threads.size(), size_t{kNumThreads});
+  EXPECT_EQ(frame.total.recordings, uint64_t{kNumThreads});
+  EXPECT_EQ(frame.total.draws, uint64_t{kNumThreads * kDrawsPerThread});
+  EXPECT_EQ(frame.total.max_recording_draws, uint64_t{kDrawsPerThread});
+  EXPECT_EQ(frame.total.recording_ns, 10u);
+  EXPECT_EQ(frame.max_thread_recording_ns, uint64_t{kNumThreads});
+}
+
+TEST(CpuRecordingStats, SeparatesInstances) {
+  CpuRecordingStats first;
+  CpuRecordingStats second;
+  first.RecordDraw(nullptr);
+  second.RecordDraw(nullptr);
+  second.RecordDraw(nullptr);
+  first.RecordDraw(nullptr);
+  EXPECT_EQ(first.TakeFrameStats().total.draws, 2u);
+  EXPECT_EQ(second.TakeFrameStats().total.draws, 2u);
+}
+
+}  // namespace
+}  // namespace performancelayers
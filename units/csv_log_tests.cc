@@ -13,6 +13,11 @@
 // limitations under the License.
 
 #include "csv_logging.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -37,5 +42,55 @@ TEST(CSVLogger, MethodCheck) {
   SUCCEED();
 }
 
+TEST(CSVLogger, ValueToCSVString) {
+  EXPECT_EQ(ValueToCSVString(true), "1");
+  EXPECT_EQ(ValueToCSVString(false), "0");
+  EXPECT_EQ(ValueToCSVString(int64_t(-42)), "-42");
+  EXPECT_EQ(ValueToCSVString(std::string("text")), "text");
+  EXPECT_EQ(ValueToCSVString(std::vector<int64_t>{}), "\"[]\"");
+  const std::vector<int64_t> hashes = {0x2, 0xabc};
+  EXPECT_EQ(ValueToCSVString(hashes), "\"[0x2,0xabc]\"");
+  const std::vector<int64_t> negative_hashes = {-1};
+  EXPECT_EQ(ValueToCSVString(negative_hashes), "\"[0xffffffffffffffff]\"");
+  EXPECT_EQ(ValueToCSVString(DurationClock::duration(1234)), "1234");
+  const TimestampClock::time_point timestamp(std::chrono::nanoseconds(5678));
+  EXPECT_EQ(ValueToCSVString(timestamp), "5678");
+}
+
+TEST(CSVLogger, AppendEventToCSV) {
+  const TimestampClock::time_point timestamp(std::chrono::nanoseconds(10));
+  VectorInt64Attr hashes("hashes", {2, 3});
+  CreateGraphicsPipelinesEvent pipeline_event(
+      "create_graphics_pipeline", timestamp, hashes,
+      DurationClock::duration(4), LogLevel::kHigh);
+  EXPECT_EQ(EventToCSVString(pipeline_event), "10,\"[0x2,0x3]\",4");
+
+  // The output is appended to, so that its memory can be reused.
+  std::string out = "prefix,";
+  AppendEventToCSV(pipeline_event, &out);
+  EXPECT_EQ(out, "prefix,10,\"[0x2,0x3]\",4");
+  out.clear();
+  AppendEventToCSV(pipeline_event, &out);
+  EXPECT_EQ(out, "10,\"[0x2,0x3]\",4");
+}
+
+TEST(CSVLogger, AppendCSVAttributeValue) {
+  BoolAttr bool_attr("bool", true);
+  DurationAttr duration_attr("duration", DurationClock::duration(7));
+  Int64Attr int64_attr("int64", 8);
+  StringAttr string_attr("string", "str");
+  TimestampAttr timestamp_attr(
+      "timestamp", TimestampClock::time_point(std::chrono::nanoseconds(9)));
+  VectorInt64Attr vector_attr("vector", {10});
+  std::string out;
+  for (Attribute *attribute :
+       std::vector<Attribute *>{&bool_attr, &duration_attr, &int64_attr,
+                                &string_attr, &timestamp_attr, &vector_attr}) {
+    AppendCSVAttributeValue(*attribute, &out);
+    out.push_back(';');
+  }
+  EXPECT_EQ(out, "1;7;8;str;9;\"[0xa]\";");
+}
+
 }  // namespace
 }  // namespace performancelayers
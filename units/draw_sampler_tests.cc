@@ -0,0 +1,170 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "draw_sampler.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+// Fake handles, only used as keys.
+const VkPipeline kPipelineA = reinterpret_cast<VkPipeline>(uintptr_t{1});
+const VkPipeline kPipelineB = reinterpret_cast<VkPipeline>(uintptr_t{2});
+
+// Records |count| draws of the bound pipeline of |sampler|, and returns how
+// many are sampled.
+int SampleDraws(DrawSampler& sampler, int count) {
+  int sampled = 0;
+  for (int i = 0; i != count; ++i) {
+    sampled += sampler.SampleDraw() ? 1 : 0;
+  }
+  return sampled;
+}
+
+// Returns the draws of |pipeline| in the recording of |sampler|.
+DrawSampler::PipelineDraws GetDraws(const DrawSampler& sampler,
+                                    VkPipeline pipeline) {
+  for (const DrawSampler::PipelineDraws& draws : sampler.GetPipelineDraws()) {
+    if (draws.pipeline == pipeline) {
+      return draws;
+    }
+  }
+  return {};
+}
+
+TEST(DrawSamplingConfig, ParsesPolicies) {
+  absl::StatusOr<DrawSamplingConfig> config = ParseDrawSamplingConfig("all");
+  ASSERT_TRUE(config.ok());
+  EXPECT_TRUE(config->SamplesAll());
+
+  config = ParseDrawSamplingConfig("every:8");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->policy, DrawSamplingConfig::Policy::kEveryNth);
+  EXPECT_EQ(config->period, 8u);
+
+  config = ParseDrawSamplingConfig("fraction:0.25");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->policy, DrawSamplingConfig::Policy::kFraction);
+  EXPECT_DOUBLE_EQ(config->fraction, 0.25);
+
+  config = ParseDrawSamplingConfig("budget:4");
+  ASSERT_TRUE(config.ok());
+  EXPECT_EQ(config->policy, DrawSamplingConfig::Policy::kPipelineBudget);
+  EXPECT_EQ(config->budget, 4u);
+}
+
+TEST(DrawSamplingConfig, RejectsInvalidPolicies) {
+  EXPECT_FALSE(ParseDrawSamplingConfig("some").ok());
+  EXPECT_FALSE(ParseDrawSamplingConfig("every:0").ok());
+  EXPECT_FALSE(ParseDrawSamplingConfig("every:x").ok());
+  EXPECT_FALSE(ParseDrawSamplingConfig("fraction:0").ok());
+  EXPECT_FALSE(ParseDrawSamplingConfig("fraction:1.5").ok());
+  EXPECT_FALSE(ParseDrawSamplingConfig("budget:0").ok());
+}
+
+TEST(DrawSampler, SamplesAll) {
+  DrawSampler sampler;
+  sampler.Reset(1);
+  sampler.BindPipeline(kPipelineA);
+  EXPECT_EQ(SampleDraws(sampler, 5), 5);
+  EXPECT_DOUBLE_EQ(GetDraws(sampler, kPipelineA).GetWeight(), 1.0);
+}
+
+TEST(DrawSampler, SamplesEveryNthDrawOfEachPipeline) {
+  DrawSamplingConfig config;
+  config.policy = DrawSamplingConfig::Policy::kEveryNth;
+  config.period = 4;
+  DrawSampler sampler(config);
+  sampler.Reset(1);
+  sampler.BindPipeline(kPipelineA);
+  EXPECT_TRUE(sampler.SampleDraw());
+  EXPECT_EQ(SampleDraws(sampler, 3), 0);
+  sampler.BindPipeline(kPipelineB);
+  EXPECT_TRUE(sampler.SampleDraw());
+  sampler.BindPipeline(kPipelineA);
+  EXPECT_TRUE(sampler.SampleDraw());
+  EXPECT_EQ(SampleDraws(sampler, 2), 0);
+
+  EXPECT_EQ(GetDraws(sampler, kPipelineA).draws, 7u);
+  EXPECT_EQ(GetDraws(sampler, kPipelineA).measured, 2u);
+  EXPECT_DOUBLE_EQ(GetDraws(sampler, kPipelineA).GetWeight(), 3.5);
+  EXPECT_DOUBLE_EQ(GetDraws(sampler, kPipelineB).GetWeight(), 1.0);
+}
+
+TEST(DrawSampler, SamplesFraction) {
+  DrawSamplingConfig config;
+  config.policy = DrawSamplingConfig::Policy::kFraction;
+  config.fraction = 0.25;
+  DrawSampler sampler(config);
+  sampler.Reset(42);
+  sampler.BindPipeline(kPipelineA);
+  const int sampled = SampleDraws(sampler, 10000);
+  EXPECT_GT(sampled, 2200);
+  EXPECT_LT(sampled, 2800);
+  EXPECT_NEAR(GetDraws(sampler, kPipelineA).GetWeight(), 4.0, 0.5);
+
+  // The same seed makes the same choices.
+  DrawSampler other(config);
+  other.Reset(42);
+  other.BindPipeline(kPipelineA);
+  EXPECT_EQ(SampleDraws(other, 10000), sampled);
+}
+
+TEST(DrawSampler, StopsAtPipelineBudget) {
+  DrawSamplingConfig config;
+  config.policy = DrawSamplingConfig::Policy::kPipelineBudget;
+  config.budget = 2;
+  DrawSampler sampler(config);
+  sampler.Reset(1);
+  sampler.BindPipeline(kPipelineA);
+  EXPECT_EQ(SampleDraws(sampler, 5), 2);
+  sampler.BindPipeline(kPipelineB);
+  EXPECT_EQ(SampleDraws(sampler, 1), 1);
+  sampler.BindPipeline(kPipelineA);
+  EXPECT_EQ(SampleDraws(sampler, 5), 0);
+  EXPECT_DOUBLE_EQ(GetDraws(sampler, kPipelineA).GetWeight(), 5.0);
+
+  // A new recording gets a new budget.
+  sampler.Reset(2);
+  EXPECT_TRUE(sampler.GetPipelineDraws().empty());
+  sampler.BindPipeline(kPipelineA);
+  EXPECT_EQ(SampleDraws(sampler, 5), 2);
+}
+
+TEST(DrawSampler, DroppedSamplesAreNotMeasured) {
+  DrawSamplingConfig config;
+  config.policy = DrawSamplingConfig::Policy::kPipelineBudget;
+  config.budget = 2;
+  DrawSampler sampler(config);
+  sampler.Reset(1);
+  sampler.BindPipeline(kPipelineA);
+  EXPECT_TRUE(sampler.SampleDraw());
+  sampler.DropSample();
+  EXPECT_EQ(SampleDraws(sampler, 3), 2);
+  EXPECT_EQ(GetDraws(sampler, kPipelineA).draws, 4u);
+  EXPECT_EQ(GetDraws(sampler, kPipelineA).measured, 2u);
+}
+
+TEST(DrawSampler, IgnoresDrawsWithoutPipeline) {
+  DrawSampler sampler;
+  sampler.Reset(1);
+  EXPECT_FALSE(sampler.SampleDraw());
+  EXPECT_TRUE(sampler.GetPipelineDraws().empty());
+}
+
+}  // namespace
+}  // namespace performancelayers
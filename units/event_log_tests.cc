@@ -13,6 +13,13 @@
 // limitations under the License.
 
 #include "event_logging.h"
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -60,6 +67,7 @@ TEST(Event, AttributeCreation) {
   const VectorInt64Attr pipeline("pipeline", {hash_val1, hash_val2});
   EXPECT_EQ(timestamp.GetName(), "timestamp");
   EXPECT_EQ(timestamp.GetValue(), timestamp_val);
+  EXPECT_EQ(timestamp.GetValueType(), ValueType::kTimestamp);
   EXPECT_EQ(state.GetName(), "state");
   EXPECT_EQ(state.GetValue(), "1");
   EXPECT_EQ(pipeline.GetName(), "pipeline");
@@ -68,6 +76,40 @@ TEST(Event, AttributeCreation) {
   EXPECT_EQ(pipeline.GetValue()[1], hash_val2);
 }
 
+TEST(Event, VectorAttributeFromUnsignedValues) {
+  const std::vector<uint64_t> hashes = {0x67d6fd0aaa78a6d8, ~uint64_t(0)};
+  const VectorInt64Attr pipeline("pipeline", absl::MakeConstSpan(hashes));
+  EXPECT_THAT(pipeline.GetValue(), ElementsAre(0x67d6fd0aaa78a6d8, -1));
+}
+
+TEST(Event, VisitsAttributeValuesWithTheirType) {
+  const BoolAttr bool_attr("bool", true);
+  const Int64Attr int64_attr("int64", 42);
+  const StringAttr string_attr("string", "text");
+  const VectorInt64Attr vector_attr("vector", {1, 2});
+  std::vector<std::string> visited;
+  auto visitor = [&visited](const auto &value) {
+    using T = std::decay_t<decltype(value)>;
+    if constexpr (std::is_same_v<T, bool>) {
+      visited.push_back(value ? "bool:1" : "bool:0");
+    } else if constexpr (std::is_same_v<T, int64_t>) {
+      visited.push_back("int64:" + std::to_string(value));
+    } else if constexpr (std::is_same_v<T, std::string>) {
+      visited.push_back("string:" + value);
+    } else if constexpr (std::is_same_v<T, absl::Span<const int64_t>>) {
+      visited.push_back("vector:" + std::to_string(value.size()));
+    } else {
+      visited.push_back("other");
+    }
+  };
+  VisitAttributeValue(bool_attr, visitor);
+  VisitAttributeValue(int64_attr, visitor);
+  VisitAttributeValue(string_attr, visitor);
+  VisitAttributeValue(vector_attr, visitor);
+  EXPECT_THAT(visited,
+              ElementsAre("bool:1", "int64:42", "string:text", "vector:2"));
+}
+
 TEST(Event, CreateShaderModuleEventCreation) {
   TimestampClock::time_point timestamp_val = {};
   const int64_t hash_val1 = 0x67d6fd0aaa78a6d8;
@@ -0,0 +1,140 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "frame_time_stats.h"
+
+#include <chrono>
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+
+TEST(LogLinearHistogram, Buckets) {
+  constexpr uint64_t kSubBucketCount = LogLinearHistogram::kSubBucketCount;
+  for (uint64_t value = 0; value != kSubBucketCount; ++value) {
+    EXPECT_EQ(LogLinearHistogram::GetBucketIndex(value), value);
+  }
+  EXPECT_EQ(LogLinearHistogram::GetBucketIndex(2 * kSubBucketCount),
+            2 * kSubBucketCount);
+  EXPECT_EQ(LogLinearHistogram::GetBucketIndex(2 * kSubBucketCount + 1),
+            2 * kSubBucketCount);
+  EXPECT_EQ(LogLinearHistogram::GetBucketIndex(UINT64_MAX),
+            LogLinearHistogram::kBucketCount - 1);
+
+  // The buckets are contiguous and each value falls in its own bucket.
+  uint64_t next_lower_bound = 0;
+  for (size_t index = 0; index != LogLinearHistogram::kBucketCount; ++index) {
+    const uint64_t lower_bound = LogLinearHistogram::GetBucketLowerBound(index);
+    const uint64_t width = LogLinearHistogram::GetBucketWidth(index);
+    ASSERT_EQ(lower_bound, next_lower_bound) << index;
+    EXPECT_EQ(LogLinearHistogram::GetBucketIndex(lower_bound), index);
+    EXPECT_EQ(LogLinearHistogram::GetBucketIndex(lower_bound + width - 1),
+              index);
+    // The relative error is bounded.
+    if (index >= kSubBucketCount) {
+      EXPECT_LE(width * kSubBucketCount, lower_bound);
+    }
+    next_lower_bound = lower_bound + width;
+  }
+}
+
+TEST(LogLinearHistogram, Empty) {
+  LogLinearHistogram histogram;
+  EXPECT_EQ(histogram.GetCount(), 0u);
+  EXPECT_EQ(histogram.GetMin(), 0u);
+  EXPECT_EQ(histogram.GetMax(), 0u);
+  EXPECT_EQ(histogram.GetMean(), 0.0);
+  EXPECT_EQ(histogram.GetPercentile(50.0), 0u);
+  EXPECT_EQ(histogram.GetMeanOfLargest(0.01), 0.0);
+}
+
+TEST(LogLinearHistogram, Percentiles) {
+  LogLinearHistogram histogram;
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.Record(value * 1000);
+  }
+  EXPECT_EQ(histogram.GetCount(), 1000u);
+  EXPECT_EQ(histogram.GetMin(), 1000u);
+  EXPECT_EQ(histogram.GetMax(), 1000000u);
+  EXPECT_DOUBLE_EQ(histogram.GetMean(), 500500.0);
+  EXPECT_NEAR(histogram.GetPercentile(50.0), 500000.0, 500000.0 / 32);
+  EXPECT_NEAR(histogram.GetPercentile(90.0), 900000.0, 900000.0 / 32);
+  EXPECT_NEAR(histogram.GetPercentile(99.0), 990000.0, 990000.0 / 32);
+  EXPECT_EQ(histogram.GetPercentile(0.0), 1000u);
+  EXPECT_EQ(histogram.GetPercentile(100.0), 1000000u);
+  // The 10 largest values.
+  EXPECT_NEAR(histogram.GetMeanOfLargest(0.01), 995500.0, 995500.0 / 32);
+
+  histogram.Reset();
+  EXPECT_EQ(histogram.GetCount(), 0u);
+  EXPECT_EQ(histogram.GetPercentile(50.0), 0u);
+}
+
+TEST(LogLinearHistogram, SmallValuesAreExact) {
+  LogLinearHistogram histogram;
+  histogram.Record(3);
+  histogram.Record(5);
+  histogram.Record(7);
+  EXPECT_EQ(histogram.GetPercentile(50.0), 5u);
+  EXPECT_EQ(histogram.GetMeanOfLargest(0.01), 7.0);
+}
+
+TEST(FrameTimeSeries, Summary) {
+  FrameTimeSeries series;
+  EXPECT_EQ(series.GetSummary().frame_count, 0u);
+
+  // Alternating frame times, evenly spaced on average, but badly paced.
+  for (int i = 0; i != 100; ++i) {
+    series.Record(milliseconds(i % 2 == 0 ? 10 : 20));
+  }
+  const FrameTimeSummary summary = series.GetSummary();
+  EXPECT_EQ(summary.frame_count, 100u);
+  EXPECT_EQ(summary.mean, milliseconds(15));
+  EXPECT_EQ(summary.min, milliseconds(10));
+  EXPECT_EQ(summary.max, milliseconds(20));
+  EXPECT_NEAR(summary.p50.count(), nanoseconds(milliseconds(10)).count(),
+              nanoseconds(milliseconds(10)).count() / 32);
+  EXPECT_NEAR(summary.p99.count(), nanoseconds(milliseconds(20)).count(),
+              nanoseconds(milliseconds(20)).count() / 32);
+  EXPECT_NEAR(summary.one_percent_low.count(),
+              nanoseconds(milliseconds(20)).count(),
+              nanoseconds(milliseconds(20)).count() / 32);
+  EXPECT_EQ(summary.jitter, milliseconds(10));
+}
+
+TEST(FrameTimeStats, SplitsByBenchmarkState) {
+  FrameTimeStats stats;
+  stats.Record(milliseconds(30), false);
+  stats.Record(milliseconds(10), true);
+  stats.Record(milliseconds(12), true);
+  EXPECT_EQ(stats.GetWindow(false).GetFrameCount(), 1u);
+  EXPECT_EQ(stats.GetWindow(true).GetFrameCount(), 2u);
+  // The jitter does not span the start of the benchmark.
+  EXPECT_EQ(stats.GetTotal(true).GetSummary().jitter, milliseconds(2));
+
+  stats.ResetWindows();
+  stats.Record(milliseconds(16), true);
+  EXPECT_EQ(stats.GetWindow(false).GetFrameCount(), 0u);
+  EXPECT_EQ(stats.GetWindow(true).GetFrameCount(), 1u);
+  EXPECT_EQ(stats.GetTotal(false).GetFrameCount(), 1u);
+  EXPECT_EQ(stats.GetTotal(true).GetFrameCount(), 3u);
+  EXPECT_EQ(stats.GetTotal(true).GetSummary().max, milliseconds(16));
+}
+
+}  // namespace
+}  // namespace performancelayers
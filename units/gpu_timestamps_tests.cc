@@ -0,0 +1,84 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gpu_timestamps.h"
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+TEST(TimestampProperties, Mask) {
+  const TimestampProperties full_properties{1.0, 64};
+  EXPECT_EQ(full_properties.Mask(), ~uint64_t(0));
+  const TimestampProperties properties_36{1.0, 36};
+  EXPECT_EQ(properties_36.Mask(), (uint64_t(1) << 36) - 1);
+  const TimestampProperties properties_1{1.0, 1};
+  EXPECT_EQ(properties_1.Mask(), 1u);
+}
+
+TEST(TimestampProperties, TicksBetween) {
+  const TimestampProperties properties{1.0, 32};
+  EXPECT_EQ(properties.TicksBetween(10, 25), 15u);
+  // Bits above |valid_bits| are ignored.
+  EXPECT_EQ(properties.TicksBetween(0xabc00000010, 0x12300000025), 0x15u);
+  // The timestamps wrap around between begin and end.
+  EXPECT_EQ(properties.TicksBetween(0xfffffff0, 0x10), 0x20u);
+
+  const TimestampProperties full_properties{1.0, 64};
+  EXPECT_EQ(full_properties.TicksBetween(~uint64_t(0), 4), 5u);
+}
+
+TEST(TimestampProperties, ToNanoseconds) {
+  const TimestampProperties nanosecond_properties{1.0, 64};
+  EXPECT_EQ(nanosecond_properties.ToNanoseconds(1234), 1234u);
+  const TimestampProperties slow_properties{52.08, 64};
+  EXPECT_EQ(slow_properties.ToNanoseconds(100), 5208u);
+  // Rounds to the nearest nanosecond.
+  const TimestampProperties fast_properties{0.5, 64};
+  EXPECT_EQ(fast_properties.ToNanoseconds(3), 2u);
+}
+
+TEST(TimestampCalibration, Uncalibrated) {
+  TimestampCalibration calibration(TimestampProperties{2.0, 48});
+  EXPECT_FALSE(calibration.IsCalibrated());
+  EXPECT_EQ(calibration.GetProperties().period, 2.0);
+  EXPECT_EQ(calibration.GetProperties().valid_bits, 48u);
+}
+
+TEST(TimestampCalibration, ToHostNanos) {
+  TimestampCalibration calibration(TimestampProperties{2.0, 64});
+  calibration.Calibrate(1000, 5'000'000);
+  ASSERT_TRUE(calibration.IsCalibrated());
+  EXPECT_EQ(calibration.ToHostNanos(1000), 5'000'000);
+  EXPECT_EQ(calibration.ToHostNanos(1500), 5'001'000);
+  EXPECT_EQ(calibration.ToHostNanos(400), 4'998'800);
+
+  // A later calibration replaces the earlier one.
+  calibration.Calibrate(2000, 7'000'000);
+  EXPECT_EQ(calibration.ToHostNanos(2010), 7'000'020);
+}
+
+TEST(TimestampCalibration, ToHostNanosWrapsAround) {
+  TimestampCalibration calibration(TimestampProperties{1.0, 32});
+  calibration.Calibrate(0xfffffff0, 1'000'000);
+  EXPECT_EQ(calibration.ToHostNanos(0x10), 1'000'032);
+  EXPECT_EQ(calibration.ToHostNanos(0xffffffe0), 999'984);
+
+  calibration.Calibrate(0x10, 1'000'000);
+  EXPECT_EQ(calibration.ToHostNanos(0xfffffff0), 999'968);
+}
+
+}  // namespace
+}  // namespace performancelayers
@@ -0,0 +1,117 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hitch_detector.h"
+
+#include <chrono>
+#include <optional>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+using std::chrono::milliseconds;
+
+TEST(HitchDetector, Disabled) {
+  HitchDetector detector({});
+  EXPECT_FALSE(detector.IsEnabled());
+  EXPECT_FALSE(detector.EndFrame(milliseconds(1000)).has_value());
+}
+
+TEST(HitchDetector, Threshold) {
+  HitchDetectorConfig config;
+  config.threshold = milliseconds(50);
+  HitchDetector detector(config);
+  ASSERT_TRUE(detector.IsEnabled());
+
+  detector.RecordPipelineCreation({"0x1", 7, milliseconds(3)});
+  EXPECT_FALSE(detector.EndFrame(milliseconds(50)).has_value());
+
+  // The activity of the previous frame is not attributed to this one.
+  detector.RecordShaderModuleCreation({"0x2", 8, milliseconds(1)});
+  detector.RecordPipelineCreation({"[0x2]", 8, milliseconds(40)});
+  detector.RecordAllocation(100);
+  detector.RecordAllocation(28);
+  std::optional<Hitch> hitch = detector.EndFrame(milliseconds(51));
+  ASSERT_TRUE(hitch.has_value());
+  EXPECT_EQ(hitch->frame_time, milliseconds(51));
+  EXPECT_EQ(hitch->limit, milliseconds(50));
+  const FrameActivity& activity = hitch->activity;
+  ASSERT_EQ(activity.pipelines.size(), 1u);
+  EXPECT_EQ(activity.pipelines[0].hash, "[0x2]");
+  EXPECT_EQ(activity.pipelines[0].thread_id, 8u);
+  EXPECT_EQ(activity.pipelines[0].duration, milliseconds(40));
+  ASSERT_EQ(activity.shader_modules.size(), 1u);
+  EXPECT_EQ(activity.shader_modules[0].hash, "0x2");
+  EXPECT_EQ(activity.allocation_count, 2u);
+  EXPECT_EQ(activity.allocation_size, 128u);
+  EXPECT_EQ(activity.dropped_records, 0u);
+
+  hitch = detector.EndFrame(milliseconds(60));
+  ASSERT_TRUE(hitch.has_value());
+  EXPECT_TRUE(hitch->activity.pipelines.empty());
+  EXPECT_EQ(hitch->activity.allocation_count, 0u);
+}
+
+TEST(HitchDetector, Percentile) {
+  HitchDetectorConfig config;
+  config.percentile = 90.0;
+  HitchDetector detector(config);
+
+  // Not enough frames to compute the percentile yet.
+  for (size_t i = 0; i != HitchDetector::kMinWindowSize; ++i) {
+    EXPECT_FALSE(detector.EndFrame(milliseconds(i == 0 ? 100 : 16)));
+  }
+  EXPECT_FALSE(detector.EndFrame(milliseconds(16)).has_value());
+  std::optional<Hitch> hitch = detector.EndFrame(milliseconds(17));
+  ASSERT_TRUE(hitch.has_value());
+  EXPECT_EQ(hitch->limit, milliseconds(16));
+
+  // Once the window is full, the oldest frames are forgotten.
+  for (size_t i = 0; i != HitchDetector::kWindowSize; ++i) {
+    detector.EndFrame(milliseconds(33));
+  }
+  EXPECT_FALSE(detector.EndFrame(milliseconds(33)).has_value());
+  EXPECT_TRUE(detector.EndFrame(milliseconds(34)).has_value());
+}
+
+TEST(HitchDetector, ThresholdAndPercentile) {
+  HitchDetectorConfig config;
+  config.threshold = milliseconds(20);
+  config.percentile = 50.0;
+  HitchDetector detector(config);
+  for (size_t i = 0; i != HitchDetector::kMinWindowSize; ++i) {
+    detector.EndFrame(milliseconds(10));
+  }
+  std::optional<Hitch> hitch = detector.EndFrame(milliseconds(15));
+  ASSERT_TRUE(hitch.has_value());
+  EXPECT_EQ(hitch->limit, milliseconds(10));
+}
+
+TEST(HitchDetector, BoundsRecords) {
+  HitchDetectorConfig config;
+  config.threshold = milliseconds(1);
+  HitchDetector detector(config);
+  for (size_t i = 0; i != HitchDetector::kMaxRecordsPerFrame + 3; ++i) {
+    detector.RecordPipelineCreation({"0x1", 1, milliseconds(1)});
+  }
+  std::optional<Hitch> hitch = detector.EndFrame(milliseconds(2));
+  ASSERT_TRUE(hitch.has_value());
+  EXPECT_EQ(hitch->activity.pipelines.size(),
+            HitchDetector::kMaxRecordsPerFrame);
+  EXPECT_EQ(hitch->activity.dropped_records, 3u);
+}
+
+}  // namespace
+}  // namespace performancelayers
@@ -137,6 +137,31 @@ TEST(InputBuffer, MemMapNonEmptyFile) {
   for (size_t i = 0; i != data_size; ++i)
     EXPECT_EQ(buffer_or_err->GetBuffer()[i], write_data[i]);
 }
+
+TEST(InputBuffer, MemMapPrefetch) {
+  TmpFile tmp("cache.bin");
+  constexpr size_t data_size = 3 * 4096 + 7;
+  std::vector<uint8_t> write_data(data_size);
+  std::iota(write_data.begin(), write_data.end(), uint8_t(0));
+  tmp.AppendData(write_data);
+
+  auto buffer_or_err = InputBuffer::Create(
+      tmp.path.c_str(), InputBuffer::ImplementationKind::kMemMapped);
+  ASSERT_TRUE(buffer_or_err.ok());
+  buffer_or_err->Prefetch();
+  ASSERT_EQ(buffer_or_err->GetBufferSize(), data_size);
+  for (size_t i = 0; i != data_size; ++i)
+    EXPECT_EQ(buffer_or_err->GetBuffer()[i], write_data[i]);
+}
+
+TEST(InputBuffer, MemMapPrefetchEmptyFile) {
+  TmpFile tmp("cache.bin");
+  auto buffer_or_err = InputBuffer::Create(
+      tmp.path.c_str(), InputBuffer::ImplementationKind::kMemMapped);
+  ASSERT_TRUE(buffer_or_err.ok());
+  buffer_or_err->Prefetch();
+  EXPECT_EQ(buffer_or_err->GetBufferSize(), 0);
+}
 #endif  // defined(__unix__)
 
 TEST(InputBuffer, DefaultImplNonEmptyFile) {
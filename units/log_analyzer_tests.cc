@@ -0,0 +1,236 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "log_analyzer.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "binary_logging.h"
+#include "event_logging.h"
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+namespace fs = std::filesystem;
+
+constexpr char kFrameTimeLog[] =
+    "Frame Time (ns),Benchmark State\n"
+    "10000000,0\n"
+    "20000000,1\n"
+    "30000000,1\n"
+    "40000000,1\n";
+
+class FramePresentEvent : public Event {
+ public:
+  FramePresentEvent(DurationClock::duration frame_time, bool started)
+      : Event("frame_present", LogLevel::kHigh),
+        frame_time_("frame_time", frame_time),
+        started_("started", started) {
+    InitAttributes({&frame_time_, &started_});
+  }
+
+ private:
+  DurationAttr frame_time_;
+  BoolAttr started_;
+};
+
+class PipelineEvent : public Event {
+ public:
+  PipelineEvent(const char* name, DurationClock::duration duration)
+      : Event(name, LogLevel::kHigh),
+        hashes_("hashes", {1, 2}),
+        duration_("duration", duration) {
+    InitAttributes({&hashes_, &duration_});
+  }
+
+ private:
+  VectorInt64Attr hashes_;
+  DurationAttr duration_;
+};
+
+fs::path WriteFile(const std::string& filename, const std::string& contents) {
+  const fs::path path = fs::temp_directory_path() / filename;
+  std::ofstream file(path, std::ios::binary);
+  file << contents;
+  return path;
+}
+
+TEST(LogAnalyzer, SummarizesFrameTimeLog) {
+  absl::StatusOr<LogSummary> summary = AnalyzeLog(kFrameTimeLog, {});
+  ASSERT_TRUE(summary.ok()) << summary.status();
+  EXPECT_EQ(summary->frame_count, 4u);
+  EXPECT_EQ(summary->total_duration_ns, 100'000'000);
+  EXPECT_DOUBLE_EQ(summary->average_frame_time_ns, 25'000'000);
+  ASSERT_EQ(summary->percentile_frame_time_ns.size(), 100u);
+  EXPECT_DOUBLE_EQ(summary->percentile_frame_time_ns[0], 10'000'000);
+  EXPECT_DOUBLE_EQ(summary->percentile_frame_time_ns[50], 25'000'000);
+  EXPECT_DOUBLE_EQ(summary->percentile_frame_time_ns[90], 37'000'000);
+  // The frames longer than 1/45 s.
+  EXPECT_DOUBLE_EQ(summary->missed_frames_percent, 50);
+  EXPECT_EQ(summary->state_duration_ns,
+            (std::map<int64_t, int64_t>{{0, 10'000'000}, {1, 90'000'000}}));
+  ASSERT_EQ(summary->fps_over_time.size(), 1u);
+  EXPECT_EQ(summary->fps_over_time[0].frames, 4u);
+  EXPECT_EQ(summary->fps_over_time[0].state, 1);
+}
+
+TEST(LogAnalyzer, SelectsFramesInGameplayState) {
+  LogAnalysisOptions options;
+  options.gameplay_state = 1;
+  absl::StatusOr<LogSummary> summary = AnalyzeLog(kFrameTimeLog, options);
+  ASSERT_TRUE(summary.ok()) << summary.status();
+  EXPECT_EQ(summary->frame_count, 3u);
+  EXPECT_EQ(summary->total_duration_ns, 90'000'000);
+  // The state durations include all the frames.
+  EXPECT_EQ(summary->state_duration_ns.at(0), 10'000'000);
+}
+
+TEST(LogAnalyzer, DropsFrontAndLimitsDuration) {
+  std::string log = "Frame Time (ns),Benchmark State\n";
+  for (int i = 0; i != 5; ++i) {
+    log += "600000000,1\n";
+  }
+  LogAnalysisOptions options;
+  options.drop_front_s = 1;
+  options.duration_s = 1;
+  absl::StatusOr<LogSummary> summary = AnalyzeLog(log, options);
+  ASSERT_TRUE(summary.ok()) << summary.status();
+  // The first frame ends before the dropped second, and the second frame
+  // after the selected frames is the first one past the duration.
+  EXPECT_EQ(summary->frame_count, 2u);
+  EXPECT_EQ(summary->total_duration_ns, 1'200'000'000);
+  ASSERT_EQ(summary->fps_over_time.size(), 2u);
+  EXPECT_EQ(summary->fps_over_time[0].frames, 1u);
+  EXPECT_EQ(summary->fps_over_time[1].frames, 1u);
+}
+
+TEST(LogAnalyzer, SummarizesEventLog) {
+  constexpr char kEventLog[] =
+      "frame_time_layer_init,1000\n"
+      "create_graphics_pipelines,2000,\"[0x1,0x2]\",3000000,7\n"
+      "frame_present,3000,16000000,0\n"
+      "create_compute_pipelines,4000,\"[0x3]\",1000000,7\n"
+      "frame_present,5000,18000000,1\n";
+  absl::StatusOr<LogSummary> summary = AnalyzeLog(kEventLog, {});
+  ASSERT_TRUE(summary.ok()) << summary.status();
+  EXPECT_EQ(summary->frame_count, 2u);
+  EXPECT_EQ(summary->total_duration_ns, 34'000'000);
+  EXPECT_EQ(summary->pipeline_compiles.calls, 2u);
+  EXPECT_EQ(summary->pipeline_compiles.total_ns, 4'000'000);
+  EXPECT_EQ(summary->pipeline_compiles.max_ns, 3'000'000);
+}
+
+TEST(LogAnalyzer, SummarizesCompileTimeLog) {
+  constexpr char kCompileTimeLog[] =
+      "Pipeline,Compile Time (ns),Start Timestamp (ns),Thread\n"
+      "\"[0x1,0x2]\",5000,100,1\n"
+      "\"[0x3]\",7000,200,2\n";
+  absl::StatusOr<LogSummary> summary = AnalyzeLog(kCompileTimeLog, {});
+  ASSERT_TRUE(summary.ok()) << summary.status();
+  EXPECT_EQ(summary->frame_count, 0u);
+  EXPECT_TRUE(summary->percentile_frame_time_ns.empty());
+  EXPECT_EQ(summary->pipeline_compiles.calls, 2u);
+  EXPECT_EQ(summary->pipeline_compiles.total_ns, 12000);
+  EXPECT_EQ(summary->pipeline_compiles.max_ns, 7000);
+}
+
+TEST(LogAnalyzer, IgnoresTruncatedLastLine) {
+  absl::StatusOr<LogSummary> summary =
+      AnalyzeLog("Frame Time (ns),Benchmark State\n10,0\n2", {});
+  ASSERT_TRUE(summary.ok()) << summary.status();
+  EXPECT_EQ(summary->frame_count, 1u);
+
+  EXPECT_FALSE(
+      AnalyzeLog("Frame Time (ns),Benchmark State\nx,0\n20,0\n", {}).ok());
+}
+
+TEST(LogAnalyzer, SummarizesBinaryLog) {
+  const fs::path path = fs::temp_directory_path() / "log_analyzer_test.bin";
+  {
+    BinaryLogger logger("Frame Time (ns),Benchmark State", path.c_str());
+    logger.StartLog();
+    FramePresentEvent first(std::chrono::milliseconds(10), false);
+    FramePresentEvent second(std::chrono::milliseconds(30), true);
+    PipelineEvent pipeline("create_graphics_pipelines",
+                           std::chrono::milliseconds(2));
+    logger.AddEvent(&first);
+    logger.AddEvent(&pipeline);
+    logger.AddEvent(&second);
+    logger.EndLog();
+  }
+
+  absl::StatusOr<LogSummary> summary = AnalyzeLogFile(path.string(), {});
+  ASSERT_TRUE(summary.ok()) << summary.status();
+  EXPECT_EQ(summary->frame_count, 2u);
+  EXPECT_EQ(summary->total_duration_ns, 40'000'000);
+  EXPECT_EQ(summary->state_duration_ns,
+            (std::map<int64_t, int64_t>{{0, 10'000'000}, {1, 30'000'000}}));
+  EXPECT_EQ(summary->pipeline_compiles.calls, 1u);
+  EXPECT_EQ(summary->pipeline_compiles.total_ns, 2'000'000);
+  fs::remove(path);
+}
+
+TEST(LogAnalyzer, AnalyzesFilesInParallel) {
+  std::vector<std::string> paths;
+  for (int i = 0; i != 8; ++i) {
+    std::string log = "Frame Time (ns),Benchmark State\n";
+    for (int frame = 0; frame <= i; ++frame) {
+      log += "1000,1\n";
+    }
+    paths.push_back(
+        WriteFile("log_analyzer_test_" + std::to_string(i) + ".log", log)
+            .string());
+  }
+  paths.push_back((fs::temp_directory_path() / "log_analyzer_missing.log")
+                      .string());
+
+  const std::vector<absl::StatusOr<LogSummary>> summaries =
+      AnalyzeLogFiles(paths, {}, 4);
+  ASSERT_EQ(summaries.size(), paths.size());
+  for (size_t i = 0; i != 8; ++i) {
+    ASSERT_TRUE(summaries[i].ok()) << summaries[i].status();
+    EXPECT_EQ(summaries[i]->frame_count, i + 1);
+    fs::remove(paths[i]);
+  }
+  EXPECT_FALSE(summaries.back().ok());
+}
+
+TEST(LogAnalyzer, FormatsSummaries) {
+  absl::StatusOr<LogSummary> summary = AnalyzeLog(
+      "Frame Time (ns),Benchmark State\n1000000,0\n3000000,1\n", {});
+  ASSERT_TRUE(summary.ok()) << summary.status();
+
+  std::string json;
+  AppendLogSummaryJson("base\"line", "a.log", *summary, &json);
+  const std::string prefix =
+      "{\"dataset\":\"base\\\"line\",\"path\":\"a.log\",\"frames\":2,"
+      "\"duration_ms\":4.000000,";
+  EXPECT_EQ(json.substr(0, prefix.size()), prefix);
+  EXPECT_NE(json.find("\"state_duration_ms\":{\"0\":1.000000,\"1\":3.000000}"),
+            std::string::npos);
+  EXPECT_NE(json.find("\"fps_over_time\":[[2,1]]"), std::string::npos);
+  EXPECT_EQ(json.back(), '}');
+
+  std::string csv;
+  AppendLogSummaryCsv("baseline", "a.log", *summary, &csv);
+  EXPECT_EQ(csv,
+            "\"baseline\",\"a.log\",2,4.000000,2.000000,2.000000,2.800000,"
+            "2.900000,2.980000,0.000000,0,0.000000,0.000000");
+}
+
+}  // namespace
+}  // namespace performancelayers
@@ -1,7 +1,10 @@
 #include <cstdio>
 #include <filesystem>
+#include <string>
 #include <utility>
 
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "gtest/gtest.h"
 #include "log_scanner.h"
 
@@ -178,4 +181,123 @@ TEST(LogScanner, NoNewline) {
   fs::remove(path);
 }
 
+TEST(LogScanner, LineWrittenInParts) {
+  FILE* file;
+  fs::path path;
+  std::tie(file, path) = make_tmp_file("line_written_in_parts.log");
+  ASSERT_TRUE(file != nullptr);
+
+  auto scanner = LogScanner::FromFilename(path);
+  EXPECT_TRUE(scanner.has_value());
+
+  const char* pattern = "Benchmark start";
+  scanner->RegisterWatchedPattern(pattern);
+
+  fprintf(file, "loading\nBench");
+  fflush(file);
+  EXPECT_FALSE(scanner->ConsumeNewLines());
+
+  fprintf(file, "mark start\n");
+  fflush(file);
+  EXPECT_TRUE(scanner->ConsumeNewLines());
+  EXPECT_EQ(scanner->GetFirstOccurrenceLineNum(pattern), 2u);
+
+  fclose(file);
+  fs::remove(path);
+}
+
+TEST(LogScanner, PatternsDoNotSpanLines) {
+  FILE* file;
+  fs::path path;
+  std::tie(file, path) = make_tmp_file("patterns_do_not_span_lines.log");
+  ASSERT_TRUE(file != nullptr);
+
+  auto scanner = LogScanner::FromFilename(path);
+  EXPECT_TRUE(scanner.has_value());
+  scanner->RegisterWatchedPattern("ab");
+
+  fprintf(file, "a\nb\n");
+  fflush(file);
+  EXPECT_FALSE(scanner->ConsumeNewLines());
+  EXPECT_EQ(scanner->GetSeenPatternCount(), 0u);
+
+  fclose(file);
+  fs::remove(path);
+}
+
+TEST(LogScanner, ManyPatternsOneLine) {
+  FILE* file;
+  fs::path path;
+  std::tie(file, path) = make_tmp_file("many_patterns_one_line.log");
+  ASSERT_TRUE(file != nullptr);
+
+  auto scanner = LogScanner::FromFilename(path);
+  EXPECT_TRUE(scanner.has_value());
+  for (int i = 0; i != 100; ++i)
+    scanner->RegisterWatchedPattern("stage " + std::to_string(i) + ";");
+  EXPECT_EQ(scanner->GetPatternCount(), 100u);
+
+  fprintf(file, "filler\nstage 7; stage 42; stage 420;\n");
+  fflush(file);
+  EXPECT_TRUE(scanner->ConsumeNewLines());
+  EXPECT_EQ(scanner->GetSeenPatternCount(), 2u);
+  EXPECT_EQ(scanner->GetFirstOccurrenceLineNum("stage 7;"), 2u);
+  EXPECT_EQ(scanner->GetFirstOccurrenceLineNum("stage 42;"), 2u);
+  EXPECT_EQ(scanner->GetFirstOccurrenceLineNum("stage 4;"), 0u);
+
+  fclose(file);
+  fs::remove(path);
+}
+
+TEST(LogWatcher, SeesPatternsInBackground) {
+  FILE* file;
+  fs::path path;
+  std::tie(file, path) = make_tmp_file("log_watcher.log");
+  ASSERT_TRUE(file != nullptr);
+
+  auto scanner = LogScanner::FromFilename(path);
+  ASSERT_TRUE(scanner.has_value());
+  scanner->RegisterWatchedPattern("start");
+  scanner->RegisterWatchedPattern("end");
+  LogWatcher watcher(*std::move(scanner), absl::Milliseconds(1));
+  EXPECT_EQ(watcher.GetSeenPatternCount(), 0u);
+
+  fprintf(file, "benchmark start\n");
+  fflush(file);
+  while (watcher.GetSeenPatternCount() != 1)
+    absl::SleepFor(absl::Milliseconds(1));
+  auto seen_patterns = watcher.GetSeenPatterns();
+  ASSERT_EQ(seen_patterns.size(), 1u);
+  EXPECT_EQ(seen_patterns[0], LogScanner::PatternLineNumPair("start", 1));
+
+  fprintf(file, "benchmark end\n");
+  fflush(file);
+  while (watcher.GetSeenPatternCount() != 2)
+    absl::SleepFor(absl::Milliseconds(1));
+  seen_patterns = watcher.GetSeenPatterns();
+  ASSERT_EQ(seen_patterns.size(), 2u);
+  EXPECT_EQ(seen_patterns[1], LogScanner::PatternLineNumPair("end", 2));
+
+  fclose(file);
+  fs::remove(path);
+}
+
+TEST(LogWatcher, StopsWithPatternsUnseen) {
+  FILE* file;
+  fs::path path;
+  std::tie(file, path) = make_tmp_file("log_watcher_unseen.log");
+  ASSERT_TRUE(file != nullptr);
+
+  auto scanner = LogScanner::FromFilename(path);
+  ASSERT_TRUE(scanner.has_value());
+  scanner->RegisterWatchedPattern("never");
+  {
+    LogWatcher watcher(*std::move(scanner), absl::Hours(1));
+    EXPECT_EQ(watcher.GetSeenPatternCount(), 0u);
+  }
+
+  fclose(file);
+  fs::remove(path);
+}
+
 }  // namespace
@@ -0,0 +1,196 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "memory_usage_tracker.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+// Returns a fake handle of type `Handle` with the value `value`.
+template <typename Handle>
+Handle MakeHandle(uint64_t value) {
+  static_assert(sizeof(Handle) == sizeof(uint64_t), "Requires 64-bit handles");
+  return reinterpret_cast<Handle>(value);
+}
+
+TEST(MemoryUsageTracker, AllocateAndFree) {
+  MemoryUsageTracker tracker;
+  const VkDevice device = MakeHandle<VkDevice>(1);
+  tracker.AddDevice(device);
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(1), 100, 0);
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(2), 50, 0);
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 150u);
+  EXPECT_EQ(tracker.GetDeviceAllocationSize(device), 150u);
+
+  tracker.RecordFreeMemory(device, MakeHandle<VkDeviceMemory>(1));
+  tracker.RecordFreeMemory(device, VK_NULL_HANDLE);
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 50u);
+  EXPECT_EQ(tracker.GetPeakAllocationSize(), 150u);
+
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(1), 200, 0);
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 250u);
+  EXPECT_EQ(tracker.GetPeakAllocationSize(), 250u);
+}
+
+TEST(MemoryUsageTracker, DestroyDeviceReleasesOnlyItsAllocations) {
+  MemoryUsageTracker tracker;
+  const VkDevice first = MakeHandle<VkDevice>(1);
+  const VkDevice second = MakeHandle<VkDevice>(2);
+  // The same memory handle value on two devices are different allocations.
+  tracker.RecordAllocateMemory(first, MakeHandle<VkDeviceMemory>(1), 10, 0);
+  tracker.RecordAllocateMemory(first, MakeHandle<VkDeviceMemory>(2), 20, 0);
+  tracker.RecordAllocateMemory(second, MakeHandle<VkDeviceMemory>(1), 40, 0);
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 70u);
+
+  tracker.RecordDestroyDevice(first);
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 40u);
+  EXPECT_EQ(tracker.GetDeviceAllocationSize(first), 0u);
+  EXPECT_EQ(tracker.GetDeviceAllocationSize(second), 40u);
+  EXPECT_EQ(tracker.GetPeakAllocationSize(), 70u);
+
+  // A new device may reuse the handle of a destroyed one.
+  tracker.RecordAllocateMemory(first, MakeHandle<VkDeviceMemory>(1), 5, 0);
+  EXPECT_EQ(tracker.GetDeviceAllocationSize(first), 5u);
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 45u);
+
+  tracker.RecordDestroyDevice(MakeHandle<VkDevice>(3));
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 45u);
+}
+
+TEST(MemoryUsageTracker, ConcurrentAllocations) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumAllocations = 10000;
+  MemoryUsageTracker tracker;
+  const VkDevice device = MakeHandle<VkDevice>(1);
+  tracker.AddDevice(device);
+
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread != kNumThreads; ++thread) {
+    threads.emplace_back([&tracker, device, thread] {
+      for (int i = 0; i != kNumAllocations; ++i) {
+        const auto memory = MakeHandle<VkDeviceMemory>(
+            1 + uint64_t(thread) * kNumAllocations + i);
+        tracker.RecordAllocateMemory(device, memory, 2, 0);
+        if (i % 2 == 0) tracker.RecordFreeMemory(device, memory);
+      }
+    });
+  }
+  for (std::thread &thread : threads) thread.join();
+
+  const uint64_t expected = uint64_t(kNumThreads) * kNumAllocations;
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), expected);
+  EXPECT_EQ(tracker.GetDeviceAllocationSize(device), expected);
+  EXPECT_GE(tracker.GetPeakAllocationSize(), expected);
+  EXPECT_LE(tracker.GetPeakAllocationSize(), expected + 2 * kNumThreads);
+
+  tracker.RecordDestroyDevice(device);
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 0u);
+}
+
+TEST(MemoryUsageTracker, HeapsAndMemoryTypes) {
+  // Memory types 0 and 2 are in the device local heap 0, and type 1 in heap 1.
+  VkPhysicalDeviceMemoryProperties properties = {};
+  properties.memoryTypeCount = 3;
+  properties.memoryTypes[0].heapIndex = 0;
+  properties.memoryTypes[1].heapIndex = 1;
+  properties.memoryTypes[2].heapIndex = 0;
+  properties.memoryHeapCount = 2;
+  properties.memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+
+  MemoryUsageTracker tracker;
+  const VkDevice device = MakeHandle<VkDevice>(1);
+  tracker.AddDevice(device, properties);
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(1), 100, 0);
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(2), 20, 1);
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(3), 30, 2);
+  tracker.RecordFreeMemory(device, MakeHandle<VkDeviceMemory>(1));
+
+  DeviceMemoryUsage usage = tracker.GetDeviceMemoryUsage(device);
+  ASSERT_EQ(usage.GetHeaps().size(), 2u);
+  const VkMemoryHeapFlags device_local = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+  EXPECT_EQ(usage.heaps[0].flags, device_local);
+  EXPECT_EQ(usage.heaps[0].current, 30u);
+  EXPECT_EQ(usage.heaps[0].peak, 130u);
+  EXPECT_EQ(usage.heaps[1].current, 20u);
+  EXPECT_EQ(usage.heaps[1].peak, 20u);
+  const std::vector<uint64_t> expected_types = {0, 20, 30};
+  EXPECT_EQ(std::vector<uint64_t>(usage.GetMemoryTypeCurrent().begin(),
+                                  usage.GetMemoryTypeCurrent().end()),
+            expected_types);
+}
+
+TEST(MemoryUsageTracker, UnknownMemoryProperties) {
+  MemoryUsageTracker tracker;
+  const VkDevice device = MakeHandle<VkDevice>(1);
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(1), 8, 3);
+  // Out of range memory types are only counted in the totals.
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(2), 8, 100);
+
+  DeviceMemoryUsage usage = tracker.GetDeviceMemoryUsage(device);
+  EXPECT_TRUE(usage.GetHeaps().empty());
+  const std::vector<uint64_t> expected_types = {0, 0, 0, 8};
+  EXPECT_EQ(std::vector<uint64_t>(usage.GetMemoryTypeCurrent().begin(),
+                                  usage.GetMemoryTypeCurrent().end()),
+            expected_types);
+  EXPECT_EQ(tracker.GetCurrentAllocationSize(), 16u);
+
+  const DeviceMemoryUsage untracked =
+      tracker.GetDeviceMemoryUsage(MakeHandle<VkDevice>(2));
+  EXPECT_TRUE(untracked.GetHeaps().empty());
+  EXPECT_TRUE(untracked.GetMemoryTypeCurrent().empty());
+  for (uint64_t count : untracked.size_histogram) EXPECT_EQ(count, 0u);
+}
+
+TEST(MemoryUsageTracker, SizeHistogram) {
+  MemoryUsageTracker tracker;
+  const VkDevice device = MakeHandle<VkDevice>(1);
+  uint64_t handle = 1;
+  for (VkDeviceSize size : {0, 1, 4096, 8191, 8192, 1 << 20}) {
+    tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(handle++),
+                                 size, 0);
+  }
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(handle++),
+                               uint64_t(1) << 60, 0);
+
+  DeviceMemoryUsage usage = tracker.GetDeviceMemoryUsage(device);
+  EXPECT_EQ(usage.size_histogram[0], 2u);
+  EXPECT_EQ(usage.size_histogram[12], 2u);
+  EXPECT_EQ(usage.size_histogram[13], 1u);
+  EXPECT_EQ(usage.size_histogram[20], 1u);
+  EXPECT_EQ(usage.size_histogram.back(), 1u);
+}
+
+TEST(MemoryUsageTracker, TakeChurn) {
+  MemoryUsageTracker tracker;
+  const VkDevice device = MakeHandle<VkDevice>(1);
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(1), 8, 0);
+  tracker.RecordAllocateMemory(device, MakeHandle<VkDeviceMemory>(2), 8, 0);
+  tracker.RecordFreeMemory(device, MakeHandle<VkDeviceMemory>(1));
+
+  MemoryChurn churn = tracker.TakeChurn();
+  EXPECT_EQ(churn.allocations, 2u);
+  EXPECT_EQ(churn.frees, 1u);
+  churn = tracker.TakeChurn();
+  EXPECT_EQ(churn.allocations, 0u);
+  EXPECT_EQ(churn.frees, 0u);
+}
+
+}  // namespace
+}  // namespace performancelayers
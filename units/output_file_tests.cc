@@ -0,0 +1,71 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "output_file.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+namespace fs = std::filesystem;
+
+std::string ReadFile(const fs::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+TEST(WriteFileAtomically, CreatesAndReplacesFile) {
+  const fs::path dir = fs::temp_directory_path() / "output_file_test";
+  fs::remove_all(dir);
+  fs::create_directory(dir);
+  const fs::path path = dir / "cache.bin";
+
+  const std::vector<uint8_t> first = {'a', 'b', 'c'};
+  ASSERT_TRUE(WriteFileAtomically(path.string(), first).ok());
+  EXPECT_EQ(ReadFile(path), "abc");
+
+  const std::vector<uint8_t> second = {'d', 'e'};
+  ASSERT_TRUE(WriteFileAtomically(path.string(), second).ok());
+  EXPECT_EQ(ReadFile(path), "de");
+
+  ASSERT_TRUE(WriteFileAtomically(path.string(), {}).ok());
+  EXPECT_EQ(ReadFile(path), "");
+
+  // No temporary files are left behind.
+  int num_files = 0;
+  for ([[maybe_unused]] const auto& entry : fs::directory_iterator(dir)) {
+    ++num_files;
+  }
+  EXPECT_EQ(num_files, 1);
+  fs::remove_all(dir);
+}
+
+TEST(WriteFileAtomically, MissingDirectory) {
+  const std::vector<uint8_t> data = {'a'};
+  absl::Status status =
+      WriteFileAtomically("/definitely/nothing/here/cache.bin", data);
+  EXPECT_EQ(status.code(), absl::StatusCode::kUnavailable);
+}
+
+}  // namespace
+}  // namespace performancelayers
@@ -0,0 +1,95 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pattern_matcher.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+using Match = std::pair<uint32_t, size_t>;
+
+std::vector<Match> FindAll(const PatternMatcher& matcher,
+                           std::string_view text) {
+  std::vector<Match> matches;
+  matcher.FindAll(text, [&matches](uint32_t pattern_index, size_t end) {
+    matches.emplace_back(pattern_index, end);
+  });
+  return matches;
+}
+
+TEST(PatternMatcher, NoPatterns) {
+  PatternMatcher matcher;
+  EXPECT_TRUE(FindAll(matcher, "anything").empty());
+}
+
+TEST(PatternMatcher, SinglePattern) {
+  const std::vector<std::string> patterns = {"abab"};
+  PatternMatcher matcher(patterns);
+  EXPECT_TRUE(FindAll(matcher, "aba").empty());
+  // Overlapping occurrences are all found.
+  EXPECT_EQ(FindAll(matcher, "xababab"),
+            (std::vector<Match>{{0, 5}, {0, 7}}));
+}
+
+TEST(PatternMatcher, OverlappingPatterns) {
+  // The classic example: "he", "she", "his", and "hers" in "ushers".
+  const std::vector<std::string> patterns = {"he", "she", "his", "hers"};
+  PatternMatcher matcher(patterns);
+  std::vector<Match> matches = FindAll(matcher, "ushers");
+  std::sort(matches.begin(), matches.end());
+  EXPECT_EQ(matches, (std::vector<Match>{{0, 4}, {1, 4}, {3, 6}}));
+}
+
+TEST(PatternMatcher, EmptyAndDuplicatePatterns) {
+  const std::vector<std::string> patterns = {"", "ab", "ab"};
+  PatternMatcher matcher(patterns);
+  std::vector<Match> matches = FindAll(matcher, "ab");
+  std::sort(matches.begin(), matches.end());
+  EXPECT_EQ(matches, (std::vector<Match>{{1, 2}, {2, 2}}));
+}
+
+TEST(PatternMatcher, StreamingAcrossChunks) {
+  const std::vector<std::string> patterns = {"Benchmark start",
+                                             "Loading level"};
+  PatternMatcher matcher(patterns);
+  PatternMatcher::State state = PatternMatcher::kInitialState;
+  std::vector<uint32_t> seen;
+  for (std::string_view chunk : {"... Bench", "mark st", "art ... Loading",
+                                 " level 2"}) {
+    for (char c : chunk) {
+      state = matcher.Next(state, c);
+      for (uint32_t pattern_index : matcher.GetMatches(state)) {
+        seen.push_back(pattern_index);
+      }
+    }
+  }
+  EXPECT_EQ(seen, (std::vector<uint32_t>{0, 1}));
+}
+
+TEST(PatternMatcher, BinaryText) {
+  const std::vector<std::string> patterns = {std::string("\xff\x00\x80", 3)};
+  PatternMatcher matcher(patterns);
+  EXPECT_EQ(FindAll(matcher, std::string_view("\x01\xff\x00\x80", 4)),
+            (std::vector<Match>{{0, 4}}));
+}
+
+}  // namespace
+}  // namespace performancelayers
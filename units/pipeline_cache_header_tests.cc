@@ -0,0 +1,107 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline_cache_header.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+VkPhysicalDeviceProperties MakeProperties() {
+  VkPhysicalDeviceProperties properties = {};
+  properties.vendorID = 0x10de;
+  properties.deviceID = 0x2204;
+  properties.driverVersion = 0x1f2a0000;
+  for (uint8_t i = 0; i != VK_UUID_SIZE; ++i) {
+    properties.pipelineCacheUUID[i] = i;
+  }
+  return properties;
+}
+
+std::vector<uint8_t> MakeCache(const VkPhysicalDeviceProperties& properties,
+                               size_t payload_size) {
+  VkPipelineCacheHeaderVersionOne header = {};
+  header.headerSize = sizeof(header);
+  header.headerVersion = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+  header.vendorID = properties.vendorID;
+  header.deviceID = properties.deviceID;
+  memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+         VK_UUID_SIZE);
+  std::vector<uint8_t> cache(sizeof(header) + payload_size, 0xab);
+  memcpy(cache.data(), &header, sizeof(header));
+  return cache;
+}
+
+TEST(PipelineCacheHeader, AcceptsMatchingCache) {
+  const VkPhysicalDeviceProperties properties = MakeProperties();
+  EXPECT_TRUE(
+      ValidatePipelineCacheHeader(MakeCache(properties, 100), properties).ok());
+  EXPECT_TRUE(
+      ValidatePipelineCacheHeader(MakeCache(properties, 0), properties).ok());
+}
+
+TEST(PipelineCacheHeader, RejectsTruncatedCache) {
+  const VkPhysicalDeviceProperties properties = MakeProperties();
+  std::vector<uint8_t> cache = MakeCache(properties, 0);
+  cache.pop_back();
+  EXPECT_EQ(ValidatePipelineCacheHeader(cache, properties).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ValidatePipelineCacheHeader({}, properties).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(PipelineCacheHeader, RejectsUnknownHeader) {
+  const VkPhysicalDeviceProperties properties = MakeProperties();
+  std::vector<uint8_t> cache = MakeCache(properties, 16);
+  const uint32_t version = 2;
+  memcpy(cache.data() + 4, &version, sizeof(version));
+  EXPECT_EQ(ValidatePipelineCacheHeader(cache, properties).code(),
+            absl::StatusCode::kInvalidArgument);
+
+  cache = MakeCache(properties, 16);
+  const uint32_t header_size = static_cast<uint32_t>(cache.size() + 1);
+  memcpy(cache.data(), &header_size, sizeof(header_size));
+  EXPECT_EQ(ValidatePipelineCacheHeader(cache, properties).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(PipelineCacheHeader, RejectsOtherDevice) {
+  const VkPhysicalDeviceProperties properties = MakeProperties();
+  VkPhysicalDeviceProperties other_device = properties;
+  other_device.deviceID = 0x1234;
+  EXPECT_EQ(
+      ValidatePipelineCacheHeader(MakeCache(other_device, 8), properties)
+          .code(),
+      absl::StatusCode::kFailedPrecondition);
+
+  VkPhysicalDeviceProperties other_driver = properties;
+  other_driver.pipelineCacheUUID[3] = 0xff;
+  EXPECT_EQ(
+      ValidatePipelineCacheHeader(MakeCache(other_driver, 8), properties)
+          .code(),
+      absl::StatusCode::kFailedPrecondition);
+}
+
+TEST(PipelineCacheHeader, FileName) {
+  EXPECT_EQ(GetPipelineCacheFileName(MakeProperties()),
+            "10de-2204-1f2a0000-000102030405060708090a0b0c0d0e0f.bin");
+}
+
+}  // namespace
+}  // namespace performancelayers
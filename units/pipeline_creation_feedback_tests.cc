@@ -0,0 +1,88 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline_creation_feedback.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+TEST(PipelineCreationFeedback, ChainsFeedbackIntoCopies) {
+  VkPipelineShaderStageCreateInfo stages[3] = {};
+  VkGraphicsPipelineCreateInfo app_infos[2] = {};
+  VkBaseInStructure app_extension = {};
+  app_extension.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_infos[0].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  app_infos[0].pNext = &app_extension;
+  app_infos[0].stageCount = 2;
+  app_infos[0].pStages = stages;
+  app_infos[1].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  app_infos[1].stageCount = 1;
+  app_infos[1].pStages = stages + 2;
+
+  PipelineCreationFeedbackRequest<VkGraphicsPipelineCreateInfo> request(
+      app_infos, 2);
+  const VkGraphicsPipelineCreateInfo* infos = request.GetCreateInfos();
+  ASSERT_NE(infos, app_infos);
+  // The application's structures are unchanged.
+  EXPECT_EQ(app_infos[0].pNext, &app_extension);
+  EXPECT_EQ(app_infos[1].pNext, nullptr);
+
+  for (uint32_t i = 0; i != 2; ++i) {
+    const auto* feedback =
+        FindInChain<VkPipelineCreationFeedbackCreateInfoEXT>(
+            infos[i].pNext,
+            VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT);
+    ASSERT_NE(feedback, nullptr);
+    EXPECT_EQ(feedback, &request.GetFeedback(i));
+    EXPECT_EQ(feedback->pipelineStageCreationFeedbackCount,
+              app_infos[i].stageCount);
+    ASSERT_NE(feedback->pPipelineCreationFeedback, nullptr);
+    ASSERT_NE(feedback->pPipelineStageCreationFeedbacks, nullptr);
+    EXPECT_EQ(infos[i].stageCount, app_infos[i].stageCount);
+    EXPECT_EQ(infos[i].pStages, app_infos[i].pStages);
+  }
+  // The rest of the application's chain follows the feedback.
+  EXPECT_EQ(request.GetFeedback(0).pNext, &app_extension);
+  EXPECT_EQ(request.GetFeedback(1).pNext, nullptr);
+  // Each pipeline gets its own stage feedbacks.
+  EXPECT_EQ(request.GetFeedback(0).pPipelineStageCreationFeedbacks + 2,
+            request.GetFeedback(1).pPipelineStageCreationFeedbacks);
+}
+
+TEST(PipelineCreationFeedback, KeepsApplicationFeedback) {
+  VkPipelineCreationFeedbackEXT app_pipeline_feedback = {};
+  VkPipelineCreationFeedbackCreateInfoEXT app_feedback = {};
+  app_feedback.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+  app_feedback.pPipelineCreationFeedback = &app_pipeline_feedback;
+  VkComputePipelineCreateInfo app_infos[2] = {};
+  app_infos[0].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  app_infos[1].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  app_infos[1].pNext = &app_feedback;
+
+  PipelineCreationFeedbackRequest<VkComputePipelineCreateInfo> request(
+      app_infos, 2);
+  const VkComputePipelineCreateInfo* infos = request.GetCreateInfos();
+  EXPECT_EQ(request.GetFeedback(0).pipelineStageCreationFeedbackCount, 1u);
+  EXPECT_EQ(infos[0].pNext, &request.GetFeedback(0));
+  EXPECT_EQ(infos[1].pNext, &app_feedback);
+  EXPECT_EQ(&request.GetFeedback(1), &app_feedback);
+}
+
+}  // namespace
+}  // namespace performancelayers
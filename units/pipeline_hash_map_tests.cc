@@ -0,0 +1,83 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline_hash_map.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+// Fake handles, only used as keys.
+const VkPipeline kPipelineA = reinterpret_cast<VkPipeline>(uintptr_t{1});
+const VkPipeline kPipelineB = reinterpret_cast<VkPipeline>(uintptr_t{2});
+const VkPipeline kPipelineC = reinterpret_cast<VkPipeline>(uintptr_t{3});
+
+TEST(PipelineHashMap, ReturnsInsertedHashes) {
+  PipelineHashMap map;
+  map.Insert(kPipelineA, {1, 2});
+  map.Insert(kPipelineB, {3});
+  EXPECT_EQ(map.Get(kPipelineA), PipelineHashVector({1, 2}));
+  EXPECT_EQ(map.Get(kPipelineB), PipelineHashVector({3}));
+  EXPECT_TRUE(map.Get(kPipelineC).empty());
+  EXPECT_EQ(map.GetSize(), 2u);
+}
+
+TEST(PipelineHashMap, SharesIdenticalHashes) {
+  PipelineHashMap map;
+  map.Insert(kPipelineA, {1, 2});
+  map.Insert(kPipelineB, {1, 2});
+  map.Insert(kPipelineC, {1, 2, 3});
+  EXPECT_EQ(map.GetSize(), 3u);
+  EXPECT_EQ(map.GetInternedSize(), 2u);
+
+  map.Erase(kPipelineA);
+  EXPECT_EQ(map.GetInternedSize(), 2u);
+  EXPECT_EQ(map.Get(kPipelineB), PipelineHashVector({1, 2}));
+  map.Erase(kPipelineB);
+  EXPECT_EQ(map.GetInternedSize(), 1u);
+  map.Erase(kPipelineC);
+  EXPECT_EQ(map.GetSize(), 0u);
+  EXPECT_EQ(map.GetInternedSize(), 0u);
+}
+
+TEST(PipelineHashMap, ErasesAfterLastReference) {
+  PipelineHashMap map;
+  map.Insert(kPipelineA, {1});
+  // The handle gets reused before the erasure of the old pipeline.
+  map.Insert(kPipelineA, {2});
+  EXPECT_EQ(map.Get(kPipelineA), PipelineHashVector({2}));
+  EXPECT_EQ(map.GetInternedSize(), 1u);
+
+  map.Erase(kPipelineA);
+  EXPECT_EQ(map.Get(kPipelineA), PipelineHashVector({2}));
+  map.Erase(kPipelineA);
+  EXPECT_TRUE(map.Get(kPipelineA).empty());
+  EXPECT_EQ(map.GetSize(), 0u);
+  EXPECT_EQ(map.GetInternedSize(), 0u);
+}
+
+TEST(PipelineHashMap, IgnoresUnknownPipelines) {
+  PipelineHashMap map;
+  map.Erase(kPipelineA);
+  map.Insert(kPipelineB, {1});
+  map.Erase(kPipelineA);
+  EXPECT_EQ(map.Get(kPipelineB), PipelineHashVector({1}));
+  EXPECT_EQ(map.GetSize(), 1u);
+}
+
+}  // namespace
+}  // namespace performancelayers
@@ -0,0 +1,90 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline_runtime_aggregator.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+// Fake handles, only used as keys.
+const VkPipeline kPipelineA = reinterpret_cast<VkPipeline>(uintptr_t{1});
+const VkPipeline kPipelineB = reinterpret_cast<VkPipeline>(uintptr_t{2});
+
+TEST(PipelineRuntimeStats, AccumulatesResults) {
+  PipelineRuntimeStats stats;
+  EXPECT_EQ(stats.GetMeanNs(), 0u);
+  stats.Add(100, 10, 0, 1, 1.0);
+  stats.Add(300, 30, 5, 2, 1.0);
+  EXPECT_EQ(stats.query_count, 2u);
+  EXPECT_EQ(stats.draw_count, 3u);
+  EXPECT_EQ(stats.total_ns, 400u);
+  EXPECT_EQ(stats.min_ns, 100u);
+  EXPECT_EQ(stats.max_ns, 300u);
+  EXPECT_EQ(stats.GetMeanNs(), 200u);
+  EXPECT_DOUBLE_EQ(stats.estimated_total_ns, 400.0);
+  EXPECT_EQ(stats.fragment_invocations, 40u);
+  EXPECT_EQ(stats.compute_invocations, 5u);
+}
+
+TEST(PipelineRuntimeStats, WeightsEstimate) {
+  PipelineRuntimeStats stats;
+  stats.Add(100, 0, 0, 1, 4.0);
+  stats.Add(200, 0, 0, 1, 2.0);
+  EXPECT_EQ(stats.total_ns, 300u);
+  EXPECT_DOUBLE_EQ(stats.estimated_total_ns, 800.0);
+}
+
+TEST(PipelineRuntimeStats, FormatsHistogram) {
+  PipelineRuntimeStats stats;
+  EXPECT_EQ(stats.FormatHistogram(), "");
+  stats.Add(1, 0, 0, 1, 1.0);
+  stats.Add(1000, 0, 0, 1, 1.0);
+  stats.Add(1023, 0, 0, 1, 1.0);
+  stats.Add(1024, 0, 0, 1, 1.0);
+  EXPECT_EQ(stats.FormatHistogram(), "1:1;512:2;1024:1");
+
+  stats.Add(UINT64_MAX, 0, 0, 1, 1.0);
+  EXPECT_EQ(stats.histogram.back(), 1u);
+}
+
+TEST(PipelineRuntimeAggregator, SplitsByPipeline) {
+  PipelineRuntimeAggregator aggregator;
+  EXPECT_TRUE(aggregator.IsEmpty());
+  aggregator.Add(kPipelineA, 100, 0, 0, 1, 1.0);
+  aggregator.Add(kPipelineA, 200, 0, 0, 1, 1.0);
+  aggregator.Add(kPipelineB, 50, 0, 0, 1, 1.0);
+  EXPECT_FALSE(aggregator.IsEmpty());
+
+  auto stats = aggregator.TakeStats();
+  ASSERT_EQ(stats.size(), 2u);
+  for (const auto& [pipeline, pipeline_stats] : stats) {
+    if (pipeline == kPipelineA) {
+      EXPECT_EQ(pipeline_stats.query_count, 2u);
+      EXPECT_EQ(pipeline_stats.total_ns, 300u);
+    } else {
+      EXPECT_EQ(pipeline, kPipelineB);
+      EXPECT_EQ(pipeline_stats.query_count, 1u);
+      EXPECT_EQ(pipeline_stats.total_ns, 50u);
+    }
+  }
+  EXPECT_TRUE(aggregator.IsEmpty());
+  EXPECT_TRUE(aggregator.TakeStats().empty());
+}
+
+}  // namespace
+}  // namespace performancelayers
@@ -0,0 +1,221 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "query_slot_allocator.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+// Fake device, only passed through to the stub functions.
+const VkDevice kDevice = reinterpret_cast<VkDevice>(uintptr_t{1});
+
+struct HostReset {
+  VkQueryPool pool;
+  uint32_t first_query;
+  uint32_t query_count;
+};
+
+// What the stub Vulkan functions have been asked to do.
+struct StubCalls {
+  std::vector<VkQueryPool> created_pools;
+  std::vector<VkQueryPool> destroyed_pools;
+  std::vector<HostReset> host_resets;
+  uint32_t cmd_resets = 0;
+  bool fail_create = false;
+};
+
+StubCalls* stub_calls = nullptr;
+
+VKAPI_ATTR VkResult VKAPI_CALL
+StubCreateQueryPool(VkDevice, const VkQueryPoolCreateInfo*,
+                    const VkAllocationCallbacks*, VkQueryPool* pool) {
+  if (stub_calls->fail_create) {
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  }
+  *pool = reinterpret_cast<VkQueryPool>(
+      uintptr_t{stub_calls->created_pools.size() + 1});
+  stub_calls->created_pools.push_back(*pool);
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL StubDestroyQueryPool(VkDevice, VkQueryPool pool,
+                                                const VkAllocationCallbacks*) {
+  stub_calls->destroyed_pools.push_back(pool);
+}
+
+VKAPI_ATTR void VKAPI_CALL StubCmdResetQueryPool(VkCommandBuffer, VkQueryPool,
+                                                 uint32_t, uint32_t) {
+  ++stub_calls->cmd_resets;
+}
+
+VKAPI_ATTR void VKAPI_CALL StubResetQueryPool(VkDevice, VkQueryPool pool,
+                                              uint32_t first_query,
+                                              uint32_t query_count) {
+  stub_calls->host_resets.push_back({pool, first_query, query_count});
+}
+
+class QuerySlotAllocatorTest : public ::testing::Test {
+ protected:
+  QuerySlotAllocatorTest() { stub_calls = &calls_; }
+  ~QuerySlotAllocatorTest() override { stub_calls = nullptr; }
+
+  QuerySlotAllocator CreateAllocator(bool host_reset) {
+    return QuerySlotAllocator(kDevice, StubCreateQueryPool,
+                              StubDestroyQueryPool, StubCmdResetQueryPool,
+                              host_reset ? StubResetQueryPool : nullptr);
+  }
+
+  StubCalls calls_;
+};
+
+TEST_F(QuerySlotAllocatorTest, CreatesBlocksOnDemand) {
+  {
+    QuerySlotAllocator allocator = CreateAllocator(/*host_reset=*/false);
+    EXPECT_FALSE(allocator.UsesHostReset());
+    EXPECT_TRUE(calls_.created_pools.empty());
+
+    std::set<std::pair<VkQueryPool, uint32_t>> chunks;
+    for (uint32_t i = 0; i != QuerySlotAllocator::kChunksPerBlock; ++i) {
+      QuerySlotAllocator::Chunk* chunk = allocator.AcquireChunk();
+      ASSERT_NE(chunk, nullptr);
+      EXPECT_TRUE(
+          chunks.insert({chunk->timestamp_pool, chunk->first_slot}).second);
+      EXPECT_EQ(chunk->first_slot % QuerySlotAllocator::kSlotsPerChunk, 0);
+      EXPECT_LT(chunk->first_slot, QuerySlotAllocator::kSlotsPerBlock);
+    }
+    // One timestamp pool and one statistics pool for the first block.
+    EXPECT_EQ(calls_.created_pools.size(), 2);
+
+    QuerySlotAllocator::Chunk* chunk = allocator.AcquireChunk();
+    ASSERT_NE(chunk, nullptr);
+    EXPECT_EQ(calls_.created_pools.size(), 4);
+    EXPECT_EQ(chunk->timestamp_pool, calls_.created_pools[2]);
+    EXPECT_EQ(chunk->stat_pool, calls_.created_pools[3]);
+    EXPECT_TRUE(calls_.host_resets.empty());
+  }
+  EXPECT_EQ(std::multiset<VkQueryPool>(calls_.destroyed_pools.begin(),
+                                       calls_.destroyed_pools.end()),
+            std::multiset<VkQueryPool>(calls_.created_pools.begin(),
+                                       calls_.created_pools.end()));
+}
+
+TEST_F(QuerySlotAllocatorTest, FailsWhenPoolsCannotBeCreated) {
+  QuerySlotAllocator allocator = CreateAllocator(/*host_reset=*/false);
+  calls_.fail_create = true;
+  EXPECT_EQ(allocator.AcquireChunk(), nullptr);
+  calls_.fail_create = false;
+  EXPECT_NE(allocator.AcquireChunk(), nullptr);
+}
+
+TEST_F(QuerySlotAllocatorTest, TakesSlotsUntilChunkIsFull) {
+  QuerySlotAllocator allocator = CreateAllocator(/*host_reset=*/false);
+  QuerySlotAllocator::Chunk* chunk = allocator.AcquireChunk();
+  ASSERT_NE(chunk, nullptr);
+
+  for (uint32_t i = 0; i != QuerySlotAllocator::kSlotsPerChunk; ++i) {
+    QuerySlotAllocator::Slot slot;
+    ASSERT_TRUE(QuerySlotAllocator::TakeSlot(chunk, &slot));
+    EXPECT_EQ(slot.chunk, chunk);
+    EXPECT_EQ(slot.stat_query(), chunk->first_slot + i);
+    EXPECT_EQ(slot.first_timestamp_query(),
+              (chunk->first_slot + i) *
+                  QuerySlotAllocator::kTimestampQueriesPerSlot);
+  }
+  EXPECT_EQ(chunk->used, QuerySlotAllocator::kSlotsPerChunk);
+  EXPECT_EQ(chunk->references.load(), QuerySlotAllocator::kSlotsPerChunk + 1);
+
+  QuerySlotAllocator::Slot slot;
+  EXPECT_FALSE(QuerySlotAllocator::TakeSlot(chunk, &slot));
+  EXPECT_EQ(chunk->references.load(), QuerySlotAllocator::kSlotsPerChunk + 1);
+}
+
+TEST_F(QuerySlotAllocatorTest, ReusesChunkAfterLastReference) {
+  QuerySlotAllocator allocator = CreateAllocator(/*host_reset=*/false);
+  QuerySlotAllocator::Chunk* chunk = allocator.AcquireChunk();
+  ASSERT_NE(chunk, nullptr);
+  QuerySlotAllocator::Slot first;
+  QuerySlotAllocator::Slot second;
+  ASSERT_TRUE(QuerySlotAllocator::TakeSlot(chunk, &first));
+  ASSERT_TRUE(QuerySlotAllocator::TakeSlot(chunk, &second));
+
+  // The chunk stays in use while the owner or any slot holds it.
+  allocator.RetireChunk(chunk);
+  allocator.ReleaseSlot(first);
+  std::vector<QuerySlotAllocator::Chunk*> others;
+  for (uint32_t i = 1; i != QuerySlotAllocator::kChunksPerBlock; ++i) {
+    others.push_back(allocator.AcquireChunk());
+    EXPECT_NE(others.back(), chunk);
+  }
+  EXPECT_EQ(calls_.created_pools.size(), 2);
+
+  allocator.ReleaseSlot(second);
+  QuerySlotAllocator::Chunk* reused = allocator.AcquireChunk();
+  EXPECT_EQ(reused, chunk);
+  EXPECT_EQ(reused->used, 0);
+  EXPECT_EQ(reused->references.load(), 1);
+  EXPECT_EQ(calls_.created_pools.size(), 2);
+}
+
+TEST_F(QuerySlotAllocatorTest, ResetsOnHostBeforeReuse) {
+  QuerySlotAllocator allocator = CreateAllocator(/*host_reset=*/true);
+  EXPECT_TRUE(allocator.UsesHostReset());
+  QuerySlotAllocator::Chunk* chunk = allocator.AcquireChunk();
+  ASSERT_NE(chunk, nullptr);
+  // The new pools are reset as a whole.
+  ASSERT_EQ(calls_.host_resets.size(), 2);
+  EXPECT_EQ(calls_.host_resets[0].query_count,
+            QuerySlotAllocator::kSlotsPerBlock *
+                QuerySlotAllocator::kTimestampQueriesPerSlot);
+  EXPECT_EQ(calls_.host_resets[1].query_count,
+            QuerySlotAllocator::kSlotsPerBlock);
+
+  QuerySlotAllocator::Slot slot;
+  ASSERT_TRUE(QuerySlotAllocator::TakeSlot(chunk, &slot));
+  allocator.RetireChunk(chunk);
+  EXPECT_EQ(calls_.host_resets.size(), 2);
+
+  // Only the queries of the chunk are reset once its last slot is released.
+  allocator.ReleaseSlot(slot);
+  ASSERT_EQ(calls_.host_resets.size(), 4);
+  EXPECT_EQ(calls_.host_resets[2].pool, chunk->timestamp_pool);
+  EXPECT_EQ(calls_.host_resets[2].first_query,
+            chunk->first_slot * QuerySlotAllocator::kTimestampQueriesPerSlot);
+  EXPECT_EQ(calls_.host_resets[2].query_count,
+            QuerySlotAllocator::kSlotsPerChunk *
+                QuerySlotAllocator::kTimestampQueriesPerSlot);
+  EXPECT_EQ(calls_.host_resets[3].pool, chunk->stat_pool);
+  EXPECT_EQ(calls_.host_resets[3].first_query, chunk->first_slot);
+  EXPECT_EQ(calls_.host_resets[3].query_count,
+            QuerySlotAllocator::kSlotsPerChunk);
+  EXPECT_EQ(allocator.AcquireChunk(), chunk);
+  EXPECT_EQ(calls_.cmd_resets, 0);
+}
+
+TEST_F(QuerySlotAllocatorTest, RecordsChunkReset) {
+  QuerySlotAllocator allocator = CreateAllocator(/*host_reset=*/false);
+  QuerySlotAllocator::Chunk* chunk = allocator.AcquireChunk();
+  ASSERT_NE(chunk, nullptr);
+  allocator.RecordChunkReset(VK_NULL_HANDLE, *chunk);
+  EXPECT_EQ(calls_.cmd_resets, 2);
+  EXPECT_TRUE(calls_.host_resets.empty());
+}
+
+}  // namespace
+}  // namespace performancelayers
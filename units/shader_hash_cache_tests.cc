@@ -0,0 +1,91 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shader_hash_cache.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+const std::vector<uint32_t> kCode = {0x07230203, 0x00010000, 1, 2, 3};
+const size_t kCodeSize = kCode.size() * sizeof(uint32_t);
+
+TEST(ShaderHashCache, SharesHashWhileAcquired) {
+  ShaderHashCache cache;
+  const uint64_t expected =
+      ShaderHashCache::ComputeHash(kCode.data(), kCodeSize);
+
+  auto [hash, cached] = cache.Acquire(kCode.data(), kCodeSize);
+  EXPECT_EQ(hash, expected);
+  EXPECT_TRUE(cached);
+  auto [nested_hash, nested_cached] = cache.Acquire(kCode.data(), kCodeSize);
+  EXPECT_EQ(nested_hash, expected);
+  EXPECT_TRUE(nested_cached);
+  EXPECT_EQ(cache.GetSize(), 1u);
+
+  cache.Release(kCode.data(), kCodeSize);
+  EXPECT_EQ(cache.GetSize(), 1u);
+  cache.Release(kCode.data(), kCodeSize);
+  EXPECT_EQ(cache.GetSize(), 0u);
+}
+
+TEST(ShaderHashCache, SizeIsPartOfTheKey) {
+  ShaderHashCache cache;
+  const size_t prefix_size = kCodeSize - sizeof(uint32_t);
+  uint64_t hash = cache.Acquire(kCode.data(), kCodeSize).first;
+  uint64_t prefix_hash = cache.Acquire(kCode.data(), prefix_size).first;
+  EXPECT_NE(hash, prefix_hash);
+  EXPECT_EQ(prefix_hash,
+            ShaderHashCache::ComputeHash(kCode.data(), prefix_size));
+  EXPECT_EQ(cache.GetSize(), 2u);
+}
+
+TEST(ShaderHashCache, DetectsChangedCode) {
+  ShaderHashCache cache;
+  std::vector<uint32_t> code = kCode;
+  const uint64_t original = cache.Acquire(code.data(), kCodeSize).first;
+  code.back() = 4;
+  auto [hash, cached] = cache.Acquire(code.data(), kCodeSize);
+  EXPECT_FALSE(cached);
+  EXPECT_NE(hash, original);
+  EXPECT_EQ(hash, ShaderHashCache::ComputeHash(code.data(), kCodeSize));
+  cache.Release(code.data(), kCodeSize);
+  EXPECT_EQ(cache.GetSize(), 0u);
+}
+
+TEST(ScopedShaderHash, NestedScopes) {
+  const uint64_t expected =
+      ShaderHashCache::ComputeHash(kCode.data(), kCodeSize);
+  ScopedShaderHash outer(kCode.data(), kCodeSize);
+  EXPECT_EQ(outer.GetHash(), expected);
+  {
+    ScopedShaderHash inner(kCode.data(), kCodeSize);
+    EXPECT_EQ(inner.GetHash(), expected);
+  }
+  const SplShaderHashCacheInterface *interface =
+      SPL_GetShaderHashCacheInterface();
+  ASSERT_NE(interface, nullptr);
+  EXPECT_EQ(interface->version, kShaderHashCacheInterfaceVersion);
+  uint64_t hash = 0;
+  EXPECT_TRUE(interface->acquire(kCode.data(), kCodeSize, &hash));
+  EXPECT_EQ(hash, expected);
+  interface->release(kCode.data(), kCodeSize);
+}
+
+}  // namespace
+}  // namespace performancelayers
@@ -0,0 +1,191 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shared_memory_ring.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "gtest/gtest.h"
+
+namespace performancelayers {
+namespace {
+
+// Returns a ring name that does not collide with concurrent test runs.
+std::string GetRingName(const char *test_name) {
+  return absl::StrCat("/spl_ring_test_", getpid(), "_", test_name);
+}
+
+class SingleValueEvent : public Event {
+ public:
+  SingleValueEvent(const char *name, int64_t value)
+      : Event(name, LogLevel::kHigh), value_("value", value) {
+    InitAttributes({&value_});
+  }
+
+ private:
+  Int64Attr value_;
+};
+
+TEST(SharedMemoryRing, InvalidParameters) {
+  const std::string name = GetRingName("invalid");
+  EXPECT_FALSE(SharedMemoryRing::Create(name, 3).ok());
+  EXPECT_FALSE(SharedMemoryRing::Create(name, 0).ok());
+  EXPECT_FALSE(SharedMemoryRing::Create(name, 4, 20).ok());
+  EXPECT_FALSE(SharedMemoryRing::Create(name, 4, 24).ok());
+  EXPECT_FALSE(SharedMemoryRing::Attach(name).ok());
+}
+
+TEST(SharedMemoryRing, WriteAndRead) {
+  const std::string name = GetRingName("write_read");
+  absl::StatusOr<SharedMemoryRing> reader = SharedMemoryRing::Create(name, 4);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  absl::StatusOr<SharedMemoryRing> writer = SharedMemoryRing::Attach(name);
+  ASSERT_TRUE(writer.ok()) << writer.status();
+  EXPECT_EQ(writer->GetCapacity(), 4u);
+
+  SharedRingRecord record;
+  EXPECT_FALSE(reader->TryRead(&record));
+  EXPECT_TRUE(writer->TryWrite(123, "first"));
+  EXPECT_TRUE(writer->TryWrite(456, "second"));
+  ASSERT_TRUE(reader->TryRead(&record));
+  EXPECT_EQ(record.timestamp, 123);
+  EXPECT_EQ(record.process_id, static_cast<uint32_t>(getpid()));
+  EXPECT_FALSE(record.truncated);
+  EXPECT_EQ(record.payload, "first");
+  ASSERT_TRUE(reader->TryRead(&record));
+  EXPECT_EQ(record.payload, "second");
+  EXPECT_FALSE(reader->TryRead(&record));
+  EXPECT_EQ(reader->GetDroppedCount(), 0u);
+}
+
+TEST(SharedMemoryRing, DropsWhenFull) {
+  const std::string name = GetRingName("full");
+  absl::StatusOr<SharedMemoryRing> reader = SharedMemoryRing::Create(name, 2);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  absl::StatusOr<SharedMemoryRing> writer = SharedMemoryRing::Attach(name);
+  ASSERT_TRUE(writer.ok()) << writer.status();
+
+  EXPECT_TRUE(writer->TryWrite(1, "1"));
+  EXPECT_TRUE(writer->TryWrite(2, "2"));
+  EXPECT_FALSE(writer->TryWrite(3, "3"));
+  EXPECT_FALSE(writer->TryWrite(4, "4"));
+  EXPECT_EQ(reader->GetDroppedCount(), 2u);
+
+  // Reading frees the slots for the next lap.
+  SharedRingRecord record;
+  ASSERT_TRUE(reader->TryRead(&record));
+  EXPECT_EQ(record.payload, "1");
+  EXPECT_TRUE(writer->TryWrite(5, "5"));
+  ASSERT_TRUE(reader->TryRead(&record));
+  EXPECT_EQ(record.payload, "2");
+  ASSERT_TRUE(reader->TryRead(&record));
+  EXPECT_EQ(record.payload, "5");
+  EXPECT_FALSE(reader->TryRead(&record));
+}
+
+TEST(SharedMemoryRing, TruncatesLongPayloads) {
+  const std::string name = GetRingName("truncate");
+  absl::StatusOr<SharedMemoryRing> reader =
+      SharedMemoryRing::Create(name, 2, /*record_size=*/32);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  EXPECT_EQ(reader->GetMaxPayloadSize(), 8u);
+  absl::StatusOr<SharedMemoryRing> writer = SharedMemoryRing::Attach(name);
+  ASSERT_TRUE(writer.ok()) << writer.status();
+
+  EXPECT_TRUE(writer->TryWrite(1, "0123456789"));
+  SharedRingRecord record;
+  ASSERT_TRUE(reader->TryRead(&record));
+  EXPECT_TRUE(record.truncated);
+  EXPECT_EQ(record.payload, "01234567");
+}
+
+TEST(SharedMemoryRing, ConcurrentWriters) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumRecords = 10000;
+  const std::string name = GetRingName("concurrent");
+  absl::StatusOr<SharedMemoryRing> reader = SharedMemoryRing::Create(name, 64);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread != kNumThreads; ++thread) {
+    threads.emplace_back([&name, thread] {
+      absl::StatusOr<SharedMemoryRing> writer = SharedMemoryRing::Attach(name);
+      ASSERT_TRUE(writer.ok()) << writer.status();
+      for (int i = 0; i != kNumRecords; ++i) {
+        writer->TryWrite(i, absl::StrCat(thread, ",", i));
+      }
+    });
+  }
+
+  // Records of each thread arrive in order, possibly with gaps from drops.
+  std::vector<int> last_record(kNumThreads, -1);
+  uint64_t num_read = 0;
+  auto read_all = [&] {
+    SharedRingRecord record;
+    while (reader->TryRead(&record)) {
+      std::vector<std::string> fields = absl::StrSplit(record.payload, ',');
+      ASSERT_EQ(fields.size(), 2u);
+      int thread = 0;
+      int value = 0;
+      ASSERT_TRUE(absl::SimpleAtoi(fields[0], &thread));
+      ASSERT_TRUE(absl::SimpleAtoi(fields[1], &value));
+      ASSERT_LT(thread, kNumThreads);
+      EXPECT_GT(value, last_record[thread]);
+      EXPECT_EQ(record.timestamp, value);
+      last_record[thread] = value;
+      ++num_read;
+    }
+  };
+  for (int i = 0; i != 1000; ++i) read_all();
+  for (std::thread &thread : threads) thread.join();
+  read_all();
+
+  EXPECT_EQ(num_read + reader->GetDroppedCount(),
+            uint64_t(kNumThreads) * kNumRecords);
+}
+
+TEST(SharedMemoryRingLogger, StreamsEvents) {
+  const std::string name = GetRingName("logger");
+  absl::StatusOr<SharedMemoryRing> reader = SharedMemoryRing::Create(name, 8);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+
+  SharedMemoryRingLogger logger(name.c_str());
+  ASSERT_TRUE(logger.IsAttached());
+  SingleValueEvent event("frame_present", 42);
+  logger.StartLog();
+  logger.AddEvent(&event);
+  logger.EndLog();
+
+  SharedRingRecord record;
+  ASSERT_TRUE(reader->TryRead(&record));
+  EXPECT_EQ(record.payload, "frame_present,value:42");
+  EXPECT_GT(record.timestamp, 0);
+}
+
+TEST(SharedMemoryRingLogger, MissingRing) {
+  SharedMemoryRingLogger logger(GetRingName("missing").c_str());
+  EXPECT_FALSE(logger.IsAttached());
+  SingleValueEvent event("frame_present", 42);
+  logger.AddEvent(&event);
+}
+
+}  // namespace
+}  // namespace performancelayers